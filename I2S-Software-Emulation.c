@@ -99,19 +99,14 @@ const audio_format_t *audio_i2s_setup(const audio_format_t *intended_audio_forma
 
 static audio_buffer_pool_t *audio_i2s_consumer;
 
-static void update_pio_frequency(uint32_t sample_freq) {
-    uint32_t system_clock_frequency = clock_get_hz(clk_sys);
-    assert(system_clock_frequency < 0x40000000);
-    uint32_t divider = system_clock_frequency * 4 / sample_freq; // avoid arithmetic overflow
-    assert(divider < 0x1000000);
-    pio_sm_set_clkdiv_int_frac(audio_pio, shared_state.pio_sm, divider >> 8u, divider & 0xffu);
-    shared_state.freq = sample_freq;
+static void update_pio_frequency_single(uint32_t sample_freq) {
+    update_pio_frequency(sample_freq, shared_state.pio_sm, &shared_state.freq);
 }
 
 static audio_buffer_t *wrap_consumer_take(audio_connection_t *connection, bool block) {
     // support dynamic frequency shifting
     if (connection->producer_pool->format->sample_freq != shared_state.freq) {
-        update_pio_frequency(connection->producer_pool->format->sample_freq);
+        update_pio_frequency_single(connection->producer_pool->format->sample_freq);
     }
 #if PICO_AUDIO_I2S_MONO_INPUT
 #if PICO_AUDIO_I2S_MONO_OUTPUT
@@ -131,7 +126,7 @@ static audio_buffer_t *wrap_consumer_take(audio_connection_t *connection, bool b
 static void wrap_producer_give(audio_connection_t *connection, audio_buffer_t *buffer) {
     // support dynamic frequency shifting
     if (connection->producer_pool->format->sample_freq != shared_state.freq) {
-        update_pio_frequency(connection->producer_pool->format->sample_freq);
+        update_pio_frequency_single(connection->producer_pool->format->sample_freq);
     }
 #if PICO_AUDIO_I2S_MONO_INPUT
 #if PICO_AUDIO_I2S_MONO_OUTPUT
@@ -213,7 +208,7 @@ bool audio_i2s_connect_extra(audio_buffer_pool_t *producer, bool buffer_on_give,
 
     audio_i2s_consumer = audio_new_consumer_pool(&pio_i2s_consumer_buffer_format, buffer_count, samples_per_buffer);
 
-    update_pio_frequency(producer->format->sample_freq);
+    update_pio_frequency_single(producer->format->sample_freq);
 
     // todo cleanup threading
     __mem_fence_release();
@@ -431,7 +426,7 @@ const audio_format_t *audio_i2s_setup_multi_dac(const audio_format_t *intended_a
 
     // Add and initialize clock generator program
     uint clock_offset = pio_add_program(audio_pio, &audio_i2s_clock_gen_program);
-    audio_i2s_clock_gen_program_init(audio_pio, clock_sm, clock_offset, config->clock_pin_base);
+    audio_i2s_clock_gen_program_init(audio_pio, clock_sm, clock_offset, config->clock_pin_base, 16);
 
     // Add data-only program (only need to add once)
     uint data_offset = pio_add_program(audio_pio, &audio_i2s_data_only_program);
@@ -478,10 +473,9 @@ const audio_format_t *audio_i2s_setup_multi_dac(const audio_format_t *intended_a
 }
 
 static void update_pio_frequency_multi_dac(uint32_t sample_freq) {
-    uint32_t system_clock_frequency = clock_get_hz(clk_sys);
-    assert(system_clock_frequency < 0x40000000);
-    uint32_t divider = system_clock_frequency * 4 / sample_freq;
-    assert(divider < 0x1000000);
+    audio_i2s_clock_divider_t clock_divider;
+    audio_i2s_calc_clock_divider(sample_freq, &clock_divider);
+    uint32_t divider = clock_divider.divider;
 
     // Update clock generator
     pio_sm_set_clkdiv_int_frac(audio_pio, multi_dac_state.clock_pio_sm, divider >> 8u, divider & 0xffu);
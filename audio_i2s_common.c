@@ -8,39 +8,1218 @@
  *  \brief Common utility functions for I2S audio implementation
  *  
  * This file implements shared utility functions used by both single and
- * multi-DAC I2S implementations, primarily focused on frequency calculation
- * and PIO clock configuration.
+ * multi-DAC I2S implementations: frequency calculation and PIO clock
+ * configuration, and the converting consumer-take connection.
  */
 
+#include <stdio.h>
+#include <string.h>
 #include "include/pico/audio_i2s_common.h"
 #include "hardware/clocks.h"
 #include "hardware/pio.h"
+#include "hardware/structs/bus_ctrl.h"
+#include "hardware/sync.h"
 
-/** \brief Update PIO state machine frequency for I2S audio sample rate
+/** \brief Calculate the PIO clock divider for an I2S sample rate
  *
- * Calculates and applies the appropriate PIO clock divider to achieve the target
- * I2S sample frequency. The calculation considers the I2S bit clock requirements:
+ * The I2S bit clock requirements are:
  * - BCLK = sample_rate * bits_per_sample * channels
  * - For 16-bit stereo: BCLK = sample_rate * 16 * 2 = sample_rate * 32
  * - PIO clock = BCLK * 2 (for proper I2S timing)
  * - Final divider = sys_clock / (sample_rate * 64)
  *
- * The function uses a simplified calculation (sys_clock * 4 / sample_rate) that
- * accounts for the fixed 64x multiplier while avoiding arithmetic overflow.
+ * In 16.8 fixed point this is sys_clock * 4 / sample_rate, which is rounded to
+ * the nearest step rather than truncated. The remainder is kept so that
+ * audio_i2s_clock_divider_dither() can make up the difference over time.
  *
  * \param sample_freq Target audio sample frequency in Hz (e.g., 44100)
- * \param pio_sm PIO state machine number to configure
- * \param freq_ptr Pointer to store the configured frequency for tracking
+ * \param div Receives the divider and its rate error
  *
  * \note The system clock frequency must be less than 1GHz to prevent overflow
  * \note The calculated divider must fit in 24 bits (PIO hardware limitation)
- * \note This function directly modifies the PIO state machine clock divider
  */
-void update_pio_frequency(uint32_t sample_freq, uint8_t pio_sm, uint32_t *freq_ptr) {
+void audio_i2s_calc_clock_divider(uint32_t sample_freq, audio_i2s_clock_divider_t *div) {
+    audio_i2s_calc_clock_divider_frame_bits(sample_freq, 32, div);
+}
+
+/** \brief Calculate the PIO clock divider for frames of any width
+ *
+ * In 16.8 fixed point the divider is sys_clock * 256 / (sample_rate * frame_bits * 2).
+ * The fraction is reduced by the common power of two first, so that for 32 and
+ * 64-bit frames the remainder is in units of 1 / sample_rate and the dither
+ * accumulator stays within 32 bits.
+ */
+void audio_i2s_calc_clock_divider_frame_bits(uint32_t sample_freq, uint frame_bits, audio_i2s_clock_divider_t *div) {
     uint32_t system_clock_frequency = clock_get_hz(clk_sys);
     assert(system_clock_frequency < 0x40000000);
-    uint32_t divider = system_clock_frequency * 4 / sample_freq; // avoid arithmetic overflow
-    assert(divider < 0x1000000);
-    pio_sm_set_clkdiv_int_frac(audio_pio, pio_sm, divider >> 8u, divider & 0xffu);
+    assert(frame_bits && frame_bits <= 512);
+    uint32_t numerator = 128;
+    while (!(numerator & 1) && !(frame_bits & 1)) {
+        numerator >>= 1;
+        frame_bits >>= 1;
+    }
+    uint64_t scaled = (uint64_t) system_clock_frequency * numerator;
+    div->sample_freq = sample_freq;
+    div->modulus = sample_freq * frame_bits;
+    div->divider_floor = (uint32_t) (scaled / div->modulus);
+    div->remainder = (uint32_t) (scaled % div->modulus);
+    div->divider = div->divider_floor + (div->remainder >= (div->modulus + 1) / 2);
+    assert(div->divider < 0x1000000);
+    int64_t actual = (int64_t) div->modulus * div->divider;
+    div->error_ppm = (int32_t) (((int64_t) scaled - actual) * 1000000 / actual);
+    div->dither_error = 0;
+}
+
+/** \brief Pick the divider for the next block of frames when dithering
+ *
+ * A first-order (Bresenham style) accumulator: each block adds the fractional
+ * part it is owed, and a block is played at divider_floor + 1 whenever the
+ * accumulated error is positive. The error stays bounded by one block, so the
+ * average divider weighted by frames is exact.
+ *
+ * \note Called from the DMA IRQ
+ */
+uint32_t __audio_i2s_isr_func(audio_i2s_clock_divider_dither)(audio_i2s_clock_divider_t *div, uint32_t frames) {
+    assert((uint64_t) frames * div->modulus < 0x80000000u);
+    div->dither_error += (int32_t) (frames * div->remainder);
+    if (div->dither_error > 0) {
+        div->dither_error -= (int32_t) (frames * div->modulus);
+        return div->divider_floor + 1;
+    }
+    return div->divider_floor;
+}
+
+/** \brief Suggest a system clock that gives an exact PIO divider for a sample rate
+ *
+ * Only frequencies with an exact divider are passed to check_sys_clock_khz(),
+ * which is comparatively expensive, so the search is fast enough for setup code.
+ */
+uint32_t audio_i2s_suggest_sys_clock_khz(uint32_t sample_freq, uint32_t max_sys_clock_khz) {
+    uint vco_freq, post_div1, post_div2;
+    for (uint32_t khz = max_sys_clock_khz; khz >= max_sys_clock_khz / 2 && khz; khz--) {
+        if ((uint64_t) khz * 4000 % sample_freq) {
+            continue;
+        }
+        if (check_sys_clock_khz(khz, &vco_freq, &post_div1, &post_div2)) {
+            return khz;
+        }
+    }
+    return 0;
+}
+
+/** \brief Worst-case error in ppb, over count rates, of the rounded 32-bit frame divider from khz */
+static uint32_t worst_divider_error_ppb(uint32_t khz, const uint32_t *sample_freqs, uint count) {
+    uint32_t worst = 0;
+    for (uint i = 0; i < count; i++) {
+        uint64_t scaled = (uint64_t) khz * 4000;
+        uint64_t divider = (scaled + sample_freqs[i] / 2) / sample_freqs[i];
+        uint64_t actual = divider * sample_freqs[i];
+        uint64_t off = scaled > actual ? scaled - actual : actual - scaled;
+        worst = MAX(worst, (uint32_t) (off * 1000000000 / actual));
+    }
+    return worst;
+}
+
+/** \brief Suggest a system clock with the smallest worst divider error for a set of rates
+ *
+ * The error is cheap to work out, so check_sys_clock_khz() is only asked about
+ * frequencies that beat the best found so far.
+ */
+uint32_t audio_i2s_suggest_sys_clock_khz_for_rates(const uint32_t *sample_freqs, uint count,
+                                                   uint32_t max_sys_clock_khz, uint32_t *error_ppb) {
+    assert(count);
+    uint vco_freq, post_div1, post_div2;
+    uint32_t best_khz = 0;
+    uint32_t best_error = UINT32_MAX;
+    for (uint32_t khz = max_sys_clock_khz; khz >= max_sys_clock_khz / 2 && khz && best_error; khz--) {
+        uint32_t error = worst_divider_error_ppb(khz, sample_freqs, count);
+        if (error < best_error && check_sys_clock_khz(khz, &vco_freq, &post_div1, &post_div2)) {
+            best_khz = khz;
+            best_error = error;
+        }
+    }
+    if (error_ppb) {
+        *error_ppb = best_error;
+    }
+    return best_khz;
+}
+
+/** \brief Whether khz gives an exact 16.8 divider of at least 1 for frame_bits bit frames at sample_freq */
+static bool audio_i2s_divider_exact(uint32_t khz, uint32_t sample_freq, uint frame_bits) {
+    // the 16.8 divider is clk_sys * 128 / (sample_freq * frame_bits)
+    uint64_t modulus = (uint64_t) sample_freq * frame_bits;
+    uint64_t scaled = (uint64_t) khz * 1000 * 128;
+    return !(scaled % modulus) && scaled / modulus >= 0x100;
+}
+
+uint32_t audio_i2s_suggest_min_sys_clock_khz(uint32_t sample_freq, uint frame_bits, uint32_t min_sys_clock_khz,
+                                             uint32_t max_sys_clock_khz) {
+    uint vco_freq, post_div1, post_div2;
+    for (uint32_t khz = MAX(min_sys_clock_khz, 1u); khz <= max_sys_clock_khz; khz++) {
+        if (!audio_i2s_divider_exact(khz, sample_freq, frame_bits)) {
+            continue;
+        }
+        if (check_sys_clock_khz(khz, &vco_freq, &post_div1, &post_div2)) {
+            return khz;
+        }
+    }
+    return 0;
+}
+
+/** \brief Outputs set up so far, one per driver */
+static const audio_i2s_clock_user_t *clock_users[3];
+static uint clock_user_count;
+
+void audio_i2s_add_clock_user(const audio_i2s_clock_user_t *user) {
+    for (uint i = 0; i < clock_user_count; i++) {
+        if (clock_users[i] == user) {
+            return;
+        }
+    }
+    assert(clock_user_count < count_of(clock_users));
+    clock_users[clock_user_count++] = user;
+}
+
+uint32_t audio_i2s_lower_sys_clock(uint32_t min_sys_clock_khz) {
+    uint32_t sample_freqs[count_of(clock_users)];
+    uint frame_bits[count_of(clock_users)];
+    uint count = 0;
+    for (uint i = 0; i < clock_user_count; i++) {
+        sample_freqs[count] = clock_users[i]->sample_freq(&frame_bits[count]);
+        if (sample_freqs[count]) {
+            count++;
+        }
+    }
+    if (!count) {
+        return 0;
+    }
+    uint vco_freq, post_div1, post_div2;
+    uint32_t max_sys_clock_khz = clock_get_hz(clk_sys) / 1000u;
+    uint32_t khz;
+    for (khz = MAX(min_sys_clock_khz, 1u); khz <= max_sys_clock_khz; khz++) {
+        bool exact = true;
+        for (uint i = 0; i < count && exact; i++) {
+            exact = audio_i2s_divider_exact(khz, sample_freqs[i], frame_bits[i]);
+        }
+        if (exact && check_sys_clock_khz(khz, &vco_freq, &post_div1, &post_div2)) {
+            break;
+        }
+    }
+    if (khz > max_sys_clock_khz) {
+        return 0;
+    }
+    set_sys_clock_khz(khz, true);
+    // every divider was worked out for the old clk_sys
+    for (uint i = 0; i < clock_user_count; i++) {
+        clock_users[i]->retune();
+    }
+    printf("System clock %d kHz, exact for %d output(s)\n", (int) khz, (int) count);
+    return khz;
+}
+
+/** \brief Update PIO state machine frequency for I2S audio sample rate
+ *
+ * Calculates (see audio_i2s_calc_clock_divider()) and applies the nearest PIO
+ * clock divider to achieve the target I2S sample frequency.
+ *
+ * \param sample_freq Target audio sample frequency in Hz (e.g., 44100)
+ * \param pio_sm PIO state machine number to configure
+ * \param freq_ptr Pointer to store the configured frequency for tracking
+ *
+ * \note This function directly modifies the PIO state machine clock divider
+ */
+void update_pio_frequency(uint32_t sample_freq, uint8_t pio_sm, uint32_t *freq_ptr) {
+    audio_i2s_clock_divider_t div;
+    audio_i2s_calc_clock_divider(sample_freq, &div);
+    pio_sm_set_clkdiv_int_frac(audio_pio, pio_sm, div.divider >> 8u, div.divider & 0xffu);
     *freq_ptr = sample_freq;
-}
\ No newline at end of file
+}
+
+void audio_i2s_set_dma_high_bus_priority(bool high) {
+    const uint32_t dma_bits = BUSCTRL_BUS_PRIORITY_DMA_R_BITS | BUSCTRL_BUS_PRIORITY_DMA_W_BITS;
+    if (high) {
+        hw_set_bits(&bus_ctrl_hw->priority, dma_bits);
+    } else {
+        hw_clear_bits(&bus_ctrl_hw->priority, dma_bits);
+    }
+}
+
+void audio_i2s_stats_reset(audio_i2s_stats_t *stats) {
+    *stats = (audio_i2s_stats_t) {
+            .min_fill = 0xffffu,
+    };
+#if PICO_AUDIO_I2S_STATS
+#if defined(__riscv)
+    // make sure the cycle counter isn't inhibited
+    __asm volatile ("csrci mcountinhibit, 0x1");
+#else
+    if (!(systick_hw->csr & 1u)) {
+        systick_hw->rvr = 0xffffffu;
+        systick_hw->cvr = 0;
+        systick_hw->csr = 0x5; // enable, clocked from the processor clock, no interrupt
+    }
+#endif
+#endif
+}
+
+/** \brief Queue a buffer on an SPSC ring; only the pushing side may call this
+ *  \return false if the ring is full
+ */
+static bool __audio_i2s_isr_func(spsc_push)(audio_i2s_spsc_ring_t *ring, audio_buffer_t *ab) {
+    uint32_t head = ring->head;
+    if (head - ring->tail == PICO_AUDIO_I2S_SPSC_RING_SIZE) {
+        return false;
+    }
+    ring->slots[head & (PICO_AUDIO_I2S_SPSC_RING_SIZE - 1)] = ab;
+    // publish the slot before the new head
+    __mem_fence_release();
+    ring->head = head + 1;
+    return true;
+}
+
+/** \brief Take the oldest buffer from an SPSC ring; only the popping side may call this
+ *  \return The buffer, or NULL if the ring is empty
+ */
+static audio_buffer_t *__audio_i2s_isr_func(spsc_pop)(audio_i2s_spsc_ring_t *ring) {
+    uint32_t tail = ring->tail;
+    if (ring->head == tail) {
+        return NULL;
+    }
+    __mem_fence_acquire();
+    audio_buffer_t *ab = ring->slots[tail & (PICO_AUDIO_I2S_SPSC_RING_SIZE - 1)];
+    // read the slot before handing it back to the pushing side
+    __mem_fence_release();
+    ring->tail = tail + 1;
+    return ab;
+}
+
+static audio_buffer_t *spsc_producer_take(audio_connection_t *connection, bool block) {
+    audio_i2s_spsc_connection_t *spsc = (audio_i2s_spsc_connection_t *) connection;
+    audio_buffer_t *ab;
+    while (!(ab = spsc_pop(&spsc->free)) && block) {
+        // woken by the __sev() in spsc_consumer_give
+        __wfe();
+    }
+    return ab;
+}
+
+static void spsc_producer_give(audio_connection_t *connection, audio_buffer_t *buffer) {
+    audio_i2s_spsc_connection_t *spsc = (audio_i2s_spsc_connection_t *) connection;
+    // the pool's buffers all fit in the ring, so it can't be full
+    bool queued = spsc_push(&spsc->full, buffer);
+    assert(queued);
+    (void) queued;
+}
+
+static audio_buffer_t *__audio_i2s_isr_func(spsc_consumer_take)(audio_connection_t *connection, bool block) {
+    audio_i2s_spsc_connection_t *spsc = (audio_i2s_spsc_connection_t *) connection;
+    audio_buffer_t *ab;
+    while (!(ab = spsc_pop(&spsc->full)) && block) {
+        tight_loop_contents();
+    }
+    // the DMA reads the producer's buffer directly
+    assert(!ab || (ab->format->format->format == connection->consumer_pool->format->format &&
+                   ab->format->format->channel_count == connection->consumer_pool->format->channel_count));
+    return ab;
+}
+
+static void __audio_i2s_isr_func(spsc_consumer_give)(audio_connection_t *connection, audio_buffer_t *buffer) {
+    audio_i2s_spsc_connection_t *spsc = (audio_i2s_spsc_connection_t *) connection;
+    bool queued = spsc_push(&spsc->free, buffer);
+    assert(queued);
+    (void) queued;
+    // wake a producer blocked in spsc_producer_take
+    __sev();
+}
+
+audio_connection_t *audio_i2s_spsc_connection_init(audio_i2s_spsc_connection_t *connection,
+                                                   audio_buffer_pool_t *producer) {
+    *connection = (audio_i2s_spsc_connection_t) {
+            .core = {
+                    .producer_pool_take = spsc_producer_take,
+                    .producer_pool_give = spsc_producer_give,
+                    .consumer_pool_take = spsc_consumer_take,
+                    .consumer_pool_give = spsc_consumer_give,
+            },
+    };
+    audio_buffer_t *ab;
+    while ((ab = get_free_audio_buffer(producer, false))) {
+        if (!spsc_push(&connection->free, ab)) {
+            panic("producer pool has more than %d buffers for the SPSC connection", PICO_AUDIO_I2S_SPSC_RING_SIZE);
+        }
+    }
+    return &connection->core;
+}
+
+audio_buffer_t *__audio_i2s_isr_func(audio_i2s_stats_take)(audio_i2s_stats_t *stats, audio_buffer_pool_t *consumer) {
+#if PICO_AUDIO_I2S_STATS
+    if (consumer->connection && consumer->connection->consumer_pool_take == spsc_consumer_take) {
+        audio_i2s_stats_fill(stats,
+                             audio_i2s_spsc_ring_count(&((audio_i2s_spsc_connection_t *) consumer->connection)->full));
+    }
+    audio_buffer_t *ab = take_audio_buffer(consumer, false);
+    if (ab) {
+        stats->buffers_played++;
+    } else {
+        stats->underruns++;
+    }
+    return ab;
+#else
+    (void) stats;
+    return take_audio_buffer(consumer, false);
+#endif
+}
+
+audio_buffer_t *__audio_i2s_isr_func(audio_i2s_stats_take_free)(audio_i2s_stats_t *stats, audio_buffer_pool_t *producer,
+                                                                uint32_t drop_frames) {
+    audio_buffer_t *ab = get_free_audio_buffer(producer, false);
+#if PICO_AUDIO_I2S_STATS
+    if (ab) {
+        stats->buffers_played++;
+    } else {
+        stats->underruns++;
+        stats->silence_samples += drop_frames;
+    }
+#else
+    (void) stats;
+    (void) drop_frames;
+#endif
+    return ab;
+}
+
+/** \name Fade ramps and hold
+ *
+ * Gains are Q15, and the 32-bit products are taken in 64 bits, so every slot
+ * width shares one ramp.
+ * @{
+ */
+void audio_i2s_fade_init(audio_i2s_fade_t *fade, uint slot_bits, uint channel_count) {
+    memset(fade, 0, sizeof(*fade));
+    fade->slot_bits = (uint8_t) slot_bits;
+    fade->channel_count = (uint8_t) channel_count;
+    // an output that has just been enabled ramps in from zero
+    fade->silent = true;
+#if AUDIO_I2S_FADE_ENABLED
+    fade->ramp = fade->ramp_buffer;
+#endif
+}
+
+#if AUDIO_I2S_FADE_ENABLED
+/** \brief Sample c of frame i in the output's buffer layout */
+static __force_inline int32_t fade_get(const audio_i2s_fade_t *fade, const void *frames, uint i, uint c) {
+    if (fade->slot_bits == 32) {
+        return ((const int32_t *) frames)[2u * i + c];
+    }
+    return ((const int16_t *) frames)[i * fade->channel_count + c];
+}
+
+static __force_inline void fade_put(const audio_i2s_fade_t *fade, void *frames, uint i, uint c, int32_t sample) {
+    if (fade->slot_bits == 32) {
+        ((int32_t *) frames)[2u * i + c] = sample;
+    } else {
+        ((int16_t *) frames)[i * fade->channel_count + c] = (int16_t) sample;
+    }
+}
+
+/** \brief Remember frame i of frames as the output's level */
+static void fade_set_level(audio_i2s_fade_t *fade, const void *frames, uint i) {
+    for (uint c = 0; c < fade->channel_count; c++) {
+        fade->level[c] = fade_get(fade, frames, i, c);
+    }
+}
+#endif
+
+#if PICO_AUDIO_I2S_FADE_FRAMES
+/** \brief Fill the ramp buffer from the level (frame 0) down to zero (the last frame), and drop the level to zero */
+static void __audio_i2s_isr_func(fade_fill_ramp_down)(audio_i2s_fade_t *fade) {
+    const uint n = PICO_AUDIO_I2S_FADE_FRAMES;
+    for (uint i = 0; i < n; i++) {
+        int32_t gain = (int32_t) (((n - 1u - i) << 15) / (n - 1u));
+        for (uint c = 0; c < fade->channel_count; c++) {
+            fade_put(fade, fade->ramp, i, c, (int32_t) (((int64_t) fade->level[c] * gain) >> 15));
+        }
+    }
+    fade->level[0] = fade->level[1] = 0;
+}
+#endif
+
+#if AUDIO_I2S_FADE_ENABLED
+void __audio_i2s_isr_func(audio_i2s_fade_apply)(audio_i2s_fade_t *fade, audio_buffer_t *ab) {
+    void *frames = ab->buffer->bytes;
+    uint count = ab->sample_count;
+#if PICO_AUDIO_I2S_FADE_FRAMES
+    if (fade->silent) {
+        // glide from the silence level to the buffer's own samples over its head
+        const uint n = MIN(count, PICO_AUDIO_I2S_FADE_FRAMES);
+        for (uint i = 0; i < n; i++) {
+            int32_t gain = (int32_t) (((i + 1u) << 15) / n);
+            for (uint c = 0; c < fade->channel_count; c++) {
+                int64_t from = fade->level[c];
+                int64_t delta = fade_get(fade, frames, i, c) - from;
+                fade_put(fade, frames, i, c, (int32_t) (from + ((delta * gain) >> 15)));
+            }
+        }
+    }
+#endif
+    fade->silent = false;
+    fade_set_level(fade, frames, count - 1u);
+}
+
+const void *__audio_i2s_isr_func(audio_i2s_fade_silence_source)(audio_i2s_fade_t *fade, const void *zero,
+                                                                uint32_t *frames, uint *read) {
+#if PICO_AUDIO_I2S_UNDERRUN_HOLD
+    // hold the frame the last buffer ended on; it is written for every run, since each
+    // may have its own storage at fade->ramp
+    fade->silent = true;
+    int32_t right = fade->level[fade->channel_count - 1u];
+    if (fade->slot_bits == 32) {
+        fade->ramp[0] = (uint32_t) fade->level[0];
+        fade->ramp[1] = (uint32_t) right;
+    } else {
+        ((int16_t *) fade->ramp)[0] = (int16_t) fade->level[0];
+        ((int16_t *) fade->ramp)[1] = (int16_t) right;
+    }
+#elif PICO_AUDIO_I2S_FADE_FRAMES
+    if (!fade->silent) {
+        fade->silent = true;
+        fade_fill_ramp_down(fade);
+        *frames = PICO_AUDIO_I2S_FADE_FRAMES;
+        *read = AUDIO_I2S_DMA_READ_STEP;
+        return fade->ramp;
+    }
+#endif
+#if PICO_AUDIO_I2S_UNDERRUN_HOLD
+    // a held frame repeats for as long as the run asks
+    (void) zero;
+    (void) frames;
+    // a word holds one channel of a 32-bit frame, so the DMA wraps around the frame's two words
+    *read = fade->slot_bits == 32 ? AUDIO_I2S_DMA_READ_FRAME : AUDIO_I2S_DMA_READ_FIXED;
+    return fade->ramp;
+#else
+    *read = AUDIO_I2S_DMA_READ_FIXED;
+    return zero;
+#endif
+}
+#endif
+
+uint audio_i2s_fade_prepare_stop(audio_i2s_fade_t *fade, const void *source, uint32_t frames, const void *read_addr) {
+#if PICO_AUDIO_I2S_FADE_FRAMES
+    const uint8_t *base = (const uint8_t *) source;
+    uint32_t count = frames;
+    uint transfers_per_frame = fade->slot_bits / 16u;
+    uint transfer_bytes = fade->slot_bits == 32 ? 4u : 2u * fade->channel_count;
+    uintptr_t addr = (uintptr_t) read_addr;
+    fade->stop_skip = 0;
+    if (base && addr >= (uintptr_t) base && addr <= (uintptr_t) base + count * transfers_per_frame * transfer_bytes) {
+        uint done = (uint) (addr - (uintptr_t) base) / transfer_bytes;
+        uint frame = done / transfers_per_frame;
+        fade->stop_skip = (uint16_t) (done % transfers_per_frame);
+        if (!fade->stop_skip && frame) {
+            // the last frame sent in full
+            frame--;
+        }
+        fade_set_level(fade, base, frame);
+    } else if (!base) {
+        fade->level[0] = fade->level[1] = 0;
+    }
+    // the stop ramp is pushed by the CPU, so it goes in the fade's own buffer
+    fade->ramp = fade->ramp_buffer;
+    fade_fill_ramp_down(fade);
+    fade->silent = true;
+    // ramp frame 0 completes a half-sent 32-bit frame; a zero frame after the ramp pushes its last frame out in full
+    return (PICO_AUDIO_I2S_FADE_FRAMES + 1u) * transfers_per_frame - fade->stop_skip;
+#else
+    (void) fade;
+    (void) source;
+    (void) frames;
+    (void) read_addr;
+    return 0;
+#endif
+}
+
+uint32_t audio_i2s_fade_stop_word(const audio_i2s_fade_t *fade, uint i) {
+#if PICO_AUDIO_I2S_FADE_FRAMES
+    i += fade->stop_skip;
+    if (fade->slot_bits == 32 || fade->channel_count == 2) {
+        return i < PICO_AUDIO_I2S_FADE_FRAMES * (fade->slot_bits / 16u) ? fade->ramp[i] : 0;
+    }
+    if (i >= PICO_AUDIO_I2S_FADE_FRAMES) {
+        return 0;
+    }
+    // a halfword DMA write is replicated into both halves of the FIFO word
+    uint16_t sample = ((const uint16_t *) fade->ramp)[i];
+    return sample | ((uint32_t) sample << 16);
+#else
+    (void) fade;
+    (void) i;
+    return 0;
+#endif
+}
+/** @} */
+
+audio_buffer_pool_t *audio_i2s_new_consumer_pool_in_arena(audio_buffer_format_t *format, uint buffer_count,
+                                                         uint samples_per_buffer, uint32_t *arena, size_t arena_words) {
+    size_t needed = AUDIO_I2S_POOL_ARENA_WORDS(buffer_count, samples_per_buffer, format->sample_stride);
+    if (arena_words < needed) {
+        panic("I2S consumer pool arena too small (%u words, need %u)", (uint) arena_words, (uint) needed);
+    }
+    assert(!((uintptr_t) arena & 3u));
+    uint buffer_words = (samples_per_buffer * format->sample_stride + 3u) / 4u;
+    audio_buffer_pool_t *pool = (audio_buffer_pool_t *) (arena + buffer_count * buffer_words);
+    audio_buffer_t *buffers = (audio_buffer_t *) (pool + 1);
+    mem_buffer_t *mem_buffers = (mem_buffer_t *) (buffers + buffer_count);
+
+    memset(pool, 0, sizeof(*pool));
+    pool->type = ac_consumer;
+    pool->format = format->format;
+    for (uint i = 0; i < buffer_count; i++) {
+        mem_buffers[i] = (mem_buffer_t) {
+                .size = samples_per_buffer * format->sample_stride,
+                .bytes = (uint8_t *) (arena + i * buffer_words),
+        };
+        buffers[i] = (audio_buffer_t) {
+                .buffer = &mem_buffers[i],
+                .format = format,
+                .max_sample_count = samples_per_buffer,
+                .next = i != buffer_count - 1 ? &buffers[i + 1] : NULL,
+        };
+    }
+    // the same locks audio_new_buffer_pool() uses
+    pool->free_list_spin_lock = spin_lock_init(SPINLOCK_ID_AUDIO_FREE_LIST_LOCK);
+    pool->free_list = buffer_count ? buffers : NULL;
+    pool->prepared_list_spin_lock = spin_lock_init(SPINLOCK_ID_AUDIO_PREPARED_LISTS_LOCK);
+    return pool;
+}
+
+void audio_i2s_release_copying_connection(struct buffer_copying_on_consumer_take_connection *connection) {
+    if (connection->current_producer_buffer) {
+        queue_free_audio_buffer(connection->core.producer_pool, connection->current_producer_buffer);
+        connection->current_producer_buffer = NULL;
+    }
+    connection->current_producer_buffer_pos = 0;
+}
+
+void audio_i2s_release_consumer_pool(audio_buffer_pool_t *consumer) {
+    audio_connection_t *connection = consumer->connection;
+    if (!connection) {
+        return;
+    }
+    audio_buffer_t *ab;
+    while ((ab = get_full_audio_buffer(consumer, false))) {
+        connection->consumer_pool_give(connection, ab);
+    }
+    if (connection->consumer_pool_take == spsc_consumer_take) {
+        // everything the rings hold belongs to the producer pool
+        audio_i2s_spsc_connection_t *spsc = (audio_i2s_spsc_connection_t *) connection;
+        while ((ab = spsc_pop(&spsc->full)) || (ab = spsc_pop(&spsc->free))) {
+            queue_free_audio_buffer(connection->producer_pool, ab);
+        }
+    }
+    if (connection->producer_pool) {
+        connection->producer_pool->connection = NULL;
+    }
+    consumer->connection = NULL;
+}
+
+/** \name Output processing
+ *
+ * The processors are one inline loop, specialized by macro for each producer
+ * format and channel layout, so the format branches fold away. Samples are
+ * loaded at the output's scale (S16 for 16-bit slots, MSB-aligned S32 for
+ * 32-bit slots), DC blocked, saturated, scaled by the gain and stored, each in
+ * a single pass. The DC blocker carries 8 fractional bits, in 32 bits at S16
+ * scale and in 64 bits at S32 scale.
+ * @{
+ */
+void audio_i2s_output_process_init(audio_i2s_output_process_t *process) {
+    memset(process, 0, sizeof(*process));
+    process->gain = AUDIO_I2S_UNITY_GAIN;
+    process->gain_acc = process->gain_end = AUDIO_I2S_UNITY_GAIN * 65536;
+}
+
+void audio_i2s_output_process_set_dc_blocker(audio_i2s_output_process_t *process, uint dc_shift) {
+    assert(dc_shift <= 15);
+    if (!process->dc_shift) {
+        // picking up from the first frame avoids a step from zero
+        process->dc_restart = true;
+    }
+    process->dc_shift = (uint8_t) dc_shift;
+}
+
+/** \brief Work out the gain ramp over a consumer buffer of frames frames
+ *
+ *  \return true if processing changes the samples, false if they can be converted as they are
+ */
+static bool __audio_i2s_isr_func(output_process_begin)(audio_i2s_output_process_t *process, uint frames) {
+    int32_t target = process->gain * 65536;
+    process->gain_end = target;
+    process->gain_step = ((int64_t) target - process->gain_acc) / (int32_t) frames;
+    return process->gain_acc != AUDIO_I2S_UNITY_GAIN * 65536 || target != AUDIO_I2S_UNITY_GAIN * 65536 ||
+           process->dc_shift;
+}
+
+/** \brief Input sample i at the output's scale */
+static __force_inline int32_t process_load(const void *input, uint i, uint in_format, bool wide) {
+    switch (in_format) {
+        case AUDIO_BUFFER_FORMAT_PCM_S8:
+            return ((const int8_t *) input)[i] * 256;
+        case AUDIO_BUFFER_FORMAT_PCM_S16:
+            return wide ? (int32_t) ((uint32_t) ((const int16_t *) input)[i] << 16) : ((const int16_t *) input)[i];
+        case AUDIO_BUFFER_FORMAT_PCM_S24:
+            return (int32_t) ((uint32_t) ((const int32_t *) input)[i] << 8);
+        default:
+            return ((const int32_t *) input)[i];
+    }
+}
+
+/** \brief Frame i of the input, in the output's channels (stereo is mixed down to (left + right) / 2 for mono) */
+static __force_inline uint process_load_frame(int32_t *samples, const void *input, uint i, uint in_format,
+                                              uint in_channels, uint out_channels, bool wide) {
+    if (in_channels == 2 && out_channels == 1) {
+        samples[0] = (process_load(input, 2 * i, in_format, wide) + process_load(input, 2 * i + 1, in_format, wide)) >> 1;
+        return 1;
+    }
+    for (uint c = 0; c < in_channels; c++) {
+        samples[c] = process_load(input, i * in_channels + c, in_format, wide);
+    }
+    return in_channels;
+}
+
+static __force_inline void process_frames(audio_i2s_output_process_t *process, void *output, const void *input,
+                                          uint sample_count, uint in_format, uint in_channels, uint out_channels,
+                                          bool wide) {
+    int32_t samples[2];
+    uint channels;
+    if (process->dc_restart && sample_count) {
+        channels = process_load_frame(samples, input, 0, in_format, in_channels, out_channels, wide);
+        for (uint c = 0; c < channels; c++) {
+            process->dc_prev[c] = samples[c];
+            process->dc_acc[c] = 0;
+        }
+        process->dc_restart = false;
+    }
+    const uint dc_shift = process->dc_shift;
+    int32_t gain_acc = process->gain_acc;
+    const int64_t gain_step = process->gain_step;
+    int32_t prev[2] = {process->dc_prev[0], process->dc_prev[1]};
+    int32_t acc32[2] = {(int32_t) process->dc_acc[0], (int32_t) process->dc_acc[1]};
+    int64_t acc64[2] = {process->dc_acc[0], process->dc_acc[1]};
+    for (uint i = 0; i < sample_count; i++) {
+        int32_t gain = gain_acc >> 16;
+        // AUDIO_I2S_UNITY_GAIN multiplies by exactly 1.0
+        gain += gain == AUDIO_I2S_UNITY_GAIN;
+        // every step lands between the start and the target, so the sum fits
+        gain_acc = (int32_t) (gain_acc + gain_step);
+        channels = process_load_frame(samples, input, i, in_format, in_channels, out_channels, wide);
+        for (uint c = 0; c < channels; c++) {
+            int32_t x = samples[c];
+            if (wide) {
+                int64_t y = x;
+                if (dc_shift) {
+                    acc64[c] += ((int64_t) x - prev[c]) * 256;
+                    acc64[c] -= acc64[c] >> dc_shift;
+                    prev[c] = x;
+                    y = acc64[c] >> 8;
+                    y = MAX(MIN(y, INT32_MAX), INT32_MIN);
+                }
+                if (gain != 0x8000) {
+                    y = (y * gain) >> 15;
+                }
+                samples[c] = (int32_t) y;
+            } else {
+                int32_t y = x;
+                if (dc_shift) {
+                    acc32[c] += (x - prev[c]) * 256;
+                    acc32[c] -= acc32[c] >> dc_shift;
+                    prev[c] = x;
+                    y = acc32[c] >> 8;
+                    y = MAX(MIN(y, INT16_MAX), INT16_MIN);
+                }
+                samples[c] = (y * gain) >> 15;
+            }
+        }
+        if (wide) {
+            int32_t *out = (int32_t *) output + 2 * i;
+            out[0] = samples[0];
+            out[1] = samples[channels - 1];
+        } else if (out_channels == 2) {
+            int16_t *out = (int16_t *) output + 2 * i;
+            out[0] = (int16_t) samples[0];
+            out[1] = (int16_t) samples[channels - 1];
+        } else {
+            ((int16_t *) output)[i] = (int16_t) samples[0];
+        }
+    }
+    process->gain_acc = gain_acc;
+    for (uint c = 0; c < 2; c++) {
+        process->dc_prev[c] = prev[c];
+        process->dc_acc[c] = wide ? acc64[c] : acc32[c];
+    }
+}
+
+#define AUDIO_I2S_PROCESSOR(name, in_format, in_channels, out_channels, wide) \
+static void __time_critical_func(name)(audio_i2s_output_process_t *process, void *output, const void *input, \
+                                       uint sample_count) { \
+    process_frames(process, output, input, sample_count, in_format, in_channels, out_channels, wide); \
+}
+
+AUDIO_I2S_PROCESSOR(process_s16_mono_to_s16_mono, AUDIO_BUFFER_FORMAT_PCM_S16, 1, 1, false)
+AUDIO_I2S_PROCESSOR(process_s16_stereo_to_s16_mono, AUDIO_BUFFER_FORMAT_PCM_S16, 2, 1, false)
+AUDIO_I2S_PROCESSOR(process_s8_mono_to_s16_mono, AUDIO_BUFFER_FORMAT_PCM_S8, 1, 1, false)
+AUDIO_I2S_PROCESSOR(process_s8_stereo_to_s16_mono, AUDIO_BUFFER_FORMAT_PCM_S8, 2, 1, false)
+AUDIO_I2S_PROCESSOR(process_s16_mono_to_s16_stereo, AUDIO_BUFFER_FORMAT_PCM_S16, 1, 2, false)
+AUDIO_I2S_PROCESSOR(process_s16_stereo_to_s16_stereo, AUDIO_BUFFER_FORMAT_PCM_S16, 2, 2, false)
+AUDIO_I2S_PROCESSOR(process_s8_mono_to_s16_stereo, AUDIO_BUFFER_FORMAT_PCM_S8, 1, 2, false)
+AUDIO_I2S_PROCESSOR(process_s8_stereo_to_s16_stereo, AUDIO_BUFFER_FORMAT_PCM_S8, 2, 2, false)
+AUDIO_I2S_PROCESSOR(process_s16_mono_to_s32_stereo, AUDIO_BUFFER_FORMAT_PCM_S16, 1, 2, true)
+AUDIO_I2S_PROCESSOR(process_s16_stereo_to_s32_stereo, AUDIO_BUFFER_FORMAT_PCM_S16, 2, 2, true)
+AUDIO_I2S_PROCESSOR(process_s24_mono_to_s32_stereo, AUDIO_BUFFER_FORMAT_PCM_S24, 1, 2, true)
+AUDIO_I2S_PROCESSOR(process_s24_stereo_to_s32_stereo, AUDIO_BUFFER_FORMAT_PCM_S24, 2, 2, true)
+AUDIO_I2S_PROCESSOR(process_s32_mono_to_s32_stereo, AUDIO_BUFFER_FORMAT_PCM_S32, 1, 2, true)
+AUDIO_I2S_PROCESSOR(process_s32_stereo_to_s32_stereo, AUDIO_BUFFER_FORMAT_PCM_S32, 2, 2, true)
+
+audio_i2s_sample_processor_t audio_i2s_s16_processor(const audio_format_t *producer_format, uint output_channel_count) {
+    bool stereo_in = producer_format->channel_count == 2;
+    if (!stereo_in && producer_format->channel_count != 1) {
+        return NULL;
+    }
+    bool stereo_out = output_channel_count == 2;
+    switch (producer_format->format) {
+        case AUDIO_BUFFER_FORMAT_PCM_S16:
+            if (stereo_out) {
+                return stereo_in ? process_s16_stereo_to_s16_stereo : process_s16_mono_to_s16_stereo;
+            }
+            return stereo_in ? process_s16_stereo_to_s16_mono : process_s16_mono_to_s16_mono;
+        case AUDIO_BUFFER_FORMAT_PCM_S8:
+            if (stereo_out) {
+                return stereo_in ? process_s8_stereo_to_s16_stereo : process_s8_mono_to_s16_stereo;
+            }
+            return stereo_in ? process_s8_stereo_to_s16_mono : process_s8_mono_to_s16_mono;
+        default:
+            return NULL;
+    }
+}
+
+audio_i2s_sample_processor_t audio_i2s_s32_stereo_processor(const audio_format_t *producer_format) {
+    bool stereo = producer_format->channel_count == 2;
+    if (!stereo && producer_format->channel_count != 1) {
+        return NULL;
+    }
+    switch (producer_format->format) {
+        case AUDIO_BUFFER_FORMAT_PCM_S16:
+            return stereo ? process_s16_stereo_to_s32_stereo : process_s16_mono_to_s32_stereo;
+        case AUDIO_BUFFER_FORMAT_PCM_S24:
+            return stereo ? process_s24_stereo_to_s32_stereo : process_s24_mono_to_s32_stereo;
+        case AUDIO_BUFFER_FORMAT_PCM_S32:
+            return stereo ? process_s32_stereo_to_s32_stereo : process_s32_mono_to_s32_stereo;
+        default:
+            return NULL;
+    }
+}
+/** @} */
+
+/** \name Rate changes
+ * @{
+ */
+void audio_i2s_rate_change_reset(audio_i2s_rate_change_t *rc, uint32_t sample_freq) {
+    // consumer_fence and counted are cleared too: the driver sets them for its connection
+    *rc = (audio_i2s_rate_change_t) {
+            .producer_freq = sample_freq,
+    };
+}
+
+void audio_i2s_rate_change_queue(audio_i2s_rate_change_t *rc, uint32_t sample_freq, uint32_t mute_frames) {
+    assert(sample_freq);
+    rc->fence = rc->given;
+    rc->mute_frames = mute_frames;
+    rc->flush = true;
+    // the DMA IRQ acts on the change as soon as it sees the rate
+    __mem_fence_release();
+    rc->sample_freq = sample_freq;
+}
+
+void audio_i2s_converting_producer_give(audio_connection_t *connection, audio_buffer_t *buffer) {
+    audio_i2s_rate_change_t *rc = ((audio_i2s_converting_connection_t *) connection)->rate_change;
+    if (rc) {
+        uint32_t sample_freq = buffer->format->format->sample_freq;
+        if (audio_i2s_rate_change_check_give(rc, sample_freq)) {
+            audio_i2s_rate_change_queue(rc, sample_freq, PICO_AUDIO_I2S_RATE_CHANGE_MUTE_FRAMES);
+        }
+        rc->given++;
+    }
+    producer_pool_give_buffer_default(connection, buffer);
+}
+
+void audio_i2s_rate_change_flush_give(struct producer_pool_blocking_give_connection *pbc, audio_i2s_rate_change_t *rc) {
+    audio_buffer_t *ab = pbc->current_consumer_buffer;
+    rc->flush = false;
+    if (ab && pbc->current_consumer_buffer_pos) {
+        ab->sample_count = pbc->current_consumer_buffer_pos;
+        pbc->current_consumer_buffer = NULL;
+        pbc->current_consumer_buffer_pos = 0;
+        rc->given++;
+        queue_full_audio_buffer(pbc->core.consumer_pool, ab);
+    }
+}
+
+void audio_i2s_rate_change_copy_give(struct producer_pool_blocking_give_connection *pbc, audio_i2s_rate_change_t *rc,
+                                     void (*give)(audio_connection_t *, audio_buffer_t *), audio_buffer_t *buffer) {
+    if (rc->flush) {
+        uint32_t given = rc->given;
+        audio_i2s_rate_change_flush_give(pbc, rc);
+        if (rc->given != given && rc->sample_freq) {
+            // the flushed frames were copied before the change, so they go before the fence
+            __mem_fence_release();
+            rc->fence = rc->given;
+        }
+    }
+    // take the buffer the give would start on, to learn the consumer buffer length
+    if (!pbc->current_consumer_buffer) {
+        pbc->current_consumer_buffer = get_free_audio_buffer(pbc->core.consumer_pool, true);
+        pbc->current_consumer_buffer_pos = 0;
+    }
+    // count the buffers the give fills before it queues them, so the IRQ can never have
+    // taken one that a change queued by another core in the meantime would put after the fence
+    uint32_t frames = pbc->current_consumer_buffer_pos + buffer->sample_count;
+    rc->given += frames / pbc->current_consumer_buffer->max_sample_count;
+    give(&pbc->core, buffer);
+}
+/** @} */
+
+/** \brief Copy loop shared by all converting connections
+ *
+ * Fills one consumer buffer from as many producer buffers as it takes, converting
+ * each contiguous run of frames with a single converter call. When not blocking, a
+ * partially filled buffer is returned rather than waiting for the producer; the
+ * buffer is also cut short at a pending rate change fence.
+ */
+audio_buffer_t *__audio_i2s_isr_func(audio_i2s_converting_consumer_take)(audio_connection_t *connection, bool block) {
+    audio_i2s_converting_connection_t *cc = (audio_i2s_converting_connection_t *) connection;
+    audio_buffer_t *buffer = get_free_audio_buffer(cc->core.core.consumer_pool, block);
+    if (!buffer) {
+        return NULL;
+    }
+    uint output_stride = buffer->format->sample_stride;
+    audio_i2s_output_process_t *process = cc->process;
+    bool processing = process && output_process_begin(process, buffer->max_sample_count);
+    uint32_t pos = 0;
+    while (pos < buffer->max_sample_count) {
+        audio_buffer_t *ab = cc->core.current_producer_buffer;
+        if (!ab) {
+            audio_i2s_rate_change_t *rc = cc->rate_change;
+            if (rc && rc->sample_freq && rc->taken == rc->fence) {
+                // the rest is at a new rate, which starts in a consumer buffer of its own
+                break;
+            }
+            ab = cc->core.current_producer_buffer = get_full_audio_buffer(cc->core.core.producer_pool, block);
+            if (!ab) {
+                assert(!block);
+                break;
+            }
+            if (rc) {
+                rc->taken++;
+            }
+            cc->core.current_producer_buffer_pos = 0;
+        }
+        uint32_t count = MIN(buffer->max_sample_count - pos, ab->sample_count - cc->core.current_producer_buffer_pos);
+        uint8_t *out = buffer->buffer->bytes + pos * output_stride;
+        const uint8_t *in = ab->buffer->bytes + cc->core.current_producer_buffer_pos * ab->format->sample_stride;
+        if (processing) {
+            cc->process_convert(process, out, in, count);
+        } else {
+            cc->convert(out, in, count);
+        }
+        pos += count;
+        cc->core.current_producer_buffer_pos += count;
+        if (cc->core.current_producer_buffer_pos == ab->sample_count) {
+            queue_free_audio_buffer(cc->core.core.producer_pool, ab);
+            cc->core.current_producer_buffer = NULL;
+        }
+    }
+    if (!pos) {
+        queue_free_audio_buffer(cc->core.core.consumer_pool, buffer);
+        return NULL;
+    }
+    if (processing && pos == buffer->max_sample_count) {
+        // land exactly on the target, whatever the rounding of the step
+        process->gain_acc = process->gain_end;
+    }
+    buffer->sample_count = pos;
+    return buffer;
+}
+
+/** \name 16-bit output kernels
+ *
+ * These work a 32-bit word (2 S16 or 4 S8 samples) at a time. S8 to S16 is a
+ * byte shift (the S16 value is the S8 value * 256), so no sign extension is
+ * needed: masking the word with 0xff00ff00, before and after shifting it up by
+ * 8, gives the odd and even samples as packed S16 pairs. Packing halfwords into
+ * output words is a single PKHBT/PKHTB on cores with the DSP extension
+ * (Cortex-M33), and a mask and a shifted OR elsewhere (Hazard3, Cortex-M0+).
+ *
+ * Input words are only loaded aligned, since neither Hazard3 nor Cortex-M0+
+ * supports unaligned loads; the head and tail of a run that is not word-aligned
+ * are done a sample at a time.
+ * @{
+ */
+#if defined(__ARM_FEATURE_DSP) && __ARM_FEATURE_DSP
+/** \brief (lo & 0xffff) | (hi << 16) */
+static __force_inline uint32_t pack_lo_lo(uint32_t lo, uint32_t hi) {
+    uint32_t r;
+    __asm ("pkhbt %0, %1, %2, lsl #16" : "=r" (r) : "r" (lo), "r" (hi));
+    return r;
+}
+
+/** \brief (lo >> 16) | (hi & 0xffff0000) */
+static __force_inline uint32_t pack_hi_hi(uint32_t lo, uint32_t hi) {
+    uint32_t r;
+    __asm ("pkhtb %0, %1, %2, asr #16" : "=r" (r) : "r" (hi), "r" (lo));
+    return r;
+}
+
+/** \brief Signed halfword lanes of (x + y) >> 1 */
+static __force_inline uint32_t halving_add_16(uint32_t x, uint32_t y) {
+    uint32_t r;
+    __asm ("shadd16 %0, %1, %2" : "=r" (r) : "r" (x), "r" (y));
+    return r;
+}
+#else
+static __force_inline uint32_t pack_lo_lo(uint32_t lo, uint32_t hi) {
+    return (lo & 0xffffu) | (hi << 16);
+}
+
+static __force_inline uint32_t pack_hi_hi(uint32_t lo, uint32_t hi) {
+    return (lo >> 16) | (hi & 0xffff0000u);
+}
+
+static __force_inline uint32_t halving_add_16(uint32_t x, uint32_t y) {
+    uint32_t lo = (uint16_t) (((int16_t) x + (int16_t) y) >> 1);
+    uint32_t hi = (uint16_t) (((int16_t) (x >> 16) + (int16_t) (y >> 16)) >> 1);
+    return lo | (hi << 16);
+}
+#endif
+
+/** \brief S8 sample to S16, as the raw halfword */
+static __force_inline uint32_t s8_to_s16(int8_t sample) {
+    return (uint32_t) (uint8_t) sample << 8;
+}
+
+static void __time_critical_func(s16_copy_stereo)(void *output, const void *input, uint sample_count) {
+    memcpy(output, input, sample_count * 4);
+}
+
+static void __time_critical_func(s16_copy_mono)(void *output, const void *input, uint sample_count) {
+    memcpy(output, input, sample_count * 2);
+}
+
+static void __time_critical_func(s16_mono_to_s16_stereo)(void *output, const void *input, uint sample_count) {
+    uint32_t *out = (uint32_t *) output;
+    const uint16_t *in = (const uint16_t *) input;
+    if (sample_count && ((uintptr_t) in & 2u)) {
+        *out++ = *in++ * 0x10001u;
+        sample_count--;
+    }
+    const uint32_t *in32 = (const uint32_t *) in;
+    for (uint i = sample_count / 4; i; i--) {
+        uint32_t a = in32[0];
+        uint32_t b = in32[1];
+        out[0] = pack_lo_lo(a, a);
+        out[1] = pack_hi_hi(a, a);
+        out[2] = pack_lo_lo(b, b);
+        out[3] = pack_hi_hi(b, b);
+        in32 += 2;
+        out += 4;
+    }
+    in = (const uint16_t *) in32;
+    for (uint i = sample_count & 3u; i; i--) {
+        *out++ = *in++ * 0x10001u;
+    }
+}
+
+static void __time_critical_func(s8_mono_to_s16_stereo)(void *output, const void *input, uint sample_count) {
+    uint32_t *out = (uint32_t *) output;
+    const int8_t *in = (const int8_t *) input;
+    for (; sample_count && ((uintptr_t) in & 3u); sample_count--) {
+        *out++ = s8_to_s16(*in++) * 0x10001u;
+    }
+    const uint32_t *in32 = (const uint32_t *) in;
+    for (uint i = sample_count / 4; i; i--) {
+        uint32_t w = *in32++;
+        uint32_t even = (w << 8) & 0xff00ff00u;
+        uint32_t odd = w & 0xff00ff00u;
+        out[0] = pack_lo_lo(even, even);
+        out[1] = pack_lo_lo(odd, odd);
+        out[2] = pack_hi_hi(even, even);
+        out[3] = pack_hi_hi(odd, odd);
+        out += 4;
+    }
+    in = (const int8_t *) in32;
+    for (uint i = sample_count & 3u; i; i--) {
+        *out++ = s8_to_s16(*in++) * 0x10001u;
+    }
+}
+
+/** \brief S8 to S16 with the same channel layout (sample_count is in samples, not frames) */
+static void __time_critical_func(s8_to_s16_samples)(uint16_t *out, const int8_t *in, uint sample_count) {
+    uint head = (4u - ((uintptr_t) in & 3u)) & 3u;
+    if (head > sample_count || (((uintptr_t) (out + head)) & 2u)) {
+        // input and output can't both be word aligned
+        head = sample_count;
+    }
+    for (uint i = head; i; i--) {
+        *out++ = (uint16_t) s8_to_s16(*in++);
+    }
+    sample_count -= head;
+    const uint32_t *in32 = (const uint32_t *) in;
+    uint32_t *out32 = (uint32_t *) out;
+    for (uint i = sample_count / 4; i; i--) {
+        uint32_t w = *in32++;
+        uint32_t even = (w << 8) & 0xff00ff00u;
+        uint32_t odd = w & 0xff00ff00u;
+        out32[0] = pack_lo_lo(even, odd);
+        out32[1] = pack_hi_hi(even, odd);
+        out32 += 2;
+    }
+    in = (const int8_t *) in32;
+    out = (uint16_t *) out32;
+    for (uint i = sample_count & 3u; i; i--) {
+        *out++ = (uint16_t) s8_to_s16(*in++);
+    }
+}
+
+/** \brief S16 stereo frame to its mono mix down, (left + right) >> 1, as the raw halfword */
+static __force_inline uint16_t s16_frame_to_mono(uint32_t frame) {
+    return (uint16_t) (((int16_t) frame + (int16_t) (frame >> 16)) >> 1);
+}
+
+static void __time_critical_func(s16_stereo_to_s16_mono)(void *output, const void *input, uint sample_count) {
+    uint16_t *out = (uint16_t *) output;
+    const uint32_t *in = (const uint32_t *) input;
+    if (sample_count && ((uintptr_t) out & 2u)) {
+        *out++ = s16_frame_to_mono(*in++);
+        sample_count--;
+    }
+    // two frames in, one word of two mono samples out
+    uint32_t *out32 = (uint32_t *) out;
+    for (uint i = sample_count / 2; i; i--) {
+        uint32_t a = in[0];
+        uint32_t b = in[1];
+        *out32++ = halving_add_16(pack_lo_lo(a, b), pack_hi_hi(a, b));
+        in += 2;
+    }
+    if (sample_count & 1u) {
+        *(uint16_t *) out32 = s16_frame_to_mono(*in);
+    }
+}
+
+static void __time_critical_func(s8_stereo_to_s16_mono)(void *output, const void *input, uint sample_count) {
+    uint16_t *out = (uint16_t *) output;
+    const int8_t *in = (const int8_t *) input;
+    for (uint i = sample_count; i; i--) {
+        // same as expanding both channels to S16 and then mixing down
+        *out++ = (uint16_t) ((in[0] + in[1]) * 128);
+        in += 2;
+    }
+}
+
+static void __time_critical_func(s8_mono_to_s16_mono)(void *output, const void *input, uint sample_count) {
+    s8_to_s16_samples((uint16_t *) output, (const int8_t *) input, sample_count);
+}
+
+static void __time_critical_func(s8_stereo_to_s16_stereo)(void *output, const void *input, uint sample_count) {
+    s8_to_s16_samples((uint16_t *) output, (const int8_t *) input, sample_count * 2);
+}
+/** @} */
+
+audio_i2s_sample_converter_t audio_i2s_s16_converter(const audio_format_t *producer_format, uint output_channel_count) {
+    bool stereo_in = producer_format->channel_count == 2;
+    if (!stereo_in && producer_format->channel_count != 1) {
+        return NULL;
+    }
+    if (output_channel_count == 1) {
+        // stereo is mixed down
+        switch (producer_format->format) {
+            case AUDIO_BUFFER_FORMAT_PCM_S16:
+                return stereo_in ? s16_stereo_to_s16_mono : s16_copy_mono;
+            case AUDIO_BUFFER_FORMAT_PCM_S8:
+                return stereo_in ? s8_stereo_to_s16_mono : s8_mono_to_s16_mono;
+            default:
+                return NULL;
+        }
+    }
+    assert(output_channel_count == 2);
+    switch (producer_format->format) {
+        case AUDIO_BUFFER_FORMAT_PCM_S16:
+            return stereo_in ? s16_copy_stereo : s16_mono_to_s16_stereo;
+        case AUDIO_BUFFER_FORMAT_PCM_S8:
+            return stereo_in ? s8_stereo_to_s16_stereo : s8_mono_to_s16_stereo;
+        default:
+            return NULL;
+    }
+}
+
+/** \name 32-bit stereo output converters
+ *  Output samples are MSB-aligned: S16 is shifted up by 16, S24 by 8
+ * @{
+ */
+static void __time_critical_func(s16_stereo_to_s32_stereo)(void *output, const void *input, uint sample_count) {
+    int32_t *out = (int32_t *) output;
+    const int16_t *in = (const int16_t *) input;
+    for (uint i = 0; i < sample_count * 2; i++) {
+        out[i] = (int32_t) ((uint32_t) in[i] << 16);
+    }
+}
+
+static void __time_critical_func(s16_mono_to_s32_stereo)(void *output, const void *input, uint sample_count) {
+    int32_t *out = (int32_t *) output;
+    const int16_t *in = (const int16_t *) input;
+    for (uint i = 0; i < sample_count; i++) {
+        out[i * 2] = out[i * 2 + 1] = (int32_t) ((uint32_t) in[i] << 16);
+    }
+}
+
+static void __time_critical_func(s24_stereo_to_s32_stereo)(void *output, const void *input, uint sample_count) {
+    int32_t *out = (int32_t *) output;
+    const int32_t *in = (const int32_t *) input;
+    for (uint i = 0; i < sample_count * 2; i++) {
+        out[i] = (int32_t) ((uint32_t) in[i] << 8);
+    }
+}
+
+static void __time_critical_func(s24_mono_to_s32_stereo)(void *output, const void *input, uint sample_count) {
+    int32_t *out = (int32_t *) output;
+    const int32_t *in = (const int32_t *) input;
+    for (uint i = 0; i < sample_count; i++) {
+        out[i * 2] = out[i * 2 + 1] = (int32_t) ((uint32_t) in[i] << 8);
+    }
+}
+
+static void __time_critical_func(s32_stereo_to_s32_stereo)(void *output, const void *input, uint sample_count) {
+    memcpy(output, input, sample_count * 8);
+}
+
+static void __time_critical_func(s32_mono_to_s32_stereo)(void *output, const void *input, uint sample_count) {
+    int32_t *out = (int32_t *) output;
+    const int32_t *in = (const int32_t *) input;
+    for (uint i = 0; i < sample_count; i++) {
+        out[i * 2] = out[i * 2 + 1] = in[i];
+    }
+}
+/** @} */
+
+audio_i2s_sample_converter_t audio_i2s_s32_stereo_converter(const audio_format_t *producer_format) {
+    bool stereo = producer_format->channel_count == 2;
+    if (!stereo && producer_format->channel_count != 1) {
+        return NULL;
+    }
+    switch (producer_format->format) {
+        case AUDIO_BUFFER_FORMAT_PCM_S16:
+            return stereo ? s16_stereo_to_s32_stereo : s16_mono_to_s32_stereo;
+        case AUDIO_BUFFER_FORMAT_PCM_S24:
+            return stereo ? s24_stereo_to_s32_stereo : s24_mono_to_s32_stereo;
+        case AUDIO_BUFFER_FORMAT_PCM_S32:
+            return stereo ? s32_stereo_to_s32_stereo : s32_mono_to_s32_stereo;
+        default:
+            return NULL;
+    }
+}
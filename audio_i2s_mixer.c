@@ -0,0 +1,280 @@
+/*
+ * Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/** \file audio_i2s_mixer.c
+ *  \brief Software mixer connection
+ *
+ * The consumer take fills one consumer buffer from every stream at once, in runs
+ * of frames over which no stream changes buffer (like the multi-DAC lane fill).
+ *
+ * Mixing Arithmetic:
+ * - Streams are taken in pairs: the left (or right) samples of both streams are
+ *   packed into one word and multiplied by the packed Q15 gains of the pair with
+ *   a single SMLAD on cores with the DSP extension (Cortex-M33)
+ * - Gains are clamped to +-0x7fff, so a pair's sum fits in 32 bits; each pair is
+ *   rounded back to Q0 before the pairs are added, and the total is saturated to
+ *   16 bits with SSAT
+ * - Cores without the DSP extension (Hazard3, Cortex-M0+) do the same with
+ *   plain multiplies and a compare
+ */
+
+#include <string.h>
+#include "include/pico/audio_i2s_mixer.h"
+
+/** \brief Pairs of streams */
+#define MIXER_MAX_PAIRS ((PICO_AUDIO_I2S_MIXER_MAX_STREAMS + 1) / 2)
+
+#if defined(__ARM_FEATURE_DSP) && __ARM_FEATURE_DSP
+/** \brief acc + (int16) x * (int16) y + (x >> 16) * (y >> 16), halves signed */
+static __force_inline int32_t mix_smlad(uint32_t x, uint32_t y, int32_t acc) {
+    int32_t r;
+    __asm ("smlad %0, %1, %2, %3" : "=r" (r) : "r" (x), "r" (y), "r" (acc));
+    return r;
+}
+
+/** \brief Saturate to the S16 range */
+static __force_inline int32_t mix_ssat16(int32_t x) {
+    int32_t r;
+    __asm ("ssat %0, #16, %1" : "=r" (r) : "r" (x));
+    return r;
+}
+
+/** \brief (lo & 0xffff) | (hi << 16) */
+static __force_inline uint32_t mix_pack_lo_lo(uint32_t lo, uint32_t hi) {
+    uint32_t r;
+    __asm ("pkhbt %0, %1, %2, lsl #16" : "=r" (r) : "r" (lo), "r" (hi));
+    return r;
+}
+
+/** \brief (lo >> 16) | (hi & 0xffff0000) */
+static __force_inline uint32_t mix_pack_hi_hi(uint32_t lo, uint32_t hi) {
+    uint32_t r;
+    __asm ("pkhtb %0, %1, %2, asr #16" : "=r" (r) : "r" (hi), "r" (lo));
+    return r;
+}
+#else
+static __force_inline int32_t mix_smlad(uint32_t x, uint32_t y, int32_t acc) {
+    return acc + (int16_t) x * (int16_t) y + (int16_t) (x >> 16) * (int16_t) (y >> 16);
+}
+
+static __force_inline int32_t mix_ssat16(int32_t x) {
+    return x > INT16_MAX ? INT16_MAX : (x < INT16_MIN ? INT16_MIN : x);
+}
+
+static __force_inline uint32_t mix_pack_lo_lo(uint32_t lo, uint32_t hi) {
+    return (lo & 0xffffu) | (hi << 16);
+}
+
+static __force_inline uint32_t mix_pack_hi_hi(uint32_t lo, uint32_t hi) {
+    return (lo >> 16) | (hi & 0xffff0000u);
+}
+#endif
+
+/** \brief Where to read a stream's frames for one run */
+typedef struct mixer_source {
+    const uint8_t *bytes;  ///< Next frame
+    uint8_t stride;        ///< Bytes per frame: 4 (stereo), 2 (mono) or 0 (silent)
+} mixer_source_t;
+
+/** \brief Read a frame as a (left | right << 16) word and advance */
+static __force_inline uint32_t mixer_next_frame(mixer_source_t *src) {
+    uint32_t frame;
+    if (src->stride == 2) {
+        frame = (uint16_t) *(const int16_t *) src->bytes * 0x10001u;
+    } else {
+        frame = *(const uint32_t *) src->bytes;
+    }
+    src->bytes += src->stride;
+    return frame;
+}
+
+static const uint32_t mixer_silent_frame;
+
+/**
+ * \brief Mix frame_count frames from every source into out
+ *
+ * Inlined once per output layout: S16 or S32 (MSB aligned) samples, and mono outputs get the mix down.
+ */
+static __force_inline void mixer_mix_run(void *out, mixer_source_t *src, const uint32_t *pair_gains, uint pair_count,
+                                         uint frame_count, bool s32, bool stereo) {
+    for (uint f = 0; f < frame_count; f++) {
+        int32_t left = 0;
+        int32_t right = 0;
+        for (uint p = 0; p < pair_count; p++) {
+            uint32_t a = mixer_next_frame(&src[2 * p]);
+            uint32_t b = mixer_next_frame(&src[2 * p + 1]);
+            // rounded Q15 products summed in 32 bits, then back to Q0
+            left += mix_smlad(mix_pack_lo_lo(a, b), pair_gains[p], 0x4000) >> 15;
+            right += mix_smlad(mix_pack_hi_hi(a, b), pair_gains[p], 0x4000) >> 15;
+        }
+        left = mix_ssat16(left);
+        right = mix_ssat16(right);
+        if (!stereo) {
+            int32_t mono = (left + right) >> 1;
+            if (s32) {
+                ((int32_t *) out)[f] = (int32_t) ((uint32_t) mono << 16);
+            } else {
+                ((int16_t *) out)[f] = (int16_t) mono;
+            }
+        } else if (s32) {
+            ((int32_t *) out)[f * 2] = (int32_t) ((uint32_t) left << 16);
+            ((int32_t *) out)[f * 2 + 1] = (int32_t) ((uint32_t) right << 16);
+        } else {
+            ((uint32_t *) out)[f] = mix_pack_lo_lo((uint32_t) left, (uint32_t) right);
+        }
+    }
+}
+
+static audio_buffer_t *__audio_i2s_isr_func(mixer_consumer_take)(audio_connection_t *connection, bool block) {
+    audio_i2s_mixer_t *mixer = (audio_i2s_mixer_t *) connection;
+    audio_buffer_t *buffer = get_free_audio_buffer(connection->consumer_pool, block);
+    if (!buffer) {
+        return NULL;
+    }
+    const audio_format_t *output_format = buffer->format->format;
+    bool s32 = output_format->format == AUDIO_BUFFER_FORMAT_PCM_S32;
+    bool stereo = output_format->channel_count == 2;
+    if ((!s32 && output_format->format != AUDIO_BUFFER_FORMAT_PCM_S16) ||
+        (!stereo && output_format->channel_count != 1)) {
+        panic("mixer output must be PCM S16 or S32, mono or stereo");
+    }
+    uint8_t *out = buffer->buffer->bytes;
+    uint out_stride = buffer->format->sample_stride;
+
+    uint stream_count = mixer->stream_count;
+    // stream_count is published after the stream it counts
+    __mem_fence_acquire();
+    uint pair_count = (stream_count + 1) / 2;
+    uint32_t pair_gains[MIXER_MAX_PAIRS];
+    for (uint p = 0; p < pair_count; p++) {
+        uint32_t hi = 2 * p + 1 < stream_count ? (uint16_t) mixer->streams[2 * p + 1].gain : 0;
+        pair_gains[p] = (uint16_t) mixer->streams[2 * p].gain | (hi << 16);
+    }
+
+    mixer_source_t src[2 * MIXER_MAX_PAIRS];
+    if (stream_count & 1u) {
+        // an odd stream out is paired with silence
+        src[stream_count] = (mixer_source_t) {.bytes = (const uint8_t *) &mixer_silent_frame};
+    }
+    uint pos = 0;
+    while (pos < buffer->max_sample_count) {
+        uint run = buffer->max_sample_count - pos;
+        bool any = false;
+        for (uint i = 0; i < stream_count; i++) {
+            audio_i2s_mixer_stream_t *stream = &mixer->streams[i];
+            audio_buffer_t *ab = stream->current_buffer;
+            if (!ab) {
+                ab = stream->current_buffer = get_full_audio_buffer(stream->core.producer_pool, false);
+                stream->current_buffer_pos = 0;
+            }
+            if (ab) {
+                src[i] = (mixer_source_t) {
+                        .bytes = ab->buffer->bytes + stream->current_buffer_pos * ab->format->sample_stride,
+                        .stride = (uint8_t) ab->format->sample_stride,
+                };
+                run = MIN(run, ab->sample_count - stream->current_buffer_pos);
+                any = true;
+            } else {
+                src[i] = (mixer_source_t) {.bytes = (const uint8_t *) &mixer_silent_frame};
+            }
+        }
+        if (!any) {
+            // every stream has run dry; play what has been mixed rather than pad with silence
+            break;
+        }
+        void *run_out = out + pos * out_stride;
+        if (s32) {
+            if (stereo) {
+                mixer_mix_run(run_out, src, pair_gains, pair_count, run, true, true);
+            } else {
+                mixer_mix_run(run_out, src, pair_gains, pair_count, run, true, false);
+            }
+        } else if (stereo) {
+            mixer_mix_run(run_out, src, pair_gains, pair_count, run, false, true);
+        } else {
+            mixer_mix_run(run_out, src, pair_gains, pair_count, run, false, false);
+        }
+        pos += run;
+        for (uint i = 0; i < stream_count; i++) {
+            audio_i2s_mixer_stream_t *stream = &mixer->streams[i];
+            audio_buffer_t *ab = stream->current_buffer;
+            if (ab) {
+                stream->current_buffer_pos += run;
+                if (stream->current_buffer_pos == ab->sample_count) {
+                    queue_free_audio_buffer(stream->core.producer_pool, ab);
+                    stream->current_buffer = NULL;
+                }
+            }
+        }
+    }
+    if (!pos) {
+        // nothing to play: let the driver count an underrun
+        queue_free_audio_buffer(connection->consumer_pool, buffer);
+        return NULL;
+    }
+    buffer->sample_count = pos;
+    return buffer;
+}
+
+audio_buffer_pool_t *audio_i2s_mixer_init(audio_i2s_mixer_t *mixer, uint32_t sample_freq) {
+    memset(mixer, 0, sizeof(*mixer));
+    mixer->core = (audio_connection_t) {
+            .consumer_pool_take = mixer_consumer_take,
+            .consumer_pool_give = consumer_pool_give_buffer_default,
+            .producer_pool_take = producer_pool_take_buffer_default,
+            .producer_pool_give = producer_pool_give_buffer_default,
+    };
+    mixer->format = (audio_format_t) {
+            .sample_freq = sample_freq,
+            .format = AUDIO_BUFFER_FORMAT_PCM_S16,
+            .channel_count = 2,
+    };
+    mixer->buffer_format = (audio_buffer_format_t) {
+            .format = &mixer->format,
+            .sample_stride = 4,
+    };
+    // a producer pool with no buffers, so the drivers can read the format and connect it
+    mixer->output.type = ac_producer;
+    mixer->output.format = &mixer->format;
+    mixer->output.free_list_spin_lock = spin_lock_init(SPINLOCK_ID_AUDIO_FREE_LIST_LOCK);
+    mixer->output.prepared_list_spin_lock = spin_lock_init(SPINLOCK_ID_AUDIO_PREPARED_LISTS_LOCK);
+    return &mixer->output;
+}
+
+/** \brief Gain with -0x8000 moved to -0x7fff, so two full-scale products and the rounding bias can't overflow */
+static inline int16_t mixer_clamp_gain(int16_t gain) {
+    return (int16_t) MAX(gain, -AUDIO_I2S_MIXER_UNITY_GAIN);
+}
+
+int audio_i2s_mixer_add_stream(audio_i2s_mixer_t *mixer, audio_buffer_pool_t *producer, int16_t gain) {
+    uint index = mixer->stream_count;
+    if (index >= PICO_AUDIO_I2S_MIXER_MAX_STREAMS) {
+        return -1;
+    }
+    assert(producer->format->format == AUDIO_BUFFER_FORMAT_PCM_S16);
+    assert(producer->format->channel_count == 1 || producer->format->channel_count == 2);
+    assert(producer->format->sample_freq == mixer->format.sample_freq);
+
+    audio_i2s_mixer_stream_t *stream = &mixer->streams[index];
+    *stream = (audio_i2s_mixer_stream_t) {
+            .core = {
+                    .producer_pool_take = producer_pool_take_buffer_default,
+                    .producer_pool_give = producer_pool_give_buffer_default,
+                    .producer_pool = producer,
+            },
+            .gain = mixer_clamp_gain(gain),
+    };
+    // the stream is only consumed by the mixer, so only the producer side is connected
+    producer->connection = &stream->core;
+    __mem_fence_release();
+    mixer->stream_count = (uint8_t) (index + 1);
+    return (int) index;
+}
+
+void audio_i2s_mixer_set_gain(audio_i2s_mixer_t *mixer, uint stream, int16_t gain) {
+    assert(stream < mixer->stream_count);
+    mixer->streams[stream].gain = mixer_clamp_gain(gain);
+}
@@ -13,7 +13,7 @@
  *
  * Key Features Implemented:
  * - Synchronized clock generation shared across all DACs
- * - Independent data streams for up to 4 DACs
+ * - Independent data streams for up to 7 DACs (RP2040) or 11 (RP2350)
  * - Individual DMA channels and PIO state machines per DAC
  * - Coordinated enable/disable for perfect synchronization
  * - Independent audio format support per DAC
@@ -24,6 +24,10 @@
  * - Individual data-only PIO state machines for each DAC
  * - Separate DMA channels ensure independent data flow per DAC
  * - Coordinated IRQ handling manages all DACs efficiently
+ * - Optional capture state machine sampling an I2S input in lockstep (full duplex)
+ * - Sample rate changes that wait for every DAC to reach its fence, then retune all
+ *   state machines together while each plays silence (in lane mode, once the lane
+ *   buffers in flight hold nothing but silence)
  * - Phase-locked operation maintains audio coherence
  *
  * Synchronization Strategy:
@@ -38,6 +42,8 @@
  */
 
 #include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
 #include "pico/stdlib.h"
 #include "include/pico/audio_i2s_multi.h"
 #include "include/pico/audio_i2s_common.h"
@@ -46,6 +52,7 @@
 #include "hardware/gpio.h"
 #include "hardware/dma.h"
 #include "hardware/irq.h"
+#include "hardware/sync.h"
 
 /** \brief Global state for multi-DAC I2S implementation
  *
@@ -61,55 +68,282 @@ struct {
     uint8_t num_dacs;                                         ///< Number of configured DACs
     uint8_t clock_pio_sm;                                     ///< PIO state machine for shared clock generation
     uint8_t data_pio_sms[PICO_AUDIO_I2S_MAX_DACS];          ///< PIO state machines for data output per DAC
+    PIO clock_pio;                                            ///< PIO block running clock_pio_sm
+    PIO data_pios[PICO_AUDIO_I2S_MAX_DACS];                 ///< PIO block running each data state machine
+    uint32_t sm_masks[NUM_PIOS];                              ///< State machines in use in each PIO block
+    bool multi_pio;                                           ///< Data state machines in more than one PIO block
+    uint8_t clock_entry_pc;                                   ///< Frame start of the clock generator program
+    uint8_t data_entry_pcs[PICO_AUDIO_I2S_MAX_DACS];        ///< Frame start of the data program of each DAC
     uint8_t dma_channels[PICO_AUDIO_I2S_MAX_DACS];          ///< DMA channels assigned to each DAC
+    uint8_t channel_counts[PICO_AUDIO_I2S_MAX_DACS];        ///< Channels per consumer frame for each DAC: 1 (mono) or 2
+    uint8_t sample_bits[PICO_AUDIO_I2S_MAX_DACS];           ///< Bits per consumer sample for each DAC: 16 or 32 (stereo)
+    uint8_t slot_bits;                                        ///< Bits per slot on the shared clocks: 16, or 32 if any DAC takes 32-bit samples
+    uint8_t dma_channel_dac[NUM_DMA_CHANNELS];                ///< DAC index for each channel set in dma_channel_mask
+    uint32_t dma_channel_mask;                                ///< Bit mask of the DMA channels owned by the DACs
     bool initialized;                                         ///< System initialization status flag
+    bool single_sm;                                           ///< All lanes shifted by clock_pio_sm (one DMA channel)
+    uint32_t playing_buffer_pos[PICO_AUDIO_I2S_MAX_DACS];    ///< Frames of playing_buffers already interleaved (single_sm)
+    uint32_t *lane_buffers[2];                                ///< Lane-interleaved DMA buffers (single_sm)
+    audio_i2s_clock_divider_t clock_divider;                  ///< PIO divider shared by all state machines
+    audio_i2s_stats_t stats[PICO_AUDIO_I2S_MAX_DACS];        ///< Playback statistics for each DAC
+    uint32_t underrun_runs[PICO_AUDIO_I2S_MAX_DACS];         ///< Next silence run of each DAC's underrun (0 once a buffer plays)
+    audio_i2s_fade_t fades[PICO_AUDIO_I2S_MAX_DACS];          ///< Fade ramps and held level of each DAC (not single_sm)
+    audio_i2s_output_process_t processes[PICO_AUDIO_I2S_MAX_DACS]; ///< Gain and DC blocker of each DAC
+    audio_i2s_rate_change_t rate_changes[PICO_AUDIO_I2S_MAX_DACS]; ///< Queued rate change and fence of each DAC
+    uint32_t rate_switch_freq;                                ///< Rate the muted DACs are waiting to switch to
+    uint32_t rate_muted_mask;                                 ///< DACs past their fence, playing the rate change mute
+    uint32_t rate_parked_mask;                                ///< Muted DACs with nothing but silence left in their FIFOs
+    uint8_t lane_switch_countdown;                            ///< Lane IRQs left until the divider is written (single_sm)
+    uint32_t idle_park_ms;                                    ///< Silence before parking, 0 to never park
+    uint32_t park_frames;                                     ///< idle_park_ms in frames at freq
+    uint32_t idle_frames[PICO_AUDIO_I2S_MAX_DACS];           ///< Underrun silence queued by each DAC since a buffer last played
+    uint32_t silence_runs[PICO_AUDIO_I2S_MAX_DACS];          ///< Frames of the underrun silence each DAC's DMA is on (not single_sm)
+    volatile bool parked;                                     ///< Stopped while idle, until a give restarts the output
+    bool capture;                                             ///< A capture state machine runs beside the clock generator
+    uint8_t capture_pio_sm;                                   ///< PIO state machine sampling the data input (on clock_pio)
+    uint8_t capture_dma_channel;                              ///< DMA channel draining the capture RX FIFO
+    uint8_t capture_entry_pc;                                 ///< Frame start of the capture program
+    audio_buffer_pool_t *volatile capture_pool;               ///< Pool receiving captured buffers (NULL to discard)
+    audio_buffer_t *capture_buffer;                           ///< Buffer being filled by the capture DMA (NULL if discarding)
+    audio_i2s_stats_t capture_stats;                          ///< Capture statistics
 } multi_dac_state = {.initialized = false};
 
 audio_format_t pio_i2s_consumer_formats[PICO_AUDIO_I2S_MAX_DACS];
 audio_buffer_format_t pio_i2s_consumer_buffer_formats[PICO_AUDIO_I2S_MAX_DACS];
 
+static bool multi_dac_audio_enabled = false;
+
 // Forward declarations for multi-DAC
 static void update_pio_frequency_multi_dac(uint32_t sample_freq);
 static void audio_start_dma_transfer_multi_dac(uint8_t dac_index);
-static void __isr __time_critical_func(audio_i2s_dma_irq_handler_multi_dac)();
+static void __isr __audio_i2s_isr_func(audio_i2s_dma_irq_handler_multi_dac)();
+static void __isr __audio_i2s_isr_func(audio_i2s_dma_irq_handler_multi_lane)();
+static bool __audio_i2s_isr_func(multi_dac_park_due)(void);
+static void multi_dac_park(void);
+static void multi_dac_wake(void);
+static const audio_i2s_clock_user_t multi_dac_clock_user;
+
+/** \brief Load the capture program beside the clock generator and claim its DMA channel
+ *
+ * The capture state machine runs on the clock's block with the same divider and
+ * is in sm_masks, so it is started, stopped, rewound and retuned with the others
+ * and samples every bit clock in lockstep with them.
+ */
+static void multi_dac_setup_capture(const audio_i2s_multi_dac_config_t *config) {
+    PIO pio = multi_dac_state.clock_pio;
+    gpio_set_function(config->capture_pin, pio_get_funcsel(pio));
+
+    uint8_t sm = config->capture_pio_sm;
+    pio_sm_claim(pio, sm);
+    uint offset = pio_add_program(pio, &audio_i2s_capture_program);
+    audio_i2s_capture_program_init(pio, sm, offset, config->capture_pin);
+    multi_dac_state.capture_entry_pc = (uint8_t) (offset + audio_i2s_capture_offset_capture_entry_point);
+    multi_dac_state.capture_pio_sm = sm;
+    multi_dac_state.sm_masks[pio_get_index(pio)] |= 1u << sm;
+
+    uint8_t dma_channel = config->capture_dma_channel;
+    dma_channel_claim(dma_channel);
+    multi_dac_state.capture_dma_channel = dma_channel;
+
+    dma_channel_config dma_config = dma_channel_get_default_config(dma_channel);
+    channel_config_set_dreq(&dma_config, pio_get_dreq(pio, sm, false));
+    channel_config_set_read_increment(&dma_config, false);
+    channel_config_set_write_increment(&dma_config, true);
+    dma_channel_configure(dma_channel,
+                          &dma_config,
+                          NULL, // dest
+                          &pio->rxf[sm],  // src
+                          0, // count
+                          false // trigger
+    );
+    dma_irqn_set_channel_enabled(PICO_AUDIO_I2S_DMA_IRQ, dma_channel, 1);
+
+    audio_i2s_stats_reset(&multi_dac_state.capture_stats);
+    multi_dac_state.capture = true;
+}
+
+static const audio_format_t *audio_i2s_setup_multi_lane(const audio_format_t *intended_audio_format,
+                                                        const audio_i2s_multi_dac_config_t *config) {
+    uint8_t lanes = config->num_dacs;
+    // lanes are interleaved from 16-bit frames, and capture packs a 32-bit frame per word
+    if (lanes > 4 || 32 % lanes || config->s32_output_mask) {
+        return NULL;
+    }
+    for (uint8_t i = 1; i < lanes; i++) {
+        if (config->data_pins[i] != config->data_pins[0] + i) {
+            return NULL;
+        }
+    }
+    if (config->dma_channels[0] == config->dma_channels[1]) {
+        return NULL;
+    }
+
+    printf("Setting up single state machine multi-DAC I2S with %d lanes\n", lanes);
+
+    PIO pio = multi_dac_state.clock_pio;
+    uint func = pio_get_funcsel(pio);
+    gpio_set_function(config->clock_pin_base, func);
+    gpio_set_function(config->clock_pin_base + 1, func);
+    for (uint8_t i = 0; i < lanes; i++) {
+        gpio_set_function(config->data_pins[i], func);
+    }
+
+    uint8_t sm = config->clock_pio_sm;
+    pio_sm_claim(pio, sm);
+
+    uint offset = audio_i2s_multi_lane_program_add(pio, lanes);
+    audio_i2s_multi_lane_program_init(pio, sm, offset, config->data_pins[0], lanes, config->clock_pin_base);
+
+    multi_dac_state.clock_pio_sm = sm;
+    multi_dac_state.num_dacs = lanes;
+    multi_dac_state.single_sm = true;
+    multi_dac_state.sm_masks[pio_get_index(pio)] = 1u << sm;
+    // lanes are interleaved a stereo word per frame, so mono is expanded on take
+    multi_dac_state.slot_bits = 16;
+    for (uint8_t i = 0; i < lanes; i++) {
+        multi_dac_state.channel_counts[i] = 2;
+        multi_dac_state.sample_bits[i] = 16;
+    }
+
+    // Two buffers so one can be filled while the other is being played
+    for (uint b = 0; b < 2; b++) {
+        multi_dac_state.lane_buffers[b] = calloc(PICO_AUDIO_I2S_MULTI_LANE_BUFFER_SAMPLE_LENGTH * lanes, sizeof(uint32_t));
+        if (!multi_dac_state.lane_buffers[b]) {
+            panic("Failed to allocate multi-lane DMA buffers");
+        }
+    }
+
+    __mem_fence_release();
+
+    // each channel plays one lane buffer and starts the other as it completes
+    for (uint b = 0; b < 2; b++) {
+        uint8_t dma_channel = config->dma_channels[b];
+        dma_channel_claim(dma_channel);
+        multi_dac_state.dma_channels[b] = dma_channel;
+
+        dma_channel_config dma_config = dma_channel_get_default_config(dma_channel);
+        channel_config_set_dreq(&dma_config, pio_get_dreq(pio, sm, true));
+        // Lane-interleaved words are always 32 bits, regardless of mono/stereo output
+        channel_config_set_transfer_data_size(&dma_config, DMA_SIZE_32);
+        channel_config_set_chain_to(&dma_config, config->dma_channels[b ^ 1u]);
+        dma_channel_configure(dma_channel,
+                              &dma_config,
+                              &pio->txf[sm],  // dest
+                              NULL, // src
+                              0, // count
+                              false // trigger
+        );
+        dma_irqn_set_channel_enabled(PICO_AUDIO_I2S_DMA_IRQ, dma_channel, 1);
+    }
+
+    irq_add_shared_handler(DMA_IRQ_0 + PICO_AUDIO_I2S_DMA_IRQ, audio_i2s_dma_irq_handler_multi_lane,
+                           PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+
+    if (config->capture) {
+        multi_dac_setup_capture(config);
+    }
+
+    for (uint8_t i = 0; i < PICO_AUDIO_I2S_MAX_DACS; i++) {
+        audio_i2s_stats_reset(&multi_dac_state.stats[i]);
+        audio_i2s_output_process_init(&multi_dac_state.processes[i]);
+    }
+    multi_dac_state.initialized = true;
+    return intended_audio_format;
+}
 
 const audio_format_t *audio_i2s_setup_multi_dac(const audio_format_t *intended_audio_format,
                                                  const audio_i2s_multi_dac_config_t *config) {
     if (config->num_dacs == 0 || config->num_dacs > PICO_AUDIO_I2S_MAX_DACS) {
         return NULL;
     }
+    // captured words are whole 16-bit frames
+    if (config->capture && config->s32_output_mask) {
+        return NULL;
+    }
 
-    printf("Setting up multi-DAC I2S with %d DACs\n", config->num_dacs);
+#if PICO_AUDIO_I2S_DMA_HIGH_PRIORITY
+    audio_i2s_set_dma_high_bus_priority(true);
+#endif
 
-    uint func = GPIO_FUNC_PIOx;
+    PIO clock_pio = config->clock_pio ? config->clock_pio : audio_pio;
+    multi_dac_state.clock_pio = clock_pio;
+    multi_dac_state.idle_park_ms = PICO_AUDIO_I2S_IDLE_PARK_MS;
+    audio_i2s_add_clock_user(&multi_dac_clock_user);
+    if (config->single_sm) {
+        return audio_i2s_setup_multi_lane(intended_audio_format, config);
+    }
+
+    printf("Setting up multi-DAC I2S with %d DACs\n", config->num_dacs);
 
     // Set up clock pins
-    gpio_set_function(config->clock_pin_base, func);
-    gpio_set_function(config->clock_pin_base + 1, func);
+    gpio_set_function(config->clock_pin_base, pio_get_funcsel(clock_pio));
+    gpio_set_function(config->clock_pin_base + 1, pio_get_funcsel(clock_pio));
 
-    // Set up data pins for each DAC
+    // Set up data pins for each DAC, on the block of its state machine
     for (uint8_t i = 0; i < config->num_dacs; i++) {
-        gpio_set_function(config->data_pins[i], func);
+        PIO data_pio = config->data_pios[i] ? config->data_pios[i] : clock_pio;
+        multi_dac_state.data_pios[i] = data_pio;
+        multi_dac_state.multi_pio |= data_pio != clock_pio;
+        gpio_set_function(config->data_pins[i], pio_get_funcsel(data_pio));
     }
 
     // Claim and initialize clock state machine
     uint8_t clock_sm = config->clock_pio_sm;
-    pio_sm_claim(audio_pio, clock_sm);
-
-    // Add and initialize clock generator program
-    uint clock_offset = pio_add_program(audio_pio, &audio_i2s_clock_gen_program);
-    audio_i2s_clock_gen_program_init(audio_pio, clock_sm, clock_offset, config->clock_pin_base);
+    pio_sm_claim(clock_pio, clock_sm);
 
-    // Add data-only program (only need to add once)
-    uint data_offset = pio_add_program(audio_pio, &audio_i2s_data_only_program);
+    // Add and initialize clock generator program; one DAC taking 32-bit samples widens every slot
+    multi_dac_state.slot_bits = config->s32_output_mask ? 32 : 16;
+    uint clock_offset = pio_add_program(clock_pio, &audio_i2s_clock_gen_program);
+    audio_i2s_clock_gen_program_init(clock_pio, clock_sm, clock_offset, config->clock_pin_base,
+                                     multi_dac_state.slot_bits);
+    multi_dac_state.clock_entry_pc = (uint8_t) (clock_offset + audio_i2s_clock_gen_offset_clock_entry_point);
+    multi_dac_state.sm_masks[pio_get_index(clock_pio)] = 1u << clock_sm;
 
-    // Claim and initialize data state machines for each DAC
+    // Claim and initialize data state machines for each DAC, adding each data program
+    // once to each block that uses it: data-only with 16-bit slots; with 32-bit slots,
+    // data-slot for the DACs taking 32-bit samples and data-pad for the others
+    enum {
+        DATA_PROGRAM_16, DATA_PROGRAM_SLOT, DATA_PROGRAM_PAD, DATA_PROGRAM_COUNT
+    };
+    static const pio_program_t *const data_programs[DATA_PROGRAM_COUNT] = {
+            &audio_i2s_data_only_program, &audio_i2s_data_slot_program, &audio_i2s_data_pad_program,
+    };
+    static const uint8_t data_entry_points[DATA_PROGRAM_COUNT] = {
+            audio_i2s_data_only_offset_data_entry_point, audio_i2s_data_slot_offset_slot_data_entry_point,
+            audio_i2s_data_pad_offset_pad_entry_point,
+    };
+    int data_offsets[NUM_PIOS][DATA_PROGRAM_COUNT];
+    for (uint block = 0; block < NUM_PIOS; block++) {
+        for (uint program = 0; program < DATA_PROGRAM_COUNT; program++) {
+            data_offsets[block][program] = -1;
+        }
+    }
     for (uint8_t i = 0; i < config->num_dacs; i++) {
+        PIO data_pio = multi_dac_state.data_pios[i];
+        uint block = pio_get_index(data_pio);
+        bool s32 = config->s32_output_mask & (1u << i);
+        uint program = multi_dac_state.slot_bits == 16 ? DATA_PROGRAM_16 : s32 ? DATA_PROGRAM_SLOT : DATA_PROGRAM_PAD;
+        if (data_offsets[block][program] < 0) {
+            data_offsets[block][program] = (int) pio_add_program(data_pio, data_programs[program]);
+        }
+        uint offset = (uint) data_offsets[block][program];
+        multi_dac_state.data_entry_pcs[i] = (uint8_t) (offset + data_entry_points[program]);
         uint8_t data_sm = config->data_pio_sms[i];
-        pio_sm_claim(audio_pio, data_sm);
-        audio_i2s_data_only_program_init(audio_pio, data_sm, data_offset, config->data_pins[i]);
+        pio_sm_claim(data_pio, data_sm);
+        if (program == DATA_PROGRAM_SLOT) {
+            audio_i2s_data_slot_program_init(data_pio, data_sm, offset, config->data_pins[i]);
+        } else if (program == DATA_PROGRAM_PAD) {
+            audio_i2s_data_pad_program_init(data_pio, data_sm, offset, config->data_pins[i]);
+        } else {
+            audio_i2s_data_only_program_init(data_pio, data_sm, offset, config->data_pins[i]);
+        }
 
         multi_dac_state.data_pio_sms[i] = data_sm;
+        multi_dac_state.sm_masks[block] |= 1u << data_sm;
+        // 32-bit samples are always stereo on the wire, one word per channel
+        bool mono = !s32 && (PICO_AUDIO_I2S_MONO_OUTPUT || (config->mono_output_mask & (1u << i)));
+        multi_dac_state.channel_counts[i] = mono ? 1 : 2;
+        multi_dac_state.sample_bits[i] = s32 ? 32 : 16;
     }
 
     multi_dac_state.clock_pio_sm = clock_sm;
@@ -122,163 +356,1214 @@ const audio_format_t *audio_i2s_setup_multi_dac(const audio_format_t *intended_a
         uint8_t dma_channel = config->dma_channels[i];
         dma_channel_claim(dma_channel);
         multi_dac_state.dma_channels[i] = dma_channel;
+        multi_dac_state.dma_channel_dac[dma_channel] = i;
+        multi_dac_state.dma_channel_mask |= 1u << dma_channel;
 
         dma_channel_config dma_config = dma_channel_get_default_config(dma_channel);
-        channel_config_set_dreq(&dma_config, DREQ_PIOx_TX0 + multi_dac_state.data_pio_sms[i]);
-        channel_config_set_transfer_data_size(&dma_config, i2s_dma_configure_size);
+        PIO data_pio = multi_dac_state.data_pios[i];
+        channel_config_set_dreq(&dma_config, pio_get_dreq(data_pio, multi_dac_state.data_pio_sms[i], true));
+        channel_config_set_transfer_data_size(&dma_config, multi_dac_state.sample_bits[i] == 32 ? DMA_SIZE_32 :
+                                                           audio_i2s_s16_dma_size(multi_dac_state.channel_counts[i]));
 
         dma_channel_configure(dma_channel,
                               &dma_config,
-                              &audio_pio->txf[multi_dac_state.data_pio_sms[i]],  // dest
+                              &data_pio->txf[multi_dac_state.data_pio_sms[i]],  // dest
                               NULL, // src
                               0, // count
                               false // trigger
         );
 
-        irq_add_shared_handler(DMA_IRQ_0 + PICO_AUDIO_I2S_DMA_IRQ, audio_i2s_dma_irq_handler_multi_dac,
-                               PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
-        dma_irqn_set_channel_enabled(PICO_AUDIO_I2S_DMA_IRQ, dma_channel, 1);
     }
 
+    // One handler entry for all DACs; it dispatches on the channel status bits
+    irq_add_shared_handler(DMA_IRQ_0 + PICO_AUDIO_I2S_DMA_IRQ, audio_i2s_dma_irq_handler_multi_dac,
+                           PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+    dma_irqn_set_channel_mask_enabled(PICO_AUDIO_I2S_DMA_IRQ, multi_dac_state.dma_channel_mask, true);
+
+    if (config->capture) {
+        multi_dac_setup_capture(config);
+    }
+
+    for (uint8_t i = 0; i < PICO_AUDIO_I2S_MAX_DACS; i++) {
+        audio_i2s_stats_reset(&multi_dac_state.stats[i]);
+        audio_i2s_output_process_init(&multi_dac_state.processes[i]);
+    }
     multi_dac_state.initialized = true;
     return intended_audio_format;
 }
 
+#if PICO_PIO_VERSION == 0
+/** \brief Send every state machine back to the start of a frame (they must be stopped)
+ *
+ * Words in the TX FIFOs are whole frames, so only the frame being shifted is lost.
+ */
+static void multi_dac_rewind_sms(void) {
+    pio_sm_restart(multi_dac_state.clock_pio, multi_dac_state.clock_pio_sm);
+    pio_sm_exec(multi_dac_state.clock_pio, multi_dac_state.clock_pio_sm, pio_encode_jmp(multi_dac_state.clock_entry_pc));
+    for (uint8_t i = 0; i < multi_dac_state.num_dacs; i++) {
+        PIO pio = multi_dac_state.data_pios[i];
+        uint sm = multi_dac_state.data_pio_sms[i];
+        pio_sm_restart(pio, sm);
+        pio_sm_exec(pio, sm, pio_encode_jmp(multi_dac_state.data_entry_pcs[i]));
+    }
+    if (multi_dac_state.capture) {
+        pio_sm_restart(multi_dac_state.clock_pio, multi_dac_state.capture_pio_sm);
+        pio_sm_exec(multi_dac_state.clock_pio, multi_dac_state.capture_pio_sm,
+                    pio_encode_jmp(multi_dac_state.capture_entry_pc));
+    }
+}
+#endif
+
+/** \brief Stop the clock generator and all data state machines together */
+static void multi_dac_stop_sms(void) {
+#if PICO_PIO_VERSION > 0
+    // one CTRL write reaches the clock's block and both its neighbours
+    uint block = pio_get_index(multi_dac_state.clock_pio);
+    pio_set_sm_multi_mask_enabled(multi_dac_state.clock_pio, multi_dac_state.sm_masks[(block + NUM_PIOS - 1) % NUM_PIOS],
+                                  multi_dac_state.sm_masks[block], multi_dac_state.sm_masks[(block + 1) % NUM_PIOS],
+                                  false);
+#else
+    for (uint block = 0; block < NUM_PIOS; block++) {
+        if (multi_dac_state.sm_masks[block]) {
+            pio_set_sm_mask_enabled(pio_get_instance(block), multi_dac_state.sm_masks[block], false);
+        }
+    }
+    if (multi_dac_state.multi_pio) {
+        // the blocks were stopped by separate writes, so one may have run an instruction further
+        multi_dac_rewind_sms();
+    }
+#endif
+}
+
+/** \brief Start the clock generator and all data state machines together, with their clock dividers restarted */
+static void multi_dac_start_sms(void) {
+    uint block = pio_get_index(multi_dac_state.clock_pio);
+#if PICO_PIO_VERSION > 0
+    pio_enable_sm_multi_mask_in_sync(multi_dac_state.clock_pio, multi_dac_state.sm_masks[(block + NUM_PIOS - 1) % NUM_PIOS],
+                                     multi_dac_state.sm_masks[block], multi_dac_state.sm_masks[(block + 1) % NUM_PIOS]);
+#else
+    // No cross-block start: write the clock's block first and the others straight after,
+    // so their data trails the clocks by a fixed couple of clk_sys cycles
+    uint32_t save = save_and_disable_interrupts();
+    pio_enable_sm_mask_in_sync(multi_dac_state.clock_pio, multi_dac_state.sm_masks[block]);
+    for (uint other = 0; other < NUM_PIOS; other++) {
+        if (other != block && multi_dac_state.sm_masks[other]) {
+            pio_enable_sm_mask_in_sync(pio_get_instance(other), multi_dac_state.sm_masks[other]);
+        }
+    }
+    restore_interrupts(save);
+#endif
+}
+
+/** \brief Clear the TXSTALL flags of every state machine in use */
+static void multi_dac_clear_tx_stalls(void) {
+    for (uint block = 0; block < NUM_PIOS; block++) {
+        if (multi_dac_state.sm_masks[block]) {
+            audio_i2s_clear_tx_stalls_pio(pio_get_instance(block), multi_dac_state.sm_masks[block]);
+        }
+    }
+}
+
+/** \brief Retune all state machines without letting them drift apart
+ *
+ * The data state machines count bit clocks open-loop, in lockstep with the clock
+ * generator. Writing the dividers one at a time while running would leave them a
+ * few PIO cycles apart, so running state machines are stopped together (a single
+ * CTRL write), retuned, and restarted together with their clock dividers reset.
+ */
 static void update_pio_frequency_multi_dac(uint32_t sample_freq) {
-    uint32_t system_clock_frequency = clock_get_hz(clk_sys);
-    assert(system_clock_frequency < 0x40000000);
-    uint32_t divider = system_clock_frequency * 4 / sample_freq;
-    assert(divider < 0x1000000);
+    audio_i2s_calc_clock_divider_frame_bits(sample_freq, 2u * multi_dac_state.slot_bits, &multi_dac_state.clock_divider);
+    uint32_t divider = multi_dac_state.clock_divider.divider;
+    bool running = multi_dac_audio_enabled && !multi_dac_state.parked;
+
+    if (running) {
+        multi_dac_stop_sms();
+    }
+    for (uint block = 0; block < NUM_PIOS; block++) {
+        for (uint sm = 0; sm < NUM_PIO_STATE_MACHINES; sm++) {
+            if (multi_dac_state.sm_masks[block] & (1u << sm)) {
+                pio_sm_set_clkdiv_int_frac(pio_get_instance(block), sm, divider >> 8u, divider & 0xffu);
+            }
+        }
+    }
+    if (running) {
+        multi_dac_start_sms();
+    }
+
+    multi_dac_state.freq = sample_freq;
+    multi_dac_state.park_frames = (uint32_t) ((uint64_t) multi_dac_state.idle_park_ms * sample_freq / 1000u);
+}
+
+static uint32_t multi_dac_clock_user_freq(uint *frame_bits) {
+    *frame_bits = 2u * multi_dac_state.slot_bits;
+    return multi_dac_state.freq;
+}
+
+static void multi_dac_clock_user_retune(void) {
+    update_pio_frequency_multi_dac(multi_dac_state.freq);
+}
+
+static const audio_i2s_clock_user_t multi_dac_clock_user = {
+        .sample_freq = multi_dac_clock_user_freq,
+        .retune = multi_dac_clock_user_retune,
+};
+
+const audio_i2s_clock_divider_t *audio_i2s_get_clock_divider_multi_dac(void) {
+    return &multi_dac_state.clock_divider;
+}
+
+const audio_i2s_stats_t *audio_i2s_get_stats_multi_dac(uint8_t dac_index) {
+    if (dac_index >= multi_dac_state.num_dacs) {
+        return NULL;
+    }
+    return &multi_dac_state.stats[dac_index];
+}
+
+void audio_i2s_reset_stats_multi_dac(uint8_t dac_index) {
+    if (dac_index < multi_dac_state.num_dacs) {
+        audio_i2s_stats_reset(&multi_dac_state.stats[dac_index]);
+    }
+}
+
+void audio_i2s_set_gain_multi_dac(uint8_t dac_index, int16_t gain) {
+    if (dac_index < multi_dac_state.num_dacs) {
+        audio_i2s_output_process_set_gain(&multi_dac_state.processes[dac_index], gain);
+    }
+}
+
+void audio_i2s_set_dc_blocker_multi_dac(uint8_t dac_index, uint dc_shift) {
+    if (dac_index < multi_dac_state.num_dacs) {
+        audio_i2s_output_process_set_dc_blocker(&multi_dac_state.processes[dac_index], dc_shift);
+    }
+}
+
+static void multi_dac_pass_thru_consumer_give(audio_connection_t *connection, audio_buffer_t *buffer) {
+    queue_free_audio_buffer(connection->producer_pool, buffer);
+}
+
+/** \brief Default connections, one set per DAC
+ *
+ * audio_complete_connection() binds a connection to one producer and one consumer
+ * pool, so DACs cannot share connection objects.
+ */
+static struct {
+    audio_i2s_converting_connection_t take;                ///< Copy (and convert) on consumer take
+    struct producer_pool_blocking_give_connection give;    ///< Copy on producer give
+    struct producer_pool_blocking_give_connection thru;    ///< Zero-copy (buffer_count == 0)
+} multi_dac_connections[PICO_AUDIO_I2S_MAX_DACS];
+
+/** \brief Shortest rate change mute, in frames: more than a TX FIFO (4 frames) and OSR hold */
+#define MULTI_DAC_RATE_GUARD_FRAMES 8u
 
-    // Update clock generator
-    pio_sm_set_clkdiv_int_frac(audio_pio, multi_dac_state.clock_pio_sm, divider >> 8u, divider & 0xffu);
+/** \brief The rate the DACs are heading for, once what is already queued has happened */
+static uint32_t multi_dac_target_freq(void) {
+    uint32_t target = multi_dac_state.rate_muted_mask ? multi_dac_state.rate_switch_freq : multi_dac_state.freq;
+    for (uint8_t i = 0; i < multi_dac_state.num_dacs; i++) {
+        if (multi_dac_state.rate_changes[i].sample_freq) {
+            target = multi_dac_state.rate_changes[i].sample_freq;
+        }
+    }
+    return target;
+}
 
-    // Update all data state machines
+/** \brief Queue a rate change on every connected DAC, as they share the clock
+ *
+ * With no DAC connected there is nothing to fence, and the state machines are
+ * retuned straight away.
+ */
+static void multi_dac_queue_rate_change(uint32_t sample_freq, uint32_t mute_frames) {
+    if (sample_freq == multi_dac_target_freq()) {
+        // each DAC's producer reports the same change; the first one queued it
+        return;
+    }
+    bool connected = false;
     for (uint8_t i = 0; i < multi_dac_state.num_dacs; i++) {
-        pio_sm_set_clkdiv_int_frac(audio_pio, multi_dac_state.data_pio_sms[i], divider >> 8u, divider & 0xffu);
+        connected |= multi_dac_state.consumers[i] != NULL;
+        // a DAC already fenced for this rate keeps its fence
+        if (multi_dac_state.consumers[i] && multi_dac_state.rate_changes[i].sample_freq != sample_freq) {
+            audio_i2s_rate_change_queue(&multi_dac_state.rate_changes[i], sample_freq,
+                                        MAX(mute_frames, MULTI_DAC_RATE_GUARD_FRAMES));
+        }
     }
+    if (!connected && !multi_dac_state.rate_muted_mask) {
+        update_pio_frequency_multi_dac(sample_freq);
+    }
+}
 
-    multi_dac_state.freq = sample_freq;
+void audio_i2s_set_sample_freq_multi_dac(uint32_t sample_freq, uint32_t mute_frames) {
+    if (multi_dac_state.initialized) {
+        multi_dac_queue_rate_change(sample_freq, mute_frames);
+    }
+}
+
+/** \brief Retune to the rate the muted DACs were waiting for, and let them play again */
+static void multi_dac_finish_rate_change(void) {
+    update_pio_frequency_multi_dac(multi_dac_state.rate_switch_freq);
+    multi_dac_state.rate_muted_mask = 0;
+    multi_dac_state.rate_parked_mask = 0;
+    multi_dac_state.lane_switch_countdown = 0;
+}
+
+/** \brief Whether a connected DAC still has a rate change queued, with buffers before its fence left to play */
+static bool __audio_i2s_isr_func(multi_dac_rate_change_waiting)(void) {
+    for (uint8_t i = 0; i < multi_dac_state.num_dacs; i++) {
+        if (multi_dac_state.consumers[i] && multi_dac_state.rate_changes[i].sample_freq) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/** \brief Whether a DAC has played everything before its rate change fence
+ *
+ * For a connection with a copy loop, every producer buffer before the fence has
+ * been copied out; for the others, every consumer buffer before it has been taken.
+ */
+static bool __audio_i2s_isr_func(multi_dac_rate_change_reached)(uint8_t dac_index) {
+    audio_connection_t *connection = multi_dac_state.consumers[dac_index]->connection;
+    return connection == &multi_dac_connections[dac_index].take.core.core ?
+           audio_i2s_rate_change_reached(&multi_dac_connections[dac_index].take) :
+           audio_i2s_rate_change_fence_taken(&multi_dac_state.rate_changes[dac_index]);
+}
+
+/** \brief Step a queued rate change at a refill of one DAC
+ *
+ * Each DAC plays a mute once it has played every buffer before its fence, and
+ * is parked once that mute has left its DMA. The state machines are stopped,
+ * retuned and restarted together (see update_pio_frequency_multi_dac()) when the
+ * last DAC with the change queued parks, so every FIFO holds nothing but silence
+ * across the switch; DACs parked earlier play further runs of mute while they wait.
+ *
+ * \return Frames of mute to play instead of taking a buffer, or 0
+ */
+static uint32_t __audio_i2s_isr_func(multi_dac_rate_change_refill)(uint8_t dac_index) {
+    audio_i2s_rate_change_t *rc = &multi_dac_state.rate_changes[dac_index];
+    uint32_t bit = 1u << dac_index;
+    if (multi_dac_state.rate_muted_mask & bit) {
+        multi_dac_state.rate_parked_mask |= bit;
+        // wait for DACs still muting, or still playing buffers from before their fence
+        if (multi_dac_state.rate_parked_mask != multi_dac_state.rate_muted_mask || multi_dac_rate_change_waiting()) {
+            return rc->mute_frames;
+        }
+        multi_dac_finish_rate_change();
+        return 0;
+    }
+    uint32_t sample_freq = rc->sample_freq;
+    if (!sample_freq) {
+        return 0;
+    }
+    if (!multi_dac_rate_change_reached(dac_index)) {
+        return 0;
+    }
+    rc->sample_freq = 0;
+    multi_dac_state.rate_switch_freq = sample_freq;
+    multi_dac_state.rate_muted_mask |= bit;
+    return rc->mute_frames;
+}
+
+/** \brief producer_pool_give for the converting connections, which retunes every DAC at a new producer rate */
+static void multi_dac_converting_producer_give(audio_connection_t *connection, audio_buffer_t *buffer) {
+    audio_i2s_rate_change_t *rc = ((audio_i2s_converting_connection_t *) connection)->rate_change;
+    uint32_t sample_freq = buffer->format->format->sample_freq;
+    if (sample_freq != rc->producer_freq) {
+        rc->producer_freq = sample_freq;
+        multi_dac_queue_rate_change(sample_freq, PICO_AUDIO_I2S_RATE_CHANGE_MUTE_FRAMES);
+    }
+    audio_i2s_converting_producer_give(connection, buffer);
+    multi_dac_wake();
+}
+
+static void multi_dac_wrap_producer_give(audio_connection_t *connection, audio_buffer_t *buffer) {
+    uint8_t dac_index = 0;
+    while (connection != &multi_dac_connections[dac_index].give.core) {
+        dac_index++;
+    }
+    struct producer_pool_blocking_give_connection *pbc = &multi_dac_connections[dac_index].give;
+    audio_i2s_rate_change_t *rc = &multi_dac_state.rate_changes[dac_index];
+    // consumer buffers are filled here; the copy moves the fence past the one being filled
+    uint32_t sample_freq = connection->producer_pool->format->sample_freq;
+    if (sample_freq != rc->producer_freq) {
+        rc->producer_freq = sample_freq;
+        multi_dac_queue_rate_change(sample_freq, PICO_AUDIO_I2S_RATE_CHANGE_MUTE_FRAMES);
+    }
+    // only stereo to stereo is copied on give (checked on connect)
+    audio_i2s_rate_change_copy_give(pbc, rc, stereo_to_stereo_producer_give, buffer);
+    multi_dac_wake();
+}
+
+static void multi_dac_pass_thru_producer_give(audio_connection_t *connection, audio_buffer_t *buffer) {
+    // the DMA reads the producer's buffer directly
+    assert(!((uintptr_t) buffer->buffer->bytes & 3u));
+    uint8_t dac_index = 0;
+    while (connection != &multi_dac_connections[dac_index].thru.core) {
+        dac_index++;
+    }
+    assert(buffer->format->sample_stride == pio_i2s_consumer_buffer_formats[dac_index].sample_stride);
+    audio_i2s_rate_change_t *rc = &multi_dac_state.rate_changes[dac_index];
+    uint32_t sample_freq = buffer->format->format->sample_freq;
+    if (sample_freq != rc->producer_freq) {
+        rc->producer_freq = sample_freq;
+        multi_dac_queue_rate_change(sample_freq, PICO_AUDIO_I2S_RATE_CHANGE_MUTE_FRAMES);
+    }
+    rc->given++;
+    queue_full_audio_buffer(connection->consumer_pool, buffer);
+    multi_dac_wake();
+}
+
+static audio_connection_t *multi_dac_default_connection(audio_buffer_pool_t *producer, uint8_t dac_index,
+                                                        bool buffer_on_give, uint buffer_count) {
+    const audio_format_t *format = producer->format;
+    uint output_channel_count = multi_dac_state.channel_counts[dac_index];
+    bool wide = multi_dac_state.sample_bits[dac_index] == 32;
+    if (!buffer_count) {
+        if (format->format != (wide ? AUDIO_BUFFER_FORMAT_PCM_S32 : AUDIO_BUFFER_FORMAT_PCM_S16) ||
+            format->channel_count != output_channel_count) {
+            panic("zero-copy I2S connection needs producer buffers in the DMA format");
+        }
+        printf("Zero-copy %d channel(s) at %d Hz for DAC %d\n", (int) format->channel_count,
+               (int) format->sample_freq, dac_index);
+        multi_dac_connections[dac_index].thru.core = (audio_connection_t) {
+                .consumer_pool_take = consumer_pool_take_buffer_default,
+                .consumer_pool_give = multi_dac_pass_thru_consumer_give,
+                .producer_pool_take = producer_pool_take_buffer_default,
+                .producer_pool_give = multi_dac_pass_thru_producer_give,
+        };
+        return &multi_dac_connections[dac_index].thru.core;
+    }
+    if (buffer_on_give) {
+        // conversion to 32-bit samples is only done on take
+        assert(!wide);
+        assert(format->format == AUDIO_BUFFER_FORMAT_PCM_S16 && format->channel_count == 2);
+        assert(output_channel_count == 2);
+        multi_dac_connections[dac_index].give.core = (audio_connection_t) {
+                .consumer_pool_take = consumer_pool_take_buffer_default,
+                .consumer_pool_give = consumer_pool_give_buffer_default,
+                .producer_pool_take = producer_pool_take_buffer_default,
+                .producer_pool_give = multi_dac_wrap_producer_give,
+        };
+        return &multi_dac_connections[dac_index].give.core;
+    }
+    audio_i2s_converting_connection_t *take = &multi_dac_connections[dac_index].take;
+    *take = (audio_i2s_converting_connection_t) {
+            .core = {
+                    .core = {
+                            .consumer_pool_take = audio_i2s_converting_consumer_take,
+                            .consumer_pool_give = consumer_pool_give_buffer_default,
+                            .producer_pool_take = producer_pool_take_buffer_default,
+                            .producer_pool_give = multi_dac_converting_producer_give,
+                    }
+            },
+            .convert = wide ? audio_i2s_s32_stereo_converter(format) :
+                       audio_i2s_s16_converter(format, output_channel_count),
+            .process = &multi_dac_state.processes[dac_index],
+            .process_convert = wide ? audio_i2s_s32_stereo_processor(format) :
+                               audio_i2s_s16_processor(format, output_channel_count),
+            .rate_change = &multi_dac_state.rate_changes[dac_index],
+    };
+    if (!take->convert) {
+        panic("unsupported producer format for DAC %d", dac_index);
+    }
+    return &take->core.core;
 }
 
 bool audio_i2s_connect_multi_dac(audio_buffer_pool_t *producer, uint8_t dac_index) {
+    return audio_i2s_connect_multi_dac_extra(producer, dac_index, false, 2, 256, NULL);
+}
+
+/** \brief Connect a producer to a DAC, building its consumer pool in arena or, if arena is NULL, on the heap */
+static bool multi_dac_connect_pool(audio_buffer_pool_t *producer, uint8_t dac_index, bool buffer_on_give,
+                                   uint buffer_count, uint samples_per_buffer, audio_connection_t *connection,
+                                   uint32_t *arena, size_t arena_words) {
     if (!multi_dac_state.initialized || dac_index >= multi_dac_state.num_dacs) {
         return false;
     }
 
     printf("Connecting audio to DAC %d\n", dac_index);
 
-    assert(producer->format->format == AUDIO_BUFFER_FORMAT_PCM_S16);
-    pio_i2s_consumer_formats[dac_index].format = AUDIO_BUFFER_FORMAT_PCM_S16;
-    pio_i2s_consumer_formats[dac_index].sample_freq = producer->format->sample_freq;
+    if (multi_dac_state.consumers[dac_index]) {
+        audio_i2s_disconnect_multi_dac(dac_index);
+    }
 
-#if PICO_AUDIO_I2S_MONO_OUTPUT
-    pio_i2s_consumer_formats[dac_index].channel_count = 1;
-    pio_i2s_consumer_buffer_formats[dac_index].sample_stride = 2;
-#else
-    pio_i2s_consumer_formats[dac_index].channel_count = 2;
-    pio_i2s_consumer_buffer_formats[dac_index].sample_stride = 4;
-#endif
+    if (multi_dac_state.sample_bits[dac_index] == 32) {
+        // S16, S24 and S32 are widened to S32 on take
+        pio_i2s_consumer_formats[dac_index].format = AUDIO_BUFFER_FORMAT_PCM_S32;
+    } else {
+        // S8 is expanded to S16 on take
+        assert(producer->format->format == AUDIO_BUFFER_FORMAT_PCM_S16 ||
+               producer->format->format == AUDIO_BUFFER_FORMAT_PCM_S8);
+        pio_i2s_consumer_formats[dac_index].format = AUDIO_BUFFER_FORMAT_PCM_S16;
+    }
+    pio_i2s_consumer_formats[dac_index].sample_freq = producer->format->sample_freq;
+    pio_i2s_consumer_formats[dac_index].channel_count = multi_dac_state.channel_counts[dac_index];
+    pio_i2s_consumer_buffer_formats[dac_index].sample_stride = multi_dac_state.sample_bits[dac_index] / 8u *
+                                                               multi_dac_state.channel_counts[dac_index];
 
     pio_i2s_consumer_buffer_formats[dac_index].format = &pio_i2s_consumer_formats[dac_index];
 
-    multi_dac_state.consumers[dac_index] = audio_new_consumer_pool(&pio_i2s_consumer_buffer_formats[dac_index],
-                                                                     2, 256);
+    audio_buffer_pool_t *consumer;
+    if (arena) {
+        consumer = audio_i2s_new_consumer_pool_in_arena(&pio_i2s_consumer_buffer_formats[dac_index], buffer_count,
+                                                        samples_per_buffer, arena, arena_words);
+    } else {
+        consumer = audio_new_consumer_pool(&pio_i2s_consumer_buffer_formats[dac_index], buffer_count,
+                                           samples_per_buffer);
+    }
 
-    // Update frequency only once (all DACs share the same clock)
-    if (dac_index == 0 || multi_dac_state.freq != producer->format->sample_freq) {
-        update_pio_frequency_multi_dac(producer->format->sample_freq);
+    // all DACs share the clock: a stopped output is retuned now, and a running one switches
+    // through a fenced change, which this DAC joins with nothing to play before its fence
+    uint32_t sample_freq = producer->format->sample_freq;
+    uint32_t target = multi_dac_target_freq();
+    bool switch_rate = multi_dac_audio_enabled && (target != sample_freq || multi_dac_state.freq != sample_freq);
+    if (!multi_dac_audio_enabled && multi_dac_state.freq != sample_freq) {
+        update_pio_frequency_multi_dac(sample_freq);
     }
+    audio_i2s_rate_change_reset(&multi_dac_state.rate_changes[dac_index],
+                                switch_rate ? multi_dac_state.freq : sample_freq);
 
     __mem_fence_release();
 
-    audio_connection_t *connection;
-    if (producer->format->channel_count == 2) {
-#if PICO_AUDIO_I2S_MONO_OUTPUT
-        panic("trying to play stereo thru mono not yet supported");
-#else
-        printf("Copying stereo to stereo at %d Hz for DAC %d\n",
-               (int) producer->format->sample_freq, dac_index);
-#endif
-        // Note: This would need access to the connection structures from single DAC implementation
-        // For now, using a simplified approach
-        connection = NULL; // Would need proper connection structure
-    } else {
-#if PICO_AUDIO_I2S_MONO_OUTPUT
-        printf("Copying mono to mono at %d Hz for DAC %d\n",
-               (int) producer->format->sample_freq, dac_index);
-#else
-        printf("Converting mono to stereo at %d Hz for DAC %d\n",
-               (int) producer->format->sample_freq, dac_index);
-#endif
-        connection = NULL; // Would need proper connection structure
+    if (!connection) {
+        printf("Converting %d to %d channel(s) at %d Hz for DAC %d\n", (int) producer->format->channel_count,
+               (int) multi_dac_state.channel_counts[dac_index], (int) producer->format->sample_freq, dac_index);
+        connection = multi_dac_default_connection(producer, dac_index, buffer_on_give, buffer_count);
     }
+    // the connections without a copy loop fence a rate change by consumer buffer
+    audio_i2s_rate_change_t *rc = &multi_dac_state.rate_changes[dac_index];
+    rc->consumer_fence = connection == &multi_dac_connections[dac_index].give.core ||
+                         connection == &multi_dac_connections[dac_index].thru.core;
+    // and the default connections count their buffers in the rate change, which gives the fill level
+    rc->counted = rc->consumer_fence || connection == &multi_dac_connections[dac_index].take.core.core;
 
-    if (connection) {
-        audio_complete_connection(connection, producer, multi_dac_state.consumers[dac_index]);
+    audio_complete_connection(connection, producer, consumer);
+    // publish the pool only once it is connected, as the DMA IRQ may already be running other DACs
+    __mem_fence_release();
+    multi_dac_state.consumers[dac_index] = consumer;
+    if (switch_rate && target == sample_freq) {
+        // the change to this rate is already under way, so only this DAC has to wait for it
+        audio_i2s_rate_change_queue(rc, sample_freq, MAX(PICO_AUDIO_I2S_RATE_CHANGE_MUTE_FRAMES,
+                                                         MULTI_DAC_RATE_GUARD_FRAMES));
+    } else if (switch_rate) {
+        multi_dac_queue_rate_change(sample_freq, PICO_AUDIO_I2S_RATE_CHANGE_MUTE_FRAMES);
     }
     return true;
 }
 
+bool audio_i2s_connect_multi_dac_extra(audio_buffer_pool_t *producer, uint8_t dac_index, bool buffer_on_give,
+                                       uint buffer_count, uint samples_per_buffer, audio_connection_t *connection) {
+    return multi_dac_connect_pool(producer, dac_index, buffer_on_give, buffer_count, samples_per_buffer, connection,
+                                  NULL, 0);
+}
+
+bool audio_i2s_connect_multi_dac_arena(audio_buffer_pool_t *producer, uint8_t dac_index, bool buffer_on_give,
+                                       uint buffer_count, uint samples_per_buffer, audio_connection_t *connection,
+                                       uint32_t *arena, size_t arena_words) {
+    assert(arena);
+    return multi_dac_connect_pool(producer, dac_index, buffer_on_give, buffer_count, samples_per_buffer, connection,
+                                  arena, arena_words);
+}
+
+void audio_i2s_disconnect_multi_dac(uint8_t dac_index) {
+    if (dac_index >= multi_dac_state.num_dacs || !multi_dac_state.consumers[dac_index]) {
+        return;
+    }
+    printf("Disconnecting audio from DAC %d\n", dac_index);
+    // returns the buffers the DMA was playing to their consumer pools; the DACs share
+    // the clock, so they all stop
+    audio_i2s_set_enabled_multi_dac(false);
+
+    audio_buffer_pool_t *consumer = multi_dac_state.consumers[dac_index];
+    audio_connection_t *connection = consumer->connection;
+    if (connection == &multi_dac_connections[dac_index].take.core.core) {
+        audio_i2s_release_copying_connection(&multi_dac_connections[dac_index].take.core);
+    }
+    // the give connection's partly filled buffer belongs to the consumer pool, and the
+    // default connections are rebuilt on every connect
+    audio_i2s_release_consumer_pool(consumer);
+    // heap pools from audio_i2s_connect_multi_dac_extra() cannot be freed through pico_audio and are abandoned
+    multi_dac_state.consumers[dac_index] = NULL;
+}
+
+bool audio_i2s_connect_capture_multi_dac(audio_buffer_pool_t *producer) {
+    if (!multi_dac_state.initialized || !multi_dac_state.capture) {
+        return false;
+    }
+    // the RX FIFO words are stored as they are, so only 16-bit stereo frames can be captured
+    if (producer->format->format != AUDIO_BUFFER_FORMAT_PCM_S16 || producer->format->channel_count != 2) {
+        return false;
+    }
+
+    printf("Connecting audio capture\n");
+
+    if (multi_dac_state.capture_pool) {
+        audio_i2s_disconnect_capture_multi_dac();
+    }
+
+    // the capture runs off the shared clock, so it sets the rate like a DAC producer would
+    if (multi_dac_state.freq != producer->format->sample_freq) {
+        if (multi_dac_audio_enabled) {
+            multi_dac_queue_rate_change(producer->format->sample_freq, PICO_AUDIO_I2S_RATE_CHANGE_MUTE_FRAMES);
+        } else {
+            update_pio_frequency_multi_dac(producer->format->sample_freq);
+        }
+    }
+
+    // publish the pool only once the rate is set, as the DMA IRQ picks it up on the next buffer
+    __mem_fence_release();
+    multi_dac_state.capture_pool = producer;
+    return true;
+}
+
+void audio_i2s_disconnect_capture_multi_dac(void) {
+    if (!multi_dac_state.capture_pool) {
+        return;
+    }
+    printf("Disconnecting audio capture\n");
+    // returns the buffer being filled to the pool's free list
+    audio_i2s_set_enabled_multi_dac(false);
+    multi_dac_state.capture_pool = NULL;
+}
+
+const audio_i2s_stats_t *audio_i2s_get_capture_stats_multi_dac(void) {
+    return multi_dac_state.capture ? &multi_dac_state.capture_stats : NULL;
+}
+
+void audio_i2s_reset_capture_stats_multi_dac(void) {
+    audio_i2s_stats_reset(&multi_dac_state.capture_stats);
+}
+
+/** \brief Point the capture DMA at the next free buffer of the capture pool, or discard a
+ *  block of frames if there is none, so the RX FIFO never fills and stalls the state machine
+ */
+static void __audio_i2s_isr_func(multi_dac_start_capture_transfer)(void) {
+    static uint32_t discard;
+    audio_buffer_pool_t *pool = multi_dac_state.capture_pool;
+    audio_buffer_t *ab = NULL;
+    if (pool) {
+        ab = audio_i2s_stats_take_free(&multi_dac_state.capture_stats, pool, PICO_AUDIO_I2S_SILENCE_BUFFER_SAMPLE_LENGTH);
+    }
+    multi_dac_state.capture_buffer = ab;
+
+    uint dma_channel = multi_dac_state.capture_dma_channel;
+    dma_channel_config c = dma_get_channel_config(dma_channel);
+    channel_config_set_write_increment(&c, ab != NULL);
+    dma_channel_set_config(dma_channel, &c, false);
+    if (ab) {
+        assert(ab->format->sample_stride == 4);
+        assert(!((uintptr_t) ab->buffer->bytes & 3u));
+        dma_channel_transfer_to_buffer_now(dma_channel, ab->buffer->bytes, ab->max_sample_count);
+    } else {
+        dma_channel_transfer_to_buffer_now(dma_channel, &discard, PICO_AUDIO_I2S_SILENCE_BUFFER_SAMPLE_LENGTH);
+    }
+}
+
+/** \brief Hand a filled capture buffer to its pool and start filling the next one */
+static void __audio_i2s_isr_func(multi_dac_capture_irq)(void) {
+    uint dma_channel = multi_dac_state.capture_dma_channel;
+    if (!multi_dac_state.capture || !dma_irqn_get_channel_status(PICO_AUDIO_I2S_DMA_IRQ, dma_channel)) {
+        return;
+    }
+    uint32_t start_cycles = audio_i2s_stats_cycles();
+    dma_irqn_acknowledge_channel(PICO_AUDIO_I2S_DMA_IRQ, dma_channel);
+    // restart the DMA first; the RX FIFO only holds a few frames
+    audio_buffer_t *filled = multi_dac_state.capture_buffer;
+    multi_dac_start_capture_transfer();
+    if (filled) {
+        filled->sample_count = filled->max_sample_count;
+        queue_full_audio_buffer(multi_dac_state.capture_pool, filled);
+    }
+    if (audio_i2s_take_rx_stall_pio(multi_dac_state.clock_pio, multi_dac_state.capture_pio_sm)) {
+        // the capture state machine lost bit clocks, so its frames are no longer aligned until the next enable
+        audio_i2s_stats_tx_stall(&multi_dac_state.capture_stats);
+    }
+    audio_i2s_stats_isr_done(&multi_dac_state.capture_stats, start_cycles);
+}
+
+/** \brief Empty the capture RX FIFO and arm the capture DMA before the state machines start */
+static void multi_dac_start_capture(void) {
+    pio_sm_clear_fifos(multi_dac_state.clock_pio, multi_dac_state.capture_pio_sm);
+    audio_i2s_take_rx_stall_pio(multi_dac_state.clock_pio, multi_dac_state.capture_pio_sm);
+    multi_dac_start_capture_transfer();
+}
+
+/** \brief Stop the capture DMA and return the partly filled buffer to the pool's free list */
+static void multi_dac_stop_capture(void) {
+    uint dma_channel = multi_dac_state.capture_dma_channel;
+    dma_channel_abort(dma_channel);
+    dma_irqn_acknowledge_channel(PICO_AUDIO_I2S_DMA_IRQ, dma_channel);
+    if (multi_dac_state.capture_buffer) {
+        queue_free_audio_buffer(multi_dac_state.capture_pool, multi_dac_state.capture_buffer);
+        multi_dac_state.capture_buffer = NULL;
+    }
+}
+
+/** \brief DMA transfers per frame of a DAC's consumer buffers: one, or one per channel for 32-bit samples */
+static inline uint multi_dac_transfers_per_frame(uint8_t dac_index) {
+    return multi_dac_state.sample_bits[dac_index] / 16u;
+}
+
 static inline void audio_start_dma_transfer_multi_dac(uint8_t dac_index) {
     assert(!multi_dac_state.playing_buffers[dac_index]);
-    audio_buffer_t *ab = take_audio_buffer(multi_dac_state.consumers[dac_index], false);
+    audio_buffer_t *ab = NULL;
+    uint32_t mute_frames = 0;
+    if (multi_dac_state.consumers[dac_index]) {
+        mute_frames = multi_dac_rate_change_refill(dac_index);
+        if (!mute_frames) {
+            ab = audio_i2s_rate_change_take(&multi_dac_state.rate_changes[dac_index], &multi_dac_state.stats[dac_index],
+                                            multi_dac_state.consumers[dac_index]);
+        }
+    }
 
     multi_dac_state.playing_buffers[dac_index] = ab;
+    multi_dac_state.silence_runs[dac_index] = 0;
     uint8_t dma_channel = multi_dac_state.dma_channels[dac_index];
 
     if (!ab) {
         // Play silence
         static uint32_t zero;
+        uint32_t frames = PICO_AUDIO_I2S_SILENCE_BUFFER_SAMPLE_LENGTH;
+        const void *read_addr = &zero;
+        uint read = AUDIO_I2S_DMA_READ_FIXED;
+        if (mute_frames) {
+            frames = mute_frames;
+            read_addr = audio_i2s_fade_silence(&multi_dac_state.fades[dac_index], &zero, &frames, &read);
+        } else if (multi_dac_state.consumers[dac_index]) {
+            // an unconnected DAC has nothing to wait for, so it keeps to full runs
+            frames = audio_i2s_underrun_silence_frames(&multi_dac_state.underrun_runs[dac_index], frames);
+            read_addr = audio_i2s_fade_silence(&multi_dac_state.fades[dac_index], &zero, &frames, &read);
+            audio_i2s_stats_silence(&multi_dac_state.stats[dac_index], frames);
+            multi_dac_state.idle_frames[dac_index] += frames;
+            multi_dac_state.silence_runs[dac_index] = frames;
+        }
         dma_channel_config c = dma_get_channel_config(dma_channel);
-        channel_config_set_read_increment(&c, false);
+        audio_i2s_dma_config_set_read(&c, read);
         dma_channel_set_config(dma_channel, &c, false);
-        dma_channel_transfer_from_buffer_now(dma_channel, &zero,
-                                             PICO_AUDIO_I2S_SILENCE_BUFFER_SAMPLE_LENGTH);
+        dma_channel_transfer_from_buffer_now(dma_channel, read_addr, frames * multi_dac_transfers_per_frame(dac_index));
         return;
     }
+    multi_dac_state.underrun_runs[dac_index] = 0;
+    multi_dac_state.idle_frames[dac_index] = 0;
 
     assert(ab->sample_count);
-    assert(ab->format->format->format == AUDIO_BUFFER_FORMAT_PCM_S16);
-
-#if PICO_AUDIO_I2S_MONO_OUTPUT
-    assert(ab->format->format->channel_count == 1);
-    assert(ab->format->sample_stride == 2);
-#else
-    assert(ab->format->format->channel_count == 2);
-    assert(ab->format->sample_stride == 4);
-#endif
+    assert(ab->format->format->format == (multi_dac_state.sample_bits[dac_index] == 32 ? AUDIO_BUFFER_FORMAT_PCM_S32 :
+                                          AUDIO_BUFFER_FORMAT_PCM_S16));
+    assert(ab->format->format->channel_count == multi_dac_state.channel_counts[dac_index]);
+    assert(ab->format->sample_stride == multi_dac_state.sample_bits[dac_index] / 8u *
+                                        multi_dac_state.channel_counts[dac_index]);
+    audio_i2s_fade_buffer(&multi_dac_state.fades[dac_index], ab);
 
     dma_channel_config c = dma_get_channel_config(dma_channel);
     channel_config_set_read_increment(&c, true);
     dma_channel_set_config(dma_channel, &c, false);
-    dma_channel_transfer_from_buffer_now(dma_channel, ab->buffer->bytes, ab->sample_count);
+    dma_channel_transfer_from_buffer_now(dma_channel, ab->buffer->bytes,
+                                         ab->sample_count * multi_dac_transfers_per_frame(dac_index));
 }
 
-void __isr __time_critical_func(audio_i2s_dma_irq_handler_multi_dac)() {
+void __isr __audio_i2s_isr_func(audio_i2s_dma_irq_handler_multi_dac)() {
 #if PICO_AUDIO_I2S_NOOP
     assert(false);
 #else
-    // Check which DMA channel triggered the interrupt
+    multi_dac_capture_irq();
+    // Read and acknowledge the status of all our channels at once, then visit only the ones that completed
+    uint32_t status = dma_hw->irq_ctrl[PICO_AUDIO_I2S_DMA_IRQ].ints & multi_dac_state.dma_channel_mask;
+    dma_hw->irq_ctrl[PICO_AUDIO_I2S_DMA_IRQ].ints = status;
+    while (status) {
+        uint dma_channel = (uint) __builtin_ctz(status);
+        status &= status - 1u;
+        uint8_t i = multi_dac_state.dma_channel_dac[dma_channel];
+        uint32_t start_cycles = audio_i2s_stats_cycles();
+
+        // Free the buffer we just finished
+        if (multi_dac_state.playing_buffers[i]) {
+            give_audio_buffer(multi_dac_state.consumers[i], multi_dac_state.playing_buffers[i]);
+#ifndef NDEBUG
+            multi_dac_state.playing_buffers[i] = NULL;
+#endif
+        }
+        audio_start_dma_transfer_multi_dac(i);
+        if (audio_i2s_take_tx_stall_pio(multi_dac_state.data_pios[i], multi_dac_state.data_pio_sms[i])) {
+            // the clock generator kept running, so this DAC's data is now late against LRCLK
+            audio_i2s_stats_tx_stall(&multi_dac_state.stats[i]);
+        }
+        audio_i2s_stats_isr_done(&multi_dac_state.stats[i], start_cycles);
+        if (multi_dac_park_due()) {
+            multi_dac_park();
+            break;
+        }
+    }
+#endif
+}
+
+/** \brief Spread the low 16 bits of x so that bit k lands in bit 2k */
+static inline uint32_t spread_bits_2(uint32_t x) {
+    x &= 0xffffu;
+    x = (x | (x << 8)) & 0x00ff00ffu;
+    x = (x | (x << 4)) & 0x0f0f0f0fu;
+    x = (x | (x << 2)) & 0x33333333u;
+    x = (x | (x << 1)) & 0x55555555u;
+    return x;
+}
+
+/** \brief Spread the low 8 bits of x so that bit k lands in bit 4k */
+static inline uint32_t spread_bits_4(uint32_t x) {
+    x &= 0xffu;
+    x = (x | (x << 12)) & 0x000f000fu;
+    x = (x | (x << 6)) & 0x03030303u;
+    x = (x | (x << 3)) & 0x11111111u;
+    return x;
+}
+
+/** \brief Read frame k of a (stereo) consumer buffer as the 32-bit word the audio_i2s program would shift out */
+static inline uint32_t lane_frame(const void *src, uint k) {
+    if (!src) {
+        return 0;
+    }
+    return ((const uint32_t *) src)[k];
+}
+
+/** \brief Bit-interleave frame_count frames from each lane into the multi-lane wire format */
+static void __audio_i2s_isr_func(interleave_lanes)(uint32_t *wire, const void *const *src, uint frame_count) {
+    switch (multi_dac_state.num_dacs) {
+        case 1:
+            for (uint k = 0; k < frame_count; k++) {
+                wire[k] = lane_frame(src[0], k);
+            }
+            break;
+        case 2:
+            for (uint k = 0; k < frame_count; k++) {
+                uint32_t f0 = lane_frame(src[0], k);
+                uint32_t f1 = lane_frame(src[1], k);
+                *wire++ = spread_bits_2(f0 >> 16) | (spread_bits_2(f1 >> 16) << 1);
+                *wire++ = spread_bits_2(f0) | (spread_bits_2(f1) << 1);
+            }
+            break;
+        case 4:
+            for (uint k = 0; k < frame_count; k++) {
+                uint32_t f0 = lane_frame(src[0], k);
+                uint32_t f1 = lane_frame(src[1], k);
+                uint32_t f2 = lane_frame(src[2], k);
+                uint32_t f3 = lane_frame(src[3], k);
+                for (int shift = 24; shift >= 0; shift -= 8) {
+                    *wire++ = spread_bits_4(f0 >> shift) | (spread_bits_4(f1 >> shift) << 1) |
+                              (spread_bits_4(f2 >> shift) << 2) | (spread_bits_4(f3 >> shift) << 3);
+                }
+            }
+            break;
+        default:
+            assert(false);
+    }
+}
+
+/** \brief Whether a lane is parked for a rate change: it has played everything before its fence
+ *
+ * A parked lane plays silence, without counting it as underrun, until the switch.
+ */
+static bool __audio_i2s_isr_func(multi_lane_rate_change_parked)(uint8_t dac_index) {
+    uint32_t bit = 1u << dac_index;
+    if (multi_dac_state.rate_muted_mask & bit) {
+        return true;
+    }
+    audio_i2s_rate_change_t *rc = &multi_dac_state.rate_changes[dac_index];
+    uint32_t sample_freq = rc->sample_freq;
+    if (!sample_freq || !multi_dac_rate_change_reached(dac_index)) {
+        return false;
+    }
+    rc->sample_freq = 0;
+    multi_dac_state.rate_switch_freq = sample_freq;
+    multi_dac_state.rate_muted_mask |= bit;
+    return true;
+}
+
+/** \brief Start the switch once every lane with a rate change is parked
+ *
+ * The lane buffer just filled ends in silence, and the two filled after it are
+ * all silence, as the lanes stay parked until the switch. The divider is written
+ * at the third lane IRQ from here, once the DMA has moved past the second of
+ * those (see multi_lane_refill()), so only silence is left in the TX FIFO. A
+ * mute longer than those two buffers holds the switch back by further buffers
+ * of silence.
+ */
+static void __audio_i2s_isr_func(multi_lane_rate_change_step)(void) {
+    if (!multi_dac_state.rate_muted_mask || multi_dac_state.lane_switch_countdown ||
+        multi_dac_rate_change_waiting()) {
+        return;
+    }
+    uint32_t mute_frames = 0;
     for (uint8_t i = 0; i < multi_dac_state.num_dacs; i++) {
-        uint8_t dma_channel = multi_dac_state.dma_channels[i];
+        if (multi_dac_state.rate_muted_mask & (1u << i)) {
+            mute_frames = MAX(mute_frames, multi_dac_state.rate_changes[i].mute_frames);
+        }
+    }
+    uint32_t extra = 0;
+    if (mute_frames > 2 * PICO_AUDIO_I2S_MULTI_LANE_BUFFER_SAMPLE_LENGTH) {
+        extra = (mute_frames - 2 * PICO_AUDIO_I2S_MULTI_LANE_BUFFER_SAMPLE_LENGTH +
+                 PICO_AUDIO_I2S_MULTI_LANE_BUFFER_SAMPLE_LENGTH - 1) / PICO_AUDIO_I2S_MULTI_LANE_BUFFER_SAMPLE_LENGTH;
+    }
+    multi_dac_state.lane_switch_countdown = (uint8_t) MIN(3u + extra, 255u);
+}
+
+/** \brief Fill a lane-interleaved buffer from every DAC's consumer pool
+ *
+ * Consumer buffers are consumed across lane buffer boundaries and returned to
+ * their pool as soon as all their frames have been interleaved. Lanes without
+ * data output silence. A lane stops taking at its rate change fence, so no lane
+ * buffer mixes the two rates on one lane.
+ */
+static void __audio_i2s_isr_func(audio_multi_lane_fill)(uint32_t *wire) {
+    uint8_t lanes = multi_dac_state.num_dacs;
+    uint pos = 0;
+    while (pos < PICO_AUDIO_I2S_MULTI_LANE_BUFFER_SAMPLE_LENGTH) {
+        const void *src[PICO_AUDIO_I2S_MAX_DACS];
+        uint run = PICO_AUDIO_I2S_MULTI_LANE_BUFFER_SAMPLE_LENGTH - pos;
+        for (uint8_t i = 0; i < lanes; i++) {
+            audio_buffer_t *ab = multi_dac_state.playing_buffers[i];
+            if (!ab && multi_dac_state.consumers[i] && !multi_lane_rate_change_parked(i)) {
+                ab = multi_dac_state.playing_buffers[i] = audio_i2s_rate_change_take(&multi_dac_state.rate_changes[i],
+                                                                                     &multi_dac_state.stats[i],
+                                                                                     multi_dac_state.consumers[i]);
+                multi_dac_state.playing_buffer_pos[i] = 0;
+            }
+            if (ab) {
+                uint32_t ab_pos = multi_dac_state.playing_buffer_pos[i];
+                src[i] = ab->buffer->bytes + ab_pos * ab->format->sample_stride;
+                run = MIN(run, ab->sample_count - ab_pos);
+            } else {
+                src[i] = NULL;
+            }
+        }
+        for (uint8_t i = 0; i < lanes; i++) {
+            if (src[i]) {
+                multi_dac_state.idle_frames[i] = 0;
+            } else if (multi_dac_state.consumers[i] && !(multi_dac_state.rate_muted_mask & (1u << i))) {
+                audio_i2s_stats_silence(&multi_dac_state.stats[i], run);
+                multi_dac_state.idle_frames[i] += run;
+            }
+        }
+        interleave_lanes(wire + pos * lanes, src, run);
+        pos += run;
+        for (uint8_t i = 0; i < lanes; i++) {
+            audio_buffer_t *ab = multi_dac_state.playing_buffers[i];
+            if (ab) {
+                multi_dac_state.playing_buffer_pos[i] += run;
+                if (multi_dac_state.playing_buffer_pos[i] == ab->sample_count) {
+                    give_audio_buffer(multi_dac_state.consumers[i], ab);
+                    multi_dac_state.playing_buffers[i] = NULL;
+                }
+            }
+        }
+    }
+    multi_lane_rate_change_step();
+}
+
+/** \brief Point a lane buffer's channel back at the start of its buffer, for the chain to trigger */
+static inline void audio_arm_dma_transfer_multi_lane(uint8_t lane_buffer) {
+    uint dma_channel = multi_dac_state.dma_channels[lane_buffer];
+    dma_channel_set_read_addr(dma_channel, multi_dac_state.lane_buffers[lane_buffer], false);
+    dma_channel_set_trans_count(dma_channel, PICO_AUDIO_I2S_MULTI_LANE_BUFFER_SAMPLE_LENGTH * multi_dac_state.num_dacs,
+                                false);
+}
+
+/** \brief Enable or break the chaining between the two lane buffer channels
+ *
+ * As for the single DAC ping-pong pair, the chain is pointed back at each
+ * channel itself before the channels are aborted, so neither re-triggers the other.
+ */
+static void multi_lane_set_chained(bool chained) {
+    for (uint b = 0; b < 2; b++) {
+        uint dma_channel = multi_dac_state.dma_channels[b];
+        dma_channel_config c = dma_get_channel_config(dma_channel);
+        channel_config_set_chain_to(&c, multi_dac_state.dma_channels[chained ? b ^ 1u : b]);
+        dma_channel_set_config(dma_channel, &c, false);
+    }
+}
+
+/** \brief Refill a lane buffer whose channel has finished, while the chain plays the other */
+static void __audio_i2s_isr_func(multi_lane_refill)(uint8_t lane_buffer) {
+    audio_arm_dma_transfer_multi_lane(lane_buffer);
+    if (multi_dac_state.lane_switch_countdown && !--multi_dac_state.lane_switch_countdown) {
+        // the buffer the chain just started and the one before it are silence on every lane
+        multi_dac_finish_rate_change();
+    }
+#if PICO_AUDIO_I2S_CLOCK_DITHER
+    // Only one state machine, so the divider can change without skewing lanes; a
+    // capture state machine would fall out of step, so it is left alone then
+    if (!multi_dac_state.capture) {
+        uint32_t divider = audio_i2s_clock_divider_dither(&multi_dac_state.clock_divider,
+                                                          PICO_AUDIO_I2S_MULTI_LANE_BUFFER_SAMPLE_LENGTH);
+        pio_sm_set_clkdiv_int_frac(multi_dac_state.clock_pio, multi_dac_state.clock_pio_sm, divider >> 8u,
+                                   divider & 0xffu);
+    }
+#endif
+    audio_multi_lane_fill(multi_dac_state.lane_buffers[lane_buffer]);
+}
+
+void __isr __audio_i2s_isr_func(audio_i2s_dma_irq_handler_multi_lane)() {
+#if PICO_AUDIO_I2S_NOOP
+    assert(false);
+#else
+    multi_dac_capture_irq();
+    bool pending = false;
+    uint32_t start_cycles = audio_i2s_stats_cycles();
+    // the other channel is already playing the other buffer, so this only interleaves
+    for (uint8_t b = 0; b < 2; b++) {
+        uint dma_channel = multi_dac_state.dma_channels[b];
         if (dma_irqn_get_channel_status(PICO_AUDIO_I2S_DMA_IRQ, dma_channel)) {
             dma_irqn_acknowledge_channel(PICO_AUDIO_I2S_DMA_IRQ, dma_channel);
-
-            // Free the buffer we just finished
-            if (multi_dac_state.playing_buffers[i]) {
-                give_audio_buffer(multi_dac_state.consumers[i], multi_dac_state.playing_buffers[i]);
-#ifndef NDEBUG
-                multi_dac_state.playing_buffers[i] = NULL;
+            multi_lane_refill(b);
+            pending = true;
+        }
+    }
+    if (pending) {
+        // one interrupt serves every lane, so each DAC reports the whole cost (and any stall)
+        bool stalled = audio_i2s_take_tx_stall_pio(multi_dac_state.clock_pio, multi_dac_state.clock_pio_sm);
+        for (uint8_t i = 0; i < multi_dac_state.num_dacs; i++) {
+            if (stalled) {
+                audio_i2s_stats_tx_stall(&multi_dac_state.stats[i]);
+            }
+            audio_i2s_stats_isr_done(&multi_dac_state.stats[i], start_cycles);
+        }
+        if (multi_dac_park_due()) {
+            multi_dac_park();
+        }
+    }
 #endif
+}
+
+
+#if PICO_AUDIO_I2S_FADE_FRAMES
+/** \brief Stop every DAC's DMA and ramp each output down from where it stopped
+ *
+ * The data state machines drain at the same rate, so the ramps are pushed a
+ * word to each DAC in turn and no FIFO runs dry while another is being waited on.
+ */
+static void multi_dac_fade_out(void) {
+    uint words[PICO_AUDIO_I2S_MAX_DACS];
+    uint most = 0;
+    for (uint8_t i = 0; i < multi_dac_state.num_dacs; i++) {
+        uint dma_channel = multi_dac_state.dma_channels[i];
+        dma_channel_abort(dma_channel);
+        // a DAC's channel is refilled once it finishes, so its fade state is what was playing
+        const audio_buffer_t *ab = multi_dac_state.playing_buffers[i];
+        words[i] = audio_i2s_fade_prepare_stop(&multi_dac_state.fades[i],
+                                               ab ? (const void *) ab->buffer->bytes : multi_dac_state.fades[i].ramp,
+                                               ab ? ab->sample_count : AUDIO_I2S_FADE_BUFFER_FRAMES,
+                                               (const void *) (uintptr_t) dma_hw->ch[dma_channel].read_addr);
+        most = MAX(most, words[i]);
+    }
+    for (uint w = 0; w < most; w++) {
+        for (uint8_t i = 0; i < multi_dac_state.num_dacs; i++) {
+            if (w < words[i]) {
+                pio_sm_put_blocking(multi_dac_state.data_pios[i], multi_dac_state.data_pio_sms[i],
+                                    audio_i2s_fade_stop_word(&multi_dac_state.fades[i], w));
             }
-            audio_start_dma_transfer_multi_dac(i);
         }
     }
+    for (uint8_t i = 0; i < multi_dac_state.num_dacs; i++) {
+        while (!pio_sm_is_tx_fifo_empty(multi_dac_state.data_pios[i], multi_dac_state.data_pio_sms[i])) {
+            tight_loop_contents();
+        }
+    }
+}
 #endif
+
+/** \brief Frames of silence every DAC starts on when a give wakes the output
+ *
+ * Longer than a TX FIFO, so the first refills are taken in the DMA IRQ a few
+ * frames after the wake, by when buffers given to several DACs together have all
+ * arrived, and the DACs start them on the same frame.
+ */
+#define MULTI_DAC_WAKE_FRAMES 16
+
+/** \brief Queue the first buffers on the DMA and start all state machines together
+ *
+ * \param wake Restarting from a give: start on silence and leave the first takes to the DMA IRQ
+ */
+static void multi_dac_start(bool wake) {
+    if (multi_dac_state.single_sm) {
+        // queue both lane buffers, then start the first; it chains to the second
+        for (uint8_t b = 0; b < 2; b++) {
+            if (wake) {
+                memset(multi_dac_state.lane_buffers[b], 0,
+                       PICO_AUDIO_I2S_MULTI_LANE_BUFFER_SAMPLE_LENGTH * multi_dac_state.num_dacs * sizeof(uint32_t));
+            } else {
+                audio_multi_lane_fill(multi_dac_state.lane_buffers[b]);
+            }
+            audio_arm_dma_transfer_multi_lane(b);
+        }
+        multi_lane_set_chained(true);
+        dma_channel_start(multi_dac_state.dma_channels[0]);
+        while (!pio_sm_is_tx_fifo_full(multi_dac_state.clock_pio, multi_dac_state.clock_pio_sm)) {
+            tight_loop_contents();
+        }
+    } else {
+        // Start DMA transfers for all DACs
+        for (uint8_t i = 0; i < multi_dac_state.num_dacs; i++) {
+            audio_i2s_fade_init(&multi_dac_state.fades[i], multi_dac_state.sample_bits[i],
+                                multi_dac_state.channel_counts[i]);
+            if (wake) {
+                static uint32_t zero;
+                uint dma_channel = multi_dac_state.dma_channels[i];
+                dma_channel_config c = dma_get_channel_config(dma_channel);
+                audio_i2s_dma_config_set_read(&c, AUDIO_I2S_DMA_READ_FIXED);
+                dma_channel_set_config(dma_channel, &c, false);
+                dma_channel_transfer_from_buffer_now(dma_channel, &zero,
+                                                     MULTI_DAC_WAKE_FRAMES * multi_dac_transfers_per_frame(i));
+            } else {
+                audio_start_dma_transfer_multi_dac(i);
+            }
+        }
+        // Let the DMA fill every TX FIFO, so no data state machine stalls on its first pull
+        for (uint8_t i = 0; i < multi_dac_state.num_dacs; i++) {
+            while (!pio_sm_is_tx_fifo_full(multi_dac_state.data_pios[i], multi_dac_state.data_pio_sms[i])) {
+                tight_loop_contents();
+            }
+        }
+    }
+    if (multi_dac_state.capture) {
+        multi_dac_start_capture();
+    }
+    // Enable the clock generator and all data state machines on the same cycle,
+    // with their clock dividers restarted together
+    multi_dac_clear_tx_stalls();
+    multi_dac_start_sms();
 }
 
-static bool multi_dac_audio_enabled = false;
+/** \brief Stop all state machines and the DMA, and give back the buffers in flight */
+static void multi_dac_stop(void) {
+    // Disable all state machines (together, so they stay in step for the next start)
+    multi_dac_stop_sms();
+    if (multi_dac_state.capture) {
+        multi_dac_stop_capture();
+    }
+    // Stop the channels (paused on DREQ now) and drop what they queued, so nothing
+    // still points into the buffers given back below or completes after a restart
+    if (multi_dac_state.single_sm) {
+        multi_lane_set_chained(false);
+    }
+    uint8_t channels = multi_dac_state.single_sm ? 2 : multi_dac_state.num_dacs;
+    for (uint8_t i = 0; i < channels; i++) {
+        dma_channel_abort(multi_dac_state.dma_channels[i]);
+        dma_irqn_acknowledge_channel(PICO_AUDIO_I2S_DMA_IRQ, multi_dac_state.dma_channels[i]);
+    }
+    if (multi_dac_state.single_sm) {
+        pio_sm_clear_fifos(multi_dac_state.clock_pio, multi_dac_state.clock_pio_sm);
+    } else {
+        for (uint8_t i = 0; i < multi_dac_state.num_dacs; i++) {
+            pio_sm_clear_fifos(multi_dac_state.data_pios[i], multi_dac_state.data_pio_sms[i]);
+        }
+    }
+
+    // Free any buffers in flight
+    for (uint8_t i = 0; i < multi_dac_state.num_dacs; i++) {
+        if (multi_dac_state.playing_buffers[i]) {
+            give_audio_buffer(multi_dac_state.consumers[i], multi_dac_state.playing_buffers[i]);
+            multi_dac_state.playing_buffers[i] = NULL;
+        }
+    }
+}
+
+/** \brief Whether the next refill of a DAC would find a buffer to play */
+static bool multi_dac_buffer_ready(uint8_t dac_index) {
+    audio_buffer_pool_t *consumer = multi_dac_state.consumers[dac_index];
+    if (consumer->connection == &multi_dac_connections[dac_index].take.core.core) {
+        // the consumer buffer is filled on take, from the producer's
+        const audio_i2s_converting_connection_t *cc = &multi_dac_connections[dac_index].take;
+        return cc->core.current_producer_buffer || cc->core.core.producer_pool->prepared_list;
+    }
+    return consumer->prepared_list;
+}
+
+/** \brief Underrun silence a DAC has played out of its DMA, not counting what is still queued
+ *
+ * In lane mode the lane buffer playing and the one just filled are still to go.
+ */
+static inline uint32_t multi_dac_idle_played(uint8_t dac_index) {
+    uint32_t queued = multi_dac_state.single_sm ? 2u * PICO_AUDIO_I2S_MULTI_LANE_BUFFER_SAMPLE_LENGTH :
+                      multi_dac_state.silence_runs[dac_index];
+    uint32_t idle = multi_dac_state.idle_frames[dac_index];
+    return idle > queued ? idle - queued : 0;
+}
+
+/** \brief Whether every connected DAC has played idle_park_ms of underrun silence, with nothing ready
+ *
+ * Only the connections built by audio_i2s_connect_multi_dac*() wake the output
+ * from their gives, so a custom connection on any DAC, capture or a rate change
+ * in progress keeps the output running. At least a TX FIFO of silence (8 frames
+ * at most) must have played too, as the FIFOs are cleared when the output parks.
+ */
+static bool __audio_i2s_isr_func(multi_dac_park_due)(void) {
+    if (!multi_dac_state.park_frames || multi_dac_state.capture || multi_dac_state.rate_muted_mask ||
+        multi_dac_state.lane_switch_countdown) {
+        return false;
+    }
+    bool connected = false;
+    for (uint8_t i = 0; i < multi_dac_state.num_dacs; i++) {
+        audio_buffer_pool_t *consumer = multi_dac_state.consumers[i];
+        if (!consumer) {
+            continue;
+        }
+        audio_connection_t *connection = consumer->connection;
+        const audio_i2s_rate_change_t *rc = &multi_dac_state.rate_changes[i];
+        if ((connection != &multi_dac_connections[i].take.core.core && connection != &multi_dac_connections[i].give.core &&
+             connection != &multi_dac_connections[i].thru.core) ||
+            multi_dac_idle_played(i) < MAX(multi_dac_state.park_frames, 8u) || multi_dac_state.playing_buffers[i] ||
+            rc->sample_freq || rc->countdown || multi_dac_buffer_ready(i)) {
+            return false;
+        }
+        connected = true;
+    }
+    return connected;
+}
+
+/** \brief Stop the idle output from the DMA IRQ, until a give wakes it
+ *
+ * The state machines are stopped and rewound to a frame boundary together, as on
+ * disable, so BCLK and LRCLK are held and the DACs see a paused clock.
+ */
+static void multi_dac_park(void) {
+    multi_dac_stop();
+    multi_dac_state.parked = true;
+    __dmb();
+    // a buffer given before parked was visible did not wake the output
+    multi_dac_wake();
+}
+
+/** \brief Restart a parked output after a give, if a DAC now has a buffer to play
+ *
+ * Producers on both cores may give at once, so the pools' prepared list lock
+ * picks the one that restarts the output.
+ */
+static void multi_dac_wake(void) {
+    // pairs with the barrier in multi_dac_park(): either it sees the buffer or this sees parked
+    __dmb();
+    if (!multi_dac_state.parked) {
+        return;
+    }
+    spin_lock_t *lock = spin_lock_instance(SPINLOCK_ID_AUDIO_PREPARED_LISTS_LOCK);
+    uint32_t save = spin_lock_blocking(lock);
+    bool wake = false;
+    if (multi_dac_state.parked) {
+        for (uint8_t i = 0; i < multi_dac_state.num_dacs && !wake; i++) {
+            wake = multi_dac_state.consumers[i] && multi_dac_buffer_ready(i);
+        }
+        multi_dac_state.parked = !wake;
+    }
+    spin_unlock(lock, save);
+    if (wake) {
+        for (uint8_t i = 0; i < multi_dac_state.num_dacs; i++) {
+            multi_dac_state.idle_frames[i] = 0;
+        }
+        multi_dac_start(true);
+    }
+}
+
+void audio_i2s_set_idle_park_ms_multi_dac(uint32_t idle_ms) {
+    multi_dac_state.idle_park_ms = idle_ms;
+    multi_dac_state.park_frames = (uint32_t) ((uint64_t) idle_ms * multi_dac_state.freq / 1000u);
+}
+
+bool audio_i2s_is_parked_multi_dac(void) {
+    return multi_dac_state.parked;
+}
 
 void audio_i2s_set_enabled_multi_dac(bool enabled) {
     if (!multi_dac_state.initialized) {
@@ -295,36 +1580,29 @@ void audio_i2s_set_enabled_multi_dac(bool enabled) {
 
         irq_set_enabled(DMA_IRQ_0 + PICO_AUDIO_I2S_DMA_IRQ, enabled);
 
+        bool parked = multi_dac_state.parked;
+        multi_dac_state.parked = false;
+        for (uint8_t i = 0; i < multi_dac_state.num_dacs; i++) {
+            multi_dac_state.idle_frames[i] = 0;
+        }
         if (enabled) {
-            // Start DMA transfers for all DACs
-            for (uint8_t i = 0; i < multi_dac_state.num_dacs; i++) {
-                audio_start_dma_transfer_multi_dac(i);
-            }
-            // Enable clock generator first
-            pio_sm_set_enabled(audio_pio, multi_dac_state.clock_pio_sm, true);
-            // Then enable all data state machines simultaneously
-            uint32_t sm_mask = 0;
-            for (uint8_t i = 0; i < multi_dac_state.num_dacs; i++) {
-                sm_mask |= (1u << multi_dac_state.data_pio_sms[i]);
-            }
-            pio_set_sm_mask_enabled(audio_pio, sm_mask, true);
+            multi_dac_start(false);
         } else {
-            // Disable all state machines
-            uint32_t sm_mask = (1u << multi_dac_state.clock_pio_sm);
-            for (uint8_t i = 0; i < multi_dac_state.num_dacs; i++) {
-                sm_mask |= (1u << multi_dac_state.data_pio_sms[i]);
-            }
-            pio_set_sm_mask_enabled(audio_pio, sm_mask, false);
-
-            // Free any buffers in flight
-            for (uint8_t i = 0; i < multi_dac_state.num_dacs; i++) {
-                if (multi_dac_state.playing_buffers[i]) {
-                    give_audio_buffer(multi_dac_state.consumers[i], multi_dac_state.playing_buffers[i]);
-                    multi_dac_state.playing_buffers[i] = NULL;
-                }
+#if PICO_AUDIO_I2S_FADE_FRAMES
+            // a parked output is already silent, with nothing in flight to ramp down from
+            if (!multi_dac_state.single_sm && !parked) {
+                multi_dac_fade_out();
             }
+#else
+            (void) parked;
+#endif
+            multi_dac_stop();
         }
 
         multi_dac_audio_enabled = enabled;
+        if (!enabled && multi_dac_state.rate_muted_mask) {
+            // a switch that had begun is completed now, with the state machines stopped
+            multi_dac_finish_rate_change();
+        }
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,160 @@
+/*
+ * Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/** \file audio_i2s_rate_match.c
+ *  \brief Adaptive rate matching (asynchronous sample rate conversion) connection
+ *
+ * This file implements a consumer-take copying connection with a resampler in
+ * the copy loop. The resampler is a linear interpolator with a Q8.24 phase
+ * accumulator, which resolves ratio changes of well under 1 ppm.
+ *
+ * Control Loop:
+ * - The producer side counts frames given and the consumer side counts frames
+ *   read; each counter has a single writer, so the backlog is read lock-free
+ * - Once per consumer buffer the backlog error is low-pass filtered (producer
+ *   buffers arrive in blocks, so the raw backlog is a sawtooth) and fed to a
+ *   PI controller whose output is the resampling ratio in ppm
+ * - The correction is clamped to PICO_AUDIO_I2S_RATE_MATCH_MAX_PPM
+ */
+
+#include "include/pico/audio_i2s_rate_match.h"
+
+/** \brief One input frame in Q8.24 phase units */
+#define RATE_MATCH_PHASE_ONE (1u << 24)
+
+static inline int32_t clamp_ppm(int32_t value, int32_t limit) {
+    return value > limit ? limit : (value < -limit ? -limit : value);
+}
+
+/** \brief Update the resampling step from the producer backlog (once per consumer buffer) */
+static void __time_critical_func(rate_match_update_step)(audio_i2s_rate_match_connection_t *rm) {
+    int32_t error = (int32_t) (rm->frames_given - rm->frames_taken) - (int32_t) rm->target_frames;
+    rm->filtered_error += ((error * 256) - rm->filtered_error) >> 4;
+
+    int32_t proportional = rm->filtered_error * PICO_AUDIO_I2S_RATE_MATCH_GAIN_PPM_PER_FRAME;
+    rm->integral_ppm = clamp_ppm(rm->integral_ppm + proportional / PICO_AUDIO_I2S_RATE_MATCH_INTEGRAL_BUFFERS,
+                                 PICO_AUDIO_I2S_RATE_MATCH_MAX_PPM << 8);
+    int32_t ppm = clamp_ppm((proportional + rm->integral_ppm) >> 8, PICO_AUDIO_I2S_RATE_MATCH_MAX_PPM);
+
+    rm->correction_ppm = ppm;
+    // 2^24 / 10^6 = 16.777216 phase units per ppm
+    rm->step = (uint32_t) ((int32_t) RATE_MATCH_PHASE_ONE + ppm * 16777 / 1000);
+}
+
+/** \brief Advance the resampler input by one frame
+ *
+ * \return false if the producer has no more data (only possible when not blocking)
+ */
+static bool __time_critical_func(rate_match_next_frame)(audio_i2s_rate_match_connection_t *rm, bool block) {
+    audio_buffer_t *ab = rm->current_producer_buffer;
+    if (!ab) {
+        ab = rm->current_producer_buffer = get_full_audio_buffer(rm->core.producer_pool, block);
+        if (!ab) {
+            assert(!block);
+            return false;
+        }
+        assert(ab->format->format->format == AUDIO_BUFFER_FORMAT_PCM_S16);
+        rm->current_producer_buffer_pos = 0;
+    }
+    const int16_t *input = (const int16_t *) ab->buffer->bytes;
+    uint32_t pos = rm->current_producer_buffer_pos++;
+    rm->prev[0] = rm->cur[0];
+    rm->prev[1] = rm->cur[1];
+    if (ab->format->format->channel_count == 2) {
+        rm->cur[0] = input[pos * 2];
+        rm->cur[1] = input[pos * 2 + 1];
+    } else {
+        rm->cur[0] = rm->cur[1] = input[pos];
+    }
+    rm->frames_taken++;
+    if (rm->current_producer_buffer_pos == ab->sample_count) {
+        queue_free_audio_buffer(rm->core.producer_pool, ab);
+        rm->current_producer_buffer = NULL;
+    }
+    return true;
+}
+
+static audio_buffer_t *__time_critical_func(rate_match_consumer_take)(audio_connection_t *connection, bool block) {
+    audio_i2s_rate_match_connection_t *rm = (audio_i2s_rate_match_connection_t *) connection;
+    audio_buffer_t *buffer = get_free_audio_buffer(rm->core.consumer_pool, block);
+    if (!buffer) {
+        return NULL;
+    }
+    rate_match_update_step(rm);
+
+    const audio_format_t *output_format = buffer->format->format;
+    // 32-bit slots get the samples MSB aligned
+    bool s32 = output_format->format == AUDIO_BUFFER_FORMAT_PCM_S32;
+    // mono outputs get the mix down
+    bool mono_output = output_format->channel_count == 1;
+    if ((!s32 && output_format->format != AUDIO_BUFFER_FORMAT_PCM_S16) ||
+        (!mono_output && output_format->channel_count != 2)) {
+        panic("rate matched output must be PCM S16 or S32, mono or stereo");
+    }
+    int16_t *output = (int16_t *) buffer->buffer->bytes;
+    int32_t *output32 = (int32_t *) buffer->buffer->bytes;
+    uint32_t pos;
+    bool have_input = true;
+    for (pos = 0; pos < buffer->max_sample_count; pos++) {
+        while (rm->phase >= RATE_MATCH_PHASE_ONE) {
+            if (!rate_match_next_frame(rm, block)) {
+                have_input = false;
+                break;
+            }
+            rm->phase -= RATE_MATCH_PHASE_ONE;
+        }
+        if (!have_input) {
+            break;
+        }
+        int32_t frac = (int32_t) (rm->phase >> 9); // Q15
+        int32_t left = rm->prev[0] + (((rm->cur[0] - rm->prev[0]) * frac) >> 15);
+        int32_t right = rm->prev[1] + (((rm->cur[1] - rm->prev[1]) * frac) >> 15);
+        if (mono_output) {
+            left = (left + right) >> 1;
+            if (s32) {
+                output32[pos] = (int32_t) ((uint32_t) left << 16);
+            } else {
+                output[pos] = (int16_t) left;
+            }
+        } else if (s32) {
+            output32[pos * 2] = (int32_t) ((uint32_t) left << 16);
+            output32[pos * 2 + 1] = (int32_t) ((uint32_t) right << 16);
+        } else {
+            output[pos * 2] = (int16_t) left;
+            output[pos * 2 + 1] = (int16_t) right;
+        }
+        rm->phase += rm->step;
+    }
+    if (!pos) {
+        queue_free_audio_buffer(rm->core.consumer_pool, buffer);
+        return NULL;
+    }
+    buffer->sample_count = pos;
+    return buffer;
+}
+
+static void rate_match_producer_give(audio_connection_t *connection, audio_buffer_t *buffer) {
+    audio_i2s_rate_match_connection_t *rm = (audio_i2s_rate_match_connection_t *) connection;
+    rm->frames_given += buffer->sample_count;
+    producer_pool_give_buffer_default(connection, buffer);
+}
+
+audio_connection_t *audio_i2s_rate_match_connection_init(audio_i2s_rate_match_connection_t *connection,
+                                                         uint32_t target_frames) {
+    *connection = (audio_i2s_rate_match_connection_t) {
+            .core = {
+                    .consumer_pool_take = rate_match_consumer_take,
+                    .consumer_pool_give = consumer_pool_give_buffer_default,
+                    .producer_pool_take = producer_pool_take_buffer_default,
+                    .producer_pool_give = rate_match_producer_give,
+            },
+            .target_frames = target_frames,
+            // start one frame in, so the first output interpolates from silence into the first input frame
+            .phase = RATE_MATCH_PHASE_ONE,
+            .step = RATE_MATCH_PHASE_ONE,
+    };
+    return &connection->core;
+}
@@ -14,11 +14,15 @@
  * Key Features Implemented:
  * - PIO-based I2S protocol generation (BCLK, LRCLK, SDOUT)
  * - DMA-driven audio data streaming with minimal CPU overhead
- * - Support for multiple audio formats (16-bit stereo/mono, 8-bit with conversion)
+ * - Support for multiple audio formats (16-bit stereo/mono, 8-bit with conversion,
+ *   24/32-bit through 32-bit slots)
  * - Automatic format conversion and channel mapping
- * - Dynamic frequency adjustment for different sample rates
+ * - Sample rate changes between producer buffers, fenced so no buffer plays at the wrong rate
  * - Multiple connection types (pass-through, buffered, format converting)
  * - Comprehensive error handling and silence generation
+ * - Buffer and silence sizing from an output latency budget
+ * - Gain and DC blocker applied in the convert-on-take copy
+ * - Parking of an idle output, with its DMA stopped, until the next buffer is given
  *
  * Architecture:
  * - Single PIO state machine handles both clock generation and data output
@@ -31,6 +35,7 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include "pico/stdlib.h"
 #include "include/pico/audio_i2s_single.h"
 #include "include/pico/audio_i2s_common.h"
@@ -39,6 +44,7 @@
 #include "hardware/gpio.h"
 #include "hardware/dma.h"
 #include "hardware/irq.h"
+#include "hardware/clocks.h"
 
 CU_REGISTER_DEBUG_PINS(audio_timing)
 
@@ -50,21 +56,201 @@ CU_REGISTER_DEBUG_PINS(audio_timing)
  */
 struct {
     audio_buffer_t *playing_buffer;  ///< Currently playing audio buffer (NULL if silence)
+    audio_buffer_t *playing_buffer_b; ///< Buffer queued on or playing from dma_channel_b (ping-pong)
     uint32_t freq;                   ///< Current configured sample frequency
     uint8_t pio_sm;                 ///< PIO state machine number in use
+    uint8_t slot_bits;              ///< Bits per channel slot: 16 (audio_i2s program) or 32 (audio_i2s_slot program)
+    uint8_t entry_pc;               ///< Program counter of the loaded program's entry point
+    uint8_t channel_count;          ///< Channels per consumer frame: 1 (16-bit mono, sent in both slots) or 2
     uint8_t dma_channel;            ///< DMA channel number in use
+    uint8_t dma_channel_b;          ///< Second DMA channel (ping-pong partner or ring control channel)
+    uint8_t dma_mode;               ///< enum audio_i2s_dma_mode
+    uint8_t ring_irq_interval;      ///< Descriptors per IRQ (ring)
+    uint16_t ring_next_refill;      ///< First descriptor of the half to recycle on the next IRQ (ring)
+    struct audio_i2s_dma_block *ring; ///< 2 * ring_irq_interval descriptors followed by the reload block (ring)
+    audio_buffer_t **ring_buffers;  ///< Buffer owned by each ring descriptor, NULL for silence (ring)
+#if AUDIO_I2S_FADE_ENABLED
+    uint32_t *ring_ramps;           ///< AUDIO_I2S_FADE_BUFFER_WORDS of ramp storage per ring descriptor (ring)
+#endif
+#if PICO_AUDIO_I2S_FADE_FRAMES
+    const void *silence_sources[2]; ///< Silence source loaded on dma_channel and dma_channel_b, NULL for a buffer or zeros
+#endif
+    uint32_t ring_ctrl[3][2];       ///< Data channel CTRL values, indexed by [enum audio_i2s_dma_read][raises IRQ] (ring)
+    uint32_t silence_frames;        ///< Frames of silence played per refill that finds no buffer ready
+    uint32_t underrun_run;          ///< Next silence run of the current underrun (0 once a buffer plays)
+    audio_i2s_fade_t fade;          ///< Fade ramps and held level
+    audio_i2s_output_process_t process; ///< Gain and DC blocker of the converting connections
+    audio_i2s_latency_t latency;    ///< Output latency of the current connection
+    audio_i2s_rate_change_t rate_change; ///< Queued rate change and its fence
+    const audio_i2s_converting_connection_t *converting; ///< Connection in use if it has a rate fence, else NULL
+    uint32_t idle_park_ms;          ///< Silence before parking, 0 to never park
+    uint32_t park_frames;           ///< idle_park_ms in frames at freq
+    uint32_t idle_frames;           ///< Underrun silence queued since a buffer last played
+    bool parkable;                  ///< The connection wakes the output when it is given a buffer
+    volatile uint8_t park_state;    ///< enum audio_park_state
+    audio_i2s_clock_divider_t clock_divider; ///< PIO divider for freq
+    audio_i2s_stats_t stats;        ///< Playback statistics
 } shared_state;
 
+/** \brief DMA control block, laid out to match the data channel's alias 1 registers
+ *
+ * The control channel writes one block per transfer into
+ * AL1_CTRL / AL1_READ_ADDR / AL1_WRITE_ADDR / AL1_TRANS_COUNT_TRIG. The addresses
+ * are held as 32-bit bus addresses, so the layout does not depend on the size of
+ * a pointer.
+ */
+struct audio_i2s_dma_block {
+    uint32_t ctrl;
+    uint32_t read_addr;
+    uint32_t write_addr;
+    uint32_t transfer_count;
+};
+
+/** \brief Where an idle output is in parking and waking (see audio_park_refill()) */
+enum audio_park_state {
+    AUDIO_PARK_RUNNING = 0, ///< Refills play buffers or silence
+    AUDIO_PARK_DRAINING,    ///< Ping-pong only: unchained, waiting for the other channel to finish
+    AUDIO_PARK_PARKED,      ///< DMA stopped, with a TX FIFO of silence (the kick) loaded but not triggered
+    AUDIO_PARK_WAKING,      ///< The kick has been triggered by a give
+};
+
+static uint32_t zero;
+
 audio_format_t pio_i2s_consumer_format;
 audio_buffer_format_t pio_i2s_consumer_buffer_format = {
         .format = &pio_i2s_consumer_format,
 };
 
 static audio_buffer_pool_t *audio_i2s_consumer;
-static void __isr __time_critical_func(audio_i2s_dma_irq_handler)();
+static void __isr __audio_i2s_isr_func(audio_i2s_dma_irq_handler)();
+static const audio_i2s_clock_user_t audio_i2s_clock_user;
+
+/** \brief Formats that are played through 32-bit slots */
+static inline bool audio_i2s_is_wide_format(uint16_t format) {
+    return format == AUDIO_BUFFER_FORMAT_PCM_S32 || format == AUDIO_BUFFER_FORMAT_PCM_S24;
+}
+
+/** \brief DMA transfers per frame: one for 16-bit slots (a packed stereo word, or a mono
+ *  halfword), two for 32-bit slots (one word per channel)
+ */
+static inline uint audio_dma_transfers_per_frame(void) {
+    return shared_state.slot_bits / 16u;
+}
+
+/** \brief Consumer buffers queued to the DMA at once in the configured DMA mode */
+static inline uint audio_dma_buffers_in_flight(void) {
+    switch (shared_state.dma_mode) {
+        case AUDIO_I2S_DMA_MODE_PING_PONG:
+            return 2;
+        case AUDIO_I2S_DMA_MODE_RING:
+            return 2u * shared_state.ring_irq_interval;
+        default:
+            return 1;
+    }
+}
+
+/** \brief Frames held past the DMA: the 4 entry TX FIFO plus the word in the OSR, rounded up */
+static inline uint audio_fifo_frames(void) {
+    uint transfers_per_frame = audio_dma_transfers_per_frame();
+    return (4u + 1u + transfers_per_frame - 1u) / transfers_per_frame;
+}
+
+/** \brief Work out the output latency of a connection with samples_per_buffer frames per consumer buffer
+ *
+ * Once playback resumes after an underrun, the silence runs already queued
+ * play out first, so a silence run longer than a buffer adds to the latency.
+ */
+static void audio_i2s_record_latency(uint32_t samples_per_buffer, uint32_t sample_freq) {
+    audio_i2s_latency_t *latency = &shared_state.latency;
+    latency->samples_per_buffer = samples_per_buffer;
+    latency->silence_frames = shared_state.silence_frames;
+    latency->buffers_in_flight = audio_dma_buffers_in_flight();
+    if (!samples_per_buffer) {
+        // zero-copy: the producer's buffers, which are only known as they are given, set the latency
+        latency->buffered_frames = 0;
+        latency->latency_us = 0;
+        return;
+    }
+    latency->buffered_frames = latency->buffers_in_flight * MAX(samples_per_buffer, shared_state.silence_frames) +
+                               audio_fifo_frames();
+    latency->latency_us = (uint32_t) (((uint64_t) latency->buffered_frames * 1000000u + sample_freq - 1u) /
+                                      sample_freq);
+}
+
+/** \brief Claim the ring control channel and precompute the descriptor ring
+ *
+ * Each descriptor reprograms the data channel completely (it also reprograms it
+ * into the reload block that rewinds the control channel), so the ring runs
+ * indefinitely without CPU intervention.
+ */
+static void audio_i2s_setup_ring(const audio_i2s_config_t *config, dma_channel_config *dma_config) {
+    uint8_t dma_channel = config->dma_channel;
+    uint8_t control_channel = config->dma_channel_b;
+    assert(control_channel != dma_channel);
+    dma_channel_claim(control_channel);
+    shared_state.dma_channel_b = control_channel;
+
+    uint interval = config->ring_irq_interval ? config->ring_irq_interval : PICO_AUDIO_I2S_RING_IRQ_INTERVAL;
+    shared_state.ring_irq_interval = (uint8_t) interval;
+    shared_state.ring = calloc(2 * interval + 1, sizeof(struct audio_i2s_dma_block));
+    shared_state.ring_buffers = calloc(2 * interval, sizeof(audio_buffer_t *));
+    if (!shared_state.ring || !shared_state.ring_buffers) {
+        panic("Failed to allocate I2S DMA descriptor ring");
+    }
+#if AUDIO_I2S_FADE_ENABLED
+    // a half is queued a whole half ahead, so each descriptor builds its ramp or held frame in its own storage
+    shared_state.ring_ramps = calloc(2 * interval * AUDIO_I2S_FADE_BUFFER_WORDS, sizeof(uint32_t));
+    if (!shared_state.ring_ramps) {
+        panic("Failed to allocate I2S DMA descriptor ring");
+    }
+    // word pairs must be 8-byte aligned for the hold's read ring
+    assert(!((uintptr_t) shared_state.ring_ramps & 7u));
+#endif
+
+    // the data channel hands over to the control channel at the end of every block
+    channel_config_set_chain_to(dma_config, control_channel);
+    for (uint read = 0; read < 3; read++) {
+        for (uint raise_irq = 0; raise_irq < 2; raise_irq++) {
+            dma_channel_config c = *dma_config;
+            audio_i2s_dma_config_set_read(&c, read);
+            channel_config_set_irq_quiet(&c, !raise_irq);
+            shared_state.ring_ctrl[read][raise_irq] = channel_config_get_ctrl_value(&c);
+        }
+    }
+
+    // the reload block copies the ring start address back into the control channel
+    static uint32_t ring_start;
+    ring_start = (uint32_t) (uintptr_t) shared_state.ring;
+    dma_channel_config c = dma_channel_get_default_config(dma_channel);
+    channel_config_set_read_increment(&c, false);
+    channel_config_set_dreq(&c, DREQ_FORCE);
+    channel_config_set_chain_to(&c, control_channel);
+    channel_config_set_irq_quiet(&c, true);
+    struct audio_i2s_dma_block *reload = &shared_state.ring[2 * interval];
+    reload->ctrl = channel_config_get_ctrl_value(&c);
+    reload->read_addr = (uint32_t) (uintptr_t) &ring_start;
+    reload->write_addr = (uint32_t) (uintptr_t) &dma_hw->ch[control_channel].read_addr;
+    reload->transfer_count = 1;
+
+    c = dma_channel_get_default_config(control_channel);
+    channel_config_set_read_increment(&c, true);
+    channel_config_set_write_increment(&c, true);
+    // wrap the writes around the 4 alias 1 registers
+    channel_config_set_ring(&c, true, 4);
+    dma_channel_configure(control_channel,
+                          &c,
+                          &dma_hw->ch[dma_channel].al1_ctrl,  // dest
+                          shared_state.ring, // src
+                          sizeof(struct audio_i2s_dma_block) / 4, // count
+                          false // trigger
+    );
+}
 
 const audio_format_t *audio_i2s_setup(const audio_format_t *intended_audio_format,
                                       const audio_i2s_config_t *config) {
+#if PICO_AUDIO_I2S_DMA_HIGH_PRIORITY
+    audio_i2s_set_dma_high_bus_priority(true);
+#endif
     uint func = GPIO_FUNC_PIOx;
     gpio_set_function(config->data_pin, func);
     gpio_set_function(config->clock_pin_base, func);
@@ -73,22 +259,62 @@ const audio_format_t *audio_i2s_setup(const audio_format_t *intended_audio_forma
     uint8_t sm = shared_state.pio_sm = config->pio_sm;
     pio_sm_claim(audio_pio, sm);
 
-    uint offset = pio_add_program(audio_pio, &audio_i2s_program);
-
-    audio_i2s_program_init(audio_pio, sm, offset, config->data_pin, config->clock_pin_base);
+    uint offset;
+    if (audio_i2s_is_wide_format(intended_audio_format->format)) {
+        // 24-bit samples are sent MSB-aligned in 32-bit slots, which every 24-bit DAC accepts
+        shared_state.slot_bits = 32;
+        shared_state.channel_count = 2;
+        offset = pio_add_program(audio_pio, &audio_i2s_slot_program);
+        audio_i2s_slot_program_init(audio_pio, sm, offset, config->data_pin, config->clock_pin_base,
+                                    shared_state.slot_bits);
+        shared_state.entry_pc = (uint8_t) (offset + audio_i2s_slot_offset_slot_entry_point);
+    } else {
+        shared_state.slot_bits = 16;
+        shared_state.channel_count = (config->mono_output || PICO_AUDIO_I2S_MONO_OUTPUT) ? 1 : 2;
+        offset = pio_add_program(audio_pio, &audio_i2s_program);
+        audio_i2s_program_init(audio_pio, sm, offset, config->data_pin, config->clock_pin_base);
+        shared_state.entry_pc = (uint8_t) (offset + audio_i2s_offset_entry_point);
+    }
 
     __mem_fence_release();
     uint8_t dma_channel = config->dma_channel;
     dma_channel_claim(dma_channel);
 
     shared_state.dma_channel = dma_channel;
+    shared_state.dma_mode = config->dma_mode;
+    shared_state.silence_frames = PICO_AUDIO_I2S_SILENCE_BUFFER_SAMPLE_LENGTH;
+    shared_state.latency.target_us = 0;
+    shared_state.idle_park_ms = PICO_AUDIO_I2S_IDLE_PARK_MS;
+    audio_i2s_output_process_init(&shared_state.process);
+    audio_i2s_stats_reset(&shared_state.stats);
 
     dma_channel_config dma_config = dma_channel_get_default_config(dma_channel);
 
     channel_config_set_dreq(&dma_config,
                             DREQ_PIOx_TX0 + sm
     );
-    channel_config_set_transfer_data_size(&dma_config, i2s_dma_configure_size);
+    channel_config_set_transfer_data_size(&dma_config, shared_state.slot_bits == 32 ? DMA_SIZE_32 :
+                                                       audio_i2s_s16_dma_size(shared_state.channel_count));
+    if (shared_state.dma_mode == AUDIO_I2S_DMA_MODE_PING_PONG) {
+        uint8_t dma_channel_b = config->dma_channel_b;
+        assert(dma_channel_b != dma_channel);
+        dma_channel_claim(dma_channel_b);
+        shared_state.dma_channel_b = dma_channel_b;
+
+        // each channel starts the other as it completes
+        channel_config_set_chain_to(&dma_config, dma_channel);
+        dma_channel_configure(dma_channel_b,
+                              &dma_config,
+                              &audio_pio->txf[sm],  // dest
+                              NULL, // src
+                              0, // count
+                              false // trigger
+        );
+        channel_config_set_chain_to(&dma_config, dma_channel_b);
+        dma_irqn_set_channel_enabled(PICO_AUDIO_I2S_DMA_IRQ, dma_channel_b, 1);
+    } else if (shared_state.dma_mode == AUDIO_I2S_DMA_MODE_RING) {
+        audio_i2s_setup_ring(config, &dma_config);
+    }
     dma_channel_configure(dma_channel,
                           &dma_config,
                           &audio_pio->txf[sm],  // dest
@@ -99,62 +325,207 @@ const audio_format_t *audio_i2s_setup(const audio_format_t *intended_audio_forma
 
     irq_add_shared_handler(DMA_IRQ_0 + PICO_AUDIO_I2S_DMA_IRQ, audio_i2s_dma_irq_handler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
     dma_irqn_set_channel_enabled(PICO_AUDIO_I2S_DMA_IRQ, dma_channel, 1);
+    audio_i2s_add_clock_user(&audio_i2s_clock_user);
     return intended_audio_format;
 }
 
+const audio_format_t *audio_i2s_setup_latency(const audio_format_t *intended_audio_format,
+                                              const audio_i2s_config_t *config, uint32_t target_latency_us) {
+    assert(target_latency_us);
+    audio_i2s_config_t latency_config = *config;
+    if (latency_config.dma_mode == AUDIO_I2S_DMA_MODE_SINGLE) {
+        // a single channel must be re-armed within the TX FIFO drain time, whereas
+        // ping-pong gives the IRQ a whole (small) buffer period; the caller names the
+        // partner channel, which audio_i2s_setup() claims
+        assert(config->dma_channel_b < NUM_DMA_CHANNELS && config->dma_channel_b != config->dma_channel);
+        latency_config.dma_mode = AUDIO_I2S_DMA_MODE_PING_PONG;
+        printf("Latency budget: ping-pong DMA on channels %d and %d\n", (int) config->dma_channel,
+               (int) config->dma_channel_b);
+    }
+    const audio_format_t *format = audio_i2s_setup(intended_audio_format, &latency_config);
+    shared_state.latency.target_us = target_latency_us;
+    return format;
+}
+
 static void update_pio_frequency_single(uint32_t sample_freq) {
-    update_pio_frequency(sample_freq, shared_state.pio_sm, &shared_state.freq);
+    audio_i2s_calc_clock_divider_frame_bits(sample_freq, 2u * shared_state.slot_bits, &shared_state.clock_divider);
+    uint32_t divider = shared_state.clock_divider.divider;
+    pio_sm_set_clkdiv_int_frac(audio_pio, shared_state.pio_sm, divider >> 8u, divider & 0xffu);
+    shared_state.freq = sample_freq;
+    shared_state.park_frames = (uint32_t) ((uint64_t) shared_state.idle_park_ms * sample_freq / 1000u);
 }
 
-static audio_buffer_t *wrap_consumer_take(audio_connection_t *connection, bool block) {
-    // support dynamic frequency shifting
-    if (connection->producer_pool->format->sample_freq != shared_state.freq) {
-        update_pio_frequency_single(connection->producer_pool->format->sample_freq);
-    }
-#if PICO_AUDIO_I2S_MONO_INPUT
-#if PICO_AUDIO_I2S_MONO_OUTPUT
-    return mono_to_mono_consumer_take(connection, block);
-#else
-    return mono_to_stereo_consumer_take(connection, block);
-#endif
-#else
-#if PICO_AUDIO_I2S_MONO_OUTPUT
-    unsupported;
+const audio_i2s_clock_divider_t *audio_i2s_get_clock_divider(void) {
+    return &shared_state.clock_divider;
+}
+
+const audio_i2s_stats_t *audio_i2s_get_stats(void) {
+    return &shared_state.stats;
+}
+
+void audio_i2s_reset_stats(void) {
+    audio_i2s_stats_reset(&shared_state.stats);
+}
+
+const audio_i2s_latency_t *audio_i2s_get_latency(void) {
+    return &shared_state.latency;
+}
+
+void audio_i2s_set_gain(int16_t gain) {
+    audio_i2s_output_process_set_gain(&shared_state.process, gain);
+}
+
+void audio_i2s_set_dc_blocker(uint dc_shift) {
+    audio_i2s_output_process_set_dc_blocker(&shared_state.process, dc_shift);
+}
+
+void audio_i2s_set_idle_park_ms(uint32_t idle_ms) {
+    shared_state.idle_park_ms = idle_ms;
+    shared_state.park_frames = (uint32_t) ((uint64_t) idle_ms * shared_state.freq / 1000u);
+}
+
+bool audio_i2s_is_parked(void) {
+    return shared_state.park_state == AUDIO_PARK_PARKED;
+}
+
+static uint32_t audio_i2s_clock_user_freq(uint *frame_bits) {
+    *frame_bits = 2u * shared_state.slot_bits;
+    return shared_state.freq;
+}
+
+static void audio_i2s_clock_user_retune(void) {
+    update_pio_frequency_single(shared_state.freq);
+}
+
+static const audio_i2s_clock_user_t audio_i2s_clock_user = {
+        .sample_freq = audio_i2s_clock_user_freq,
+        .retune = audio_i2s_clock_user_retune,
+};
+
+/** \brief Apply the dithered divider for the next frames frames (no-op unless PICO_AUDIO_I2S_CLOCK_DITHER) */
+static inline void audio_dither_clock(uint32_t frames) {
+#if PICO_AUDIO_I2S_CLOCK_DITHER
+    uint32_t divider = audio_i2s_clock_divider_dither(&shared_state.clock_divider, frames);
+    pio_sm_set_clkdiv_int_frac(audio_pio, shared_state.pio_sm, divider >> 8u, divider & 0xffu);
 #else
-    return stereo_to_stereo_consumer_take(connection, block);
-#endif
+    (void) frames;
 #endif
 }
 
+/** \brief Whether every buffer before the queued rate change's fence has been taken */
+static inline bool audio_rate_change_reached(void) {
+    const audio_i2s_converting_connection_t *cc = shared_state.converting;
+    return cc ? audio_i2s_rate_change_reached(cc) : audio_i2s_rate_change_fence_taken(&shared_state.rate_change);
+}
+
+/** \brief Step a queued rate change at a refill, writing the new divider when its time comes
+ *
+ * \return true if this refill plays the mute instead of taking a buffer
+ */
+static inline bool audio_rate_change_refill(void) {
+    audio_i2s_rate_change_t *rc = &shared_state.rate_change;
+    if (!rc->sample_freq && !rc->countdown) {
+        return false;
+    }
+    bool reached = audio_rate_change_reached();
+    // a ring is refilled a half at a time, so like ping-pong a block leaves the DMA two refills after it is queued
+    uint refills_in_flight = shared_state.dma_mode == AUDIO_I2S_DMA_MODE_SINGLE ? 1 : 2;
+    switch (audio_i2s_rate_change_refill(rc, reached, refills_in_flight)) {
+        case AUDIO_I2S_RATE_MUTE:
+            return true;
+        case AUDIO_I2S_RATE_SWITCH:
+            update_pio_frequency_single(rc->switch_freq);
+            break;
+        default:
+            break;
+    }
+    return false;
+}
+
+/** \brief Begin a queued rate change whose fence a ring half reaches part way through
+ *
+ * The change is only stepped once per half, so the blocks after the fence would
+ * otherwise each underrun. They play the mute instead, at least a frame each, and
+ * the divider is written once the half has played out.
+ *
+ * \param blocks_left Blocks of the half still to refill
+ * \return Frames of mute for each of those blocks, or 0 to keep taking buffers
+ */
+static inline uint32_t audio_ring_rate_change_mute(uint blocks_left) {
+    audio_i2s_rate_change_t *rc = &shared_state.rate_change;
+    if (!rc->sample_freq || rc->countdown) {
+        return 0;
+    }
+    if (!audio_i2s_rate_change_begin_within(rc, audio_rate_change_reached(), 2)) {
+        return 0;
+    }
+    return MAX((rc->mute_frames + blocks_left - 1u) / blocks_left, 1u);
+}
+
+/** \brief Whether the next refill would find a buffer to play */
+static inline bool audio_buffer_ready(void) {
+    const audio_i2s_converting_connection_t *cc = shared_state.converting;
+    if (cc) {
+        // the consumer buffer is filled on take, from the producer's
+        return cc->core.current_producer_buffer || cc->core.core.producer_pool->prepared_list;
+    }
+    return audio_i2s_consumer->prepared_list;
+}
+
+/** \brief Restart a parked output after a give, if it now has a buffer to play
+ *
+ * Only triggers the kick loaded by audio_park(); the refill that takes
+ * the buffer is done by the DMA IRQ as usual.
+ */
+static inline void audio_wake(void) {
+    // pairs with the barrier in audio_park(): either it sees the buffer or this sees PARKED
+    __dmb();
+    if (shared_state.park_state == AUDIO_PARK_PARKED && audio_buffer_ready()) {
+        shared_state.park_state = AUDIO_PARK_WAKING;
+        dma_channel_start(shared_state.dma_channel);
+    }
+}
+
+static void wrap_converting_producer_give(audio_connection_t *connection, audio_buffer_t *buffer) {
+    audio_i2s_converting_producer_give(connection, buffer);
+    audio_wake();
+}
+
 static void wrap_producer_give(audio_connection_t *connection, audio_buffer_t *buffer) {
-    // support dynamic frequency shifting
-    if (connection->producer_pool->format->sample_freq != shared_state.freq) {
-        update_pio_frequency_single(connection->producer_pool->format->sample_freq);
+    struct producer_pool_blocking_give_connection *pbc = (struct producer_pool_blocking_give_connection *) connection;
+    audio_i2s_rate_change_t *rc = &shared_state.rate_change;
+    // consumer buffers are filled here; the copy moves the fence past the one being filled
+    uint32_t sample_freq = connection->producer_pool->format->sample_freq;
+    if (audio_i2s_rate_change_check_give(rc, sample_freq)) {
+        audio_i2s_rate_change_queue(rc, sample_freq, PICO_AUDIO_I2S_RATE_CHANGE_MUTE_FRAMES);
     }
-#if PICO_AUDIO_I2S_MONO_INPUT
-#if PICO_AUDIO_I2S_MONO_OUTPUT
-    assert(false);
-//    return mono_to_mono_producer_give(connection, block);
-#else
-    assert(false);
-    //return mono_to_stereo_producer_give(connection, buffer);
-#endif
-#else
-#if PICO_AUDIO_I2S_MONO_OUTPUT
-    unsupported;
-#else
-    return stereo_to_stereo_producer_give(connection, buffer);
-#endif
-#endif
+    // only stereo to stereo is copied on give (checked on connect)
+    audio_i2s_rate_change_copy_give(pbc, rc, stereo_to_stereo_producer_give, buffer);
+    audio_wake();
 }
 
-static struct buffer_copying_on_consumer_take_connection m2s_audio_i2s_ct_connection = {
+static audio_i2s_converting_connection_t m2s_audio_i2s_ct_connection = {
         .core = {
-                .consumer_pool_take = wrap_consumer_take,
-                .consumer_pool_give = consumer_pool_give_buffer_default,
-                .producer_pool_take = producer_pool_take_buffer_default,
-                .producer_pool_give = producer_pool_give_buffer_default,
-        }
+                .core = {
+                        .consumer_pool_take = audio_i2s_converting_consumer_take,
+                        .consumer_pool_give = consumer_pool_give_buffer_default,
+                        .producer_pool_take = producer_pool_take_buffer_default,
+                        .producer_pool_give = wrap_converting_producer_give,
+                }
+        },
+        .rate_change = &shared_state.rate_change,
+};
+
+static audio_i2s_converting_connection_t m2s_audio_i2s_s32_connection = {
+        .core = {
+                .core = {
+                        .consumer_pool_take = audio_i2s_converting_consumer_take,
+                        .consumer_pool_give = consumer_pool_give_buffer_default,
+                        .producer_pool_take = producer_pool_take_buffer_default,
+                        .producer_pool_give = wrap_converting_producer_give,
+                }
+        },
+        .rate_change = &shared_state.rate_change,
 };
 
 static struct producer_pool_blocking_give_connection m2s_audio_i2s_pg_connection = {
@@ -166,8 +537,38 @@ static struct producer_pool_blocking_give_connection m2s_audio_i2s_pg_connection
         }
 };
 
+void audio_i2s_set_sample_freq(uint32_t sample_freq, uint32_t mute_frames) {
+    if (!audio_i2s_consumer) {
+        // the rate is set from the producer on connect
+        return;
+    }
+    if (audio_i2s_consumer->connection == &m2s_audio_i2s_pg_connection.core) {
+        // what the producer has given so far plays at the old rate
+        audio_i2s_rate_change_flush_give(&m2s_audio_i2s_pg_connection, &shared_state.rate_change);
+    }
+    audio_i2s_rate_change_queue(&shared_state.rate_change, sample_freq, mute_frames);
+}
+
+/** \brief Whether buffers in a producer format can be handed to the DMA unchanged */
+static bool audio_i2s_is_dma_format(const audio_format_t *format) {
+    if (shared_state.slot_bits == 32) {
+        return format->format == AUDIO_BUFFER_FORMAT_PCM_S32 && format->channel_count == 2;
+    }
+    return format->format == AUDIO_BUFFER_FORMAT_PCM_S16 && format->channel_count == shared_state.channel_count;
+}
+
 static void pass_thru_producer_give(audio_connection_t *connection, audio_buffer_t *buffer) {
+    // the DMA reads the producer's buffer directly, so it must be laid out exactly as a consumer buffer
+    assert(buffer->format->sample_stride == pio_i2s_consumer_buffer_format.sample_stride);
+    assert(!((uintptr_t) buffer->buffer->bytes & (pio_i2s_consumer_buffer_format.sample_stride >= 4 ? 3u : 1u)));
+    audio_i2s_rate_change_t *rc = &shared_state.rate_change;
+    uint32_t sample_freq = buffer->format->format->sample_freq;
+    if (audio_i2s_rate_change_check_give(rc, sample_freq)) {
+        audio_i2s_rate_change_queue(rc, sample_freq, PICO_AUDIO_I2S_RATE_CHANGE_MUTE_FRAMES);
+    }
+    rc->given++;
     queue_full_audio_buffer(connection->consumer_pool, buffer);
+    audio_wake();
 }
 
 static void pass_thru_consumer_give(audio_connection_t *connection, audio_buffer_t *buffer) {
@@ -191,178 +592,601 @@ bool audio_i2s_connect(audio_buffer_pool_t *producer) {
     return audio_i2s_connect_thru(producer, NULL);
 }
 
-bool audio_i2s_connect_extra(audio_buffer_pool_t *producer, bool buffer_on_give, uint buffer_count,
-                             uint samples_per_buffer, audio_connection_t *connection) {
+bool audio_i2s_connect_zero_copy(audio_buffer_pool_t *producer) {
+    if (!audio_i2s_is_dma_format(producer->format)) {
+        return false;
+    }
+    return audio_i2s_connect_extra(producer, false, 0, 0, NULL);
+}
+
+/** \brief Connect a producer, building the consumer pool in arena or, if arena is NULL, on the heap
+ *
+ * \param silence_frames Frames of silence played per refill on an underrun
+ */
+static bool audio_i2s_connect_pool(audio_buffer_pool_t *producer, bool buffer_on_give, uint buffer_count,
+                                   uint samples_per_buffer, audio_connection_t *connection,
+                                   uint32_t *arena, size_t arena_words, uint silence_frames) {
     printf("Connecting PIO I2S audio\n");
 
+    if (audio_i2s_consumer) {
+        audio_i2s_disconnect();
+    }
+
     // todo we need to pick a connection based on the frequency - e.g. 22050 can be more simply upsampled to 44100
-    assert(producer->format->format == AUDIO_BUFFER_FORMAT_PCM_S16);
-    pio_i2s_consumer_format.format = AUDIO_BUFFER_FORMAT_PCM_S16;
-    // todo we could do mono
+    bool wide = shared_state.slot_bits == 32;
     // todo we can't match exact, so we should return what we can do
     pio_i2s_consumer_format.sample_freq = producer->format->sample_freq;
-#if PICO_AUDIO_I2S_MONO_OUTPUT
-    pio_i2s_consumer_format.channel_count = 1;
-    pio_i2s_consumer_buffer_format.sample_stride = 2;
-#else
-    pio_i2s_consumer_format.channel_count = 2;
-    pio_i2s_consumer_buffer_format.sample_stride = 4;
-#endif
+    if (wide) {
+        // 32-bit slots are always stereo on the wire, one word per channel
+        pio_i2s_consumer_format.format = AUDIO_BUFFER_FORMAT_PCM_S32;
+        pio_i2s_consumer_format.channel_count = 2;
+        pio_i2s_consumer_buffer_format.sample_stride = 8;
+    } else {
+        // S8 is expanded to S16 on take
+        assert(producer->format->format == AUDIO_BUFFER_FORMAT_PCM_S16 ||
+               producer->format->format == AUDIO_BUFFER_FORMAT_PCM_S8);
+        pio_i2s_consumer_format.format = AUDIO_BUFFER_FORMAT_PCM_S16;
+        pio_i2s_consumer_format.channel_count = shared_state.channel_count;
+        pio_i2s_consumer_buffer_format.sample_stride = 2u * shared_state.channel_count;
+    }
 
-    audio_i2s_consumer = audio_new_consumer_pool(&pio_i2s_consumer_buffer_format, buffer_count, samples_per_buffer);
+    if (arena) {
+        audio_i2s_consumer = audio_i2s_new_consumer_pool_in_arena(&pio_i2s_consumer_buffer_format, buffer_count,
+                                                                  samples_per_buffer, arena, arena_words);
+    } else {
+        audio_i2s_consumer = audio_new_consumer_pool(&pio_i2s_consumer_buffer_format, buffer_count, samples_per_buffer);
+    }
 
     update_pio_frequency_single(producer->format->sample_freq);
+    audio_i2s_rate_change_reset(&shared_state.rate_change, producer->format->sample_freq);
+    shared_state.silence_frames = silence_frames;
+    audio_i2s_record_latency(buffer_count ? samples_per_buffer : 0, producer->format->sample_freq);
+    printf("PIO clock divider %d + %d/256 (%d ppm)\n", (int) (shared_state.clock_divider.divider >> 8u),
+           (int) (shared_state.clock_divider.divider & 0xffu), (int) shared_state.clock_divider.error_ppm);
 
     // todo cleanup threading
     __mem_fence_release();
 
-    if (!connection) {
-        if (producer->format->channel_count == 2) {
-#if PICO_AUDIO_I2S_MONO_INPUT
-            panic("need to merge channels down\n");
-#else
-#if PICO_AUDIO_I2S_MONO_OUTPUT
-            panic("trying to play stereo thru mono not yet supported");
-#else
-            printf("Copying stereo to stereo at %d Hz\n", (int) producer->format->sample_freq);
-#endif
-#endif
+    if (!connection && !buffer_count) {
+        if (!audio_i2s_is_dma_format(producer->format)) {
+            panic("zero-copy I2S connection needs producer buffers in the DMA format");
+        }
+        printf("Zero-copy %d channel(s) at %d Hz\n", (int) producer->format->channel_count,
+               (int) producer->format->sample_freq);
+        connection = &audio_i2s_pass_thru_connection.core;
+    } else if (!connection && wide) {
+        m2s_audio_i2s_s32_connection.convert = audio_i2s_s32_stereo_converter(producer->format);
+        m2s_audio_i2s_s32_connection.process = &shared_state.process;
+        m2s_audio_i2s_s32_connection.process_convert = audio_i2s_s32_stereo_processor(producer->format);
+        if (!m2s_audio_i2s_s32_connection.convert) {
+            panic("unsupported producer format for 32-bit I2S slots");
+        }
+        // conversion is only done on take
+        assert(!buffer_on_give);
+        printf("Converting %d channel(s) to 32-bit stereo at %d Hz\n", (int) producer->format->channel_count,
+               (int) producer->format->sample_freq);
+        connection = &m2s_audio_i2s_s32_connection.core.core;
+    } else if (!connection) {
+        printf("Converting %d to %d channel(s) at %d Hz\n", (int) producer->format->channel_count,
+               (int) shared_state.channel_count, (int) producer->format->sample_freq);
+        if (buffer_on_give) {
+            assert(producer->format->format == AUDIO_BUFFER_FORMAT_PCM_S16);
+            assert(producer->format->channel_count == 2 && shared_state.channel_count == 2);
+            connection = &m2s_audio_i2s_pg_connection.core;
         } else {
-#if PICO_AUDIO_I2S_MONO_OUTPUT
-            printf("Copying mono to mono at %d Hz\n", (int) producer->format->sample_freq);
-#else
-            printf("Converting mono to stereo at %d Hz\n", (int) producer->format->sample_freq);
-#endif
+            m2s_audio_i2s_ct_connection.convert = audio_i2s_s16_converter(producer->format,
+                                                                          pio_i2s_consumer_format.channel_count);
+            m2s_audio_i2s_ct_connection.process = &shared_state.process;
+            m2s_audio_i2s_ct_connection.process_convert = audio_i2s_s16_processor(producer->format,
+                                                                                  pio_i2s_consumer_format.channel_count);
+            if (!m2s_audio_i2s_ct_connection.convert) {
+                panic("unsupported producer format for I2S");
+            }
+            connection = &m2s_audio_i2s_ct_connection.core.core;
         }
-        if (!buffer_count)
-            connection = &audio_i2s_pass_thru_connection.core;
-        else
-            connection = buffer_on_give ? &m2s_audio_i2s_pg_connection.core : &m2s_audio_i2s_ct_connection.core;
     }
+    shared_state.converting = NULL;
+    if (connection == &m2s_audio_i2s_ct_connection.core.core) {
+        shared_state.converting = &m2s_audio_i2s_ct_connection;
+    } else if (connection == &m2s_audio_i2s_s32_connection.core.core) {
+        shared_state.converting = &m2s_audio_i2s_s32_connection;
+    }
+    // a custom connection's give doesn't call audio_wake(), so it must keep the DMA running
+    shared_state.parkable = shared_state.converting || connection == &m2s_audio_i2s_pg_connection.core ||
+                            connection == &audio_i2s_pass_thru_connection.core;
+    // the connections without a copy loop fence a rate change by consumer buffer
+    shared_state.rate_change.consumer_fence = connection == &m2s_audio_i2s_pg_connection.core ||
+                                              connection == &audio_i2s_pass_thru_connection.core;
+    // and each of them counts its buffers in the rate change, which gives the fill level
+    shared_state.rate_change.counted = shared_state.parkable;
     audio_complete_connection(connection, producer, audio_i2s_consumer);
     return true;
 }
 
-static struct buffer_copying_on_consumer_take_connection m2s_audio_i2s_connection_s8 = {
-        .core = {
-#if PICO_AUDIO_I2S_MONO_OUTPUT
-                .consumer_pool_take = mono_s8_to_mono_consumer_take,
-#else
-                .consumer_pool_take = mono_s8_to_stereo_consumer_take,
-#endif
-                .consumer_pool_give = consumer_pool_give_buffer_default,
-                .producer_pool_take = producer_pool_take_buffer_default,
-                .producer_pool_give = producer_pool_give_buffer_default,
-        }
-};
+bool audio_i2s_connect_extra(audio_buffer_pool_t *producer, bool buffer_on_give, uint buffer_count,
+                             uint samples_per_buffer, audio_connection_t *connection) {
+    return audio_i2s_connect_pool(producer, buffer_on_give, buffer_count, samples_per_buffer, connection, NULL, 0,
+                                  PICO_AUDIO_I2S_SILENCE_BUFFER_SAMPLE_LENGTH);
+}
 
-bool audio_i2s_connect_s8(audio_buffer_pool_t *producer) {
-    printf("Connecting PIO I2S audio (U8)\n");
+bool audio_i2s_connect_latency(audio_buffer_pool_t *producer) {
+    // set by audio_i2s_setup_latency()
+    assert(shared_state.latency.target_us);
+    uint buffers_in_flight = audio_dma_buffers_in_flight();
+    uint fifo_frames = audio_fifo_frames();
+    uint32_t budget_frames = (uint32_t) ((uint64_t) shared_state.latency.target_us *
+                                         producer->format->sample_freq / 1000000u);
+    uint32_t samples_per_buffer = budget_frames > fifo_frames ? (budget_frames - fifo_frames) / buffers_in_flight : 0;
+    samples_per_buffer = MAX(samples_per_buffer, PICO_AUDIO_I2S_MIN_BUFFER_FRAMES);
+    printf("Latency budget %d us: %d buffer(s) of %d frames\n", (int) shared_state.latency.target_us,
+           (int) buffers_in_flight, (int) samples_per_buffer);
+    // one spare consumer buffer so that a take never waits on the DMA giving one back;
+    // an underrun plays silence in runs of a buffer, so the latency is the same once it recovers
+    return audio_i2s_connect_pool(producer, false, buffers_in_flight + 1, samples_per_buffer, NULL, NULL, 0,
+                                  samples_per_buffer);
+}
 
-    // todo we need to pick a connection based on the frequency - e.g. 22050 can be more simply upsampled to 44100
-    assert(producer->format->format == AUDIO_BUFFER_FORMAT_PCM_S8);
-    pio_i2s_consumer_format.format = AUDIO_BUFFER_FORMAT_PCM_S16;
-    // todo we could do mono
-    // todo we can't match exact, so we should return what we can do
-    pio_i2s_consumer_format.sample_freq = producer->format->sample_freq;
-#if PICO_AUDIO_I2S_MONO_OUTPUT
-    pio_i2s_consumer_format.channel_count = 1;
-    pio_i2s_consumer_buffer_format.sample_stride = 2;
-#else
-    pio_i2s_consumer_format.channel_count = 2;
-    pio_i2s_consumer_buffer_format.sample_stride = 4;
-#endif
+bool audio_i2s_connect_arena(audio_buffer_pool_t *producer, bool buffer_on_give, uint buffer_count,
+                             uint samples_per_buffer, audio_connection_t *connection,
+                             uint32_t *arena, size_t arena_words) {
+    assert(arena);
+    return audio_i2s_connect_pool(producer, buffer_on_give, buffer_count, samples_per_buffer, connection,
+                                  arena, arena_words, PICO_AUDIO_I2S_SILENCE_BUFFER_SAMPLE_LENGTH);
+}
 
-    // we do this on take so should do it quickly...
-    uint samples_per_buffer = 256;
-    // todo with take we really only need 1 buffer
-    audio_i2s_consumer = audio_new_consumer_pool(&pio_i2s_consumer_buffer_format, 2, samples_per_buffer);
+void audio_i2s_disconnect(void) {
+    if (!audio_i2s_consumer) {
+        return;
+    }
+    printf("Disconnecting PIO I2S audio\n");
+    // returns the buffers the DMA was playing to the consumer pool
+    audio_i2s_set_enabled(false);
 
-    // todo we need a method to calculate this in clocks
-    uint32_t system_clock_frequency = clock_get_hz(clk_sys);
-//    uint32_t divider = system_clock_frequency * 256 / producer->format->sample_freq * 16 * 4;
-    uint32_t divider = system_clock_frequency * 4 / producer->format->sample_freq; // avoid arithmetic overflow
-    pio_sm_set_clkdiv_int_frac(audio_pio, shared_state.pio_sm, divider >> 8u, divider & 0xffu);
+    audio_connection_t *connection = audio_i2s_consumer->connection;
+    if (connection == &m2s_audio_i2s_ct_connection.core.core) {
+        audio_i2s_release_copying_connection(&m2s_audio_i2s_ct_connection.core);
+    } else if (connection == &m2s_audio_i2s_s32_connection.core.core) {
+        audio_i2s_release_copying_connection(&m2s_audio_i2s_s32_connection.core);
+    } else if (connection == &m2s_audio_i2s_pg_connection.core) {
+        // a consumer buffer, which goes away with the pool
+        m2s_audio_i2s_pg_connection.current_consumer_buffer = NULL;
+        m2s_audio_i2s_pg_connection.current_consumer_buffer_pos = 0;
+    }
+    audio_i2s_release_consumer_pool(audio_i2s_consumer);
+    // heap pools from audio_i2s_connect_extra() cannot be freed through pico_audio and are abandoned
+    audio_i2s_consumer = NULL;
+}
 
-    // todo cleanup threading
-    __mem_fence_release();
+bool audio_i2s_connect_s8(audio_buffer_pool_t *producer) {
+    printf("Connecting PIO I2S audio (S8)\n");
+    assert(producer->format->format == AUDIO_BUFFER_FORMAT_PCM_S8);
+    // conversion is done on take, so one buffer being played and one being filled is enough
+    return audio_i2s_connect_extra(producer, false, 2, 256, NULL);
+}
 
-    audio_connection_t *connection;
-    if (producer->format->channel_count == 2) {
-#if PICO_AUDIO_I2S_MONO_OUTPUT
-        panic("trying to play stereo thru mono not yet supported");
-#endif
-        // todo we should support pass thru option anyway
-        printf("TODO... not completing stereo audio connection properly!\n");
-        connection = &m2s_audio_i2s_connection_s8.core;
-    } else {
-#if PICO_AUDIO_I2S_MONO_OUTPUT
-        printf("Copying mono to mono at %d Hz\n", (int) producer->format->sample_freq);
+/** \brief Remember the silence source loaded on a channel, for the ramp down on disable
+ *
+ * \param source Read address from audio_i2s_fade_silence(), NULL for a buffer
+ */
+static inline void audio_note_silence_source(uint dma_channel, const void *source) {
+#if PICO_AUDIO_I2S_FADE_FRAMES
+    shared_state.silence_sources[dma_channel != shared_state.dma_channel] = source == &zero ? NULL : source;
 #else
-        printf("Converting mono to stereo at %d Hz\n", (int) producer->format->sample_freq);
+    (void) dma_channel;
+    (void) source;
 #endif
-        connection = &m2s_audio_i2s_connection_s8.core;
-    }
-    audio_complete_connection(connection, producer, audio_i2s_consumer);
-    return true;
 }
 
-static inline void audio_start_dma_transfer() {
-    assert(!shared_state.playing_buffer);
-    audio_buffer_t *ab = take_audio_buffer(audio_i2s_consumer, false);
+/** \brief Take the next consumer buffer (or silence) and program it into a DMA channel
+ *
+ * \param dma_channel Channel to program
+ * \param playing Slot tracking the buffer owned by that channel
+ * \param trigger true to start the transfer now, false to only load the channel
+ *                so that a chained channel starts it
+ */
+static inline void audio_program_dma_transfer(uint dma_channel, audio_buffer_t **playing, bool trigger) {
+    assert(!*playing);
+    bool mute = audio_rate_change_refill();
+    audio_buffer_t *ab = mute ? NULL : audio_i2s_rate_change_take(&shared_state.rate_change, &shared_state.stats,
+                                                                  audio_i2s_consumer);
 
-    shared_state.playing_buffer = ab;
-    if (!ab) {
+    *playing = ab;
+    const void *read_addr;
+    uint32_t frames;
+    uint read = AUDIO_I2S_DMA_READ_STEP;
+    if (mute) {
+        frames = shared_state.rate_change.mute_frames;
+        read_addr = audio_i2s_fade_silence(&shared_state.fade, &zero, &frames, &read);
+    } else if (!ab) {
         DEBUG_PINS_XOR(audio_timing, 1);
         DEBUG_PINS_XOR(audio_timing, 2);
         DEBUG_PINS_XOR(audio_timing, 1);
         //DEBUG_PINS_XOR(audio_timing, 2);
         // just play some silence
-        static uint32_t zero;
-        dma_channel_config c = dma_get_channel_config(shared_state.dma_channel);
-        channel_config_set_read_increment(&c, false);
-        dma_channel_set_config(shared_state.dma_channel, &c, false);
-        dma_channel_transfer_from_buffer_now(shared_state.dma_channel, &zero, PICO_AUDIO_I2S_SILENCE_BUFFER_SAMPLE_LENGTH);
-        return;
+        frames = audio_i2s_underrun_silence_frames(&shared_state.underrun_run, shared_state.silence_frames);
+        read_addr = audio_i2s_fade_silence(&shared_state.fade, &zero, &frames, &read);
+        audio_i2s_stats_silence(&shared_state.stats, frames);
+        shared_state.idle_frames += frames;
+    } else {
+        shared_state.underrun_run = 0;
+        shared_state.idle_frames = 0;
+        assert(ab->sample_count);
+        // todo better naming of format->format->format!!
+        if (shared_state.slot_bits == 32) {
+            assert(ab->format->format->format == AUDIO_BUFFER_FORMAT_PCM_S32);
+            assert(ab->format->format->channel_count == 2);
+            assert(ab->format->sample_stride == 8);
+        } else {
+            assert(ab->format->format->format == AUDIO_BUFFER_FORMAT_PCM_S16);
+            assert(ab->format->format->channel_count == shared_state.channel_count);
+            assert(ab->format->sample_stride == 2u * shared_state.channel_count);
+        }
+        audio_i2s_fade_buffer(&shared_state.fade, ab);
+        read_addr = ab->buffer->bytes;
+        frames = ab->sample_count;
     }
-    assert(ab->sample_count);
-    // todo better naming of format->format->format!!
-    assert(ab->format->format->format == AUDIO_BUFFER_FORMAT_PCM_S16);
-#if PICO_AUDIO_I2S_MONO_OUTPUT
-    assert(ab->format->format->channel_count == 1);
-    assert(ab->format->sample_stride == 2);
-#else
-    assert(ab->format->format->channel_count == 2);
-    assert(ab->format->sample_stride == 4);
+    audio_note_silence_source(dma_channel, ab ? NULL : read_addr);
+    uint32_t transfer_count = frames * audio_dma_transfers_per_frame();
+    audio_dither_clock(frames);
+    dma_channel_config c = dma_get_channel_config(dma_channel);
+    audio_i2s_dma_config_set_read(&c, read);
+    dma_channel_set_config(dma_channel, &c, false);
+    if (trigger) {
+        dma_channel_transfer_from_buffer_now(dma_channel, read_addr, transfer_count);
+    } else {
+        dma_channel_set_read_addr(dma_channel, read_addr, false);
+        dma_channel_set_trans_count(dma_channel, transfer_count, false);
+    }
+}
+
+static inline void audio_start_dma_transfer() {
+    audio_program_dma_transfer(shared_state.dma_channel, &shared_state.playing_buffer, true);
+}
+
+/** \brief Return a ring descriptor's buffer to the pool and load it with the next buffer (or silence)
+ *
+ * \param mute_frames Nonzero to load this many frames of rate change mute instead
+ */
+static inline void audio_ring_refill_block(uint slot, uint32_t mute_frames) {
+    audio_buffer_t **owned = &shared_state.ring_buffers[slot];
+    if (*owned) {
+        give_audio_buffer(audio_i2s_consumer, *owned);
+    }
+    audio_buffer_t *ab = mute_frames ? NULL : audio_i2s_rate_change_take(&shared_state.rate_change,
+                                                                         &shared_state.stats, audio_i2s_consumer);
+    *owned = ab;
+
+    struct audio_i2s_dma_block *block = &shared_state.ring[slot];
+#if AUDIO_I2S_FADE_ENABLED
+    shared_state.fade.ramp = &shared_state.ring_ramps[slot * AUDIO_I2S_FADE_BUFFER_WORDS];
 #endif
-    dma_channel_config c = dma_get_channel_config(shared_state.dma_channel);
-    channel_config_set_read_increment(&c, true);
-    dma_channel_set_config(shared_state.dma_channel, &c, false);
-    dma_channel_transfer_from_buffer_now(shared_state.dma_channel, ab->buffer->bytes, ab->sample_count);
+    bool raise_irq = (slot % shared_state.ring_irq_interval) == shared_state.ring_irq_interval - 1u;
+    uint read = AUDIO_I2S_DMA_READ_STEP;
+    block->write_addr = (uint32_t) (uintptr_t) &audio_pio->txf[shared_state.pio_sm];
+    if (mute_frames) {
+        block->read_addr = (uint32_t) (uintptr_t) audio_i2s_fade_silence(&shared_state.fade, &zero, &mute_frames, &read);
+        block->transfer_count = mute_frames * audio_dma_transfers_per_frame();
+    } else if (ab) {
+        shared_state.underrun_run = 0;
+        assert(ab->sample_count);
+        audio_i2s_fade_buffer(&shared_state.fade, ab);
+        block->read_addr = (uint32_t) (uintptr_t) ab->buffer->bytes;
+        block->transfer_count = ab->sample_count * audio_dma_transfers_per_frame();
+    } else {
+        DEBUG_PINS_XOR(audio_timing, 1);
+        DEBUG_PINS_XOR(audio_timing, 2);
+        DEBUG_PINS_XOR(audio_timing, 1);
+        // the ring is only refilled every ring_irq_interval blocks, so short runs also bring the next IRQ forward
+        uint32_t frames = audio_i2s_underrun_silence_frames(&shared_state.underrun_run, shared_state.silence_frames);
+        block->read_addr = (uint32_t) (uintptr_t) audio_i2s_fade_silence(&shared_state.fade, &zero, &frames, &read);
+        block->transfer_count = frames * audio_dma_transfers_per_frame();
+        audio_i2s_stats_silence(&shared_state.stats, frames);
+        shared_state.idle_frames += frames;
+    }
+    if (ab) {
+        shared_state.idle_frames = 0;
+    }
+    block->ctrl = shared_state.ring_ctrl[read][raise_irq];
+}
+
+/** \brief Enable or break the chaining between the two ping-pong channels
+ *
+ * A chained pair keeps re-triggering itself with stale addresses once the IRQ
+ * stops refilling it, so the chain is pointed back at each channel itself
+ * (which disables chaining) before the channels are aborted.
+ */
+static void audio_set_ping_pong_chained(bool chained) {
+    uint a = shared_state.dma_channel;
+    uint b = shared_state.dma_channel_b;
+    dma_channel_config c = dma_get_channel_config(a);
+    channel_config_set_chain_to(&c, chained ? b : a);
+    dma_channel_set_config(a, &c, false);
+    c = dma_get_channel_config(b);
+    channel_config_set_chain_to(&c, chained ? a : b);
+    dma_channel_set_config(b, &c, false);
+}
+
+/** \brief Load a FIFO of silence that audio_wake() triggers to restart the DMA, and park
+ *
+ * The state machine plays out its FIFO and stalls at a frame boundary with the
+ * clocks held. The kick fills the FIFO again, so the IRQ it raises has a FIFO's
+ * worth of frames to queue the buffer in.
+ */
+static void audio_park(uint dma_channel) {
+    // audio_wake() starts shared_state.dma_channel, so a ping-pong pair parks on that one
+    assert(dma_channel == shared_state.dma_channel);
+    uint32_t frames = audio_fifo_frames();
+    uint read;
+    const void *read_addr = audio_i2s_fade_silence(&shared_state.fade, &zero, &frames, &read);
+    audio_note_silence_source(dma_channel, read_addr);
+    dma_channel_config c = dma_get_channel_config(dma_channel);
+    audio_i2s_dma_config_set_read(&c, read);
+    dma_channel_set_config(dma_channel, &c, false);
+    dma_channel_set_read_addr(dma_channel, read_addr, false);
+    dma_channel_set_trans_count(dma_channel, frames * audio_dma_transfers_per_frame(), false);
+    shared_state.park_state = AUDIO_PARK_PARKED;
+    __dmb();
+    // a buffer given before PARKED was visible did not wake the output
+    audio_wake();
+}
+
+/** \brief Park, or come back from parking, instead of a refill (single and ping-pong DMA)
+ *
+ * Once idle_park_ms of underrun silence has been queued and there is still no
+ * buffer ready, a refill stops the DMA rather than queueing more silence. A
+ * ping-pong pair is unchained first and parks when its other channel finishes.
+ *
+ * \return true if the channel has been dealt with and must not be refilled
+ */
+static bool audio_park_refill(uint dma_channel, audio_buffer_t **playing) {
+    switch (shared_state.park_state) {
+        case AUDIO_PARK_RUNNING: {
+            const audio_i2s_rate_change_t *rc = &shared_state.rate_change;
+            if (!shared_state.park_frames || !shared_state.parkable ||
+                shared_state.idle_frames < shared_state.park_frames || rc->sample_freq || rc->countdown ||
+                audio_buffer_ready()) {
+                return false;
+            }
+            *playing = NULL;
+            if (shared_state.dma_mode == AUDIO_I2S_DMA_MODE_PING_PONG) {
+                // the other channel is still playing silence; it must not trigger this one again
+                audio_set_ping_pong_chained(false);
+                shared_state.park_state = AUDIO_PARK_DRAINING;
+                return true;
+            }
+            audio_park(dma_channel);
+            return true;
+        }
+        case AUDIO_PARK_DRAINING:
+            // both channels are idle now
+            *playing = NULL;
+            audio_park(shared_state.dma_channel);
+            return true;
+        default:
+            // the kick has played
+            shared_state.park_state = AUDIO_PARK_RUNNING;
+            // the state machine stalled waiting for it
+            audio_i2s_clear_tx_stalls(1u << shared_state.pio_sm);
+            if (shared_state.dma_mode == AUDIO_I2S_DMA_MODE_SINGLE) {
+                return false;
+            }
+            // requeue both channels and start again, as audio_i2s_set_enabled() does
+            audio_set_ping_pong_chained(true);
+            audio_program_dma_transfer(shared_state.dma_channel, &shared_state.playing_buffer, false);
+            audio_program_dma_transfer(shared_state.dma_channel_b, &shared_state.playing_buffer_b, false);
+            dma_channel_start(shared_state.dma_channel);
+            return true;
+    }
+}
+
+/** \brief Park, or come back from parking, instead of refilling a ring half
+ *
+ * When the output has idled, the first block of the finished half is loaded
+ * disabled, so the control channel stops at it once the other half has played;
+ * the IRQ that half raises parks the data channel on the kick. The kick's IRQ
+ * requeues the whole ring and restarts the control channel.
+ *
+ * \param first First descriptor of the half that has just finished
+ * \return true if the half has been dealt with and must not be refilled
+ */
+static bool audio_ring_park_refill(uint first) {
+    uint dma_channel = shared_state.dma_channel;
+    switch (shared_state.park_state) {
+        case AUDIO_PARK_RUNNING: {
+            const audio_i2s_rate_change_t *rc = &shared_state.rate_change;
+            if (!shared_state.park_frames || !shared_state.parkable ||
+                shared_state.idle_frames < shared_state.park_frames || rc->sample_freq || rc->countdown ||
+                audio_buffer_ready()) {
+                return false;
+            }
+            for (uint slot = first; slot < first + shared_state.ring_irq_interval; slot++) {
+                if (shared_state.ring_buffers[slot]) {
+                    give_audio_buffer(audio_i2s_consumer, shared_state.ring_buffers[slot]);
+                    shared_state.ring_buffers[slot] = NULL;
+                }
+            }
+            // a disabled channel ignores the trigger the control channel writes, and so never chains back to it
+            struct audio_i2s_dma_block *stop = &shared_state.ring[first];
+            stop->read_addr = (uint32_t) (uintptr_t) &zero;
+            stop->transfer_count = audio_dma_transfers_per_frame();
+            stop->ctrl = shared_state.ring_ctrl[AUDIO_I2S_DMA_READ_FIXED][0] & ~DMA_CH0_CTRL_TRIG_EN_BITS;
+            shared_state.park_state = AUDIO_PARK_DRAINING;
+            return true;
+        }
+        case AUDIO_PARK_DRAINING: {
+            // the other half has played; the control channel is loading the stop block
+            while (dma_channel_is_busy(shared_state.dma_channel_b)) {
+                tight_loop_contents();
+            }
+            // the kick raises the IRQ itself rather than chaining to the control channel
+            dma_channel_config c = {.ctrl = shared_state.ring_ctrl[AUDIO_I2S_DMA_READ_STEP][1]};
+            channel_config_set_chain_to(&c, dma_channel);
+            dma_channel_set_config(dma_channel, &c, false);
+            audio_park(dma_channel);
+            return true;
+        }
+        default:
+            // the kick has played
+            shared_state.park_state = AUDIO_PARK_RUNNING;
+            // the state machine stalled waiting for it
+            audio_i2s_clear_tx_stalls(1u << shared_state.pio_sm);
+            // requeue the whole ring and restart it, as audio_i2s_set_enabled() does
+            for (uint slot = 0; slot < 2u * shared_state.ring_irq_interval; slot++) {
+                audio_ring_refill_block(slot, 0);
+            }
+            shared_state.ring_next_refill = 0;
+            dma_channel_set_write_addr(shared_state.dma_channel_b, &dma_hw->ch[dma_channel].al1_ctrl, false);
+            dma_channel_set_read_addr(shared_state.dma_channel_b, shared_state.ring, true);
+            return true;
+    }
+}
+
+/** \brief Give back a finished ring half's buffers and refill its descriptors
+ *
+ * \param first First descriptor of the half
+ */
+static void audio_ring_refill_half(uint first) {
+    uint32_t transfers = 0;
+    // a mute fills the whole half, split between its blocks
+    uint32_t mute_frames = 0;
+    if (audio_rate_change_refill()) {
+        mute_frames = (shared_state.rate_change.mute_frames + shared_state.ring_irq_interval - 1u) /
+                      shared_state.ring_irq_interval;
+    }
+    for (uint slot = first; slot < first + shared_state.ring_irq_interval; slot++) {
+        if (!mute_frames) {
+            mute_frames = audio_ring_rate_change_mute(first + shared_state.ring_irq_interval - slot);
+        }
+        audio_ring_refill_block(slot, mute_frames);
+        transfers += shared_state.ring[slot].transfer_count;
+    }
+    audio_dither_clock(transfers / audio_dma_transfers_per_frame());
+    shared_state.ring_next_refill = (uint16_t) ((first + shared_state.ring_irq_interval) %
+                                                (2u * shared_state.ring_irq_interval));
+}
+
+static inline void audio_finish_dma_transfer(uint dma_channel, audio_buffer_t **playing, bool trigger) {
+    dma_irqn_acknowledge_channel(PICO_AUDIO_I2S_DMA_IRQ, dma_channel);
+    DEBUG_PINS_SET(audio_timing, 4);
+    // free the buffer we just finished
+    if (*playing) {
+        give_audio_buffer(audio_i2s_consumer, *playing);
+#ifndef NDEBUG
+        *playing = NULL;
+#endif
+    }
+    if (!audio_park_refill(dma_channel, playing)) {
+        audio_program_dma_transfer(dma_channel, playing, trigger);
+    }
+    DEBUG_PINS_CLR(audio_timing, 4);
 }
 
 // irq handler for DMA
-void __isr __time_critical_func(audio_i2s_dma_irq_handler)() {
+void __isr __audio_i2s_isr_func(audio_i2s_dma_irq_handler)() {
 #if PICO_AUDIO_I2S_NOOP
     assert(false);
 #else
     uint dma_channel = shared_state.dma_channel;
-    if (dma_irqn_get_channel_status(PICO_AUDIO_I2S_DMA_IRQ, dma_channel)) {
-        dma_irqn_acknowledge_channel(PICO_AUDIO_I2S_DMA_IRQ, dma_channel);
-        DEBUG_PINS_SET(audio_timing, 4);
-        // free the buffer we just finished
-        if (shared_state.playing_buffer) {
-            give_audio_buffer(audio_i2s_consumer, shared_state.playing_buffer);
-#ifndef NDEBUG
-            shared_state.playing_buffer = NULL;
-#endif
+    bool pending = dma_irqn_get_channel_status(PICO_AUDIO_I2S_DMA_IRQ, dma_channel);
+    if (shared_state.dma_mode == AUDIO_I2S_DMA_MODE_PING_PONG) {
+        pending |= dma_irqn_get_channel_status(PICO_AUDIO_I2S_DMA_IRQ, shared_state.dma_channel_b);
+    }
+    if (!pending) {
+        // the shared IRQ was raised for another output
+        return;
+    }
+    uint32_t start_cycles = audio_i2s_stats_cycles();
+    if (shared_state.dma_mode == AUDIO_I2S_DMA_MODE_PING_PONG) {
+        // the other channel is already playing; just queue the next buffer on the idle one
+        if (dma_irqn_get_channel_status(PICO_AUDIO_I2S_DMA_IRQ, dma_channel)) {
+            audio_finish_dma_transfer(dma_channel, &shared_state.playing_buffer, false);
+        }
+        dma_channel = shared_state.dma_channel_b;
+        if (dma_irqn_get_channel_status(PICO_AUDIO_I2S_DMA_IRQ, dma_channel)) {
+            audio_finish_dma_transfer(dma_channel, &shared_state.playing_buffer_b, false);
         }
-        audio_start_dma_transfer();
-        DEBUG_PINS_CLR(audio_timing, 4);
+    } else if (shared_state.dma_mode == AUDIO_I2S_DMA_MODE_RING) {
+        if (dma_irqn_get_channel_status(PICO_AUDIO_I2S_DMA_IRQ, dma_channel)) {
+            dma_irqn_acknowledge_channel(PICO_AUDIO_I2S_DMA_IRQ, dma_channel);
+            DEBUG_PINS_SET(audio_timing, 4);
+            // the control channel is already playing the other half of the ring
+            uint first = shared_state.ring_next_refill;
+            if (!audio_ring_park_refill(first)) {
+                audio_ring_refill_half(first);
+            }
+            DEBUG_PINS_CLR(audio_timing, 4);
+        }
+    } else if (dma_irqn_get_channel_status(PICO_AUDIO_I2S_DMA_IRQ, dma_channel)) {
+        audio_finish_dma_transfer(dma_channel, &shared_state.playing_buffer, true);
+    }
+    if (audio_i2s_take_tx_stall(shared_state.pio_sm)) {
+        audio_i2s_stats_tx_stall(&shared_state.stats);
     }
+    audio_i2s_stats_isr_done(&shared_state.stats, start_cycles);
 #endif
 }
 
+#if PICO_AUDIO_I2S_FADE_FRAMES
+/** \brief What the stopped data channel of a ring was reading: the block it stopped in
+ *
+ * Each block's ramp or held frame has its own storage, so the block is found from
+ * the read address alone.
+ *
+ * \param frames Set to the frames of the block
+ * \return The block's buffer frames or silence source, NULL if it was reading zeros
+ */
+static const void *audio_ring_source_at(uintptr_t read_addr, uint32_t *frames) {
+    uint32_t frame_bytes = shared_state.slot_bits == 32 ? 8u : 2u * shared_state.channel_count;
+    for (uint slot = 0; slot < 2u * shared_state.ring_irq_interval; slot++) {
+        const struct audio_i2s_dma_block *block = &shared_state.ring[slot];
+        uintptr_t start = block->read_addr;
+        uint32_t n = block->transfer_count / audio_dma_transfers_per_frame();
+        if (start != (uintptr_t) &zero && read_addr >= start && read_addr <= start + n * frame_bytes) {
+            *frames = n;
+            return (const void *) start;
+        }
+    }
+    *frames = 0;
+    return NULL;
+}
+
+/** \brief What the stopped channel dma_channel was reading, for a single channel or a ping-pong pair
+ *
+ * \param frames Set to the frames of the buffer, or of the ramp buffer for silence
+ * \return The buffer frames or silence source, NULL if it was reading zeros
+ */
+static const void *audio_channel_source(uint dma_channel, uint32_t *frames) {
+    uint index = dma_channel != shared_state.dma_channel;
+    const audio_buffer_t *ab = index ? shared_state.playing_buffer_b : shared_state.playing_buffer;
+    if (ab) {
+        *frames = ab->sample_count;
+        return ab->buffer->bytes;
+    }
+    *frames = AUDIO_I2S_FADE_BUFFER_FRAMES;
+    return shared_state.silence_sources[index];
+}
+
+/** \brief Ramp the output down from where the aborted data channel stopped, and let the TX FIFO drain
+ *
+ * Blocks for PICO_AUDIO_I2S_FADE_FRAMES frames plus the FIFO; the buffer must not
+ * have been given back yet.
+ */
+static void audio_fade_out(uint dma_channel) {
+    uintptr_t read_addr = dma_hw->ch[dma_channel].read_addr;
+    // the fade state follows the refills, which run ahead of the channel
+    uint32_t frames;
+    const void *source = shared_state.dma_mode == AUDIO_I2S_DMA_MODE_RING ? audio_ring_source_at(read_addr, &frames) :
+                                                                            audio_channel_source(dma_channel, &frames);
+    uint words = audio_i2s_fade_prepare_stop(&shared_state.fade, source, frames, (const void *) read_addr);
+    for (uint i = 0; i < words; i++) {
+        pio_sm_put_blocking(audio_pio, shared_state.pio_sm, audio_i2s_fade_stop_word(&shared_state.fade, i));
+    }
+    while (!pio_sm_is_tx_fifo_empty(audio_pio, shared_state.pio_sm)) {
+        tight_loop_contents();
+    }
+}
+#endif
+
 static bool audio_enabled;
 
 void audio_i2s_set_enabled(bool enabled) {
@@ -377,8 +1201,70 @@ void audio_i2s_set_enabled(bool enabled) {
         irq_set_enabled(DMA_IRQ_0 + PICO_AUDIO_I2S_DMA_IRQ, enabled);
 
         if (enabled) {
+            audio_i2s_fade_init(&shared_state.fade, shared_state.slot_bits, shared_state.channel_count);
+        }
+        shared_state.park_state = AUDIO_PARK_RUNNING;
+        shared_state.idle_frames = 0;
+        if (enabled && shared_state.dma_mode == AUDIO_I2S_DMA_MODE_PING_PONG) {
+            // queue both channels, then start the first; it chains to the second
+            audio_set_ping_pong_chained(true);
+            audio_program_dma_transfer(shared_state.dma_channel, &shared_state.playing_buffer, false);
+            audio_program_dma_transfer(shared_state.dma_channel_b, &shared_state.playing_buffer_b, false);
+            dma_channel_start(shared_state.dma_channel);
+        } else if (enabled && shared_state.dma_mode == AUDIO_I2S_DMA_MODE_RING) {
+            // queue the whole ring, then let the control channel load the first block
+            for (uint slot = 0; slot < 2u * shared_state.ring_irq_interval; slot++) {
+                audio_ring_refill_block(slot, 0);
+            }
+            shared_state.ring_next_refill = 0;
+            dma_channel_set_write_addr(shared_state.dma_channel_b, &dma_hw->ch[shared_state.dma_channel].al1_ctrl, false);
+            dma_channel_set_read_addr(shared_state.dma_channel_b, shared_state.ring, true);
+        } else if (enabled) {
             audio_start_dma_transfer();
         } else {
+#if PICO_AUDIO_I2S_FADE_FRAMES
+            // the channel that is playing, where the ramp starts from
+            uint fade_channel = shared_state.dma_channel;
+            if (shared_state.dma_mode == AUDIO_I2S_DMA_MODE_PING_PONG && dma_channel_is_busy(shared_state.dma_channel_b)) {
+                fade_channel = shared_state.dma_channel_b;
+            }
+#endif
+            if (shared_state.dma_mode == AUDIO_I2S_DMA_MODE_RING) {
+                // stop the control channel before and after the data channel, so it can't be re-triggered by a chain
+                dma_channel_abort(shared_state.dma_channel_b);
+                dma_channel_abort(shared_state.dma_channel);
+                dma_channel_abort(shared_state.dma_channel_b);
+            }
+            if (shared_state.dma_mode == AUDIO_I2S_DMA_MODE_PING_PONG) {
+                audio_set_ping_pong_chained(false);
+                dma_channel_abort(shared_state.dma_channel);
+                dma_channel_abort(shared_state.dma_channel_b);
+            }
+            if (shared_state.dma_mode == AUDIO_I2S_DMA_MODE_SINGLE) {
+                dma_channel_abort(shared_state.dma_channel);
+            }
+            // nothing may complete after a re-enable, or point into the buffers given back below
+            dma_irqn_acknowledge_channel(PICO_AUDIO_I2S_DMA_IRQ, shared_state.dma_channel);
+            if (shared_state.dma_mode == AUDIO_I2S_DMA_MODE_PING_PONG) {
+                dma_irqn_acknowledge_channel(PICO_AUDIO_I2S_DMA_IRQ, shared_state.dma_channel_b);
+            }
+#if PICO_AUDIO_I2S_FADE_FRAMES
+            audio_fade_out(fade_channel);
+#endif
+            if (shared_state.dma_mode == AUDIO_I2S_DMA_MODE_RING) {
+                for (uint slot = 0; slot < 2u * shared_state.ring_irq_interval; slot++) {
+                    if (shared_state.ring_buffers[slot]) {
+                        give_audio_buffer(audio_i2s_consumer, shared_state.ring_buffers[slot]);
+                        shared_state.ring_buffers[slot] = NULL;
+                    }
+                }
+            }
+            if (shared_state.dma_mode == AUDIO_I2S_DMA_MODE_PING_PONG) {
+                if (shared_state.playing_buffer_b) {
+                    give_audio_buffer(audio_i2s_consumer, shared_state.playing_buffer_b);
+                    shared_state.playing_buffer_b = NULL;
+                }
+            }
             // if there was a buffer in flight, it will not be freed by DMA IRQ, let's do it manually
             if (shared_state.playing_buffer) {
                 give_audio_buffer(audio_i2s_consumer, shared_state.playing_buffer);
@@ -386,7 +1272,22 @@ void audio_i2s_set_enabled(bool enabled) {
             }
         }
 
+        if (enabled) {
+            audio_i2s_clear_tx_stalls(1u << shared_state.pio_sm);
+        }
         pio_sm_set_enabled(audio_pio, shared_state.pio_sm, enabled);
+        if (!enabled) {
+            // drop the FIFO words and the half-shifted OSR, and go back to the start of a
+            // frame, so a 32-bit slot left over can't swap the channels after a re-enable
+            pio_sm_clear_fifos(audio_pio, shared_state.pio_sm);
+            pio_sm_restart(audio_pio, shared_state.pio_sm);
+            pio_sm_exec(audio_pio, shared_state.pio_sm, pio_encode_jmp(shared_state.entry_pc));
+        }
+        if (!enabled && shared_state.rate_change.countdown) {
+            // a switch that had begun is completed now, with the state machine stopped
+            shared_state.rate_change.countdown = 0;
+            update_pio_frequency_single(shared_state.rate_change.switch_freq);
+        }
 
         audio_enabled = enabled;
     }
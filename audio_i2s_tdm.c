@@ -0,0 +1,485 @@
+/*
+ * Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/** \file audio_i2s_tdm.c
+ *  \brief TDM output implementation
+ *
+ * Architecture:
+ * - One PIO state machine runs audio_tdm (or audio_tdm_pulse for a 1-bit FSYNC
+ *   pulse), generating BCLK and FSYNC on the side-set pins and shifting one slot
+ *   per FIFO word out of the data pin
+ * - One DMA channel feeds whole interleaved frames, re-armed from the DMA IRQ
+ *   after every buffer, as in the single DAC AUDIO_I2S_DMA_MODE_SINGLE
+ * - Producers in any other layout are copied into consumer buffers on take,
+ *   widened to the slot format and padded with silent slots
+ * - Sample rate changes are fenced after the producer buffers already given, as
+ *   for the single DAC output
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "include/pico/audio_i2s_tdm.h"
+#include "include/pico/audio_i2s_common.h"
+#include "audio_i2s.pio.h"
+#include "hardware/pio.h"
+#include "hardware/gpio.h"
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+
+/** \brief Global state for the TDM output */
+static struct {
+    audio_buffer_t *playing_buffer;  ///< Currently playing audio buffer (NULL if silence)
+    uint32_t freq;                   ///< Current configured sample frequency
+    uint16_t frame_bits;             ///< Bit clocks per frame (slot_count * slot_bits)
+    uint8_t pio_sm;                  ///< PIO state machine number in use
+    uint8_t dma_channel;             ///< DMA channel number in use
+    uint8_t slot_count;              ///< Slots per frame
+    uint8_t slot_bits;               ///< Bits per slot: 16, 24 or 32
+    uint8_t slot_bytes;              ///< Bytes per slot in consumer buffers: 2 (16-bit slots) or 4
+    uint8_t entry_pc;                ///< Program counter of the sync entry point the frame starts at
+    uint8_t producer_channels;       ///< Channels per producer frame (copying connection)
+    uint8_t producer_shift;          ///< Left shift from the producer format to the slot format (copying connection)
+    audio_i2s_clock_divider_t clock_divider; ///< PIO divider for freq
+    audio_i2s_stats_t stats;         ///< Playback statistics
+    uint32_t underrun_run;           ///< Next silence run of the current underrun (0 once a buffer plays)
+    audio_i2s_rate_change_t rate_change; ///< Queued rate change and its fence
+} tdm_state;
+
+static uint32_t zero;
+
+static audio_format_t tdm_consumer_format;
+static audio_buffer_format_t tdm_consumer_buffer_format = {
+        .format = &tdm_consumer_format,
+};
+
+static audio_buffer_pool_t *tdm_consumer;
+static void __isr __audio_i2s_isr_func(audio_i2s_dma_irq_handler_tdm)();
+
+static void update_pio_frequency_tdm(uint32_t sample_freq);
+
+static uint32_t tdm_clock_user_freq(uint *frame_bits) {
+    *frame_bits = tdm_state.frame_bits;
+    return tdm_state.freq;
+}
+
+static void tdm_clock_user_retune(void) {
+    update_pio_frequency_tdm(tdm_state.freq);
+}
+
+static const audio_i2s_clock_user_t tdm_clock_user = {
+        .sample_freq = tdm_clock_user_freq,
+        .retune = tdm_clock_user_retune,
+};
+
+const audio_format_t *audio_i2s_setup_tdm(const audio_format_t *intended_audio_format,
+                                          const audio_i2s_tdm_config_t *config) {
+#if PICO_AUDIO_I2S_DMA_HIGH_PRIORITY
+    audio_i2s_set_dma_high_bus_priority(true);
+#endif
+    uint slot_count = config->slot_count ? config->slot_count : intended_audio_format->channel_count;
+    uint slot_bits = config->slot_bits;
+    if (!slot_bits) {
+        slot_bits = intended_audio_format->format == AUDIO_BUFFER_FORMAT_PCM_S16 ? 16 : 32;
+    }
+    uint sync_bits = config->frame_sync_bits ? config->frame_sync_bits : 1;
+    if (slot_count < 2 || slot_count > PICO_AUDIO_I2S_TDM_MAX_SLOTS) {
+        panic("TDM slot count must be between 2 and %d", PICO_AUDIO_I2S_TDM_MAX_SLOTS);
+    }
+    if (slot_bits != 16 && slot_bits != 24 && slot_bits != 32) {
+        panic("TDM slots must be 16, 24 or 32 bits");
+    }
+    uint frame_bits = slot_count * slot_bits;
+    if (sync_bits + 2 > frame_bits || config->data_delay > 1) {
+        panic("unsupported TDM frame sync");
+    }
+
+    tdm_state.slot_count = (uint8_t) slot_count;
+    tdm_state.slot_bits = (uint8_t) slot_bits;
+    tdm_state.slot_bytes = slot_bits == 16 ? 2 : 4;
+    tdm_state.frame_bits = (uint16_t) frame_bits;
+
+    tdm_consumer_format.format = slot_bits == 16 ? AUDIO_BUFFER_FORMAT_PCM_S16 : AUDIO_BUFFER_FORMAT_PCM_S32;
+    tdm_consumer_format.sample_freq = intended_audio_format->sample_freq;
+    tdm_consumer_format.channel_count = (uint16_t) slot_count;
+    tdm_consumer_buffer_format.sample_stride = (uint16_t) (slot_count * tdm_state.slot_bytes);
+
+    uint func = GPIO_FUNC_PIOx;
+    gpio_set_function(config->data_pin, func);
+    gpio_set_function(config->clock_pin_base, func);
+    gpio_set_function(config->clock_pin_base + 1, func);
+
+    uint8_t sm = tdm_state.pio_sm = config->pio_sm;
+    pio_sm_claim(audio_pio, sm);
+
+    uint offset = pio_add_program(audio_pio, sync_bits == 1 ? &audio_tdm_pulse_program : &audio_tdm_program);
+    audio_tdm_program_init(audio_pio, sm, offset, config->data_pin, config->clock_pin_base,
+                           slot_bits, frame_bits, sync_bits, config->data_delay);
+    tdm_state.entry_pc = (uint8_t) audio_tdm_program_entry(offset, sync_bits, config->data_delay);
+
+    __mem_fence_release();
+    uint8_t dma_channel = config->dma_channel;
+    dma_channel_claim(dma_channel);
+    tdm_state.dma_channel = dma_channel;
+    audio_i2s_stats_reset(&tdm_state.stats);
+
+    dma_channel_config dma_config = dma_channel_get_default_config(dma_channel);
+    channel_config_set_dreq(&dma_config, DREQ_PIOx_TX0 + sm);
+    // a 16-bit write is replicated across the FIFO word, and the top half is shifted out
+    channel_config_set_transfer_data_size(&dma_config, slot_bits == 16 ? DMA_SIZE_16 : DMA_SIZE_32);
+    dma_channel_configure(dma_channel,
+                          &dma_config,
+                          &audio_pio->txf[sm],  // dest
+                          NULL, // src
+                          0, // count
+                          false // trigger
+    );
+
+    irq_add_shared_handler(DMA_IRQ_0 + PICO_AUDIO_I2S_DMA_IRQ, audio_i2s_dma_irq_handler_tdm,
+                           PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+    dma_irqn_set_channel_enabled(PICO_AUDIO_I2S_DMA_IRQ, dma_channel, 1);
+    audio_i2s_add_clock_user(&tdm_clock_user);
+    return &tdm_consumer_format;
+}
+
+static void update_pio_frequency_tdm(uint32_t sample_freq) {
+    audio_i2s_calc_clock_divider_frame_bits(sample_freq, tdm_state.frame_bits, &tdm_state.clock_divider);
+    uint32_t divider = tdm_state.clock_divider.divider;
+    pio_sm_set_clkdiv_int_frac(audio_pio, tdm_state.pio_sm, divider >> 8u, divider & 0xffu);
+    tdm_state.freq = sample_freq;
+}
+
+const audio_i2s_clock_divider_t *audio_i2s_get_clock_divider_tdm(void) {
+    return &tdm_state.clock_divider;
+}
+
+const audio_i2s_stats_t *audio_i2s_get_stats_tdm(void) {
+    return &tdm_state.stats;
+}
+
+void audio_i2s_reset_stats_tdm(void) {
+    audio_i2s_stats_reset(&tdm_state.stats);
+}
+
+/** \brief Copy frames that are already in the slot layout */
+static void __audio_i2s_isr_func(tdm_copy_frames)(void *output, const void *input, uint sample_count) {
+    memcpy(output, input, sample_count * tdm_consumer_buffer_format.sample_stride);
+}
+
+/** \brief Put producer channel n in slot n, MSB-aligned to the slot format, and silence the spare slots */
+static void __audio_i2s_isr_func(tdm_expand_frames)(void *output, const void *input, uint sample_count) {
+    uint channels = tdm_state.producer_channels;
+    uint spare = tdm_state.slot_count - channels;
+    if (tdm_state.slot_bytes == 2) {
+        int16_t *out = (int16_t *) output;
+        const int16_t *in = (const int16_t *) input;
+        for (uint i = 0; i < sample_count; i++) {
+            for (uint c = 0; c < channels; c++) {
+                *out++ = *in++;
+            }
+            for (uint c = 0; c < spare; c++) {
+                *out++ = 0;
+            }
+        }
+    } else if (tdm_state.producer_shift == 16) {
+        int32_t *out = (int32_t *) output;
+        const int16_t *in = (const int16_t *) input;
+        for (uint i = 0; i < sample_count; i++) {
+            for (uint c = 0; c < channels; c++) {
+                *out++ = (int32_t) ((uint32_t) *in++ << 16);
+            }
+            for (uint c = 0; c < spare; c++) {
+                *out++ = 0;
+            }
+        }
+    } else {
+        uint shift = tdm_state.producer_shift;
+        int32_t *out = (int32_t *) output;
+        const int32_t *in = (const int32_t *) input;
+        for (uint i = 0; i < sample_count; i++) {
+            for (uint c = 0; c < channels; c++) {
+                *out++ = (int32_t) ((uint32_t) *in++ << shift);
+            }
+            for (uint c = 0; c < spare; c++) {
+                *out++ = 0;
+            }
+        }
+    }
+}
+
+/** \brief Pick the converter into consumer frames, or NULL if the producer format cannot be sent */
+static audio_i2s_sample_converter_t tdm_converter(const audio_format_t *format) {
+    if (!format->channel_count || format->channel_count > tdm_state.slot_count) {
+        return NULL;
+    }
+    if (tdm_state.slot_bytes == 2 && format->format != AUDIO_BUFFER_FORMAT_PCM_S16) {
+        return NULL;
+    }
+    switch (format->format) {
+        case AUDIO_BUFFER_FORMAT_PCM_S16:
+            tdm_state.producer_shift = tdm_state.slot_bytes == 2 ? 0 : 16;
+            break;
+        case AUDIO_BUFFER_FORMAT_PCM_S24:
+            tdm_state.producer_shift = 8;
+            break;
+        case AUDIO_BUFFER_FORMAT_PCM_S32:
+            tdm_state.producer_shift = 0;
+            break;
+        default:
+            return NULL;
+    }
+    tdm_state.producer_channels = (uint8_t) format->channel_count;
+    if (format->format == tdm_consumer_format.format && format->channel_count == tdm_state.slot_count) {
+        return tdm_copy_frames;
+    }
+    return tdm_expand_frames;
+}
+
+static audio_i2s_converting_connection_t tdm_copying_connection = {
+        .core = {
+                .core = {
+                        .consumer_pool_take = audio_i2s_converting_consumer_take,
+                        .consumer_pool_give = consumer_pool_give_buffer_default,
+                        .producer_pool_take = producer_pool_take_buffer_default,
+                        .producer_pool_give = audio_i2s_converting_producer_give,
+                }
+        },
+        .rate_change = &tdm_state.rate_change,
+};
+
+void audio_i2s_set_sample_freq_tdm(uint32_t sample_freq, uint32_t mute_frames) {
+    if (!tdm_consumer) {
+        // the rate is set from the producer on connect
+        return;
+    }
+    audio_i2s_rate_change_queue(&tdm_state.rate_change, sample_freq, mute_frames);
+}
+
+/** \brief Step a queued rate change at a refill, writing the new divider when its time comes
+ *
+ * \return true if this refill plays the mute instead of taking a buffer
+ */
+static inline bool tdm_rate_change_refill(void) {
+    audio_i2s_rate_change_t *rc = &tdm_state.rate_change;
+    if (!rc->sample_freq && !rc->countdown) {
+        return false;
+    }
+    bool reached = tdm_consumer->connection == &tdm_copying_connection.core.core ?
+                   audio_i2s_rate_change_reached(&tdm_copying_connection) : audio_i2s_rate_change_fence_taken(rc);
+    switch (audio_i2s_rate_change_refill(rc, reached, 1)) {
+        case AUDIO_I2S_RATE_MUTE:
+            return true;
+        case AUDIO_I2S_RATE_SWITCH:
+            update_pio_frequency_tdm(rc->switch_freq);
+            break;
+        default:
+            break;
+    }
+    return false;
+}
+
+/** \brief Whether buffers in a producer format can be handed to the DMA unchanged */
+static bool tdm_is_dma_format(const audio_format_t *format) {
+    return format->format == tdm_consumer_format.format && format->channel_count == tdm_state.slot_count;
+}
+
+static void tdm_pass_thru_producer_give(audio_connection_t *connection, audio_buffer_t *buffer) {
+    // the DMA reads the producer's buffer directly, so it must be laid out exactly as a consumer buffer
+    assert(buffer->format->sample_stride == tdm_consumer_buffer_format.sample_stride);
+    assert(!((uintptr_t) buffer->buffer->bytes & (tdm_state.slot_bytes - 1u)));
+    audio_i2s_rate_change_t *rc = &tdm_state.rate_change;
+    uint32_t sample_freq = buffer->format->format->sample_freq;
+    if (audio_i2s_rate_change_check_give(rc, sample_freq)) {
+        audio_i2s_rate_change_queue(rc, sample_freq, PICO_AUDIO_I2S_RATE_CHANGE_MUTE_FRAMES);
+    }
+    rc->given++;
+    queue_full_audio_buffer(connection->consumer_pool, buffer);
+}
+
+static void tdm_pass_thru_consumer_give(audio_connection_t *connection, audio_buffer_t *buffer) {
+    queue_free_audio_buffer(connection->producer_pool, buffer);
+}
+
+static struct producer_pool_blocking_give_connection tdm_pass_thru_connection = {
+        .core = {
+                .consumer_pool_take = consumer_pool_take_buffer_default,
+                .consumer_pool_give = tdm_pass_thru_consumer_give,
+                .producer_pool_take = producer_pool_take_buffer_default,
+                .producer_pool_give = tdm_pass_thru_producer_give,
+        }
+};
+
+bool audio_i2s_connect_tdm(audio_buffer_pool_t *producer) {
+    return audio_i2s_connect_tdm_extra(producer, 2, 256, NULL);
+}
+
+bool audio_i2s_connect_tdm_extra(audio_buffer_pool_t *producer, uint buffer_count, uint samples_per_buffer,
+                                 audio_connection_t *connection) {
+    printf("Connecting PIO TDM audio\n");
+
+    if (tdm_consumer) {
+        audio_i2s_disconnect_tdm();
+    }
+
+    audio_i2s_sample_converter_t convert = NULL;
+    if (!connection && !buffer_count) {
+        if (!tdm_is_dma_format(producer->format)) {
+            return false;
+        }
+    } else if (!connection) {
+        convert = tdm_converter(producer->format);
+        if (!convert) {
+            return false;
+        }
+    }
+
+    tdm_consumer_format.sample_freq = producer->format->sample_freq;
+    tdm_consumer = audio_new_consumer_pool(&tdm_consumer_buffer_format, buffer_count, samples_per_buffer);
+
+    update_pio_frequency_tdm(producer->format->sample_freq);
+    audio_i2s_rate_change_reset(&tdm_state.rate_change, producer->format->sample_freq);
+    printf("PIO clock divider %d + %d/256 (%d ppm)\n", (int) (tdm_state.clock_divider.divider >> 8u),
+           (int) (tdm_state.clock_divider.divider & 0xffu), (int) tdm_state.clock_divider.error_ppm);
+
+    __mem_fence_release();
+
+    if (!connection && !buffer_count) {
+        printf("Zero-copy %d channel(s) at %d Hz\n", (int) producer->format->channel_count,
+               (int) producer->format->sample_freq);
+        connection = &tdm_pass_thru_connection.core;
+    } else if (!connection) {
+        printf("Converting %d channel(s) to %d %d-bit slots at %d Hz\n", (int) producer->format->channel_count,
+               (int) tdm_state.slot_count, (int) tdm_state.slot_bits, (int) producer->format->sample_freq);
+        tdm_copying_connection.convert = convert;
+        connection = &tdm_copying_connection.core.core;
+    }
+    // the zero-copy connection fences a rate change by consumer buffer
+    tdm_state.rate_change.consumer_fence = connection == &tdm_pass_thru_connection.core;
+    // both connections count their buffers in the rate change, which gives the fill level
+    tdm_state.rate_change.counted = tdm_state.rate_change.consumer_fence ||
+                                    connection == &tdm_copying_connection.core.core;
+    audio_complete_connection(connection, producer, tdm_consumer);
+    return true;
+}
+
+void audio_i2s_disconnect_tdm(void) {
+    if (!tdm_consumer) {
+        return;
+    }
+    printf("Disconnecting PIO TDM audio\n");
+    // returns the buffer the DMA was playing to the consumer pool
+    audio_i2s_set_enabled_tdm(false);
+
+    if (tdm_consumer->connection == &tdm_copying_connection.core.core) {
+        audio_i2s_release_copying_connection(&tdm_copying_connection.core);
+    }
+    audio_i2s_release_consumer_pool(tdm_consumer);
+    // heap pools cannot be freed through pico_audio and are abandoned
+    tdm_consumer = NULL;
+}
+
+/** \brief Take the next consumer buffer (or silence) and start it on the DMA channel */
+static inline void tdm_start_dma_transfer(void) {
+    assert(!tdm_state.playing_buffer);
+    bool mute = tdm_rate_change_refill();
+    audio_buffer_t *ab = mute ? NULL : audio_i2s_rate_change_take(&tdm_state.rate_change, &tdm_state.stats,
+                                                                  tdm_consumer);
+
+    tdm_state.playing_buffer = ab;
+    const void *read_addr;
+    uint32_t frames;
+    if (mute) {
+        read_addr = &zero;
+        frames = tdm_state.rate_change.mute_frames;
+    } else if (!ab) {
+        // just play some silence
+        read_addr = &zero;
+        frames = audio_i2s_underrun_silence_frames(&tdm_state.underrun_run, PICO_AUDIO_I2S_SILENCE_BUFFER_SAMPLE_LENGTH);
+        audio_i2s_stats_silence(&tdm_state.stats, frames);
+    } else {
+        tdm_state.underrun_run = 0;
+        assert(ab->sample_count);
+        assert(ab->format->format->format == tdm_consumer_format.format);
+        assert(ab->format->format->channel_count == tdm_state.slot_count);
+        assert(ab->format->sample_stride == tdm_consumer_buffer_format.sample_stride);
+        read_addr = ab->buffer->bytes;
+        frames = ab->sample_count;
+    }
+#if PICO_AUDIO_I2S_CLOCK_DITHER
+    uint32_t divider = audio_i2s_clock_divider_dither(&tdm_state.clock_divider, frames);
+    pio_sm_set_clkdiv_int_frac(audio_pio, tdm_state.pio_sm, divider >> 8u, divider & 0xffu);
+#endif
+    uint dma_channel = tdm_state.dma_channel;
+    dma_channel_config c = dma_get_channel_config(dma_channel);
+    channel_config_set_read_increment(&c, ab != NULL);
+    dma_channel_set_config(dma_channel, &c, false);
+    dma_channel_transfer_from_buffer_now(dma_channel, read_addr, frames * tdm_state.slot_count);
+}
+
+// irq handler for DMA
+void __isr __audio_i2s_isr_func(audio_i2s_dma_irq_handler_tdm)() {
+#if PICO_AUDIO_I2S_NOOP
+    assert(false);
+#else
+    uint dma_channel = tdm_state.dma_channel;
+    if (!dma_irqn_get_channel_status(PICO_AUDIO_I2S_DMA_IRQ, dma_channel)) {
+        // the shared IRQ was raised for another output
+        return;
+    }
+    uint32_t start_cycles = audio_i2s_stats_cycles();
+    dma_irqn_acknowledge_channel(PICO_AUDIO_I2S_DMA_IRQ, dma_channel);
+    // free the buffer we just finished
+    if (tdm_state.playing_buffer) {
+        give_audio_buffer(tdm_consumer, tdm_state.playing_buffer);
+        tdm_state.playing_buffer = NULL;
+    }
+    tdm_start_dma_transfer();
+    if (audio_i2s_take_tx_stall(tdm_state.pio_sm)) {
+        audio_i2s_stats_tx_stall(&tdm_state.stats);
+    }
+    audio_i2s_stats_isr_done(&tdm_state.stats, start_cycles);
+#endif
+}
+
+static bool tdm_enabled;
+
+void audio_i2s_set_enabled_tdm(bool enabled) {
+    if (enabled != tdm_enabled) {
+        uint dma_channel = tdm_state.dma_channel;
+        if (enabled) {
+            dma_irqn_set_channel_enabled(PICO_AUDIO_I2S_DMA_IRQ, dma_channel, true);
+            irq_set_enabled(DMA_IRQ_0 + PICO_AUDIO_I2S_DMA_IRQ, true);
+            tdm_start_dma_transfer();
+            audio_i2s_clear_tx_stalls(1u << tdm_state.pio_sm);
+        } else {
+            // the IRQ may be shared with another output, so only this channel is masked
+            dma_irqn_set_channel_enabled(PICO_AUDIO_I2S_DMA_IRQ, dma_channel, false);
+            dma_channel_abort(dma_channel);
+            dma_irqn_acknowledge_channel(PICO_AUDIO_I2S_DMA_IRQ, dma_channel);
+            // if there was a buffer in flight, it will not be freed by DMA IRQ, let's do it manually
+            if (tdm_state.playing_buffer) {
+                give_audio_buffer(tdm_consumer, tdm_state.playing_buffer);
+                tdm_state.playing_buffer = NULL;
+            }
+        }
+        pio_sm_set_enabled(audio_pio, tdm_state.pio_sm, enabled);
+        if (!enabled) {
+            // the FIFO holds one word per slot: drop the leftovers and the half-shifted OSR and
+            // go back to the start of a frame, or every channel would play N slots late
+            pio_sm_clear_fifos(audio_pio, tdm_state.pio_sm);
+            pio_sm_restart(audio_pio, tdm_state.pio_sm);
+            pio_sm_exec(audio_pio, tdm_state.pio_sm, pio_encode_out(pio_null, 32));
+            pio_sm_exec(audio_pio, tdm_state.pio_sm, pio_encode_jmp(tdm_state.entry_pc));
+        }
+        if (!enabled && tdm_state.rate_change.countdown) {
+            // a switch that had begun is completed now, with the state machine stopped
+            tdm_state.rate_change.countdown = 0;
+            update_pio_frequency_tdm(tdm_state.rate_change.switch_freq);
+        }
+
+        tdm_enabled = enabled;
+    }
+}
@@ -0,0 +1,32 @@
+/*
+ * Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _HARDWARE_ADDRESS_MAPPED_H
+#define _HARDWARE_ADDRESS_MAPPED_H
+
+#include "pico.h"
+
+/** \file hardware/address_mapped.h
+ *  \brief Register bit helpers of the host build
+ *
+ * There are no atomic set/clear aliases on the host, so these are plain
+ * read-modify-writes; only registers the simulation does not act on (such as
+ * the bus priority) are written this way.
+ */
+
+static inline void hw_set_bits(io_rw_32 *addr, uint32_t mask) {
+    *addr |= mask;
+}
+
+static inline void hw_clear_bits(io_rw_32 *addr, uint32_t mask) {
+    *addr &= ~mask;
+}
+
+static inline void hw_write_masked(io_rw_32 *addr, uint32_t values, uint32_t write_mask) {
+    *addr = (*addr & ~write_mask) | (values & write_mask);
+}
+
+#endif
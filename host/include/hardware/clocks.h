@@ -0,0 +1,43 @@
+/*
+ * Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _HARDWARE_CLOCKS_H
+#define _HARDWARE_CLOCKS_H
+
+#include "pico.h"
+
+/** \file hardware/clocks.h
+ *  \brief Clocks of the host build
+ *
+ * clk_sys is the simulation clock (150 MHz unless a test sets it); the
+ * emulated PIO and DMA take one step per clk_sys cycle.
+ */
+
+enum clock_num_rp2350 {
+    clk_gpout0 = 0,
+    clk_gpout1 = 1,
+    clk_gpout2 = 2,
+    clk_gpout3 = 3,
+    clk_ref = 4,
+    clk_sys = 5,
+    clk_peri = 6,
+    clk_hstx = 7,
+    clk_usb = 8,
+    clk_adc = 9,
+    CLK_COUNT
+};
+
+typedef enum clock_num_rp2350 clock_handle_t;
+
+uint32_t clock_get_hz(clock_handle_t clock);
+
+/** \brief Work out the PLL settings for a system clock, as the pico-sdk does for a 12 MHz crystal */
+bool check_sys_clock_khz(uint32_t freq_khz, uint *vco_freq_out, uint *post_div1_out, uint *post_div2_out);
+
+/** \brief Switch clk_sys, panicking if required and the PLL can't make freq_khz */
+bool set_sys_clock_khz(uint32_t freq_khz, bool required);
+
+#endif
@@ -0,0 +1,264 @@
+/*
+ * Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _HARDWARE_DMA_H
+#define _HARDWARE_DMA_H
+
+#include "pico.h"
+#include "hardware/address_mapped.h"
+
+/** \file hardware/dma.h
+ *  \brief DMA API of the host build, backed by the DMA emulation in host/src/dma.c
+ *
+ * The channel functions act on the emulated channels. Code may read the
+ * channel registers (READ_ADDR, WRITE_ADDR, TRANS_COUNT and CTRL and their
+ * aliases) and the interrupt registers directly, and write INTSn to
+ * acknowledge interrupts. A DMA transfer may write the channel registers, as a
+ * control channel does, and the PIO FIFOs; every other address is host memory.
+ */
+
+#define DMA_CH0_CTRL_TRIG_EN_BITS 0x00000001u
+#define DMA_CH0_CTRL_TRIG_HIGH_PRIORITY_BITS 0x00000002u
+#define DMA_CH0_CTRL_TRIG_DATA_SIZE_LSB 2u
+#define DMA_CH0_CTRL_TRIG_DATA_SIZE_BITS 0x0000000cu
+#define DMA_CH0_CTRL_TRIG_INCR_READ_BITS 0x00000010u
+#define DMA_CH0_CTRL_TRIG_INCR_READ_REV_BITS 0x00000020u
+#define DMA_CH0_CTRL_TRIG_INCR_WRITE_BITS 0x00000040u
+#define DMA_CH0_CTRL_TRIG_INCR_WRITE_REV_BITS 0x00000080u
+#define DMA_CH0_CTRL_TRIG_RING_SIZE_LSB 8u
+#define DMA_CH0_CTRL_TRIG_RING_SIZE_BITS 0x00000f00u
+#define DMA_CH0_CTRL_TRIG_RING_SEL_BITS 0x00001000u
+#define DMA_CH0_CTRL_TRIG_CHAIN_TO_LSB 13u
+#define DMA_CH0_CTRL_TRIG_CHAIN_TO_BITS 0x0001e000u
+#define DMA_CH0_CTRL_TRIG_TREQ_SEL_LSB 17u
+#define DMA_CH0_CTRL_TRIG_TREQ_SEL_BITS 0x007e0000u
+#define DMA_CH0_CTRL_TRIG_IRQ_QUIET_BITS 0x00800000u
+#define DMA_CH0_CTRL_TRIG_BSWAP_BITS 0x01000000u
+#define DMA_CH0_CTRL_TRIG_SNIFF_EN_BITS 0x02000000u
+#define DMA_CH0_CTRL_TRIG_BUSY_BITS 0x04000000u
+
+#define DMA_CH0_TRANS_COUNT_COUNT_BITS 0x0fffffffu
+
+enum dma_channel_transfer_size {
+    DMA_SIZE_8 = 0,
+    DMA_SIZE_16 = 1,
+    DMA_SIZE_32 = 2,
+};
+
+enum dreq_num_rp2350 {
+    DREQ_PIO0_TX0 = 0,
+    DREQ_PIO0_TX1 = 1,
+    DREQ_PIO0_TX2 = 2,
+    DREQ_PIO0_TX3 = 3,
+    DREQ_PIO0_RX0 = 4,
+    DREQ_PIO0_RX1 = 5,
+    DREQ_PIO0_RX2 = 6,
+    DREQ_PIO0_RX3 = 7,
+    DREQ_PIO1_TX0 = 8,
+    DREQ_PIO1_RX0 = 12,
+    DREQ_PIO2_TX0 = 16,
+    DREQ_PIO2_RX0 = 20,
+    DREQ_DMA_TIMER0 = 59,
+    DREQ_DMA_TIMER1 = 60,
+    DREQ_DMA_TIMER2 = 61,
+    DREQ_DMA_TIMER3 = 62,
+    DREQ_FORCE = 63,
+};
+
+typedef struct {
+    io_rw_32 read_addr;
+    io_rw_32 write_addr;
+    io_rw_32 transfer_count;
+    io_rw_32 ctrl_trig;
+    io_rw_32 al1_ctrl;
+    io_rw_32 al1_read_addr;
+    io_rw_32 al1_write_addr;
+    io_rw_32 al1_transfer_count_trig;
+    io_rw_32 al2_ctrl;
+    io_rw_32 al2_transfer_count;
+    io_rw_32 al2_read_addr;
+    io_rw_32 al2_write_addr_trig;
+    io_rw_32 al3_ctrl;
+    io_rw_32 al3_write_addr;
+    io_rw_32 al3_transfer_count;
+    io_rw_32 al3_read_addr_trig;
+} dma_channel_hw_t;
+
+typedef struct {
+    io_rw_32 inte;
+    io_rw_32 intf;
+    io_rw_32 ints;
+    uint32_t _pad;
+} dma_irq_ctrl_hw_t;
+
+typedef struct {
+    dma_channel_hw_t ch[NUM_DMA_CHANNELS];
+    io_ro_32 intr;
+    dma_irq_ctrl_hw_t irq_ctrl[NUM_DMA_IRQS];
+    io_rw_32 timer[4];
+    io_wo_32 multi_channel_trigger;
+    io_rw_32 sniff_ctrl;
+    io_rw_32 sniff_data;
+    uint32_t _pad;
+    io_ro_32 fifo_levels;
+    io_wo_32 abort;
+    io_ro_32 n_channels;
+} dma_hw_t;
+
+extern dma_hw_t host_dma_hw;
+
+#define dma_hw (&host_dma_hw)
+
+typedef struct {
+    uint32_t ctrl;
+} dma_channel_config;
+
+static inline void check_dma_channel_param(__unused uint channel) {
+    valid_params_if(HARDWARE_DMA, channel < NUM_DMA_CHANNELS);
+}
+
+static inline dma_channel_hw_t *dma_channel_hw_addr(uint channel) {
+    check_dma_channel_param(channel);
+    return &dma_hw->ch[channel];
+}
+
+void dma_channel_claim(uint channel);
+
+void dma_claim_mask(uint32_t channel_mask);
+
+void dma_channel_unclaim(uint channel);
+
+int dma_claim_unused_channel(bool required);
+
+bool dma_channel_is_claimed(uint channel);
+
+static inline void channel_config_set_read_increment(dma_channel_config *c, bool incr) {
+    c->ctrl = incr ? (c->ctrl | DMA_CH0_CTRL_TRIG_INCR_READ_BITS) : (c->ctrl & ~DMA_CH0_CTRL_TRIG_INCR_READ_BITS);
+}
+
+static inline void channel_config_set_write_increment(dma_channel_config *c, bool incr) {
+    c->ctrl = incr ? (c->ctrl | DMA_CH0_CTRL_TRIG_INCR_WRITE_BITS) : (c->ctrl & ~DMA_CH0_CTRL_TRIG_INCR_WRITE_BITS);
+}
+
+static inline void channel_config_set_dreq(dma_channel_config *c, uint dreq) {
+    assert(dreq <= DREQ_FORCE);
+    c->ctrl = (c->ctrl & ~DMA_CH0_CTRL_TRIG_TREQ_SEL_BITS) | (dreq << DMA_CH0_CTRL_TRIG_TREQ_SEL_LSB);
+}
+
+static inline void channel_config_set_chain_to(dma_channel_config *c, uint chain_to) {
+    assert(chain_to < NUM_DMA_CHANNELS);
+    c->ctrl = (c->ctrl & ~DMA_CH0_CTRL_TRIG_CHAIN_TO_BITS) | (chain_to << DMA_CH0_CTRL_TRIG_CHAIN_TO_LSB);
+}
+
+static inline void channel_config_set_transfer_data_size(dma_channel_config *c, enum dma_channel_transfer_size size) {
+    assert(size == DMA_SIZE_8 || size == DMA_SIZE_16 || size == DMA_SIZE_32);
+    c->ctrl = (c->ctrl & ~DMA_CH0_CTRL_TRIG_DATA_SIZE_BITS) | (((uint) size) << DMA_CH0_CTRL_TRIG_DATA_SIZE_LSB);
+}
+
+static inline void channel_config_set_ring(dma_channel_config *c, bool write, uint size_bits) {
+    assert(size_bits < 32);
+    c->ctrl = (c->ctrl & ~(DMA_CH0_CTRL_TRIG_RING_SIZE_BITS | DMA_CH0_CTRL_TRIG_RING_SEL_BITS)) |
+              (size_bits << DMA_CH0_CTRL_TRIG_RING_SIZE_LSB) |
+              (write ? DMA_CH0_CTRL_TRIG_RING_SEL_BITS : 0);
+}
+
+static inline void channel_config_set_bswap(dma_channel_config *c, bool bswap) {
+    c->ctrl = bswap ? (c->ctrl | DMA_CH0_CTRL_TRIG_BSWAP_BITS) : (c->ctrl & ~DMA_CH0_CTRL_TRIG_BSWAP_BITS);
+}
+
+static inline void channel_config_set_irq_quiet(dma_channel_config *c, bool irq_quiet) {
+    c->ctrl = irq_quiet ? (c->ctrl | DMA_CH0_CTRL_TRIG_IRQ_QUIET_BITS) : (c->ctrl & ~DMA_CH0_CTRL_TRIG_IRQ_QUIET_BITS);
+}
+
+static inline void channel_config_set_high_priority(dma_channel_config *c, bool high_priority) {
+    c->ctrl = high_priority ? (c->ctrl | DMA_CH0_CTRL_TRIG_HIGH_PRIORITY_BITS) :
+              (c->ctrl & ~DMA_CH0_CTRL_TRIG_HIGH_PRIORITY_BITS);
+}
+
+static inline void channel_config_set_enable(dma_channel_config *c, bool enable) {
+    c->ctrl = enable ? (c->ctrl | DMA_CH0_CTRL_TRIG_EN_BITS) : (c->ctrl & ~DMA_CH0_CTRL_TRIG_EN_BITS);
+}
+
+static inline uint32_t channel_config_get_ctrl_value(const dma_channel_config *config) {
+    return config->ctrl;
+}
+
+/** \brief Read increment, no write increment, unpaced, chained to itself, 32-bit, no ring, IRQ raised, enabled */
+static inline dma_channel_config dma_channel_get_default_config(uint channel) {
+    dma_channel_config c = {0};
+    channel_config_set_read_increment(&c, true);
+    channel_config_set_write_increment(&c, false);
+    channel_config_set_dreq(&c, DREQ_FORCE);
+    channel_config_set_chain_to(&c, channel);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+    channel_config_set_ring(&c, false, 0);
+    channel_config_set_bswap(&c, false);
+    channel_config_set_irq_quiet(&c, false);
+    channel_config_set_enable(&c, true);
+    return c;
+}
+
+dma_channel_config dma_get_channel_config(uint channel);
+
+void dma_channel_set_config(uint channel, const dma_channel_config *config, bool trigger);
+
+void dma_channel_set_read_addr(uint channel, const volatile void *read_addr, bool trigger);
+
+void dma_channel_set_write_addr(uint channel, volatile void *write_addr, bool trigger);
+
+void dma_channel_set_trans_count(uint channel, uint32_t trans_count, bool trigger);
+
+void dma_channel_configure(uint channel, const dma_channel_config *config, volatile void *write_addr,
+                           const volatile void *read_addr, uint transfer_count, bool trigger);
+
+void dma_channel_transfer_from_buffer_now(uint channel, const volatile void *read_addr, uint32_t transfer_count);
+
+void dma_channel_transfer_to_buffer_now(uint channel, volatile void *write_addr, uint32_t transfer_count);
+
+void dma_start_channel_mask(uint32_t chan_mask);
+
+void dma_channel_start(uint channel);
+
+/** \brief Stop a channel where it is: it does not complete, chain or raise an interrupt */
+void dma_channel_abort(uint channel);
+
+bool dma_channel_is_busy(uint channel);
+
+void dma_channel_wait_for_finish_blocking(uint channel);
+
+void dma_irqn_set_channel_enabled(uint irq_index, uint channel, bool enabled);
+
+void dma_irqn_set_channel_mask_enabled(uint irq_index, uint32_t channel_mask, bool enabled);
+
+bool dma_irqn_get_channel_status(uint irq_index, uint channel);
+
+void dma_irqn_acknowledge_channel(uint irq_index, uint channel);
+
+static inline void dma_channel_set_irq0_enabled(uint channel, bool enabled) {
+    dma_irqn_set_channel_enabled(0, channel, enabled);
+}
+
+static inline void dma_channel_set_irq1_enabled(uint channel, bool enabled) {
+    dma_irqn_set_channel_enabled(1, channel, enabled);
+}
+
+static inline bool dma_channel_get_irq0_status(uint channel) {
+    return dma_irqn_get_channel_status(0, channel);
+}
+
+static inline bool dma_channel_get_irq1_status(uint channel) {
+    return dma_irqn_get_channel_status(1, channel);
+}
+
+static inline void dma_channel_acknowledge_irq0(uint channel) {
+    dma_irqn_acknowledge_channel(0, channel);
+}
+
+static inline void dma_channel_acknowledge_irq1(uint channel) {
+    dma_irqn_acknowledge_channel(1, channel);
+}
+
+#endif
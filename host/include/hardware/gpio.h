@@ -0,0 +1,41 @@
+/*
+ * Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _HARDWARE_GPIO_H
+#define _HARDWARE_GPIO_H
+
+#include "pico.h"
+
+/** \file hardware/gpio.h
+ *  \brief GPIO function select of the host build
+ *
+ * A pin given to a PIO block shows that block's output and output enable for
+ * the pin; a pin that is not driven reads the level set with
+ * sim_set_gpio_input(), low by default.
+ */
+
+enum gpio_function_rp2350 {
+    GPIO_FUNC_HSTX = 0,
+    GPIO_FUNC_SPI = 1,
+    GPIO_FUNC_UART = 2,
+    GPIO_FUNC_I2C = 3,
+    GPIO_FUNC_PWM = 4,
+    GPIO_FUNC_SIO = 5,
+    GPIO_FUNC_PIO0 = 6,
+    GPIO_FUNC_PIO1 = 7,
+    GPIO_FUNC_PIO2 = 8,
+    GPIO_FUNC_GPCK = 9,
+    GPIO_FUNC_USB = 10,
+    GPIO_FUNC_NULL = 0x1f,
+};
+
+void gpio_set_function(uint gpio, uint fn);
+
+uint gpio_get_function(uint gpio);
+
+bool gpio_get(uint gpio);
+
+#endif
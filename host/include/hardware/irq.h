@@ -0,0 +1,45 @@
+/*
+ * Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _HARDWARE_IRQ_H
+#define _HARDWARE_IRQ_H
+
+#include "pico.h"
+
+/** \file hardware/irq.h
+ *  \brief Interrupts of the host build
+ *
+ * Only the DMA interrupts are modelled. An enabled interrupt whose line is
+ * asserted is taken host_sim_config_t::irq_latency_cycles after the line rises,
+ * at the next point the CPU touches the hardware, waits or spins, unless
+ * interrupts are masked or a handler is already running (there is no
+ * nesting). Shared handlers run highest order priority first.
+ */
+
+typedef void (*irq_handler_t)(void);
+
+enum irq_num_rp2350 {
+    DMA_IRQ_0 = 10,
+    DMA_IRQ_1 = 11,
+    DMA_IRQ_2 = 12,
+    DMA_IRQ_3 = 13,
+};
+
+#define NUM_IRQS 52
+
+void irq_set_enabled(uint num, bool enabled);
+
+bool irq_is_enabled(uint num);
+
+void irq_set_exclusive_handler(uint num, irq_handler_t handler);
+
+void irq_add_shared_handler(uint num, irq_handler_t handler, uint8_t order_priority);
+
+void irq_remove_handler(uint num, irq_handler_t handler);
+
+void irq_set_priority(uint num, uint8_t hardware_priority);
+
+#endif
@@ -0,0 +1,359 @@
+/*
+ * Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _HARDWARE_PIO_H
+#define _HARDWARE_PIO_H
+
+#include "pico.h"
+#include "hardware/address_mapped.h"
+#include "hardware/pio_instructions.h"
+
+/** \file hardware/pio.h
+ *  \brief PIO API of the host build, backed by the PIO emulator in host/src/pio.c
+ *
+ * The state machine functions act on the emulated state machines, and the
+ * state machine config helpers build the same register values as the
+ * pico-sdk. Of the block registers, code may read FSTAT, FLEVEL and FDEBUG
+ * directly and write FDEBUG to clear its flags; the TX and RX FIFO registers
+ * are only reached through the DMA (their addresses are decoded by the DMA
+ * emulation) or the pio_sm_put() / pio_sm_get() family.
+ */
+
+#ifndef PICO_PIO_VERSION
+#define PICO_PIO_VERSION 1
+#endif
+
+#define PIO_CTRL_SM_ENABLE_LSB 0u
+#define PIO_CTRL_SM_RESTART_LSB 4u
+#define PIO_CTRL_CLKDIV_RESTART_LSB 8u
+
+#define PIO_FSTAT_RXFULL_LSB 0u
+#define PIO_FSTAT_RXEMPTY_LSB 8u
+#define PIO_FSTAT_TXFULL_LSB 16u
+#define PIO_FSTAT_TXEMPTY_LSB 24u
+
+#define PIO_FDEBUG_RXSTALL_LSB 0u
+#define PIO_FDEBUG_RXUNDER_LSB 8u
+#define PIO_FDEBUG_TXOVER_LSB 16u
+#define PIO_FDEBUG_TXSTALL_LSB 24u
+
+#define PIO_SM0_CLKDIV_INT_LSB 16u
+#define PIO_SM0_CLKDIV_FRAC_LSB 8u
+
+#define PIO_SM0_EXECCTRL_SIDE_EN_LSB 30u
+#define PIO_SM0_EXECCTRL_SIDE_PINDIR_LSB 29u
+#define PIO_SM0_EXECCTRL_JMP_PIN_LSB 24u
+#define PIO_SM0_EXECCTRL_OUT_EN_SEL_LSB 19u
+#define PIO_SM0_EXECCTRL_INLINE_OUT_EN_LSB 18u
+#define PIO_SM0_EXECCTRL_OUT_STICKY_LSB 17u
+#define PIO_SM0_EXECCTRL_WRAP_TOP_LSB 12u
+#define PIO_SM0_EXECCTRL_WRAP_BOTTOM_LSB 7u
+#define PIO_SM0_EXECCTRL_STATUS_SEL_LSB 5u
+#define PIO_SM0_EXECCTRL_STATUS_N_LSB 0u
+
+#define PIO_SM0_SHIFTCTRL_FJOIN_RX_LSB 31u
+#define PIO_SM0_SHIFTCTRL_FJOIN_TX_LSB 30u
+#define PIO_SM0_SHIFTCTRL_PULL_THRESH_LSB 25u
+#define PIO_SM0_SHIFTCTRL_PUSH_THRESH_LSB 20u
+#define PIO_SM0_SHIFTCTRL_OUT_SHIFTDIR_LSB 19u
+#define PIO_SM0_SHIFTCTRL_IN_SHIFTDIR_LSB 18u
+#define PIO_SM0_SHIFTCTRL_AUTOPULL_LSB 17u
+#define PIO_SM0_SHIFTCTRL_AUTOPUSH_LSB 16u
+
+#define PIO_SM0_PINCTRL_SIDESET_COUNT_LSB 29u
+#define PIO_SM0_PINCTRL_SET_COUNT_LSB 26u
+#define PIO_SM0_PINCTRL_OUT_COUNT_LSB 20u
+#define PIO_SM0_PINCTRL_IN_BASE_LSB 15u
+#define PIO_SM0_PINCTRL_SIDESET_BASE_LSB 10u
+#define PIO_SM0_PINCTRL_SET_BASE_LSB 5u
+#define PIO_SM0_PINCTRL_OUT_BASE_LSB 0u
+
+typedef struct {
+    io_rw_32 clkdiv;
+    io_rw_32 execctrl;
+    io_rw_32 shiftctrl;
+    io_ro_32 addr;
+    io_rw_32 instr;
+    io_rw_32 pinctrl;
+} pio_sm_hw_t;
+
+typedef struct {
+    io_rw_32 ctrl;
+    io_ro_32 fstat;
+    io_rw_32 fdebug;
+    io_ro_32 flevel;
+    io_wo_32 txf[NUM_PIO_STATE_MACHINES];
+    io_ro_32 rxf[NUM_PIO_STATE_MACHINES];
+    io_rw_32 irq;
+    io_wo_32 irq_force;
+    io_rw_32 input_sync_bypass;
+    io_ro_32 dbg_padout;
+    io_ro_32 dbg_padoe;
+    io_ro_32 dbg_cfginfo;
+    io_wo_32 instr_mem[32];
+    pio_sm_hw_t sm[NUM_PIO_STATE_MACHINES];
+} pio_hw_t;
+
+typedef pio_hw_t *PIO;
+
+extern pio_hw_t host_pio_hw[NUM_PIOS];
+
+#define pio0_hw (&host_pio_hw[0])
+#define pio1_hw (&host_pio_hw[1])
+#define pio2_hw (&host_pio_hw[2])
+#define pio0 pio0_hw
+#define pio1 pio1_hw
+#define pio2 pio2_hw
+
+typedef struct {
+    uint32_t clkdiv;
+    uint32_t execctrl;
+    uint32_t shiftctrl;
+    uint32_t pinctrl;
+} pio_sm_config;
+
+typedef struct pio_program {
+    const uint16_t *instructions;
+    uint8_t length;
+    int8_t origin; // required instruction memory origin or -1
+} pio_program_t;
+
+enum pio_fifo_join {
+    PIO_FIFO_JOIN_NONE = 0,
+    PIO_FIFO_JOIN_TX = 1,
+    PIO_FIFO_JOIN_RX = 2,
+};
+
+enum pio_mov_status_type {
+    STATUS_TX_LESSTHAN = 0,
+    STATUS_RX_LESSTHAN = 1,
+};
+
+static inline void sm_config_set_out_pins(pio_sm_config *c, uint out_base, uint out_count) {
+    valid_params_if(HARDWARE_PIO, out_base < 32);
+    valid_params_if(HARDWARE_PIO, out_count <= 32);
+    c->pinctrl = (c->pinctrl & ~(0x1fu << PIO_SM0_PINCTRL_OUT_BASE_LSB | 0x3fu << PIO_SM0_PINCTRL_OUT_COUNT_LSB)) |
+                 (out_base << PIO_SM0_PINCTRL_OUT_BASE_LSB) | (out_count << PIO_SM0_PINCTRL_OUT_COUNT_LSB);
+}
+
+static inline void sm_config_set_set_pins(pio_sm_config *c, uint set_base, uint set_count) {
+    valid_params_if(HARDWARE_PIO, set_base < 32);
+    valid_params_if(HARDWARE_PIO, set_count <= 5);
+    c->pinctrl = (c->pinctrl & ~(0x1fu << PIO_SM0_PINCTRL_SET_BASE_LSB | 0x7u << PIO_SM0_PINCTRL_SET_COUNT_LSB)) |
+                 (set_base << PIO_SM0_PINCTRL_SET_BASE_LSB) | (set_count << PIO_SM0_PINCTRL_SET_COUNT_LSB);
+}
+
+static inline void sm_config_set_in_pins(pio_sm_config *c, uint in_base) {
+    valid_params_if(HARDWARE_PIO, in_base < 32);
+    c->pinctrl = (c->pinctrl & ~(0x1fu << PIO_SM0_PINCTRL_IN_BASE_LSB)) | (in_base << PIO_SM0_PINCTRL_IN_BASE_LSB);
+}
+
+static inline void sm_config_set_sideset_pins(pio_sm_config *c, uint sideset_base) {
+    valid_params_if(HARDWARE_PIO, sideset_base < 32);
+    c->pinctrl = (c->pinctrl & ~(0x1fu << PIO_SM0_PINCTRL_SIDESET_BASE_LSB)) |
+                 (sideset_base << PIO_SM0_PINCTRL_SIDESET_BASE_LSB);
+}
+
+static inline void sm_config_set_sideset(pio_sm_config *c, uint bit_count, bool optional, bool pindirs) {
+    valid_params_if(HARDWARE_PIO, bit_count <= 5);
+    valid_params_if(HARDWARE_PIO, !optional || bit_count >= 1);
+    c->pinctrl = (c->pinctrl & ~(0x7u << PIO_SM0_PINCTRL_SIDESET_COUNT_LSB)) |
+                 (bit_count << PIO_SM0_PINCTRL_SIDESET_COUNT_LSB);
+    c->execctrl = (c->execctrl & ~(1u << PIO_SM0_EXECCTRL_SIDE_EN_LSB | 1u << PIO_SM0_EXECCTRL_SIDE_PINDIR_LSB)) |
+                  (bool_to_bit(optional) << PIO_SM0_EXECCTRL_SIDE_EN_LSB) |
+                  (bool_to_bit(pindirs) << PIO_SM0_EXECCTRL_SIDE_PINDIR_LSB);
+}
+
+static inline void sm_config_set_clkdiv_int_frac(pio_sm_config *c, uint16_t div_int, uint8_t div_frac) {
+    invalid_params_if(HARDWARE_PIO, div_int == 0 && div_frac != 0);
+    c->clkdiv = (((uint) div_frac) << PIO_SM0_CLKDIV_FRAC_LSB) | (((uint) div_int) << PIO_SM0_CLKDIV_INT_LSB);
+}
+
+static inline void sm_config_set_wrap(pio_sm_config *c, uint wrap_target, uint wrap) {
+    valid_params_if(HARDWARE_PIO, wrap < 32);
+    valid_params_if(HARDWARE_PIO, wrap_target < 32);
+    c->execctrl = (c->execctrl & ~(0x1fu << PIO_SM0_EXECCTRL_WRAP_TOP_LSB | 0x1fu << PIO_SM0_EXECCTRL_WRAP_BOTTOM_LSB)) |
+                  (wrap_target << PIO_SM0_EXECCTRL_WRAP_BOTTOM_LSB) | (wrap << PIO_SM0_EXECCTRL_WRAP_TOP_LSB);
+}
+
+static inline void sm_config_set_jmp_pin(pio_sm_config *c, uint pin) {
+    valid_params_if(HARDWARE_PIO, pin < 32);
+    c->execctrl = (c->execctrl & ~(0x1fu << PIO_SM0_EXECCTRL_JMP_PIN_LSB)) | (pin << PIO_SM0_EXECCTRL_JMP_PIN_LSB);
+}
+
+static inline void sm_config_set_in_shift(pio_sm_config *c, bool shift_right, bool autopush, uint push_threshold) {
+    valid_params_if(HARDWARE_PIO, push_threshold <= 32);
+    c->shiftctrl = (c->shiftctrl & ~(1u << PIO_SM0_SHIFTCTRL_IN_SHIFTDIR_LSB | 1u << PIO_SM0_SHIFTCTRL_AUTOPUSH_LSB |
+                                     0x1fu << PIO_SM0_SHIFTCTRL_PUSH_THRESH_LSB)) |
+                   (bool_to_bit(shift_right) << PIO_SM0_SHIFTCTRL_IN_SHIFTDIR_LSB) |
+                   (bool_to_bit(autopush) << PIO_SM0_SHIFTCTRL_AUTOPUSH_LSB) |
+                   ((push_threshold & 0x1fu) << PIO_SM0_SHIFTCTRL_PUSH_THRESH_LSB);
+}
+
+static inline void sm_config_set_out_shift(pio_sm_config *c, bool shift_right, bool autopull, uint pull_threshold) {
+    valid_params_if(HARDWARE_PIO, pull_threshold <= 32);
+    c->shiftctrl = (c->shiftctrl & ~(1u << PIO_SM0_SHIFTCTRL_OUT_SHIFTDIR_LSB | 1u << PIO_SM0_SHIFTCTRL_AUTOPULL_LSB |
+                                     0x1fu << PIO_SM0_SHIFTCTRL_PULL_THRESH_LSB)) |
+                   (bool_to_bit(shift_right) << PIO_SM0_SHIFTCTRL_OUT_SHIFTDIR_LSB) |
+                   (bool_to_bit(autopull) << PIO_SM0_SHIFTCTRL_AUTOPULL_LSB) |
+                   ((pull_threshold & 0x1fu) << PIO_SM0_SHIFTCTRL_PULL_THRESH_LSB);
+}
+
+static inline void sm_config_set_fifo_join(pio_sm_config *c, enum pio_fifo_join join) {
+    valid_params_if(HARDWARE_PIO, join == PIO_FIFO_JOIN_NONE || join == PIO_FIFO_JOIN_TX || join == PIO_FIFO_JOIN_RX);
+    c->shiftctrl = (c->shiftctrl & ~(1u << PIO_SM0_SHIFTCTRL_FJOIN_TX_LSB | 1u << PIO_SM0_SHIFTCTRL_FJOIN_RX_LSB)) |
+                   (((uint) join) << PIO_SM0_SHIFTCTRL_FJOIN_TX_LSB);
+}
+
+static inline void sm_config_set_mov_status(pio_sm_config *c, enum pio_mov_status_type status_sel, uint status_n) {
+    c->execctrl = (c->execctrl & ~(0x3u << PIO_SM0_EXECCTRL_STATUS_SEL_LSB | 0x1fu << PIO_SM0_EXECCTRL_STATUS_N_LSB)) |
+                  ((((uint) status_sel) & 0x3u) << PIO_SM0_EXECCTRL_STATUS_SEL_LSB) |
+                  ((status_n & 0x1fu) << PIO_SM0_EXECCTRL_STATUS_N_LSB);
+}
+
+/** \brief The reset state of a state machine: clock divider 1, wrap over the whole memory, shifts right at 32 bits */
+static inline pio_sm_config pio_get_default_sm_config(void) {
+    pio_sm_config c = {0, 0, 0, 0};
+    sm_config_set_clkdiv_int_frac(&c, 1, 0);
+    sm_config_set_wrap(&c, 0, 31);
+    sm_config_set_in_shift(&c, true, false, 32);
+    sm_config_set_out_shift(&c, true, false, 32);
+    return c;
+}
+
+static inline uint pio_get_index(PIO pio) {
+    uint index = (uint) (pio - host_pio_hw);
+    valid_params_if(HARDWARE_PIO, index < NUM_PIOS);
+    return index;
+}
+
+static inline PIO pio_get_instance(uint instance) {
+    valid_params_if(HARDWARE_PIO, instance < NUM_PIOS);
+    return &host_pio_hw[instance];
+}
+
+/** \brief GPIO function that connects a pin to block pio (GPIO_FUNC_PIO0 + index) */
+static inline uint pio_get_funcsel(PIO pio) {
+    return 6u + pio_get_index(pio);
+}
+
+/** \brief DREQ of a state machine's TX or RX FIFO, as enum dreq_num_rp2350 numbers them */
+static inline uint pio_get_dreq(PIO pio, uint sm, bool is_tx) {
+    valid_params_if(HARDWARE_PIO, sm < NUM_PIO_STATE_MACHINES);
+    return pio_get_index(pio) * 8u + (is_tx ? 0u : 4u) + sm;
+}
+
+// Program memory
+
+bool pio_can_add_program(PIO pio, const pio_program_t *program);
+
+bool pio_can_add_program_at_offset(PIO pio, const pio_program_t *program, uint offset);
+
+int pio_add_program(PIO pio, const pio_program_t *program);
+
+int pio_add_program_at_offset(PIO pio, const pio_program_t *program, uint offset);
+
+void pio_remove_program(PIO pio, const pio_program_t *program, uint loaded_offset);
+
+void pio_clear_instruction_memory(PIO pio);
+
+// State machine claiming
+
+void pio_sm_claim(PIO pio, uint sm);
+
+void pio_claim_sm_mask(PIO pio, uint sm_mask);
+
+void pio_sm_unclaim(PIO pio, uint sm);
+
+int pio_claim_unused_sm(PIO pio, bool required);
+
+bool pio_sm_is_claimed(PIO pio, uint sm);
+
+// State machine control
+
+/** \brief Disable the state machine, apply the config, clear its FIFOs and FIFO debug flags, restart it and jump to initial_pc */
+int pio_sm_init(PIO pio, uint sm, uint initial_pc, const pio_sm_config *config);
+
+void pio_sm_set_config(PIO pio, uint sm, const pio_sm_config *config);
+
+void pio_sm_set_enabled(PIO pio, uint sm, bool enabled);
+
+void pio_set_sm_mask_enabled(PIO pio, uint32_t mask, bool enabled);
+
+/** \brief Enable or disable state machines of this block and its two neighbours with one CTRL write (RP2350) */
+void pio_set_sm_multi_mask_enabled(PIO pio, uint32_t mask_prev, uint32_t mask, uint32_t mask_next, bool enabled);
+
+void pio_sm_restart(PIO pio, uint sm);
+
+void pio_restart_sm_mask(PIO pio, uint32_t mask);
+
+void pio_sm_clkdiv_restart(PIO pio, uint sm);
+
+void pio_clkdiv_restart_sm_mask(PIO pio, uint32_t mask);
+
+void pio_enable_sm_mask_in_sync(PIO pio, uint32_t mask);
+
+/** \brief Enable state machines of this block and its two neighbours with their clock dividers restarted on the same cycle (RP2350) */
+void pio_enable_sm_multi_mask_in_sync(PIO pio, uint32_t mask_prev, uint32_t mask, uint32_t mask_next);
+
+void pio_sm_set_clkdiv_int_frac(PIO pio, uint sm, uint16_t div_int, uint8_t div_frac);
+
+void pio_sm_set_clkdiv(PIO pio, uint sm, float div);
+
+void pio_sm_set_wrap(PIO pio, uint sm, uint wrap_target, uint wrap);
+
+void pio_sm_set_out_pins(PIO pio, uint sm, uint out_base, uint out_count);
+
+void pio_sm_set_sideset_pins(PIO pio, uint sm, uint sideset_base);
+
+uint8_t pio_sm_get_pc(PIO pio, uint sm);
+
+/** \brief Execute an instruction now if the state machine is stopped, or in place of its next instruction if it is running */
+void pio_sm_exec(PIO pio, uint sm, uint instr);
+
+bool pio_sm_is_exec_stalled(PIO pio, uint sm);
+
+void pio_sm_exec_wait_blocking(PIO pio, uint sm, uint instr);
+
+// Pins
+
+void pio_sm_set_pins(PIO pio, uint sm, uint32_t pin_values);
+
+void pio_sm_set_pins_with_mask(PIO pio, uint sm, uint32_t pin_values, uint32_t pin_mask);
+
+void pio_sm_set_pindirs_with_mask(PIO pio, uint sm, uint32_t pin_dirs, uint32_t pin_mask);
+
+int pio_sm_set_consecutive_pindirs(PIO pio, uint sm, uint pin_base, uint pin_count, bool is_out);
+
+void pio_gpio_init(PIO pio, uint pin);
+
+// FIFOs
+
+void pio_sm_put(PIO pio, uint sm, uint32_t data);
+
+uint32_t pio_sm_get(PIO pio, uint sm);
+
+bool pio_sm_is_rx_fifo_full(PIO pio, uint sm);
+
+bool pio_sm_is_rx_fifo_empty(PIO pio, uint sm);
+
+uint pio_sm_get_rx_fifo_level(PIO pio, uint sm);
+
+bool pio_sm_is_tx_fifo_full(PIO pio, uint sm);
+
+bool pio_sm_is_tx_fifo_empty(PIO pio, uint sm);
+
+uint pio_sm_get_tx_fifo_level(PIO pio, uint sm);
+
+void pio_sm_put_blocking(PIO pio, uint sm, uint32_t data);
+
+uint32_t pio_sm_get_blocking(PIO pio, uint sm);
+
+void pio_sm_drain_tx_fifo(PIO pio, uint sm);
+
+void pio_sm_clear_fifos(PIO pio, uint sm);
+
+#endif
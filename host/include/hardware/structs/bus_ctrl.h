@@ -0,0 +1,30 @@
+/*
+ * Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _HARDWARE_STRUCTS_BUS_CTRL_H
+#define _HARDWARE_STRUCTS_BUS_CTRL_H
+
+#include "pico.h"
+
+/** \file hardware/structs/bus_ctrl.h
+ *  \brief Bus fabric registers of the host build (the simulation has no bus contention, so the priority has no effect)
+ */
+
+#define BUSCTRL_BUS_PRIORITY_PROC0_BITS 0x00000001u
+#define BUSCTRL_BUS_PRIORITY_PROC1_BITS 0x00000010u
+#define BUSCTRL_BUS_PRIORITY_DMA_R_BITS 0x00000100u
+#define BUSCTRL_BUS_PRIORITY_DMA_W_BITS 0x00001000u
+
+typedef struct {
+    io_rw_32 priority;
+    io_ro_32 priority_ack;
+} bus_ctrl_hw_t;
+
+extern bus_ctrl_hw_t host_bus_ctrl_hw;
+
+#define bus_ctrl_hw (&host_bus_ctrl_hw)
+
+#endif
@@ -0,0 +1,31 @@
+/*
+ * Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _HARDWARE_STRUCTS_SYSTICK_H
+#define _HARDWARE_STRUCTS_SYSTICK_H
+
+#include "pico.h"
+
+/** \file hardware/structs/systick.h
+ *  \brief SysTick of the host build
+ *
+ * Once enabled through CSR, CVR counts down from RVR at clk_sys in simulated
+ * cycles. CVR is brought up to date whenever the simulation hands control back
+ * to the code under test.
+ */
+
+typedef struct {
+    io_rw_32 csr;
+    io_rw_32 rvr;
+    io_rw_32 cvr;
+    io_ro_32 calib;
+} systick_hw_t;
+
+extern systick_hw_t host_systick_hw;
+
+#define systick_hw (&host_systick_hw)
+
+#endif
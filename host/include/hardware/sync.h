@@ -0,0 +1,41 @@
+/*
+ * Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _HARDWARE_SYNC_H
+#define _HARDWARE_SYNC_H
+
+#include "pico.h"
+
+/** \file hardware/sync.h
+ *  \brief Interrupt masking, spin locks and events of the host build
+ *
+ * There is one simulated core, so a spin lock only masks interrupts, as it
+ * does on a single core of the device. __wfe() lets the simulation run until
+ * __sev() is called or an interrupt handler has run.
+ */
+
+typedef volatile uint32_t spin_lock_t;
+
+/** \brief Mask the simulated interrupts, returning the previous state for restore_interrupts() */
+uint32_t save_and_disable_interrupts(void);
+
+void restore_interrupts(uint32_t status);
+
+spin_lock_t *spin_lock_instance(uint lock_num);
+
+spin_lock_t *spin_lock_init(uint lock_num);
+
+uint32_t spin_lock_blocking(spin_lock_t *lock);
+
+void spin_unlock(spin_lock_t *lock, uint32_t saved_irq);
+
+void __sev(void);
+
+void __wfe(void);
+
+void __wfi(void);
+
+#endif
@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _HOST_SIM_H
+#define _HOST_SIM_H
+
+#include "pico.h"
+#include "hardware/pio.h"
+
+/** \file host_sim.h
+ *  \brief Control and observation of the host simulation the drivers run on
+ *
+ * The simulation is a single clk_sys cycle counter that every hardware access
+ * advances: each SDK hardware call first runs \ref host_sim_config_t.cpu_access_cycles
+ * cycles of the PIO blocks, the DMA and the interrupt controller, and
+ * tight_loop_contents(), __wfe(), sleep_us() and friends run it for as long as
+ * the code under test waits. The code under test is the only "CPU"; it runs in
+ * zero time between hardware accesses.
+ *
+ * PIO state machines are emulated instruction by instruction at their clock
+ * divider, driving the pads of their block; GPIO levels are the pads of the
+ * block a pin's function selects. DMA channels move at most one transfer per
+ * cycle, paced by the DREQ of their TREQ_SEL. DMA_IRQ_n handlers run
+ * \ref host_sim_config_t.irq_latency_cycles after the line rises, from
+ * whatever hardware access or wait the code under test is in, unless
+ * interrupts are disabled or a handler is already running.
+ *
+ * Registers the drivers access directly (PIO FDEBUG, FSTAT and FLEVEL, the DMA
+ * channel registers and INTSn, SysTick) are copies the simulation updates
+ * whenever it hands control back. A write-1-to-clear write to FDEBUG or INTSn
+ * takes effect at the next hardware access; a read of the same register
+ * straight after such a write, or a second write with no hardware access in
+ * between, sees the stale copy.
+ *
+ * Buffers handed to the DMA must be static or heap allocated: the host build
+ * keeps both below 4 GB so their addresses fit the 32-bit DMA registers, but
+ * the stack is not.
+ */
+
+typedef struct host_sim_config {
+    uint32_t sys_clock_hz;       ///< clk_sys at start-up (150 MHz)
+    uint32_t irq_latency_cycles; ///< cycles from an interrupt line rising to its handler running (12)
+    uint32_t cpu_access_cycles;  ///< cycles each SDK hardware call takes before it touches the hardware (1)
+    uint64_t max_cycles;         ///< panic once the simulation runs this long (a hang in the code under test)
+} host_sim_config_t;
+
+/** \brief The live configuration; change it before the code under test starts, or between phases of a test */
+host_sim_config_t *sim_config(void);
+
+/** \brief clk_sys cycles since start-up */
+uint64_t sim_cycles(void);
+
+/** \brief Run the simulation for cycles cycles with the code under test idle, taking interrupts */
+void sim_run_cycles(uint64_t cycles);
+
+/** \brief Run the simulation for us microseconds of clk_sys with the code under test idle, taking interrupts */
+void sim_run_us(uint64_t us);
+
+/** \brief Drive the level an external device puts on gpio (seen when no PIO block drives the pin) */
+void sim_set_gpio_input(uint gpio, bool level);
+
+/** \brief Current level of gpio */
+bool sim_gpio_level(uint gpio);
+
+typedef struct host_pio_sm_stats {
+    uint32_t tx_stalls;       ///< times the state machine stalled on an empty TX FIFO
+    uint64_t tx_stall_cycles; ///< state machine clock ticks spent stalled on an empty TX FIFO
+    uint32_t pulls;           ///< words moved from the TX FIFO to the OSR
+    uint32_t tx_min_level;    ///< lowest TX FIFO level left by a pull while the state machine was enabled
+} host_pio_sm_stats_t;
+
+/** \brief Counters of state machine sm of block pio since start-up, or since sim_pio_sm_stats_reset() */
+const host_pio_sm_stats_t *sim_pio_sm_stats(PIO pio, uint sm);
+
+void sim_pio_sm_stats_reset(PIO pio, uint sm);
+
+// I2S bus probe
+
+#define HOST_I2S_PROBE_MAX_LANES 4
+
+typedef struct host_i2s_probe_config {
+    uint bclk_pin;
+    uint lrclk_pin;
+    uint lane_count;                          ///< data pins sharing the clocks
+    uint data_pins[HOST_I2S_PROBE_MAX_LANES];
+    uint slot_bits;                           ///< bits per LRCLK phase (16, 24 or 32)
+    uint frame_capacity;                      ///< frames kept per lane; later frames are counted in overflow
+} host_i2s_probe_config_t;
+
+typedef struct host_i2s_lane {
+    int32_t (*frames)[2];      ///< decoded frames, { left (ws=0), right (ws=1) }, sign extended
+    uint32_t frame_count;
+    uint32_t overflow;         ///< complete frames past frame_capacity
+    uint32_t slot_errors;      ///< LRCLK phases that were not slot_bits BCLKs long (the partial frame is dropped)
+    uint64_t first_one_bclk;   ///< index of the first BCLK rising edge that sampled a 1, or UINT64_MAX
+    uint32_t late_edges;       ///< DATA changes while BCLK was high
+    uint32_t max_data_delay;   ///< most clk_sys cycles from a BCLK falling edge to a DATA change
+    // decoder state
+    uint32_t slot_value;
+    uint slot_bit_count;
+    int slot_channel;
+    int frame_start_channel;
+    bool have_half;
+    int32_t half[2];
+    bool data_level;
+} host_i2s_lane_t;
+
+typedef struct host_i2s_probe {
+    host_i2s_probe_config_t config;
+    host_i2s_lane_t lanes[HOST_I2S_PROBE_MAX_LANES];
+    uint64_t bclk_edges;       ///< BCLK rising edges
+    uint32_t min_period;       ///< shortest time between BCLK rising edges, in clk_sys cycles
+    uint32_t max_period;       ///< longest time between BCLK rising edges, in clk_sys cycles
+    uint32_t gaps;             ///< rising edge intervals more than 8 times min_period (the clocks stopped)
+    uint64_t first_edge_cycle;
+    uint64_t last_rise_cycle;
+    uint64_t last_fall_cycle;
+    bool bclk_level;
+    bool lrclk_level;
+    bool prev_ws;              ///< LRCLK at the previous rising edge
+} host_i2s_probe_t;
+
+/** \brief Start decoding the I2S bus on the given pins, from the next BCLK rising edge (replaces any running probe) */
+host_i2s_probe_t *sim_probe_start(const host_i2s_probe_config_t *config);
+
+/** \brief Stop the probe; its results stay readable until the next sim_probe_start() */
+void sim_probe_stop(void);
+
+/** \brief Write every change of the pins in pin_mask to a VCD file, for a waveform viewer */
+void sim_trace_vcd(const char *path, uint32_t pin_mask);
+
+#endif
@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _PICO_H
+#define _PICO_H
+
+/** \file pico.h
+ *  \brief Host build stand-in for the pico-sdk base header
+ *
+ * The headers under host/include declare the part of the pico-sdk and
+ * pico-extras the drivers use, with the same names and signatures, so the
+ * drivers compile unchanged on the host. Everything that touches hardware is
+ * implemented by the simulation in host/src (see host_sim.h). Only the RP2350
+ * is modelled: three PIO blocks, 16 DMA channels and 32 GPIOs.
+ *
+ * DMA addresses are 32 bits wide, so the host build must keep everything the
+ * DMA can reach (static data and the heap) below 4 GB: it links without PIE,
+ * and the simulation keeps malloc() off mmap().
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <assert.h>
+
+// glibc's single-level __CONCAT would not expand PICO_AUDIO_I2S_PIO and friends
+#undef __CONCAT
+#define __CONCAT1(x, y) x ## y
+#define __CONCAT(x, y) __CONCAT1(x, y)
+#ifndef __STRING
+#define __STRING(x) #x
+#endif
+
+typedef unsigned int uint;
+
+typedef volatile uint32_t io_rw_32;
+typedef const volatile uint32_t io_ro_32;
+typedef volatile uint32_t io_wo_32;
+
+#define PICO_RP2040 0
+#define PICO_RP2350 1
+
+#define NUM_PIOS 3
+#define NUM_PIO_STATE_MACHINES 4
+#define NUM_DMA_CHANNELS 16
+#define NUM_DMA_IRQS 4
+#define NUM_BANK0_GPIOS 32
+#define NUM_SPIN_LOCKS 32
+
+#define PICO_OK 0
+#define PICO_ERROR_GENERIC (-1)
+
+#define __isr
+#define __time_critical_func(func_name) func_name
+#define __not_in_flash_func(func_name) func_name
+#define __scratch_x(group)
+#define __scratch_y(group)
+#define __aligned(x) __attribute__((aligned(x)))
+#define __packed __attribute__((packed))
+#define __unused __attribute__((unused))
+#define __force_inline inline __attribute__((always_inline))
+
+static inline uint bool_to_bit(bool b) {
+    return (uint) b;
+}
+
+#define count_of(a) (sizeof(a) / sizeof((a)[0]))
+
+#ifndef MIN
+#define MIN(a, b) ((b) > (a) ? (a) : (b))
+#endif
+#ifndef MAX
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#endif
+
+#define __compiler_memory_barrier() __asm volatile ("" : : : "memory")
+#define __mem_fence_acquire() __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#define __mem_fence_release() __atomic_thread_fence(__ATOMIC_RELEASE)
+
+static inline void __dmb(void) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+#define invalid_params_if(x, test) assert(!(test))
+#define valid_params_if(x, test) assert(test)
+#define hard_assert(x) assert(x)
+
+// debug pins are a no-op, as in a release build
+#define CU_REGISTER_DEBUG_PINS(...)
+#define CU_SELECT_DEBUG_PINS(x)
+#define DEBUG_PINS_SET(p, v) ((void) 0)
+#define DEBUG_PINS_CLR(p, v) ((void) 0)
+#define DEBUG_PINS_XOR(p, v) ((void) 0)
+
+#define PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY 0x80
+#define PICO_SHARED_IRQ_HANDLER_HIGHEST_ORDER_PRIORITY 0xff
+#define PICO_SHARED_IRQ_HANDLER_LOWEST_ORDER_PRIORITY 0x00
+
+/** \brief Print the message to stderr and abort, so the failing test stops with a core dump */
+void __attribute__((noreturn, format(printf, 1, 2))) panic(const char *fmt, ...);
+
+/** \brief Let the simulation run for a clk_sys cycle while the CPU spins */
+void tight_loop_contents(void);
+
+/** \brief Always core 0: the host build runs everything on one simulated core */
+uint get_core_num(void);
+
+#endif
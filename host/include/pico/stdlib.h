@@ -0,0 +1,24 @@
+/*
+ * Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _PICO_STDLIB_H
+#define _PICO_STDLIB_H
+
+/** \file pico/stdlib.h
+ *  \brief The parts of pico_stdlib the drivers use, for the host build
+ */
+
+#include "pico.h"
+#include "hardware/gpio.h"
+#include "hardware/clocks.h"
+#include "pico/time.h"
+
+/** \brief stdio goes to the host's stdout; nothing to set up */
+static inline bool stdio_init_all(void) {
+    return true;
+}
+
+#endif
@@ -0,0 +1,16 @@
+/*
+ * Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _PICO_SYNC_H
+#define _PICO_SYNC_H
+
+/** \file pico/sync.h
+ *  \brief Synchronization primitives of the host build (spin locks only)
+ */
+
+#include "hardware/sync.h"
+
+#endif
@@ -0,0 +1,323 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+#
+# SPDX-License-Identifier: BSD-3-Clause
+#
+"""Assemble a .pio file into a c-sdk header for the host build.
+
+Only the part of the pioasm language used by audio_i2s.pio is supported:
+.program, .side_set, .wrap_target / .wrap, .origin, .define, (public) labels,
+the nine instructions with side-set and delay, and % c-sdk { %} blocks. The
+output has the same shape as "pioasm -o c-sdk", so the c-sdk blocks compile
+unchanged against the host SDK headers.
+
+usage: pioasm.py input.pio output.h
+"""
+
+import re
+import sys
+
+
+class PioError(Exception):
+    pass
+
+
+def parse_int(text, symbols):
+    text = text.strip()
+    if text in symbols:
+        return symbols[text]
+    try:
+        return int(text, 0)
+    except ValueError:
+        raise PioError("bad value '%s'" % text)
+
+
+class Program:
+    def __init__(self, name):
+        self.name = name
+        self.lines = []          # (source text, line number)
+        self.labels = {}
+        self.public_labels = []
+        self.defines = {}
+        self.public_defines = []
+        self.side_set = 0
+        self.side_opt = False
+        self.side_pindirs = False
+        self.wrap_target = None
+        self.wrap = None
+        self.origin = -1
+        self.c_sdk = []
+        self.instructions = []   # (encoding, listing)
+
+
+JMP_CONDITIONS = {"": 0, "!x": 1, "x--": 2, "!y": 3, "y--": 4, "x!=y": 5, "pin": 6, "!osre": 7}
+IN_SOURCES = {"pins": 0, "x": 1, "y": 2, "null": 3, "isr": 6, "osr": 7}
+OUT_DESTS = {"pins": 0, "x": 1, "y": 2, "null": 3, "pindirs": 4, "pc": 5, "isr": 6, "exec": 7}
+MOV_DESTS = {"pins": 0, "x": 1, "y": 2, "pindirs": 3, "exec": 4, "pc": 5, "isr": 6, "osr": 7}
+MOV_SOURCES = {"pins": 0, "x": 1, "y": 2, "null": 3, "status": 5, "isr": 6, "osr": 7}
+SET_DESTS = {"pins": 0, "x": 1, "y": 2, "pindirs": 4}
+WAIT_SOURCES = {"gpio": 0, "pin": 1, "irq": 2}
+
+
+def split_operands(text):
+    return [op.strip() for op in text.split(",")] if text.strip() else []
+
+
+def encode(program, text, symbols):
+    """Encode one instruction (without side-set / delay) as its 16-bit word."""
+    parts = text.split(None, 1)
+    op = parts[0].lower()
+    args = split_operands(parts[1]) if len(parts) > 1 else []
+    low = [a.lower() for a in args]
+    if op == "nop":
+        return 0xa042  # mov y, y
+    if op == "jmp":
+        # the comma between condition and target is optional
+        if len(args) == 1 and len(args[0].split()) == 2:
+            args = args[0].split()
+            low = [a.lower() for a in args]
+        cond = low[0] if len(args) == 2 else ""
+        if cond not in JMP_CONDITIONS:
+            raise PioError("bad jmp condition '%s'" % args[0])
+        target = args[-1]
+        addr = program.labels[target] if target in program.labels else parse_int(target, symbols)
+        return (JMP_CONDITIONS[cond] << 5) | (addr & 0x1f)
+    if op == "wait":
+        polarity = parse_int(args[0], symbols)
+        source = low[1].split()
+        if source[0] not in WAIT_SOURCES:
+            raise PioError("bad wait source '%s'" % args[1])
+        index = parse_int(source[1], symbols)
+        return 0x2000 | (polarity << 7) | (WAIT_SOURCES[source[0]] << 5) | (index & 0x1f)
+    if op == "in":
+        return 0x4000 | (IN_SOURCES[low[0]] << 5) | (parse_int(args[1], symbols) & 0x1f)
+    if op == "out":
+        return 0x6000 | (OUT_DESTS[low[0]] << 5) | (parse_int(args[1], symbols) & 0x1f)
+    if op in ("push", "pull"):
+        flags = set(low[0].split()) if args else set()
+        if len(parts) > 1 and not args:
+            flags = set(parts[1].lower().split())
+        word = 0x8000 | (0x80 if op == "pull" else 0)
+        if "iffull" in flags or "ifempty" in flags:
+            word |= 0x40
+        if "noblock" not in flags:
+            word |= 0x20
+        return word
+    if op == "mov":
+        dest = low[0]
+        source = low[1].replace(" ", "")
+        operation = 0
+        if source.startswith("!") or source.startswith("~"):
+            operation, source = 1, source[1:]
+        elif source.startswith("::"):
+            operation, source = 2, source[2:]
+        if dest not in MOV_DESTS or source not in MOV_SOURCES:
+            raise PioError("bad mov operands '%s'" % text)
+        return 0xa000 | (MOV_DESTS[dest] << 5) | (operation << 3) | MOV_SOURCES[source]
+    if op == "irq":
+        words = low[0].split() if args else []
+        clear = "clear" in words
+        wait = "wait" in words
+        index = parse_int(words[-1], symbols)
+        return 0xc000 | (int(clear) << 6) | (int(wait) << 5) | (index & 0x1f)
+    if op == "set":
+        return 0xe000 | (SET_DESTS[low[0]] << 5) | (parse_int(args[1], symbols) & 0x1f)
+    raise PioError("unknown instruction '%s'" % op)
+
+
+def delay_side_set(program, side, delay):
+    """Bits 12:8 of an instruction: side-set (and its enable bit) above the delay."""
+    bits = program.side_set + (1 if program.side_opt else 0)
+    delay_bits = 5 - bits
+    if delay >= 1 << delay_bits:
+        raise PioError("delay %d too large" % delay)
+    field = delay
+    if side is not None:
+        if side >= 1 << program.side_set:
+            raise PioError("side-set value %d too large" % side)
+        field |= side << delay_bits
+        if program.side_opt:
+            field |= 1 << 4
+    elif program.side_set and not program.side_opt:
+        raise PioError("side-set required")
+    return field << 8
+
+
+def assemble(source):
+    programs = []
+    globals_ = {}
+    global_defines = []
+    program = None
+    lines = source.split("\n")
+    index = 0
+    while index < len(lines):
+        raw = lines[index]
+        index += 1
+        if raw.strip().startswith("%"):
+            match = re.match(r"\s*%\s*([\w-]+)\s*\{", raw)
+            block = []
+            while index < len(lines) and not lines[index].strip().startswith("%}"):
+                block.append(lines[index])
+                index += 1
+            index += 1
+            if match and match.group(1) == "c-sdk" and program:
+                program.c_sdk.append("\n".join(block))
+            continue
+        line = re.split(r";|//", raw, 1)[0].strip()
+        if not line:
+            continue
+        match = re.match(r"\.program\s+(\w+)$", line)
+        if match:
+            program = Program(match.group(1))
+            programs.append(program)
+            continue
+        match = re.match(r"\.define\s+(public\s+)?(\w+)\s+(.+)$", line)
+        if match:
+            value = parse_int(match.group(3), program.defines if program else globals_)
+            if program:
+                program.defines[match.group(2)] = value
+                if match.group(1):
+                    program.public_defines.append((match.group(2), value))
+            else:
+                globals_[match.group(2)] = value
+                if match.group(1):
+                    global_defines.append((match.group(2), value))
+            continue
+        if program is None:
+            raise PioError("line %d: outside a .program" % index)
+        match = re.match(r"\.side_set\s+(\d+)((?:\s+\w+)*)$", line)
+        if match:
+            program.side_set = int(match.group(1))
+            options = match.group(2).split()
+            program.side_opt = "opt" in options
+            program.side_pindirs = "pindirs" in options
+            continue
+        if line == ".wrap_target":
+            program.wrap_target = len(program.lines)
+            continue
+        if line == ".wrap":
+            program.wrap = len(program.lines) - 1
+            continue
+        match = re.match(r"\.origin\s+(\S+)$", line)
+        if match:
+            program.origin = parse_int(match.group(1), program.defines)
+            continue
+        if line.startswith(".lang_opt") or line.startswith(".pio_version") or line.startswith(".fifo"):
+            continue
+        if line.startswith("."):
+            raise PioError("line %d: unsupported directive '%s'" % (index, line))
+        while True:
+            match = re.match(r"(public\s+)?(\w+):\s*(.*)$", line)
+            if not match:
+                break
+            program.labels[match.group(2)] = len(program.lines)
+            if match.group(1):
+                program.public_labels.append((match.group(2), len(program.lines)))
+            line = match.group(3)
+        if line:
+            program.lines.append((line, index))
+
+    for program in programs:
+        symbols = dict(globals_)
+        symbols.update(program.defines)
+        for text, number in program.lines:
+            body = text
+            delay = 0
+            side = None
+            match = re.search(r"\[\s*([^\]]+)\]\s*$", body)
+            if match:
+                delay = parse_int(match.group(1), symbols)
+                body = body[:match.start()].strip()
+            match = re.search(r"\s+side\s+(\S+)\s*$", body)
+            if match:
+                side = parse_int(match.group(1), symbols)
+                body = body[:match.start()].strip()
+            try:
+                word = encode(program, body, symbols) | delay_side_set(program, side, delay)
+            except (PioError, KeyError, IndexError) as error:
+                raise PioError("line %d: %s: %s" % (number, text, error))
+            program.instructions.append((word, text))
+        if len(program.instructions) > 32:
+            raise PioError("program %s is longer than 32 instructions" % program.name)
+    return programs, global_defines
+
+
+def render(programs, global_defines):
+    out = [
+        "// ----------------------------------------------------- //",
+        "// This file is autogenerated by pioasm.py; do not edit! //",
+        "// ----------------------------------------------------- //",
+        "",
+        "#pragma once",
+        "",
+        "#if !PICO_NO_HARDWARE",
+        '#include "hardware/pio.h"',
+        "#endif",
+        "",
+    ]
+    for name, value in global_defines:
+        out.append("#define %s %d" % (name, value))
+    for program in programs:
+        name = program.name
+        wrap_target = program.wrap_target if program.wrap_target is not None else 0
+        wrap = program.wrap if program.wrap is not None else len(program.instructions) - 1
+        out += ["// %s //" % ("-" * len(name)), "// %s //" % name, "// %s //" % ("-" * len(name)), ""]
+        out.append("#define %s_wrap_target %d" % (name, wrap_target))
+        out.append("#define %s_wrap %d" % (name, wrap))
+        out.append("")
+        for label, offset in program.public_labels:
+            out.append("#define %s_offset_%s %du" % (name, label, offset))
+        for define, value in program.public_defines:
+            out.append("#define %s_%s %d" % (name, define, value))
+        out.append("")
+        out.append("static const uint16_t %s_program_instructions[] = {" % name)
+        for address, (word, text) in enumerate(program.instructions):
+            if address == wrap_target:
+                out.append("            //     .wrap_target")
+            out.append("    0x%04x, // %2d: %s" % (word, address, " ".join(text.split())))
+            if address == wrap:
+                out.append("            //     .wrap")
+        out.append("};")
+        out.append("")
+        out.append("#if !PICO_NO_HARDWARE")
+        out.append("static const struct pio_program %s_program = {" % name)
+        out.append("    .instructions = %s_program_instructions," % name)
+        out.append("    .length = %d," % len(program.instructions))
+        out.append("    .origin = %d," % program.origin)
+        out.append("};")
+        out.append("")
+        out.append("static inline pio_sm_config %s_program_get_default_config(uint offset) {" % name)
+        out.append("    pio_sm_config c = pio_get_default_sm_config();")
+        out.append("    sm_config_set_wrap(&c, offset + %s_wrap_target, offset + %s_wrap);" % (name, name))
+        if program.side_set:
+            out.append("    sm_config_set_sideset(&c, %d, %s, %s);" % (
+                program.side_set + (1 if program.side_opt else 0), str(program.side_opt).lower(),
+                str(program.side_pindirs).lower()))
+        out.append("    return c;")
+        out.append("}")
+        for block in program.c_sdk:
+            out.append(block)
+        out.append("#endif")
+        out.append("")
+    return "\n".join(out) + "\n"
+
+
+def main(argv):
+    if len(argv) != 3:
+        sys.stderr.write(__doc__)
+        return 2
+    with open(argv[1]) as f:
+        source = f.read()
+    try:
+        programs, global_defines = assemble(source)
+    except PioError as error:
+        sys.stderr.write("%s: %s\n" % (argv[1], error))
+        return 1
+    with open(argv[2], "w") as f:
+        f.write(render(programs, global_defines))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
@@ -0,0 +1,231 @@
+/*
+ * Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/** \file audio.c
+ *  \brief Host port of pico-extras' pico_audio buffer pools and connections
+ *
+ * The same lists, locks and default connection as pico-extras: a pool's free
+ * list is a stack, its prepared list a queue, both under the audio spin
+ * locks, and the blocking takes wait with __wfe() for the __sev() of a queue.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "pico/audio.h"
+#include "hardware/sync.h"
+
+static audio_connection_t connection_default = {
+        .producer_pool_take = producer_pool_take_buffer_default,
+        .producer_pool_give = producer_pool_give_buffer_default,
+        .consumer_pool_take = consumer_pool_take_buffer_default,
+        .consumer_pool_give = consumer_pool_give_buffer_default,
+};
+
+static mem_buffer_t *pico_buffer_alloc(size_t size) {
+    mem_buffer_t *b = (mem_buffer_t *) calloc(1, sizeof(mem_buffer_t));
+    if (!b) {
+        panic("out of memory");
+    }
+    if (size) {
+        b->bytes = (uint8_t *) calloc(1, size);
+        if (!b->bytes) {
+            panic("out of memory");
+        }
+        b->size = size;
+    }
+    return b;
+}
+
+void audio_init_buffer(audio_buffer_t *audio_buffer, audio_buffer_format_t *format, int buffer_sample_count) {
+    audio_buffer->format = format;
+    audio_buffer->buffer = pico_buffer_alloc((size_t) buffer_sample_count * format->sample_stride);
+    audio_buffer->max_sample_count = (uint32_t) buffer_sample_count;
+    audio_buffer->sample_count = 0;
+}
+
+audio_buffer_t *audio_new_buffer(audio_buffer_format_t *format, int buffer_sample_count) {
+    audio_buffer_t *buffer = (audio_buffer_t *) calloc(1, sizeof(audio_buffer_t));
+    audio_init_buffer(buffer, format, buffer_sample_count);
+    return buffer;
+}
+
+audio_buffer_t *audio_new_wrapping_buffer(audio_buffer_format_t *format, mem_buffer_t *buffer) {
+    audio_buffer_t *audio_buffer = (audio_buffer_t *) calloc(1, sizeof(audio_buffer_t));
+    if (audio_buffer) {
+        audio_buffer->format = format;
+        audio_buffer->buffer = buffer;
+        audio_buffer->max_sample_count = (uint32_t) (buffer->size / format->sample_stride);
+        audio_buffer->sample_count = 0;
+        audio_buffer->next = 0;
+    }
+    return audio_buffer;
+}
+
+static audio_buffer_pool_t *audio_new_buffer_pool(audio_buffer_format_t *format, int buffer_count,
+                                                  int buffer_sample_count) {
+    audio_buffer_pool_t *ac = (audio_buffer_pool_t *) calloc(1, sizeof(audio_buffer_pool_t));
+    audio_buffer_t *audio_buffers = buffer_count ? (audio_buffer_t *) calloc((size_t) buffer_count,
+                                                                             sizeof(audio_buffer_t)) : 0;
+    ac->format = format->format;
+    for (int i = 0; i < buffer_count; i++) {
+        audio_init_buffer(audio_buffers + i, format, buffer_sample_count);
+        audio_buffers[i].next = i != buffer_count - 1 ? &audio_buffers[i + 1] : NULL;
+    }
+    ac->free_list_spin_lock = spin_lock_init(SPINLOCK_ID_AUDIO_FREE_LIST_LOCK);
+    ac->free_list = audio_buffers;
+    ac->prepared_list_spin_lock = spin_lock_init(SPINLOCK_ID_AUDIO_PREPARED_LISTS_LOCK);
+    ac->prepared_list = NULL;
+    ac->prepared_list_tail = NULL;
+    ac->connection = &connection_default;
+    return ac;
+}
+
+audio_buffer_pool_t *audio_new_producer_pool(audio_buffer_format_t *format, int buffer_count,
+                                             int buffer_sample_count) {
+    audio_buffer_pool_t *ac = audio_new_buffer_pool(format, buffer_count, buffer_sample_count);
+    ac->type = ac_producer;
+    return ac;
+}
+
+audio_buffer_pool_t *audio_new_consumer_pool(audio_buffer_format_t *format, int buffer_count,
+                                             int buffer_sample_count) {
+    audio_buffer_pool_t *ac = audio_new_buffer_pool(format, buffer_count, buffer_sample_count);
+    ac->type = ac_consumer;
+    return ac;
+}
+
+audio_buffer_t *get_free_audio_buffer(audio_buffer_pool_t *context, bool block) {
+    audio_buffer_t *ab;
+    do {
+        uint32_t save = spin_lock_blocking(context->free_list_spin_lock);
+        ab = context->free_list;
+        if (ab) {
+            context->free_list = ab->next;
+        }
+        spin_unlock(context->free_list_spin_lock, save);
+        if (ab || !block) break;
+        __wfe();
+    } while (true);
+    if (ab) {
+        ab->next = NULL;
+    }
+    return ab;
+}
+
+void queue_free_audio_buffer(audio_buffer_pool_t *context, audio_buffer_t *ab) {
+    assert(!ab->next);
+    uint32_t save = spin_lock_blocking(context->free_list_spin_lock);
+    ab->next = context->free_list;
+    context->free_list = ab;
+    spin_unlock(context->free_list_spin_lock, save);
+    __sev();
+}
+
+audio_buffer_t *get_full_audio_buffer(audio_buffer_pool_t *context, bool block) {
+    audio_buffer_t *ab;
+    do {
+        uint32_t save = spin_lock_blocking(context->prepared_list_spin_lock);
+        ab = context->prepared_list;
+        if (ab) {
+            context->prepared_list = ab->next;
+            if (!ab->next) {
+                context->prepared_list_tail = NULL;
+            }
+        }
+        spin_unlock(context->prepared_list_spin_lock, save);
+        if (ab || !block) break;
+        __wfe();
+    } while (true);
+    if (ab) {
+        ab->next = NULL;
+    }
+    return ab;
+}
+
+void queue_full_audio_buffer(audio_buffer_pool_t *context, audio_buffer_t *ab) {
+    assert(!ab->next);
+    uint32_t save = spin_lock_blocking(context->prepared_list_spin_lock);
+    if (context->prepared_list_tail) {
+        context->prepared_list_tail->next = ab;
+    } else {
+        context->prepared_list = ab;
+    }
+    context->prepared_list_tail = ab;
+    spin_unlock(context->prepared_list_spin_lock, save);
+    __sev();
+}
+
+void producer_pool_give_buffer_default(audio_connection_t *connection, audio_buffer_t *buffer) {
+    queue_full_audio_buffer(connection->producer_pool, buffer);
+}
+
+audio_buffer_t *producer_pool_take_buffer_default(audio_connection_t *connection, bool block) {
+    return get_free_audio_buffer(connection->producer_pool, block);
+}
+
+void consumer_pool_give_buffer_default(audio_connection_t *connection, audio_buffer_t *buffer) {
+    queue_free_audio_buffer(connection->consumer_pool, buffer);
+}
+
+audio_buffer_t *consumer_pool_take_buffer_default(audio_connection_t *connection, bool block) {
+    return get_full_audio_buffer(connection->consumer_pool, block);
+}
+
+void give_audio_buffer(audio_buffer_pool_t *ac, audio_buffer_t *buffer) {
+    buffer->user_data = 0;
+    assert(ac->connection);
+    if (ac->type == ac_producer) {
+        ac->connection->producer_pool_give(ac->connection, buffer);
+    } else {
+        ac->connection->consumer_pool_give(ac->connection, buffer);
+    }
+}
+
+audio_buffer_t *take_audio_buffer(audio_buffer_pool_t *ac, bool block) {
+    assert(ac->connection);
+    if (ac->type == ac_producer) {
+        return ac->connection->producer_pool_take(ac->connection, block);
+    } else {
+        return ac->connection->consumer_pool_take(ac->connection, block);
+    }
+}
+
+void audio_complete_connection(audio_connection_t *connection, audio_buffer_pool_t *producer_pool,
+                               audio_buffer_pool_t *consumer_pool) {
+    assert(producer_pool->type == ac_producer);
+    assert(consumer_pool->type == ac_consumer);
+    producer_pool->connection = connection;
+    consumer_pool->connection = connection;
+    connection->producer_pool = producer_pool;
+    connection->consumer_pool = consumer_pool;
+}
+
+void stereo_to_stereo_producer_give(audio_connection_t *connection, audio_buffer_t *buffer) {
+    struct producer_pool_blocking_give_connection *pbc = (struct producer_pool_blocking_give_connection *) connection;
+    const uint frame_bytes = 4; // stereo S16
+    uint pos = 0;
+    while (pos < buffer->sample_count) {
+        if (!pbc->current_consumer_buffer) {
+            pbc->current_consumer_buffer = get_free_audio_buffer(pbc->core.consumer_pool, true);
+            pbc->current_consumer_buffer_pos = 0;
+        }
+        audio_buffer_t *consumer_buffer = pbc->current_consumer_buffer;
+        uint sample_count = MIN(buffer->sample_count - pos,
+                                consumer_buffer->max_sample_count - pbc->current_consumer_buffer_pos);
+        memcpy(consumer_buffer->buffer->bytes + pbc->current_consumer_buffer_pos * frame_bytes,
+               buffer->buffer->bytes + pos * frame_bytes, sample_count * frame_bytes);
+        pos += sample_count;
+        pbc->current_consumer_buffer_pos += sample_count;
+        if (pbc->current_consumer_buffer_pos == consumer_buffer->max_sample_count) {
+            consumer_buffer->sample_count = consumer_buffer->max_sample_count;
+            queue_full_audio_buffer(pbc->core.consumer_pool, consumer_buffer);
+            pbc->current_consumer_buffer = NULL;
+        }
+    }
+    assert(pos == buffer->sample_count);
+    queue_free_audio_buffer(pbc->core.producer_pool, buffer);
+}
@@ -0,0 +1,435 @@
+/*
+ * Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/** \file dma.c
+ *  \brief DMA emulation and hardware_dma API of the host simulation
+ *
+ * A busy channel makes a transfer on a cycle its DREQ is asserted: a PIO TX
+ * FIFO DREQ while the FIFO has room, an RX FIFO DREQ while it has data, and
+ * DREQ_FORCE always. The DMA makes at most one transfer per cycle, handing
+ * them out round robin among the ready channels, high priority channels
+ * first. TRANS_COUNT written by the code under test is the reload value;
+ * reading it returns the live count of the running (or last) transfer, as on
+ * the RP2350.
+ *
+ * Transfers read and write host memory, except for addresses in the PIO TX /
+ * RX FIFO registers and the DMA channel registers, which are decoded; an 8 or
+ * 16-bit write to either is replicated across the 32-bit register, as the bus
+ * does. Writing a zero to a trigger alias is a null trigger: the channel does
+ * not start, and raises its interrupt if IRQ_QUIET is set.
+ *
+ * Not emulated: sniffing, pacing timers, TRANS_COUNT modes and bus errors.
+ */
+
+#include <string.h>
+
+#include "sim_internal.h"
+#include "hardware/dma.h"
+
+typedef struct {
+    uint32_t read_addr;
+    uint32_t write_addr;
+    uint32_t trans_count; // reload value
+    uint32_t remaining;
+    uint32_t ctrl;
+} sim_dma_channel_t;
+
+dma_hw_t host_dma_hw;
+
+static sim_dma_channel_t channels[NUM_DMA_CHANNELS];
+static uint32_t claimed;
+static uint32_t busy;
+static uint32_t intr;
+static uint32_t inte[NUM_DMA_IRQS];
+static uint32_t intf[NUM_DMA_IRQS];
+static uint next_channel; // round robin position
+
+static void dma_start(uint ch);
+
+static void raise_irq(uint ch) {
+    intr |= 1u << ch;
+    sim_irq_update();
+}
+
+static void dma_complete(uint ch) {
+    sim_dma_channel_t *c = &channels[ch];
+    busy &= ~(1u << ch);
+    if (!(c->ctrl & DMA_CH0_CTRL_TRIG_IRQ_QUIET_BITS)) {
+        raise_irq(ch);
+    }
+    uint chain_to = (c->ctrl & DMA_CH0_CTRL_TRIG_CHAIN_TO_BITS) >> DMA_CH0_CTRL_TRIG_CHAIN_TO_LSB;
+    if (chain_to != ch) {
+        dma_start(chain_to);
+    }
+}
+
+static void dma_start(uint ch) {
+    sim_dma_channel_t *c = &channels[ch];
+    if ((busy & (1u << ch)) || !(c->ctrl & DMA_CH0_CTRL_TRIG_EN_BITS)) {
+        return;
+    }
+    busy |= 1u << ch;
+    // a zero count completes on the next cycle, without a transfer
+    c->remaining = c->trans_count;
+}
+
+/** \brief Write register reg (index in dma_channel_hw_t) of channel ch */
+static void channel_write(uint ch, uint reg, uint32_t value) {
+    sim_dma_channel_t *c = &channels[ch];
+    switch (reg) {
+        case 0:
+        case 5:
+        case 10:
+        case 15:
+            c->read_addr = value;
+            break;
+        case 1:
+        case 6:
+        case 11:
+        case 13:
+            c->write_addr = value;
+            break;
+        case 2:
+        case 7:
+        case 9:
+        case 14:
+            c->trans_count = value & DMA_CH0_TRANS_COUNT_COUNT_BITS;
+            break;
+        default:
+            c->ctrl = value & ~DMA_CH0_CTRL_TRIG_BUSY_BITS;
+            break;
+    }
+    // the last register of each alias group is a trigger
+    if ((reg & 3u) == 3u) {
+        if (value) {
+            dma_start(ch);
+        } else if (c->ctrl & DMA_CH0_CTRL_TRIG_IRQ_QUIET_BITS) {
+            raise_irq(ch);
+        }
+    }
+}
+
+static uint32_t channel_read(uint ch, uint reg) {
+    const sim_dma_channel_t *c = &channels[ch];
+    switch (reg) {
+        case 0:
+        case 5:
+        case 10:
+        case 15:
+            return c->read_addr;
+        case 1:
+        case 6:
+        case 11:
+        case 13:
+            return c->write_addr;
+        case 2:
+        case 7:
+        case 9:
+        case 14:
+            return c->remaining;
+        default:
+            return c->ctrl | ((busy & (1u << ch)) ? DMA_CH0_CTRL_TRIG_BUSY_BITS : 0);
+    }
+}
+
+/** \brief Decode addr as a channel register, or return false if it is outside the DMA block */
+static bool decode_channel_reg(uint32_t addr, uint *ch, uint *reg) {
+    uint32_t base = host_bus_addr(&host_dma_hw);
+    if (addr < base || addr >= base + sizeof(host_dma_hw)) {
+        return false;
+    }
+    uint32_t offset = addr - base;
+    if (offset >= sizeof(host_dma_hw.ch)) {
+        panic("DMA access to DMA register at offset 0x%03x not supported", (uint) offset);
+    }
+    *ch = offset / sizeof(dma_channel_hw_t);
+    *reg = (offset % sizeof(dma_channel_hw_t)) / 4;
+    return true;
+}
+
+static uint32_t bus_read(uint32_t addr, uint size) {
+    uint32_t value = 0;
+    uint ch, reg;
+    if (sim_pio_bus_read(addr, &value)) {
+        return value;
+    }
+    if (decode_channel_reg(addr, &ch, &reg)) {
+        return channel_read(ch, reg);
+    }
+    memcpy(&value, host_bus_ptr(addr), size);
+    return value;
+}
+
+static void bus_write(uint32_t addr, uint32_t value, uint size) {
+    uint32_t replicated = size == 1 ? (value & 0xffu) * 0x01010101u : size == 2 ? (value & 0xffffu) * 0x00010001u : value;
+    uint ch, reg;
+    if (sim_pio_bus_write(addr, replicated)) {
+        return;
+    }
+    if (decode_channel_reg(addr, &ch, &reg)) {
+        channel_write(ch, reg, replicated);
+        return;
+    }
+    memcpy(host_bus_ptr(addr), &value, size);
+}
+
+static uint32_t advance_addr(uint32_t addr, int32_t step, uint ring_size) {
+    if (!ring_size) {
+        return addr + (uint32_t) step;
+    }
+    uint32_t mask = (1u << ring_size) - 1u;
+    return (addr & ~mask) | ((addr + (uint32_t) step) & mask);
+}
+
+static bool dreq_ready(const sim_dma_channel_t *c) {
+    uint treq = (c->ctrl & DMA_CH0_CTRL_TRIG_TREQ_SEL_BITS) >> DMA_CH0_CTRL_TRIG_TREQ_SEL_LSB;
+    if (treq == DREQ_FORCE) {
+        return true;
+    }
+    if (treq >= NUM_PIOS * 8) {
+        panic("DREQ %u not emulated", treq);
+    }
+    return sim_pio_dreq(treq);
+}
+
+static void dma_transfer(uint ch) {
+    sim_dma_channel_t *c = &channels[ch];
+    uint size = 1u << ((c->ctrl & DMA_CH0_CTRL_TRIG_DATA_SIZE_BITS) >> DMA_CH0_CTRL_TRIG_DATA_SIZE_LSB);
+    uint32_t value = bus_read(c->read_addr, size);
+    if ((c->ctrl & DMA_CH0_CTRL_TRIG_BSWAP_BITS) && size > 1) {
+        value = size == 2 ? (uint32_t) __builtin_bswap16((uint16_t) value) : __builtin_bswap32(value);
+    }
+    bus_write(c->write_addr, value, size);
+    uint ring_size = (c->ctrl & DMA_CH0_CTRL_TRIG_RING_SIZE_BITS) >> DMA_CH0_CTRL_TRIG_RING_SIZE_LSB;
+    bool ring_write = c->ctrl & DMA_CH0_CTRL_TRIG_RING_SEL_BITS;
+    if (c->ctrl & DMA_CH0_CTRL_TRIG_INCR_READ_BITS) {
+        int32_t step = (c->ctrl & DMA_CH0_CTRL_TRIG_INCR_READ_REV_BITS) ? -(int32_t) size : (int32_t) size;
+        c->read_addr = advance_addr(c->read_addr, step, ring_write ? 0 : ring_size);
+    }
+    if (c->ctrl & DMA_CH0_CTRL_TRIG_INCR_WRITE_BITS) {
+        int32_t step = (c->ctrl & DMA_CH0_CTRL_TRIG_INCR_WRITE_REV_BITS) ? -(int32_t) size : (int32_t) size;
+        c->write_addr = advance_addr(c->write_addr, step, ring_write ? ring_size : 0);
+    }
+    if (!--c->remaining) {
+        dma_complete(ch);
+    }
+}
+
+void sim_dma_cycle(void) {
+    if (!busy) {
+        return;
+    }
+    for (uint32_t mask = busy; mask; mask &= mask - 1) {
+        uint ch = (uint) __builtin_ctz(mask);
+        if (!channels[ch].remaining) {
+            dma_complete(ch);
+        }
+    }
+    for (int pass = 0; pass < 2; pass++) {
+        bool high = !pass;
+        for (uint i = 0; i < NUM_DMA_CHANNELS; i++) {
+            uint ch = (next_channel + i) % NUM_DMA_CHANNELS;
+            const sim_dma_channel_t *c = &channels[ch];
+            if (!(busy & (1u << ch)) || !(c->ctrl & DMA_CH0_CTRL_TRIG_HIGH_PRIORITY_BITS) != !high ||
+                !dreq_ready(c)) {
+                continue;
+            }
+            dma_transfer(ch);
+            next_channel = (ch + 1) % NUM_DMA_CHANNELS;
+            return;
+        }
+    }
+}
+
+uint32_t sim_dma_ints(uint irq_index) {
+    return (intr & inte[irq_index]) | intf[irq_index];
+}
+
+void sim_dma_reconcile(void) {
+    bool changed = false;
+    for (uint n = 0; n < NUM_DMA_IRQS; n++) {
+        uint32_t ints = host_dma_hw.irq_ctrl[n].ints;
+        if (!(ints & SIM_W1C_TAG)) {
+            // writing INTSn clears the raw INTR bits
+            intr &= ~ints;
+            changed = true;
+        }
+    }
+    if (changed) {
+        sim_irq_update();
+        for (uint n = 0; n < NUM_DMA_IRQS; n++) {
+            host_dma_hw.irq_ctrl[n].ints = sim_dma_ints(n) | SIM_W1C_TAG;
+        }
+    }
+}
+
+void sim_dma_publish(void) {
+    for (uint ch = 0; ch < NUM_DMA_CHANNELS; ch++) {
+        io_rw_32 *regs = &host_dma_hw.ch[ch].read_addr;
+        for (uint reg = 0; reg < sizeof(dma_channel_hw_t) / 4; reg++) {
+            regs[reg] = channel_read(ch, reg);
+        }
+    }
+    SIM_PUBLISH_RO(host_dma_hw.intr, intr);
+    for (uint n = 0; n < NUM_DMA_IRQS; n++) {
+        host_dma_hw.irq_ctrl[n].inte = inte[n];
+        host_dma_hw.irq_ctrl[n].intf = intf[n];
+        host_dma_hw.irq_ctrl[n].ints = sim_dma_ints(n) | SIM_W1C_TAG;
+    }
+    SIM_PUBLISH_RO(host_dma_hw.n_channels, NUM_DMA_CHANNELS);
+}
+
+// Claims
+
+void dma_channel_claim(uint channel) {
+    check_dma_channel_param(channel);
+    if (claimed & (1u << channel)) {
+        panic("DMA channel %u is already claimed", channel);
+    }
+    claimed |= 1u << channel;
+}
+
+void dma_claim_mask(uint32_t channel_mask) {
+    for (uint ch = 0; channel_mask; ch++, channel_mask >>= 1u) {
+        if (channel_mask & 1u) {
+            dma_channel_claim(ch);
+        }
+    }
+}
+
+void dma_channel_unclaim(uint channel) {
+    check_dma_channel_param(channel);
+    claimed &= ~(1u << channel);
+}
+
+int dma_claim_unused_channel(bool required) {
+    for (uint ch = 0; ch < NUM_DMA_CHANNELS; ch++) {
+        if (!(claimed & (1u << ch))) {
+            claimed |= 1u << ch;
+            return (int) ch;
+        }
+    }
+    if (required) {
+        panic("No DMA channels are available");
+    }
+    return -1;
+}
+
+bool dma_channel_is_claimed(uint channel) {
+    check_dma_channel_param(channel);
+    return claimed & (1u << channel);
+}
+
+// Channel registers
+
+dma_channel_config dma_get_channel_config(uint channel) {
+    check_dma_channel_param(channel);
+    sim_access();
+    return (dma_channel_config) {.ctrl = channels[channel].ctrl};
+}
+
+void dma_channel_set_config(uint channel, const dma_channel_config *config, bool trigger) {
+    check_dma_channel_param(channel);
+    sim_access();
+    channel_write(channel, trigger ? 3 : 4, config->ctrl);
+}
+
+void dma_channel_set_read_addr(uint channel, const volatile void *read_addr, bool trigger) {
+    check_dma_channel_param(channel);
+    sim_access();
+    channel_write(channel, trigger ? 15 : 0, host_bus_addr(read_addr));
+}
+
+void dma_channel_set_write_addr(uint channel, volatile void *write_addr, bool trigger) {
+    check_dma_channel_param(channel);
+    sim_access();
+    channel_write(channel, trigger ? 11 : 1, host_bus_addr(write_addr));
+}
+
+void dma_channel_set_trans_count(uint channel, uint32_t trans_count, bool trigger) {
+    check_dma_channel_param(channel);
+    sim_access();
+    channel_write(channel, trigger ? 7 : 2, trans_count);
+}
+
+void dma_channel_configure(uint channel, const dma_channel_config *config, volatile void *write_addr,
+                           const volatile void *read_addr, uint transfer_count, bool trigger) {
+    dma_channel_set_read_addr(channel, read_addr, false);
+    dma_channel_set_write_addr(channel, write_addr, false);
+    dma_channel_set_trans_count(channel, transfer_count, false);
+    dma_channel_set_config(channel, config, trigger);
+}
+
+void dma_channel_transfer_from_buffer_now(uint channel, const volatile void *read_addr, uint32_t transfer_count) {
+    dma_channel_set_read_addr(channel, read_addr, false);
+    dma_channel_set_trans_count(channel, transfer_count, true);
+}
+
+void dma_channel_transfer_to_buffer_now(uint channel, volatile void *write_addr, uint32_t transfer_count) {
+    dma_channel_set_write_addr(channel, write_addr, false);
+    dma_channel_set_trans_count(channel, transfer_count, true);
+}
+
+void dma_start_channel_mask(uint32_t chan_mask) {
+    sim_access();
+    for (uint ch = 0; ch < NUM_DMA_CHANNELS; ch++) {
+        if (chan_mask & (1u << ch)) {
+            dma_start(ch);
+        }
+    }
+}
+
+void dma_channel_start(uint channel) {
+    check_dma_channel_param(channel);
+    dma_start_channel_mask(1u << channel);
+}
+
+void dma_channel_abort(uint channel) {
+    check_dma_channel_param(channel);
+    sim_access();
+    busy &= ~(1u << channel);
+}
+
+bool dma_channel_is_busy(uint channel) {
+    check_dma_channel_param(channel);
+    sim_access();
+    return busy & (1u << channel);
+}
+
+void dma_channel_wait_for_finish_blocking(uint channel) {
+    while (dma_channel_is_busy(channel)) {
+        tight_loop_contents();
+    }
+}
+
+// Interrupts
+
+void dma_irqn_set_channel_mask_enabled(uint irq_index, uint32_t channel_mask, bool enabled) {
+    valid_params_if(HARDWARE_DMA, irq_index < NUM_DMA_IRQS);
+    sim_access();
+    inte[irq_index] = enabled ? inte[irq_index] | channel_mask : inte[irq_index] & ~channel_mask;
+    sim_irq_update();
+}
+
+void dma_irqn_set_channel_enabled(uint irq_index, uint channel, bool enabled) {
+    check_dma_channel_param(channel);
+    dma_irqn_set_channel_mask_enabled(irq_index, 1u << channel, enabled);
+}
+
+bool dma_irqn_get_channel_status(uint irq_index, uint channel) {
+    valid_params_if(HARDWARE_DMA, irq_index < NUM_DMA_IRQS);
+    check_dma_channel_param(channel);
+    sim_access();
+    return sim_dma_ints(irq_index) & (1u << channel);
+}
+
+void dma_irqn_acknowledge_channel(__unused uint irq_index, uint channel) {
+    valid_params_if(HARDWARE_DMA, irq_index < NUM_DMA_IRQS);
+    check_dma_channel_param(channel);
+    sim_access();
+    intr &= ~(1u << channel);
+    sim_irq_update();
+}
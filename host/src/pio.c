@@ -0,0 +1,1190 @@
+/*
+ * Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/** \file pio.c
+ *  \brief PIO emulator and hardware_pio API of the host simulation
+ *
+ * Each enabled state machine advances its fractional clock divider every
+ * clk_sys cycle and executes one instruction per divider tick, as the PIO
+ * does: delays count down first, a stalled instruction (OUT on an empty OSR
+ * and TX FIFO with autopull, blocking PULL/PUSH, WAIT, IRQ wait) is retried on
+ * the next tick, and side-set is applied on every attempt, after the
+ * instruction's own pin writes. Autopull refills the OSR as soon as an OUT
+ * empties it. The pads of a block are written in state machine order, so
+ * the highest numbered state machine wins a conflict, and instructions that
+ * read pins see their levels at the end of the previous cycle.
+ *
+ * Not emulated: PIO interrupts to the CPU, the RP2350 GPIO base, the prev/next
+ * block IRQ index modes, OUT_STICKY / INLINE_OUT_EN and input synchroniser
+ * bypass.
+ */
+
+#include <string.h>
+
+#include "sim_internal.h"
+#include "hardware/gpio.h"
+#include "hardware/pio.h"
+
+#define SIM_PIO_FIFO_MAX 8
+
+typedef struct {
+    uint32_t clkdiv;
+    uint32_t execctrl;
+    uint32_t shiftctrl;
+    uint32_t pinctrl;
+    uint32_t div;     // clock divider in 1/256 clk_sys cycles
+    uint32_t div_acc;
+    uint32_t x, y, isr, osr;
+    uint isr_count;
+    uint osr_count;
+    uint8_t pc;
+    uint delay;
+    bool exec_pending;
+    uint16_t exec_instr;
+    bool irq_waiting;
+    bool tx_stalled;
+    uint32_t tx_fifo[SIM_PIO_FIFO_MAX];
+    uint tx_head, tx_level;
+    uint32_t rx_fifo[SIM_PIO_FIFO_MAX];
+    uint rx_head, rx_level;
+    host_pio_sm_stats_t stats;
+} sim_sm_t;
+
+typedef struct {
+    sim_sm_t sm[NUM_PIO_STATE_MACHINES];
+    uint16_t instr_mem[32];
+    uint32_t used_instruction_space;
+    uint32_t claimed;
+    uint32_t enabled;
+    uint32_t irq;
+    uint32_t fdebug;
+    uint32_t pad_out;
+    uint32_t pad_oe;
+} sim_pio_t;
+
+pio_hw_t host_pio_hw[NUM_PIOS];
+
+static sim_pio_t pios[NUM_PIOS];
+
+static inline sim_pio_t *sim_pio(PIO pio) {
+    return &pios[pio_get_index(pio)];
+}
+
+static inline void check_sm_param(uint sm) {
+    if (sm >= NUM_PIO_STATE_MACHINES) {
+        panic("PIO state machine %u out of range", sm);
+    }
+}
+
+static inline sim_sm_t *sim_sm(PIO pio, uint sm) {
+    check_sm_param(sm);
+    return &sim_pio(pio)->sm[sm];
+}
+
+static void sm_set_clkdiv(sim_sm_t *s, uint32_t clkdiv) {
+    s->clkdiv = clkdiv;
+    uint32_t div_int = clkdiv >> PIO_SM0_CLKDIV_INT_LSB;
+    s->div = (div_int ? div_int : 65536u) * 256u + ((clkdiv >> PIO_SM0_CLKDIV_FRAC_LSB) & 0xffu);
+}
+
+static void sm_stats_reset(sim_sm_t *s) {
+    s->stats = (host_pio_sm_stats_t) {
+            .tx_min_level = UINT32_MAX,
+    };
+}
+
+static void __attribute__((constructor)) sim_pio_init(void) {
+    pio_sm_config c = pio_get_default_sm_config();
+    for (uint i = 0; i < NUM_PIOS; i++) {
+        for (uint sm = 0; sm < NUM_PIO_STATE_MACHINES; sm++) {
+            sim_sm_t *s = &pios[i].sm[sm];
+            sm_set_clkdiv(s, c.clkdiv);
+            s->execctrl = c.execctrl;
+            s->shiftctrl = c.shiftctrl;
+            s->pinctrl = c.pinctrl;
+            s->osr_count = 32;
+            sm_stats_reset(s);
+        }
+    }
+}
+
+// Register fields
+
+static inline uint pull_thresh(const sim_sm_t *s) {
+    uint thresh = (s->shiftctrl >> PIO_SM0_SHIFTCTRL_PULL_THRESH_LSB) & 0x1fu;
+    return thresh ? thresh : 32;
+}
+
+static inline uint push_thresh(const sim_sm_t *s) {
+    uint thresh = (s->shiftctrl >> PIO_SM0_SHIFTCTRL_PUSH_THRESH_LSB) & 0x1fu;
+    return thresh ? thresh : 32;
+}
+
+static inline bool autopull(const sim_sm_t *s) {
+    return (s->shiftctrl >> PIO_SM0_SHIFTCTRL_AUTOPULL_LSB) & 1u;
+}
+
+static inline bool autopush(const sim_sm_t *s) {
+    return (s->shiftctrl >> PIO_SM0_SHIFTCTRL_AUTOPUSH_LSB) & 1u;
+}
+
+static inline uint tx_capacity(const sim_sm_t *s) {
+    if ((s->shiftctrl >> PIO_SM0_SHIFTCTRL_FJOIN_TX_LSB) & 1u) {
+        return 8;
+    }
+    return ((s->shiftctrl >> PIO_SM0_SHIFTCTRL_FJOIN_RX_LSB) & 1u) ? 0 : 4;
+}
+
+static inline uint rx_capacity(const sim_sm_t *s) {
+    if ((s->shiftctrl >> PIO_SM0_SHIFTCTRL_FJOIN_RX_LSB) & 1u) {
+        return 8;
+    }
+    return ((s->shiftctrl >> PIO_SM0_SHIFTCTRL_FJOIN_TX_LSB) & 1u) ? 0 : 4;
+}
+
+static inline uint pinctrl_field(const sim_sm_t *s, uint lsb, uint bits) {
+    return (s->pinctrl >> lsb) & ((1u << bits) - 1u);
+}
+
+static inline uint32_t rotl32(uint32_t v, uint n) {
+    n &= 31u;
+    return n ? (v << n) | (v >> (32u - n)) : v;
+}
+
+static inline uint32_t rotr32(uint32_t v, uint n) {
+    n &= 31u;
+    return n ? (v >> n) | (v << (32u - n)) : v;
+}
+
+static inline uint32_t low_mask(uint bits) {
+    return bits >= 32 ? ~0u : (1u << bits) - 1u;
+}
+
+static void write_pads(uint32_t *pads, uint32_t values, uint32_t mask) {
+    uint32_t v = (*pads & ~mask) | (values & mask);
+    if (v != *pads) {
+        *pads = v;
+        sim_pads_dirty = true;
+    }
+}
+
+/** \brief Write count bits of values to the pads (or pad directions) from pin base, wrapping at 32 */
+static void write_pins(sim_pio_t *p, uint base, uint count, uint32_t values, bool pindirs) {
+    if (!count) {
+        return;
+    }
+    uint32_t mask = rotl32(low_mask(count), base);
+    write_pads(pindirs ? &p->pad_oe : &p->pad_out, rotl32(values, base), mask);
+}
+
+static inline uint32_t read_pins(const sim_sm_t *s) {
+    return rotr32(sim_pin_levels, pinctrl_field(s, PIO_SM0_PINCTRL_IN_BASE_LSB, 5));
+}
+
+// FIFOs
+
+static bool tx_push(sim_sm_t *s, uint32_t v) {
+    if (s->tx_level >= tx_capacity(s)) {
+        return false;
+    }
+    s->tx_fifo[(s->tx_head + s->tx_level) % SIM_PIO_FIFO_MAX] = v;
+    s->tx_level++;
+    return true;
+}
+
+static bool tx_pop(sim_sm_t *s, uint32_t *v) {
+    if (!s->tx_level) {
+        return false;
+    }
+    *v = s->tx_fifo[s->tx_head];
+    s->tx_head = (s->tx_head + 1) % SIM_PIO_FIFO_MAX;
+    s->tx_level--;
+    return true;
+}
+
+static bool rx_push(sim_sm_t *s, uint32_t v) {
+    if (s->rx_level >= rx_capacity(s)) {
+        return false;
+    }
+    s->rx_fifo[(s->rx_head + s->rx_level) % SIM_PIO_FIFO_MAX] = v;
+    s->rx_level++;
+    return true;
+}
+
+static bool rx_pop(sim_sm_t *s, uint32_t *v) {
+    if (!s->rx_level) {
+        return false;
+    }
+    *v = s->rx_fifo[s->rx_head];
+    s->rx_head = (s->rx_head + 1) % SIM_PIO_FIFO_MAX;
+    s->rx_level--;
+    return true;
+}
+
+static void clear_fifos(sim_sm_t *s) {
+    s->tx_head = s->tx_level = 0;
+    s->rx_head = s->rx_level = 0;
+}
+
+// Execution
+
+static bool sm_pull(sim_pio_t *p, uint sm, sim_sm_t *s) {
+    uint32_t v;
+    if (!tx_pop(s, &v)) {
+        return false;
+    }
+    s->osr = v;
+    s->osr_count = 0;
+    s->stats.pulls++;
+    if ((p->enabled & (1u << sm)) && s->tx_level < s->stats.tx_min_level) {
+        s->stats.tx_min_level = s->tx_level;
+    }
+    return true;
+}
+
+static void tx_stall(sim_pio_t *p, uint sm, sim_sm_t *s) {
+    p->fdebug |= 1u << (PIO_FDEBUG_TXSTALL_LSB + sm);
+    if (!s->tx_stalled) {
+        s->tx_stalled = true;
+        s->stats.tx_stalls++;
+    }
+    s->stats.tx_stall_cycles++;
+}
+
+static uint32_t osr_shift(sim_sm_t *s, uint n) {
+    uint32_t data;
+    if ((s->shiftctrl >> PIO_SM0_SHIFTCTRL_OUT_SHIFTDIR_LSB) & 1u) {
+        data = s->osr & low_mask(n);
+        s->osr = n == 32 ? 0 : s->osr >> n;
+    } else {
+        data = n == 32 ? s->osr : s->osr >> (32 - n);
+        s->osr = n == 32 ? 0 : s->osr << n;
+    }
+    s->osr_count = MIN(32u, s->osr_count + n);
+    return data;
+}
+
+static void isr_shift(sim_sm_t *s, uint32_t data, uint n) {
+    data &= low_mask(n);
+    if (n == 32) {
+        s->isr = data;
+    } else if ((s->shiftctrl >> PIO_SM0_SHIFTCTRL_IN_SHIFTDIR_LSB) & 1u) {
+        s->isr = (s->isr >> n) | (data << (32 - n));
+    } else {
+        s->isr = (s->isr << n) | data;
+    }
+    s->isr_count = MIN(32u, s->isr_count + n);
+}
+
+static uint irq_index(uint sm, uint index) {
+    uint mode = (index >> 3) & 3u;
+    if (mode == 2) {
+        return (index & 4u) | ((index + sm) & 3u);
+    }
+    if (mode) {
+        panic("PIO IRQ index mode %u (prev/next block) not supported", mode);
+    }
+    return index & 7u;
+}
+
+static uint32_t bit_reverse(uint32_t v) {
+    uint32_t r = 0;
+    for (uint i = 0; i < 32; i++) {
+        r = (r << 1) | ((v >> i) & 1u);
+    }
+    return r;
+}
+
+/** \brief Execute instr on state machine sm
+ *  \return false if the instruction stalled and must be retried
+ */
+static bool sm_execute(sim_pio_t *p, uint sm, sim_sm_t *s, uint16_t instr, bool is_exec) {
+    uint side_count = pinctrl_field(s, PIO_SM0_PINCTRL_SIDESET_COUNT_LSB, 3);
+    bool side_opt = (s->execctrl >> PIO_SM0_EXECCTRL_SIDE_EN_LSB) & 1u;
+    uint delay_bits = 5 - side_count;
+    uint field = (instr >> 8) & 0x1fu;
+    uint delay = field & low_mask(delay_bits);
+
+    bool stalled = false;
+    bool jump = false;
+    uint jump_to = 0;
+    bool new_exec = false;
+    uint16_t new_exec_instr = 0;
+    uint op = instr >> 13;
+    uint arg1 = (instr >> 5) & 7u;
+    uint arg2 = instr & 0x1fu;
+    uint out_base = pinctrl_field(s, PIO_SM0_PINCTRL_OUT_BASE_LSB, 5);
+    uint out_count = pinctrl_field(s, PIO_SM0_PINCTRL_OUT_COUNT_LSB, 6);
+
+    switch (op) {
+        case 0: { // JMP
+            bool taken;
+            switch (arg1) {
+                case 0:
+                    taken = true;
+                    break;
+                case 1:
+                    taken = !s->x;
+                    break;
+                case 2:
+                    taken = s->x != 0;
+                    s->x--;
+                    break;
+                case 3:
+                    taken = !s->y;
+                    break;
+                case 4:
+                    taken = s->y != 0;
+                    s->y--;
+                    break;
+                case 5:
+                    taken = s->x != s->y;
+                    break;
+                case 6:
+                    taken = (sim_pin_levels >> ((s->execctrl >> PIO_SM0_EXECCTRL_JMP_PIN_LSB) & 0x1fu)) & 1u;
+                    break;
+                default:
+                    taken = s->osr_count < pull_thresh(s);
+                    break;
+            }
+            if (taken) {
+                jump = true;
+                jump_to = arg2;
+            }
+            break;
+        }
+        case 1: { // WAIT
+            uint polarity = (instr >> 7) & 1u;
+            uint level;
+            switch ((instr >> 5) & 3u) {
+                case 0:
+                    level = (sim_pin_levels >> arg2) & 1u;
+                    break;
+                case 1:
+                    level = (read_pins(s) >> arg2) & 1u;
+                    break;
+                case 2: {
+                    uint irq = irq_index(sm, arg2);
+                    level = (p->irq >> irq) & 1u;
+                    if (polarity && level) {
+                        p->irq &= ~(1u << irq);
+                    }
+                    break;
+                }
+                default: {
+                    uint pin = ((s->execctrl >> PIO_SM0_EXECCTRL_JMP_PIN_LSB) + (arg2 & 3u)) & 0x1fu;
+                    level = (sim_pin_levels >> pin) & 1u;
+                    break;
+                }
+            }
+            stalled = level != polarity;
+            break;
+        }
+        case 2: { // IN
+            uint n = arg2 ? arg2 : 32;
+            uint32_t data;
+            switch (arg1) {
+                case 0:
+                    data = read_pins(s);
+                    break;
+                case 1:
+                    data = s->x;
+                    break;
+                case 2:
+                    data = s->y;
+                    break;
+                case 6:
+                    data = s->isr;
+                    break;
+                case 7:
+                    data = s->osr;
+                    break;
+                default:
+                    data = 0;
+                    break;
+            }
+            if (autopush(s) && MIN(32u, s->isr_count + n) >= push_thresh(s) && s->rx_level >= rx_capacity(s)) {
+                p->fdebug |= 1u << (PIO_FDEBUG_RXSTALL_LSB + sm);
+                stalled = true;
+                break;
+            }
+            isr_shift(s, data, n);
+            if (autopush(s) && s->isr_count >= push_thresh(s)) {
+                rx_push(s, s->isr);
+                s->isr = 0;
+                s->isr_count = 0;
+            }
+            break;
+        }
+        case 3: { // OUT
+            uint n = arg2 ? arg2 : 32;
+            if (autopull(s) && s->osr_count >= pull_thresh(s) && !sm_pull(p, sm, s)) {
+                tx_stall(p, sm, s);
+                stalled = true;
+                break;
+            }
+            uint32_t data = osr_shift(s, n);
+            switch (arg1) {
+                case 0:
+                    write_pins(p, out_base, out_count, data, false);
+                    break;
+                case 1:
+                    s->x = data;
+                    break;
+                case 2:
+                    s->y = data;
+                    break;
+                case 4:
+                    write_pins(p, out_base, out_count, data, true);
+                    break;
+                case 5:
+                    jump = true;
+                    jump_to = data & 0x1fu;
+                    break;
+                case 6:
+                    s->isr = data;
+                    s->isr_count = n;
+                    break;
+                case 7:
+                    new_exec = true;
+                    new_exec_instr = (uint16_t) data;
+                    break;
+                default:
+                    break;
+            }
+            if (autopull(s) && s->osr_count >= pull_thresh(s)) {
+                sm_pull(p, sm, s);
+            }
+            break;
+        }
+        case 4: {
+            bool if_flag = (instr >> 6) & 1u;
+            bool block = (instr >> 5) & 1u;
+            if (!(instr & 0x80u)) { // PUSH
+                if (if_flag && s->isr_count < push_thresh(s)) {
+                    break;
+                }
+                if (!rx_push(s, s->isr)) {
+                    p->fdebug |= 1u << (PIO_FDEBUG_RXSTALL_LSB + sm);
+                    if (block) {
+                        stalled = true;
+                        break;
+                    }
+                }
+                s->isr = 0;
+                s->isr_count = 0;
+            } else { // PULL
+                if ((if_flag && s->osr_count < pull_thresh(s)) || (autopull(s) && !s->osr_count)) {
+                    break;
+                }
+                if (!sm_pull(p, sm, s)) {
+                    if (block) {
+                        tx_stall(p, sm, s);
+                        stalled = true;
+                        break;
+                    }
+                    s->osr = s->x;
+                    s->osr_count = 0;
+                }
+            }
+            break;
+        }
+        case 5: { // MOV
+            uint32_t data;
+            switch (arg2 & 7u) {
+                case 0:
+                    data = read_pins(s);
+                    break;
+                case 1:
+                    data = s->x;
+                    break;
+                case 2:
+                    data = s->y;
+                    break;
+                case 5: {
+                    uint n = (s->execctrl >> PIO_SM0_EXECCTRL_STATUS_N_LSB) & 0x1fu;
+                    bool rx = (s->execctrl >> PIO_SM0_EXECCTRL_STATUS_SEL_LSB) & 1u;
+                    data = (rx ? s->rx_level : s->tx_level) < n ? ~0u : 0;
+                    break;
+                }
+                case 6:
+                    data = s->isr;
+                    break;
+                case 7:
+                    data = s->osr;
+                    break;
+                default:
+                    data = 0;
+                    break;
+            }
+            switch ((arg2 >> 3) & 3u) {
+                case 1:
+                    data = ~data;
+                    break;
+                case 2:
+                    data = bit_reverse(data);
+                    break;
+                default:
+                    break;
+            }
+            switch (arg1) {
+                case 0:
+                    write_pins(p, out_base, out_count, data, false);
+                    break;
+                case 1:
+                    s->x = data;
+                    break;
+                case 2:
+                    s->y = data;
+                    break;
+                case 3:
+                    write_pins(p, out_base, out_count, data, true);
+                    break;
+                case 4:
+                    new_exec = true;
+                    new_exec_instr = (uint16_t) data;
+                    break;
+                case 5:
+                    jump = true;
+                    jump_to = data & 0x1fu;
+                    break;
+                case 6:
+                    s->isr = data;
+                    s->isr_count = 0;
+                    break;
+                default:
+                    s->osr = data;
+                    s->osr_count = 0;
+                    break;
+            }
+            break;
+        }
+        case 6: { // IRQ
+            uint32_t bit = 1u << irq_index(sm, arg2);
+            if (instr & 0x40u) {
+                p->irq &= ~bit;
+            } else if (instr & 0x20u) {
+                if (!s->irq_waiting) {
+                    p->irq |= bit;
+                    s->irq_waiting = true;
+                    stalled = true;
+                } else if (p->irq & bit) {
+                    stalled = true;
+                } else {
+                    s->irq_waiting = false;
+                }
+            } else {
+                p->irq |= bit;
+            }
+            break;
+        }
+        default: { // SET
+            uint set_base = pinctrl_field(s, PIO_SM0_PINCTRL_SET_BASE_LSB, 5);
+            uint set_count = pinctrl_field(s, PIO_SM0_PINCTRL_SET_COUNT_LSB, 3);
+            switch (arg1) {
+                case 0:
+                    write_pins(p, set_base, set_count, arg2, false);
+                    break;
+                case 1:
+                    s->x = arg2;
+                    break;
+                case 2:
+                    s->y = arg2;
+                    break;
+                case 4:
+                    write_pins(p, set_base, set_count, arg2, true);
+                    break;
+                default:
+                    break;
+            }
+            break;
+        }
+    }
+
+    if (side_count > side_opt) {
+        uint side_bits = side_count - side_opt;
+        uint side = field >> delay_bits;
+        if (!side_opt || ((side >> side_bits) & 1u)) {
+            write_pins(p, pinctrl_field(s, PIO_SM0_PINCTRL_SIDESET_BASE_LSB, 5), side_bits, side,
+                       (s->execctrl >> PIO_SM0_EXECCTRL_SIDE_PINDIR_LSB) & 1u);
+        }
+    }
+
+    if (stalled) {
+        return false;
+    }
+    s->tx_stalled = false;
+    if (is_exec) {
+        s->exec_pending = false;
+    }
+    if (jump) {
+        s->pc = (uint8_t) jump_to;
+    } else if (!is_exec) {
+        uint wrap_top = (s->execctrl >> PIO_SM0_EXECCTRL_WRAP_TOP_LSB) & 0x1fu;
+        s->pc = s->pc == wrap_top ? (uint8_t) ((s->execctrl >> PIO_SM0_EXECCTRL_WRAP_BOTTOM_LSB) & 0x1fu) :
+                (uint8_t) ((s->pc + 1) & 0x1fu);
+    }
+    if (new_exec) {
+        // the delay of an OUT / MOV EXEC is ignored; the executee's own delay applies
+        s->exec_pending = true;
+        s->exec_instr = new_exec_instr;
+        s->delay = 0;
+    } else {
+        s->delay = delay;
+    }
+    return true;
+}
+
+static inline void sm_tick(sim_pio_t *p, uint sm, sim_sm_t *s) {
+    s->div_acc += 256;
+    if (s->div_acc < s->div) {
+        return;
+    }
+    s->div_acc -= s->div;
+    if (s->delay) {
+        s->delay--;
+        return;
+    }
+    if (s->exec_pending) {
+        sm_execute(p, sm, s, s->exec_instr, true);
+    } else {
+        sm_execute(p, sm, s, p->instr_mem[s->pc], false);
+    }
+}
+
+void sim_pio_cycle(void) {
+    for (uint i = 0; i < NUM_PIOS; i++) {
+        sim_pio_t *p = &pios[i];
+        for (uint32_t mask = p->enabled; mask; mask &= mask - 1) {
+            uint sm = (uint) __builtin_ctz(mask);
+            sm_tick(p, sm, &p->sm[sm]);
+        }
+    }
+}
+
+static void sm_restart(sim_sm_t *s) {
+    s->isr = 0;
+    s->isr_count = 0;
+    s->osr_count = 32;
+    s->delay = 0;
+    s->exec_pending = false;
+    s->irq_waiting = false;
+    s->tx_stalled = false;
+}
+
+// Simulation interfaces
+
+bool sim_pio_dreq(uint dreq) {
+    uint i = dreq / 8;
+    if (i >= NUM_PIOS) {
+        return false;
+    }
+    const sim_sm_t *s = &pios[i].sm[dreq & 3u];
+    if (dreq & 4u) {
+        return s->rx_level != 0;
+    }
+    return s->tx_level < tx_capacity(s);
+}
+
+static bool decode_fifo(uint32_t addr, size_t fifo_offset, uint *pio, uint *sm) {
+    uint32_t base = host_bus_addr(host_pio_hw);
+    if (addr < base || addr >= base + sizeof(host_pio_hw)) {
+        return false;
+    }
+    uint32_t offset = addr - base;
+    *pio = offset / sizeof(pio_hw_t);
+    offset %= sizeof(pio_hw_t);
+    if (offset < fifo_offset || offset >= fifo_offset + NUM_PIO_STATE_MACHINES * 4) {
+        panic("DMA access to PIO%u register at offset 0x%03x not supported", *pio, (uint) offset);
+    }
+    *sm = (offset - fifo_offset) / 4;
+    return true;
+}
+
+bool sim_pio_bus_write(uint32_t addr, uint32_t value) {
+    uint i, sm;
+    if (!decode_fifo(addr, offsetof(pio_hw_t, txf), &i, &sm)) {
+        return false;
+    }
+    if (!tx_push(&pios[i].sm[sm], value)) {
+        pios[i].fdebug |= 1u << (PIO_FDEBUG_TXOVER_LSB + sm);
+    }
+    return true;
+}
+
+bool sim_pio_bus_read(uint32_t addr, uint32_t *value) {
+    uint i, sm;
+    if (!decode_fifo(addr, offsetof(pio_hw_t, rxf), &i, &sm)) {
+        return false;
+    }
+    if (!rx_pop(&pios[i].sm[sm], value)) {
+        pios[i].fdebug |= 1u << (PIO_FDEBUG_RXUNDER_LSB + sm);
+        *value = 0;
+    }
+    return true;
+}
+
+uint32_t sim_pio_pad_out(uint pio) {
+    return pios[pio].pad_out;
+}
+
+uint32_t sim_pio_pad_oe(uint pio) {
+    return pios[pio].pad_oe;
+}
+
+void sim_pio_reconcile(void) {
+    for (uint i = 0; i < NUM_PIOS; i++) {
+        uint32_t fdebug = host_pio_hw[i].fdebug;
+        if (!(fdebug & SIM_W1C_TAG)) {
+            pios[i].fdebug &= ~fdebug;
+            host_pio_hw[i].fdebug = pios[i].fdebug | SIM_W1C_TAG;
+        }
+    }
+}
+
+void sim_pio_publish(void) {
+    for (uint i = 0; i < NUM_PIOS; i++) {
+        const sim_pio_t *p = &pios[i];
+        pio_hw_t *hw = &host_pio_hw[i];
+        uint32_t fstat = 0, flevel = 0;
+        for (uint sm = 0; sm < NUM_PIO_STATE_MACHINES; sm++) {
+            const sim_sm_t *s = &p->sm[sm];
+            fstat |= (uint32_t) (s->rx_level >= rx_capacity(s)) << (PIO_FSTAT_RXFULL_LSB + sm);
+            fstat |= (uint32_t) !s->rx_level << (PIO_FSTAT_RXEMPTY_LSB + sm);
+            fstat |= (uint32_t) (s->tx_level >= tx_capacity(s)) << (PIO_FSTAT_TXFULL_LSB + sm);
+            fstat |= (uint32_t) !s->tx_level << (PIO_FSTAT_TXEMPTY_LSB + sm);
+            flevel |= (MIN(s->tx_level, 15u) | MIN(s->rx_level, 15u) << 4) << (sm * 8);
+            hw->sm[sm].clkdiv = s->clkdiv;
+            hw->sm[sm].execctrl = s->execctrl | ((uint32_t) s->exec_pending << 31);
+            hw->sm[sm].shiftctrl = s->shiftctrl;
+            SIM_PUBLISH_RO(hw->sm[sm].addr, s->pc);
+            hw->sm[sm].instr = s->exec_pending ? s->exec_instr : p->instr_mem[s->pc];
+            hw->sm[sm].pinctrl = s->pinctrl;
+        }
+        hw->ctrl = p->enabled;
+        SIM_PUBLISH_RO(hw->fstat, fstat);
+        hw->fdebug = p->fdebug | SIM_W1C_TAG;
+        SIM_PUBLISH_RO(hw->flevel, flevel);
+        hw->irq = p->irq;
+        SIM_PUBLISH_RO(hw->dbg_padout, p->pad_out);
+        SIM_PUBLISH_RO(hw->dbg_padoe, p->pad_oe);
+        SIM_PUBLISH_RO(hw->dbg_cfginfo, (32u << 16) | (NUM_PIO_STATE_MACHINES << 8) | 4u);
+    }
+}
+
+const host_pio_sm_stats_t *sim_pio_sm_stats(PIO pio, uint sm) {
+    return &sim_sm(pio, sm)->stats;
+}
+
+void sim_pio_sm_stats_reset(PIO pio, uint sm) {
+    sm_stats_reset(sim_sm(pio, sm));
+}
+
+// Program memory
+
+static int find_offset_for_program(const sim_pio_t *p, const pio_program_t *program) {
+    uint32_t mask = low_mask(program->length);
+    if (program->origin >= 0) {
+        if (program->origin + program->length > 32 || (p->used_instruction_space & (mask << program->origin))) {
+            return -1;
+        }
+        return program->origin;
+    }
+    for (int i = 32 - program->length; i >= 0; i--) {
+        if (!(p->used_instruction_space & (mask << i))) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool pio_can_add_program(PIO pio, const pio_program_t *program) {
+    return find_offset_for_program(sim_pio(pio), program) >= 0;
+}
+
+bool pio_can_add_program_at_offset(PIO pio, const pio_program_t *program, uint offset) {
+    const sim_pio_t *p = sim_pio(pio);
+    if (program->origin >= 0 && (uint) program->origin != offset) {
+        return false;
+    }
+    if (offset + program->length > 32) {
+        return false;
+    }
+    return !(p->used_instruction_space & (low_mask(program->length) << offset));
+}
+
+int pio_add_program_at_offset(PIO pio, const pio_program_t *program, uint offset) {
+    if (!pio_can_add_program_at_offset(pio, program, offset)) {
+        return PICO_ERROR_GENERIC;
+    }
+    sim_pio_t *p = sim_pio(pio);
+    for (uint i = 0; i < program->length; i++) {
+        uint16_t instr = program->instructions[i];
+        // relocate JMP targets
+        p->instr_mem[offset + i] = (uint16_t) (instr >> 13 ? instr : instr + offset);
+    }
+    p->used_instruction_space |= low_mask(program->length) << offset;
+    return (int) offset;
+}
+
+int pio_add_program(PIO pio, const pio_program_t *program) {
+    int offset = find_offset_for_program(sim_pio(pio), program);
+    if (offset < 0) {
+        return PICO_ERROR_GENERIC;
+    }
+    return pio_add_program_at_offset(pio, program, (uint) offset);
+}
+
+void pio_remove_program(PIO pio, const pio_program_t *program, uint loaded_offset) {
+    sim_pio(pio)->used_instruction_space &= ~(low_mask(program->length) << loaded_offset);
+}
+
+void pio_clear_instruction_memory(PIO pio) {
+    sim_pio_t *p = sim_pio(pio);
+    p->used_instruction_space = 0;
+    memset(p->instr_mem, 0, sizeof(p->instr_mem));
+}
+
+// Claims
+
+void pio_sm_claim(PIO pio, uint sm) {
+    check_sm_param(sm);
+    sim_pio_t *p = sim_pio(pio);
+    if (p->claimed & (1u << sm)) {
+        panic("PIO %u SM %u already claimed", pio_get_index(pio), sm);
+    }
+    p->claimed |= 1u << sm;
+}
+
+void pio_claim_sm_mask(PIO pio, uint sm_mask) {
+    for (uint sm = 0; sm_mask; sm++, sm_mask >>= 1u) {
+        if (sm_mask & 1u) {
+            pio_sm_claim(pio, sm);
+        }
+    }
+}
+
+void pio_sm_unclaim(PIO pio, uint sm) {
+    check_sm_param(sm);
+    sim_pio(pio)->claimed &= ~(1u << sm);
+}
+
+int pio_claim_unused_sm(PIO pio, bool required) {
+    sim_pio_t *p = sim_pio(pio);
+    for (uint sm = 0; sm < NUM_PIO_STATE_MACHINES; sm++) {
+        if (!(p->claimed & (1u << sm))) {
+            p->claimed |= 1u << sm;
+            return (int) sm;
+        }
+    }
+    if (required) {
+        panic("No PIO state machines are available");
+    }
+    return -1;
+}
+
+bool pio_sm_is_claimed(PIO pio, uint sm) {
+    check_sm_param(sm);
+    return sim_pio(pio)->claimed & (1u << sm);
+}
+
+// State machine control
+
+void pio_sm_set_config(PIO pio, uint sm, const pio_sm_config *config) {
+    sim_sm_t *s = sim_sm(pio, sm);
+    sim_access();
+    const uint32_t join_bits = (1u << PIO_SM0_SHIFTCTRL_FJOIN_TX_LSB) | (1u << PIO_SM0_SHIFTCTRL_FJOIN_RX_LSB);
+    if ((s->shiftctrl ^ config->shiftctrl) & join_bits) {
+        // changing the FIFO join flushes the FIFOs
+        clear_fifos(s);
+    }
+    sm_set_clkdiv(s, config->clkdiv);
+    s->execctrl = config->execctrl;
+    s->shiftctrl = config->shiftctrl;
+    s->pinctrl = config->pinctrl;
+}
+
+int pio_sm_init(PIO pio, uint sm, uint initial_pc, const pio_sm_config *config) {
+    pio_sm_set_enabled(pio, sm, false);
+    if (config) {
+        pio_sm_set_config(pio, sm, config);
+    } else {
+        pio_sm_config c = pio_get_default_sm_config();
+        pio_sm_set_config(pio, sm, &c);
+    }
+    pio_sm_clear_fifos(pio, sm);
+    const uint32_t fdebug_sm_mask = (1u << PIO_FDEBUG_TXOVER_LSB) | (1u << PIO_FDEBUG_RXUNDER_LSB) |
+                                    (1u << PIO_FDEBUG_TXSTALL_LSB) | (1u << PIO_FDEBUG_RXSTALL_LSB);
+    sim_pio(pio)->fdebug &= ~(fdebug_sm_mask << sm);
+    pio_sm_restart(pio, sm);
+    pio_sm_clkdiv_restart(pio, sm);
+    pio_sm_exec(pio, sm, pio_encode_jmp(initial_pc));
+    return PICO_OK;
+}
+
+void pio_set_sm_mask_enabled(PIO pio, uint32_t mask, bool enabled) {
+    sim_pio_t *p = sim_pio(pio);
+    sim_access();
+    mask &= low_mask(NUM_PIO_STATE_MACHINES);
+    p->enabled = enabled ? p->enabled | mask : p->enabled & ~mask;
+}
+
+void pio_sm_set_enabled(PIO pio, uint sm, bool enabled) {
+    check_sm_param(sm);
+    pio_set_sm_mask_enabled(pio, 1u << sm, enabled);
+}
+
+static PIO pio_neighbour(PIO pio, int step) {
+    return pio_get_instance((pio_get_index(pio) + NUM_PIOS + step) % NUM_PIOS);
+}
+
+void pio_set_sm_multi_mask_enabled(PIO pio, uint32_t mask_prev, uint32_t mask, uint32_t mask_next, bool enabled) {
+    // one CTRL write: every block changes on the same cycle
+    sim_access();
+    uint32_t masks[3] = {mask_prev, mask, mask_next};
+    for (int step = -1; step <= 1; step++) {
+        sim_pio_t *p = sim_pio(pio_neighbour(pio, step));
+        uint32_t m = masks[step + 1] & low_mask(NUM_PIO_STATE_MACHINES);
+        p->enabled = enabled ? p->enabled | m : p->enabled & ~m;
+    }
+}
+
+void pio_restart_sm_mask(PIO pio, uint32_t mask) {
+    sim_pio_t *p = sim_pio(pio);
+    sim_access();
+    for (uint sm = 0; sm < NUM_PIO_STATE_MACHINES; sm++) {
+        if (mask & (1u << sm)) {
+            sm_restart(&p->sm[sm]);
+        }
+    }
+}
+
+void pio_sm_restart(PIO pio, uint sm) {
+    check_sm_param(sm);
+    pio_restart_sm_mask(pio, 1u << sm);
+}
+
+void pio_clkdiv_restart_sm_mask(PIO pio, uint32_t mask) {
+    sim_pio_t *p = sim_pio(pio);
+    sim_access();
+    for (uint sm = 0; sm < NUM_PIO_STATE_MACHINES; sm++) {
+        if (mask & (1u << sm)) {
+            p->sm[sm].div_acc = 0;
+        }
+    }
+}
+
+void pio_sm_clkdiv_restart(PIO pio, uint sm) {
+    check_sm_param(sm);
+    pio_clkdiv_restart_sm_mask(pio, 1u << sm);
+}
+
+static void enable_in_sync(sim_pio_t *p, uint32_t mask) {
+    for (uint sm = 0; sm < NUM_PIO_STATE_MACHINES; sm++) {
+        if (mask & (1u << sm)) {
+            p->sm[sm].div_acc = 0;
+            p->enabled |= 1u << sm;
+        }
+    }
+}
+
+void pio_enable_sm_mask_in_sync(PIO pio, uint32_t mask) {
+    sim_access();
+    enable_in_sync(sim_pio(pio), mask);
+}
+
+void pio_enable_sm_multi_mask_in_sync(PIO pio, uint32_t mask_prev, uint32_t mask, uint32_t mask_next) {
+    sim_access();
+    enable_in_sync(sim_pio(pio_neighbour(pio, -1)), mask_prev);
+    enable_in_sync(sim_pio(pio), mask);
+    enable_in_sync(sim_pio(pio_neighbour(pio, 1)), mask_next);
+}
+
+void pio_sm_set_clkdiv_int_frac(PIO pio, uint sm, uint16_t div_int, uint8_t div_frac) {
+    invalid_params_if(HARDWARE_PIO, div_int == 0 && div_frac != 0);
+    sim_sm_t *s = sim_sm(pio, sm);
+    sim_access();
+    sm_set_clkdiv(s, (((uint) div_frac) << PIO_SM0_CLKDIV_FRAC_LSB) | (((uint) div_int) << PIO_SM0_CLKDIV_INT_LSB));
+}
+
+void pio_sm_set_clkdiv(PIO pio, uint sm, float div) {
+    valid_params_if(HARDWARE_PIO, div >= 1 && div <= 65536);
+    uint16_t div_int = (uint16_t) div;
+    uint8_t div_frac = div_int ? (uint8_t) ((div - (float) div_int) * (1u << 8u)) : 0;
+    pio_sm_set_clkdiv_int_frac(pio, sm, div_int, div_frac);
+}
+
+void pio_sm_set_wrap(PIO pio, uint sm, uint wrap_target, uint wrap) {
+    sim_sm_t *s = sim_sm(pio, sm);
+    sim_access();
+    pio_sm_config c = {.execctrl = s->execctrl};
+    sm_config_set_wrap(&c, wrap_target, wrap);
+    s->execctrl = c.execctrl;
+}
+
+void pio_sm_set_out_pins(PIO pio, uint sm, uint out_base, uint out_count) {
+    sim_sm_t *s = sim_sm(pio, sm);
+    sim_access();
+    pio_sm_config c = {.pinctrl = s->pinctrl};
+    sm_config_set_out_pins(&c, out_base, out_count);
+    s->pinctrl = c.pinctrl;
+}
+
+void pio_sm_set_sideset_pins(PIO pio, uint sm, uint sideset_base) {
+    sim_sm_t *s = sim_sm(pio, sm);
+    sim_access();
+    pio_sm_config c = {.pinctrl = s->pinctrl};
+    sm_config_set_sideset_pins(&c, sideset_base);
+    s->pinctrl = c.pinctrl;
+}
+
+uint8_t pio_sm_get_pc(PIO pio, uint sm) {
+    sim_sm_t *s = sim_sm(pio, sm);
+    sim_access();
+    return s->pc;
+}
+
+void pio_sm_exec(PIO pio, uint sm, uint instr) {
+    sim_pio_t *p = sim_pio(pio);
+    sim_sm_t *s = sim_sm(pio, sm);
+    sim_access();
+    s->exec_pending = true;
+    s->exec_instr = (uint16_t) instr;
+    if (!(p->enabled & (1u << sm))) {
+        // a stopped state machine executes it straight away (and keeps it, stalled, if it stalls)
+        sm_execute(p, sm, s, s->exec_instr, true);
+    }
+}
+
+bool pio_sm_is_exec_stalled(PIO pio, uint sm) {
+    sim_sm_t *s = sim_sm(pio, sm);
+    sim_access();
+    return s->exec_pending;
+}
+
+void pio_sm_exec_wait_blocking(PIO pio, uint sm, uint instr) {
+    pio_sm_exec(pio, sm, instr);
+    while (pio_sm_is_exec_stalled(pio, sm)) {
+        tight_loop_contents();
+    }
+}
+
+// Pins
+
+void pio_sm_set_pins(PIO pio, uint sm, uint32_t pin_values) {
+    check_sm_param(sm);
+    sim_access();
+    write_pads(&sim_pio(pio)->pad_out, pin_values, ~0u);
+}
+
+void pio_sm_set_pins_with_mask(PIO pio, uint sm, uint32_t pin_values, uint32_t pin_mask) {
+    check_sm_param(sm);
+    sim_access();
+    write_pads(&sim_pio(pio)->pad_out, pin_values, pin_mask);
+}
+
+void pio_sm_set_pindirs_with_mask(PIO pio, uint sm, uint32_t pin_dirs, uint32_t pin_mask) {
+    check_sm_param(sm);
+    sim_access();
+    write_pads(&sim_pio(pio)->pad_oe, pin_dirs, pin_mask);
+}
+
+int pio_sm_set_consecutive_pindirs(PIO pio, uint sm, uint pin_base, uint pin_count, bool is_out) {
+    if (pin_base >= 32 || pin_count > 32) {
+        return PICO_ERROR_GENERIC;
+    }
+    uint32_t mask = rotl32(low_mask(pin_count), pin_base);
+    pio_sm_set_pindirs_with_mask(pio, sm, is_out ? mask : 0, mask);
+    return PICO_OK;
+}
+
+void pio_gpio_init(PIO pio, uint pin) {
+    gpio_set_function(pin, pio_get_funcsel(pio));
+}
+
+// FIFOs
+
+void pio_sm_put(PIO pio, uint sm, uint32_t data) {
+    sim_sm_t *s = sim_sm(pio, sm);
+    sim_access();
+    if (!tx_push(s, data)) {
+        sim_pio(pio)->fdebug |= 1u << (PIO_FDEBUG_TXOVER_LSB + sm);
+    }
+}
+
+uint32_t pio_sm_get(PIO pio, uint sm) {
+    sim_sm_t *s = sim_sm(pio, sm);
+    sim_access();
+    uint32_t v;
+    if (!rx_pop(s, &v)) {
+        sim_pio(pio)->fdebug |= 1u << (PIO_FDEBUG_RXUNDER_LSB + sm);
+        v = 0;
+    }
+    return v;
+}
+
+bool pio_sm_is_rx_fifo_full(PIO pio, uint sm) {
+    sim_sm_t *s = sim_sm(pio, sm);
+    sim_access();
+    return s->rx_level >= rx_capacity(s);
+}
+
+bool pio_sm_is_rx_fifo_empty(PIO pio, uint sm) {
+    sim_sm_t *s = sim_sm(pio, sm);
+    sim_access();
+    return !s->rx_level;
+}
+
+uint pio_sm_get_rx_fifo_level(PIO pio, uint sm) {
+    sim_sm_t *s = sim_sm(pio, sm);
+    sim_access();
+    return s->rx_level;
+}
+
+bool pio_sm_is_tx_fifo_full(PIO pio, uint sm) {
+    sim_sm_t *s = sim_sm(pio, sm);
+    sim_access();
+    return s->tx_level >= tx_capacity(s);
+}
+
+bool pio_sm_is_tx_fifo_empty(PIO pio, uint sm) {
+    sim_sm_t *s = sim_sm(pio, sm);
+    sim_access();
+    return !s->tx_level;
+}
+
+uint pio_sm_get_tx_fifo_level(PIO pio, uint sm) {
+    sim_sm_t *s = sim_sm(pio, sm);
+    sim_access();
+    return s->tx_level;
+}
+
+void pio_sm_put_blocking(PIO pio, uint sm, uint32_t data) {
+    while (pio_sm_is_tx_fifo_full(pio, sm)) {
+        tight_loop_contents();
+    }
+    pio_sm_put(pio, sm, data);
+}
+
+uint32_t pio_sm_get_blocking(PIO pio, uint sm) {
+    while (pio_sm_is_rx_fifo_empty(pio, sm)) {
+        tight_loop_contents();
+    }
+    return pio_sm_get(pio, sm);
+}
+
+void pio_sm_drain_tx_fifo(PIO pio, uint sm) {
+    uint instr = autopull(sim_sm(pio, sm)) ? pio_encode_out(pio_null, 32) : pio_encode_pull(false, false);
+    while (!pio_sm_is_tx_fifo_empty(pio, sm)) {
+        pio_sm_exec(pio, sm, instr);
+    }
+}
+
+void pio_sm_clear_fifos(PIO pio, uint sm) {
+    sim_sm_t *s = sim_sm(pio, sm);
+    sim_access();
+    clear_fifos(s);
+}
@@ -0,0 +1,213 @@
+/*
+ * Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/** \file probe.c
+ *  \brief I2S bus probe and VCD pin trace of the host simulation
+ *
+ * The probe decodes the bus as a DAC would: it samples DATA on every BCLK
+ * rising edge, and the bit belongs to the slot of the LRCLK level sampled on
+ * the previous rising edge (I2S sends each MSB one BCLK after the LRCLK
+ * transition). The first edge after the probe starts only samples LRCLK. An
+ * LRCLK phase is a slot; the channel of the first complete slot is taken as
+ * the first of each frame, so a frame is the pair of samples the transmitter
+ * took from one FIFO word (right then left for audio_i2s, left then right for
+ * audio_i2s_slot).
+ *
+ * DATA changes are timed against BCLK: a change on the cycle BCLK falls is
+ * on time, a change while BCLK is high (including on the cycle it rises) is a
+ * late edge.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim_internal.h"
+
+static host_i2s_probe_t probe;
+static bool probe_active;
+
+static FILE *vcd;
+static uint32_t vcd_mask;
+static uint32_t vcd_levels;
+
+static inline bool pin_level(uint32_t levels, uint pin) {
+    return (levels >> pin) & 1u;
+}
+
+host_i2s_probe_t *sim_probe_start(const host_i2s_probe_config_t *config) {
+    if (config->lane_count > HOST_I2S_PROBE_MAX_LANES || !config->slot_bits || config->slot_bits > 32) {
+        panic("bad probe config");
+    }
+    for (uint i = 0; i < HOST_I2S_PROBE_MAX_LANES; i++) {
+        free(probe.lanes[i].frames);
+    }
+    memset(&probe, 0, sizeof(probe));
+    probe.config = *config;
+    uint32_t levels = sim_gpio_levels();
+    for (uint i = 0; i < config->lane_count; i++) {
+        host_i2s_lane_t *lane = &probe.lanes[i];
+        lane->frames = calloc(config->frame_capacity ? config->frame_capacity : 1, sizeof(lane->frames[0]));
+        lane->first_one_bclk = UINT64_MAX;
+        lane->slot_channel = -1;
+        lane->frame_start_channel = -1;
+        lane->data_level = pin_level(levels, config->data_pins[i]);
+    }
+    probe.min_period = UINT32_MAX;
+    probe.bclk_level = pin_level(levels, config->bclk_pin);
+    probe.lrclk_level = pin_level(levels, config->lrclk_pin);
+    probe.last_fall_cycle = sim_now;
+    probe_active = true;
+    return &probe;
+}
+
+void sim_probe_stop(void) {
+    probe_active = false;
+}
+
+static void lane_end_slot(host_i2s_lane_t *lane) {
+    uint slot_bits = probe.config.slot_bits;
+    if (lane->slot_bit_count != slot_bits) {
+        lane->slot_errors++;
+        lane->have_half = false;
+        return;
+    }
+    int32_t sample = (int32_t) (lane->slot_value << (32 - slot_bits)) >> (32 - slot_bits);
+    int channel = lane->slot_channel;
+    if (lane->frame_start_channel < 0) {
+        lane->frame_start_channel = channel;
+    }
+    lane->half[channel] = sample;
+    if (channel == lane->frame_start_channel) {
+        lane->have_half = true;
+    } else if (lane->have_half) {
+        lane->have_half = false;
+        if (lane->frame_count < probe.config.frame_capacity) {
+            lane->frames[lane->frame_count][0] = lane->half[0];
+            lane->frames[lane->frame_count][1] = lane->half[1];
+            lane->frame_count++;
+        } else {
+            lane->overflow++;
+        }
+    }
+}
+
+static void lane_bit(host_i2s_lane_t *lane, int channel, bool bit, uint64_t edge) {
+    if (bit && lane->first_one_bclk == UINT64_MAX) {
+        lane->first_one_bclk = edge;
+    }
+    if (channel != lane->slot_channel) {
+        if (lane->slot_channel >= 0) {
+            lane_end_slot(lane);
+        }
+        lane->slot_channel = channel;
+        lane->slot_value = 0;
+        lane->slot_bit_count = 0;
+    }
+    lane->slot_value = (lane->slot_value << 1) | bit;
+    lane->slot_bit_count++;
+}
+
+static void probe_rising_edge(bool ws) {
+    uint64_t edge = probe.bclk_edges++;
+    if (edge) {
+        uint64_t period = sim_now - probe.last_rise_cycle;
+        if (probe.min_period != UINT32_MAX && period > 8ull * probe.min_period) {
+            probe.gaps++;
+        }
+        probe.min_period = (uint32_t) MIN(probe.min_period, period);
+        probe.max_period = (uint32_t) MAX(probe.max_period, MIN(period, UINT32_MAX));
+        for (uint i = 0; i < probe.config.lane_count; i++) {
+            lane_bit(&probe.lanes[i], probe.prev_ws, probe.lanes[i].data_level, edge);
+        }
+    } else {
+        probe.first_edge_cycle = sim_now;
+    }
+    probe.last_rise_cycle = sim_now;
+    probe.prev_ws = ws;
+}
+
+static void vcd_write(uint32_t levels) {
+    uint32_t changed = (levels ^ vcd_levels) & vcd_mask;
+    if (!changed) {
+        return;
+    }
+    fprintf(vcd, "#%llu\n", (unsigned long long) sim_now);
+    for (uint pin = 0; pin < 32; pin++) {
+        if (changed & (1u << pin)) {
+            fprintf(vcd, "%c%c\n", pin_level(levels, pin) ? '1' : '0', '!' + pin);
+        }
+    }
+    vcd_levels = levels;
+}
+
+void sim_probe_pads_changed(uint32_t levels) {
+    if (vcd) {
+        vcd_write(levels);
+    }
+    if (!probe_active) {
+        return;
+    }
+    bool bclk = pin_level(levels, probe.config.bclk_pin);
+    bool ws = pin_level(levels, probe.config.lrclk_pin);
+    if (probe.bclk_level && !bclk) {
+        probe.last_fall_cycle = sim_now;
+    }
+    for (uint i = 0; i < probe.config.lane_count; i++) {
+        host_i2s_lane_t *lane = &probe.lanes[i];
+        bool data = pin_level(levels, probe.config.data_pins[i]);
+        if (data == lane->data_level) {
+            continue;
+        }
+        lane->data_level = data;
+        if (bclk) {
+            lane->late_edges++;
+        } else {
+            lane->max_data_delay = (uint32_t) MAX(lane->max_data_delay, MIN(sim_now - probe.last_fall_cycle, UINT32_MAX));
+        }
+    }
+    if (bclk && !probe.bclk_level) {
+        probe_rising_edge(ws);
+    }
+    probe.bclk_level = bclk;
+    probe.lrclk_level = ws;
+}
+
+static void vcd_close(void) {
+    if (vcd) {
+        fclose(vcd);
+        vcd = NULL;
+    }
+}
+
+void sim_trace_vcd(const char *path, uint32_t pin_mask) {
+    static bool registered;
+    vcd_close();
+    vcd = fopen(path, "w");
+    if (!vcd) {
+        panic("cannot open %s", path);
+    }
+    if (!registered) {
+        atexit(vcd_close);
+        registered = true;
+    }
+    vcd_mask = pin_mask;
+    vcd_levels = sim_gpio_levels();
+    // one time unit is one clk_sys cycle
+    fprintf(vcd, "$timescale 1 ns $end\n$scope module gpio $end\n");
+    for (uint pin = 0; pin < 32; pin++) {
+        if (pin_mask & (1u << pin)) {
+            fprintf(vcd, "$var wire 1 %c gpio%u $end\n", '!' + pin, pin);
+        }
+    }
+    fprintf(vcd, "$upscope $end\n$enddefinitions $end\n#%llu\n$dumpvars\n", (unsigned long long) sim_now);
+    for (uint pin = 0; pin < 32; pin++) {
+        if (pin_mask & (1u << pin)) {
+            fprintf(vcd, "%c%c\n", pin_level(vcd_levels, pin) ? '1' : '0', '!' + pin);
+        }
+    }
+    fprintf(vcd, "$end\n");
+}
@@ -0,0 +1,511 @@
+/*
+ * Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/** \file sim.c
+ *  \brief Clock, interrupts, sync primitives, clocks and GPIO of the host simulation
+ */
+
+#include <malloc.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sim_internal.h"
+#include "hardware/clocks.h"
+#include "hardware/gpio.h"
+#include "hardware/irq.h"
+#include "hardware/sync.h"
+#include "hardware/structs/bus_ctrl.h"
+#include "hardware/structs/systick.h"
+#include "pico/time.h"
+
+#define SIM_MAX_SHARED_HANDLERS 4
+#define SIM_IRQ_STORM_DISPATCHES 1000
+
+uint64_t sim_now;
+bool sim_pads_dirty;
+uint32_t sim_pin_levels;
+
+static host_sim_config_t config = {
+        .sys_clock_hz = 150000000u,
+        .irq_latency_cycles = 12,
+        .cpu_access_cycles = 1,
+        .max_cycles = 150000000ull * 60,
+};
+
+host_sim_config_t *sim_config(void) {
+    return &config;
+}
+
+uint64_t sim_cycles(void) {
+    return sim_now;
+}
+
+static void __attribute__((constructor)) sim_init(void) {
+    // Keep every allocation in the brk heap, which a non-PIE executable has
+    // just above its static data, so heap buffers have 32-bit bus addresses.
+    mallopt(M_MMAP_MAX, 0);
+}
+
+uint32_t host_bus_addr(const volatile void *ptr) {
+    uintptr_t addr = (uintptr_t) ptr;
+    if (addr >> 32u) {
+        panic("address %p is above 4 GB; buffers the DMA uses must be static or heap allocated", (const void *) ptr);
+    }
+    return (uint32_t) addr;
+}
+
+void panic(const char *fmt, ...) {
+    fflush(stdout);
+    fprintf(stderr, "*** PANIC at cycle %llu ***\n", (unsigned long long) sim_now);
+    va_list args;
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+    fputc('\n', stderr);
+    abort();
+}
+
+uint get_core_num(void) {
+    return 0;
+}
+
+// SysTick and bus fabric register copies
+
+systick_hw_t host_systick_hw;
+bus_ctrl_hw_t host_bus_ctrl_hw;
+
+static bool systick_running;
+static uint64_t systick_start;
+
+static void systick_reconcile(void) {
+    bool enabled = host_systick_hw.csr & 1u;
+    if (enabled && !systick_running) {
+        systick_start = sim_now;
+    }
+    systick_running = enabled;
+}
+
+static void systick_publish(void) {
+    if (systick_running) {
+        uint32_t reload = host_systick_hw.rvr & 0xffffffu;
+        host_systick_hw.cvr = reload - (uint32_t) ((sim_now - systick_start) % (reload + 1ull));
+    }
+    SIM_PUBLISH_RO(host_bus_ctrl_hw.priority_ack, host_bus_ctrl_hw.priority);
+}
+
+static void sim_reconcile(void) {
+    sim_pio_reconcile();
+    sim_dma_reconcile();
+    systick_reconcile();
+}
+
+static void sim_publish(void) {
+    sim_pio_publish();
+    sim_dma_publish();
+    systick_publish();
+}
+
+// Interrupts
+
+static struct {
+    irq_handler_t handlers[SIM_MAX_SHARED_HANDLERS];
+    uint8_t order[SIM_MAX_SHARED_HANDLERS];
+    uint handler_count;
+    bool enabled;
+    bool asserted;
+    uint64_t due;
+    uint storm;
+} irqs[NUM_IRQS];
+
+static uint32_t dma_irqs_pending; // DMA_IRQ_n lines asserted and enabled, by n
+static bool in_handler;
+static bool interrupts_disabled;
+static bool event_flag;
+static uint64_t dispatch_count;
+
+void sim_irq_update(void) {
+    dma_irqs_pending = 0;
+    for (uint n = 0; n < NUM_DMA_IRQS; n++) {
+        uint num = DMA_IRQ_0 + n;
+        bool line = sim_dma_ints(n) != 0;
+        if (line && !irqs[num].asserted) {
+            irqs[num].due = sim_now + config.irq_latency_cycles;
+        } else if (!line) {
+            irqs[num].storm = 0;
+        }
+        irqs[num].asserted = line;
+        if (line && irqs[num].enabled) {
+            dma_irqs_pending |= 1u << n;
+        }
+    }
+}
+
+static void sim_dispatch(uint num) {
+    if (!irqs[num].handler_count) {
+        panic("IRQ %u is enabled and asserted but has no handler", num);
+    }
+    uint32_t ints_before = sim_dma_ints(num - DMA_IRQ_0);
+    sim_reconcile();
+    sim_publish();
+    in_handler = true;
+    for (uint i = 0; i < irqs[num].handler_count; i++) {
+        irqs[num].handlers[i]();
+    }
+    // take the acknowledgements the handlers wrote straight to the registers
+    sim_reconcile();
+    in_handler = false;
+    // exception return sets the event register, so a __wfe() in the interrupted code returns
+    event_flag = true;
+    dispatch_count++;
+    if (irqs[num].asserted) {
+        // not acknowledged: taken again after another latency
+        irqs[num].due = sim_now + config.irq_latency_cycles;
+        if (sim_dma_ints(num - DMA_IRQ_0) == ints_before && ++irqs[num].storm > SIM_IRQ_STORM_DISPATCHES) {
+            panic("IRQ %u storm: %u dispatches without its handler clearing INTS (0x%08x)", num, irqs[num].storm,
+                  (uint) ints_before);
+        }
+    } else {
+        irqs[num].storm = 0;
+    }
+    sim_publish();
+}
+
+static inline void sim_take_irqs(void) {
+    if (!dma_irqs_pending || in_handler || interrupts_disabled) {
+        return;
+    }
+    for (uint n = 0; n < NUM_DMA_IRQS; n++) {
+        uint num = DMA_IRQ_0 + n;
+        if ((dma_irqs_pending & (1u << n)) && sim_now >= irqs[num].due) {
+            sim_dispatch(num);
+            return;
+        }
+    }
+}
+
+static void check_irq_param(uint num) {
+    if (num >= NUM_IRQS) {
+        panic("IRQ %u out of range", num);
+    }
+}
+
+void irq_set_enabled(uint num, bool enabled) {
+    check_irq_param(num);
+    sim_access();
+    irqs[num].enabled = enabled;
+    sim_irq_update();
+}
+
+bool irq_is_enabled(uint num) {
+    check_irq_param(num);
+    return irqs[num].enabled;
+}
+
+void irq_set_exclusive_handler(uint num, irq_handler_t handler) {
+    check_irq_param(num);
+    if (irqs[num].handler_count) {
+        panic("IRQ %u already has a handler", num);
+    }
+    irqs[num].handlers[0] = handler;
+    irqs[num].handler_count = 1;
+}
+
+void irq_add_shared_handler(uint num, irq_handler_t handler, uint8_t order_priority) {
+    check_irq_param(num);
+    if (irqs[num].handler_count == SIM_MAX_SHARED_HANDLERS) {
+        panic("IRQ %u has too many shared handlers", num);
+    }
+    // higher order priorities are called first
+    uint i = irqs[num].handler_count;
+    while (i && irqs[num].order[i - 1] < order_priority) {
+        irqs[num].handlers[i] = irqs[num].handlers[i - 1];
+        irqs[num].order[i] = irqs[num].order[i - 1];
+        i--;
+    }
+    irqs[num].handlers[i] = handler;
+    irqs[num].order[i] = order_priority;
+    irqs[num].handler_count++;
+}
+
+void irq_remove_handler(uint num, irq_handler_t handler) {
+    check_irq_param(num);
+    for (uint i = 0; i < irqs[num].handler_count; i++) {
+        if (irqs[num].handlers[i] == handler) {
+            irqs[num].handler_count--;
+            for (; i < irqs[num].handler_count; i++) {
+                irqs[num].handlers[i] = irqs[num].handlers[i + 1];
+                irqs[num].order[i] = irqs[num].order[i + 1];
+            }
+            return;
+        }
+    }
+}
+
+void irq_set_priority(uint num, uint8_t hardware_priority) {
+    check_irq_param(num);
+    // one interrupt is taken at a time, so priorities never preempt
+    (void) hardware_priority;
+}
+
+// The clock
+
+static void sim_cycle(void) {
+    if (++sim_now > config.max_cycles) {
+        panic("simulation ran past max_cycles (%llu); is the code under test waiting for something that cannot happen?",
+              (unsigned long long) config.max_cycles);
+    }
+    sim_pio_cycle();
+    sim_dma_cycle();
+    if (sim_pads_dirty) {
+        sim_pads_dirty = false;
+        uint32_t levels = sim_gpio_levels();
+        if (levels != sim_pin_levels) {
+            sim_pin_levels = levels;
+            sim_probe_pads_changed(levels);
+        }
+    }
+}
+
+void sim_step(uint64_t cycles) {
+    sim_reconcile();
+    sim_take_irqs();
+    while (cycles--) {
+        sim_cycle();
+        sim_take_irqs();
+    }
+    sim_publish();
+}
+
+void sim_run_cycles(uint64_t cycles) {
+    sim_step(cycles);
+}
+
+static uint32_t sys_clock_hz;
+static double time_base_us;
+static uint64_t time_base_cycles;
+
+static uint32_t sim_sys_clock_hz(void) {
+    if (!sys_clock_hz) {
+        sys_clock_hz = config.sys_clock_hz;
+    }
+    return sys_clock_hz;
+}
+
+uint64_t time_us_64(void) {
+    sim_access();
+    return (uint64_t) (time_base_us + (double) (sim_now - time_base_cycles) * 1e6 / sim_sys_clock_hz());
+}
+
+void sim_run_us(uint64_t us) {
+    sim_step(us * sim_sys_clock_hz() / 1000000u);
+}
+
+void sleep_us(uint64_t us) {
+    sim_run_us(us);
+}
+
+void sleep_ms(uint32_t ms) {
+    sim_run_us(ms * 1000ull);
+}
+
+void busy_wait_us(uint64_t delay_us) {
+    sim_run_us(delay_us);
+}
+
+void tight_loop_contents(void) {
+    sim_step(1);
+}
+
+// Sync
+
+static spin_lock_t spin_locks[NUM_SPIN_LOCKS];
+
+uint32_t save_and_disable_interrupts(void) {
+    uint32_t status = interrupts_disabled;
+    interrupts_disabled = true;
+    return status;
+}
+
+void restore_interrupts(uint32_t status) {
+    interrupts_disabled = status;
+}
+
+spin_lock_t *spin_lock_instance(uint lock_num) {
+    if (lock_num >= NUM_SPIN_LOCKS) {
+        panic("spin lock %u out of range", lock_num);
+    }
+    return &spin_locks[lock_num];
+}
+
+spin_lock_t *spin_lock_init(uint lock_num) {
+    spin_lock_t *lock = spin_lock_instance(lock_num);
+    *lock = 0;
+    return lock;
+}
+
+uint32_t spin_lock_blocking(spin_lock_t *lock) {
+    uint32_t save = save_and_disable_interrupts();
+    if (*lock) {
+        // there is a single core, and it takes no interrupts while holding a lock
+        panic("spin lock %u taken twice", (uint) (lock - spin_locks));
+    }
+    *lock = 1;
+    return save;
+}
+
+void spin_unlock(spin_lock_t *lock, uint32_t saved_irq) {
+    *lock = 0;
+    restore_interrupts(saved_irq);
+}
+
+void __sev(void) {
+    event_flag = true;
+}
+
+void __wfe(void) {
+    if (!event_flag) {
+        sim_reconcile();
+        sim_take_irqs();
+        while (!event_flag) {
+            sim_cycle();
+            sim_take_irqs();
+        }
+        sim_publish();
+    }
+    event_flag = false;
+}
+
+void __wfi(void) {
+    uint64_t dispatches = dispatch_count;
+    sim_reconcile();
+    sim_take_irqs();
+    while (dispatch_count == dispatches) {
+        sim_cycle();
+        sim_take_irqs();
+    }
+    sim_publish();
+}
+
+// Clocks
+
+uint32_t clock_get_hz(clock_handle_t clock) {
+    switch (clock) {
+        case clk_ref:
+            return 12000000u;
+        case clk_usb:
+        case clk_adc:
+            return 48000000u;
+        default:
+            return sim_sys_clock_hz();
+    }
+}
+
+bool check_sys_clock_khz(uint32_t freq_khz, uint *vco_freq_out, uint *post_div1_out, uint *post_div2_out) {
+    const uint reference_freq_hz = 12000000u;
+    uint freq_hz = freq_khz * 1000u;
+    for (uint fbdiv = 320; fbdiv >= 16; fbdiv--) {
+        uint vco_hz = fbdiv * reference_freq_hz;
+        if (vco_hz < 750000000u || vco_hz > 1600000000u) {
+            continue;
+        }
+        for (uint postdiv1 = 7; postdiv1 >= 1; postdiv1--) {
+            for (uint postdiv2 = postdiv1; postdiv2 >= 1; postdiv2--) {
+                uint out = vco_hz / (postdiv1 * postdiv2);
+                if (out == freq_hz && !(vco_hz % (postdiv1 * postdiv2))) {
+                    *vco_freq_out = vco_hz;
+                    *post_div1_out = postdiv1;
+                    *post_div2_out = postdiv2;
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+bool set_sys_clock_khz(uint32_t freq_khz, bool required) {
+    uint vco, postdiv1, postdiv2;
+    if (!check_sys_clock_khz(freq_khz, &vco, &postdiv1, &postdiv2)) {
+        if (required) {
+            panic("System clock of %u kHz cannot be exactly achieved", (uint) freq_khz);
+        }
+        return false;
+    }
+    sim_access();
+    // keep time continuous across the change
+    time_base_us += (double) (sim_now - time_base_cycles) * 1e6 / sim_sys_clock_hz();
+    time_base_cycles = sim_now;
+    sys_clock_hz = freq_khz * 1000u;
+    return true;
+}
+
+// GPIO
+
+static uint8_t gpio_functions[NUM_BANK0_GPIOS];
+static uint32_t gpio_pio_masks[NUM_PIOS];
+static uint32_t gpio_inputs;
+
+static void __attribute__((constructor)) sim_gpio_init(void) {
+    for (uint gpio = 0; gpio < NUM_BANK0_GPIOS; gpio++) {
+        gpio_functions[gpio] = GPIO_FUNC_NULL;
+    }
+}
+
+static void check_gpio_param(uint gpio) {
+    if (gpio >= NUM_BANK0_GPIOS) {
+        panic("GPIO %u out of range", gpio);
+    }
+}
+
+void gpio_set_function(uint gpio, uint fn) {
+    check_gpio_param(gpio);
+    sim_access();
+    gpio_functions[gpio] = (uint8_t) fn;
+    for (uint i = 0; i < NUM_PIOS; i++) {
+        if (fn == GPIO_FUNC_PIO0 + i) {
+            gpio_pio_masks[i] |= 1u << gpio;
+        } else {
+            gpio_pio_masks[i] &= ~(1u << gpio);
+        }
+    }
+    sim_pads_dirty = true;
+}
+
+uint gpio_get_function(uint gpio) {
+    check_gpio_param(gpio);
+    return gpio_functions[gpio];
+}
+
+bool gpio_get(uint gpio) {
+    check_gpio_param(gpio);
+    sim_access();
+    return (sim_gpio_levels() >> gpio) & 1u;
+}
+
+uint32_t sim_gpio_pio_mask(uint pio) {
+    return gpio_pio_masks[pio];
+}
+
+uint32_t sim_gpio_levels(void) {
+    uint32_t levels = gpio_inputs;
+    for (uint i = 0; i < NUM_PIOS; i++) {
+        uint32_t driven = gpio_pio_masks[i] & sim_pio_pad_oe(i);
+        levels = (levels & ~driven) | (sim_pio_pad_out(i) & driven);
+    }
+    return levels;
+}
+
+void sim_set_gpio_input(uint gpio, bool level) {
+    check_gpio_param(gpio);
+    gpio_inputs = (gpio_inputs & ~(1u << gpio)) | ((uint32_t) level << gpio);
+    sim_pads_dirty = true;
+}
+
+bool sim_gpio_level(uint gpio) {
+    check_gpio_param(gpio);
+    return (sim_gpio_levels() >> gpio) & 1u;
+}
@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _HOST_SIM_INTERNAL_H
+#define _HOST_SIM_INTERNAL_H
+
+#include "host_sim.h"
+
+/** \file sim_internal.h
+ *  \brief Interfaces between the parts of the host simulation
+ *
+ * sim.c owns the clock and the interrupt controller and calls into pio.c,
+ * dma.c and probe.c once per cycle. Every hardware access of the code under
+ * test goes through sim_access() (or sim_step() for a wait), which first takes
+ * any CPU writes to the register copies (reconcile), then runs the cycles, and
+ * finally brings the register copies up to date again (publish).
+ */
+
+/** \brief Tag bit the simulation sets in published write-1-to-clear registers; a copy without it has been written */
+#define SIM_W1C_TAG 0x80000000u
+
+extern uint64_t sim_now;
+
+/** \brief Write a read-only register of a copy, which only the simulation may do */
+#define SIM_PUBLISH_RO(reg, value) (*(io_rw_32 *) &(reg) = (value))
+
+/** \brief Run cycles cycles, taking interrupts, with the register copies reconciled before and published after */
+void sim_step(uint64_t cycles);
+
+/** \brief The cost of one hardware access of the code under test */
+static inline void sim_access(void) {
+    sim_step(sim_config()->cpu_access_cycles);
+}
+
+/** \brief Recompute the interrupt lines after a change of DMA INTR, INTE or INTF */
+void sim_irq_update(void);
+
+/** \brief Note that a PIO block changed its pads this cycle */
+extern bool sim_pads_dirty;
+
+/** \brief Current level of every GPIO */
+uint32_t sim_gpio_levels(void);
+
+/** \brief Level of every GPIO at the end of the previous cycle, as PIO input synchronisers see them */
+extern uint32_t sim_pin_levels;
+
+/** \brief GPIOs whose function is PIO block pio */
+uint32_t sim_gpio_pio_mask(uint pio);
+
+/** \brief Bus address of ptr, which must be below 4 GB */
+uint32_t host_bus_addr(const volatile void *ptr);
+
+static inline void *host_bus_ptr(uint32_t addr) {
+    return (void *) (uintptr_t) addr;
+}
+
+// pio.c
+void sim_pio_cycle(void);
+void sim_pio_reconcile(void);
+void sim_pio_publish(void);
+bool sim_pio_dreq(uint dreq);
+/** \brief If addr is a TX FIFO, push value (replicated from a size byte write) to it and return true */
+bool sim_pio_bus_write(uint32_t addr, uint32_t value);
+/** \brief If addr is an RX FIFO, pop it into *value and return true */
+bool sim_pio_bus_read(uint32_t addr, uint32_t *value);
+uint32_t sim_pio_pad_out(uint pio);
+uint32_t sim_pio_pad_oe(uint pio);
+
+// dma.c
+void sim_dma_cycle(void);
+void sim_dma_reconcile(void);
+void sim_dma_publish(void);
+/** \brief INTSn of DMA_IRQ_n */
+uint32_t sim_dma_ints(uint irq_index);
+
+// probe.c
+void sim_probe_pads_changed(uint32_t levels);
+
+#endif
@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <stdarg.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "host_test.h"
+
+#define HOST_TEST_MAX 64
+
+static struct {
+    const char *name;
+    host_test_func_t func;
+} tests[HOST_TEST_MAX];
+static uint test_count;
+
+void host_test_register(const char *name, host_test_func_t func) {
+    if (test_count == HOST_TEST_MAX) {
+        fprintf(stderr, "too many tests\n");
+        exit(2);
+    }
+    tests[test_count].name = name;
+    tests[test_count].func = func;
+    test_count++;
+}
+
+void host_test_fail(const char *file, int line, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    fprintf(stderr, "%s:%d: check failed at cycle %llu: ", file, line, (unsigned long long) sim_cycles());
+    vfprintf(stderr, fmt, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+    exit(1);
+}
+
+uint host_test_first_signal(const host_i2s_lane_t *lane) {
+    uint i = 0;
+    while (i < lane->frame_count && !lane->frames[i][0] && !lane->frames[i][1]) {
+        i++;
+    }
+    return i;
+}
+
+static int run_one(uint i) {
+    tests[i].func();
+    printf("%s: ok (%llu cycles)\n", tests[i].name, (unsigned long long) sim_cycles());
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1) {
+        if (!strcmp(argv[1], "--list")) {
+            for (uint i = 0; i < test_count; i++) {
+                printf("%s\n", tests[i].name);
+            }
+            return 0;
+        }
+        for (uint i = 0; i < test_count; i++) {
+            if (!strcmp(argv[1], tests[i].name)) {
+                return run_one(i);
+            }
+        }
+        fprintf(stderr, "no test named %s\n", argv[1]);
+        return 2;
+    }
+    uint failed = 0;
+    for (uint i = 0; i < test_count; i++) {
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("fork");
+            return 2;
+        }
+        if (!pid) {
+            exit(run_one(i));
+        }
+        int status;
+        waitpid(pid, &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status)) {
+            printf("%s: FAILED\n", tests[i].name);
+            failed++;
+        }
+    }
+    printf("%u of %u tests failed\n", failed, test_count);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _HOST_TEST_H
+#define _HOST_TEST_H
+
+/** \file host_test.h
+ *  \brief Minimal test runner for the host simulation
+ *
+ * Each HOST_TEST() registers itself at startup. Run a single test by naming it
+ * on the command line (that is what ctest does); with no arguments every test
+ * runs in a child process of its own, since the drivers and the simulated
+ * hardware keep static state that a test cannot undo. A failed check prints
+ * its location and ends the process.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "pico.h"
+#include "host_sim.h"
+
+typedef void (*host_test_func_t)(void);
+
+void host_test_register(const char *name, host_test_func_t func);
+
+#define HOST_TEST(name) \
+    static void name(void); \
+    static void __attribute__((constructor)) __CONCAT(register_, name)(void) { host_test_register(#name, name); } \
+    static void name(void)
+
+void host_test_fail(const char *file, int line, const char *fmt, ...) __attribute__((noreturn, format(printf, 3, 4)));
+
+#define HOST_CHECK(cond) do { \
+        if (!(cond)) host_test_fail(__FILE__, __LINE__, "%s", #cond); \
+    } while (0)
+
+#define HOST_CHECK_EQ(a, b) do { \
+        long long _a = (long long) (a), _b = (long long) (b); \
+        if (_a != _b) host_test_fail(__FILE__, __LINE__, "%s == %s (%lld != %lld)", #a, #b, _a, _b); \
+    } while (0)
+
+/** \brief Index of the first decoded frame of lane with a non-zero sample, or its frame_count if there is none */
+uint host_test_first_signal(const host_i2s_lane_t *lane);
+
+#endif //_HOST_TEST_H
@@ -0,0 +1,336 @@
+/*
+ * Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/** \file test_multi.c
+ *  \brief The multi-DAC driver end to end: lanes on a shared clock stay in step
+ */
+
+#include "host_test.h"
+#include "hardware/clocks.h"
+#include "include/pico/audio_i2s.h"
+
+#define TEST_SAMPLE_FREQ 48000
+#define TEST_DACS 2
+#define TEST_PRODUCER_FRAMES 32
+#define TEST_BUFFERS 8
+#define TEST_FRAMES (TEST_BUFFERS * TEST_PRODUCER_FRAMES)
+#define TEST_MAX_FRAMES (16 * PICO_AUDIO_I2S_SILENCE_BUFFER_SAMPLE_LENGTH + TEST_FRAMES)
+
+static audio_format_t producer_format = {
+        .sample_freq = TEST_SAMPLE_FREQ,
+        .format = AUDIO_BUFFER_FORMAT_PCM_S16,
+        .channel_count = 2,
+};
+static audio_buffer_format_t producer_buffer_format = {
+        .format = &producer_format,
+        .sample_stride = 4,
+};
+static audio_buffer_pool_t *producers[TEST_DACS];
+
+static int16_t test_left(uint dac, uint i) {
+    return (int16_t) (1 + 3 * i + 0x1000 * dac);
+}
+
+static int16_t test_right(uint dac, uint i) {
+    return (int16_t) -(1000 + (int) i + 0x1000 * (int) dac);
+}
+
+static uint32_t frame_cycles(void) {
+    return clock_get_hz(clk_sys) / TEST_SAMPLE_FREQ;
+}
+
+static void setup_multi(audio_i2s_multi_dac_config_t *config) {
+    config->num_dacs = TEST_DACS;
+    config->clock_pin_base = 26;
+    for (uint i = 0; i < TEST_DACS; i++) {
+        config->data_pins[i] = (uint8_t) (20 + i);
+        config->dma_channels[i] = (uint8_t) i;
+        config->data_pio_sms[i] = (uint8_t) (1 + i);
+    }
+    config->clock_pio_sm = 0;
+    HOST_CHECK(audio_i2s_setup_multi_dac(&producer_format, config));
+    for (uint8_t i = 0; i < TEST_DACS; i++) {
+        // a single state machine interleaves PICO_AUDIO_I2S_MULTI_LANE_BUFFER_SAMPLE_LENGTH frames of every
+        // lane per refill, so the whole sequence is given up front rather than a few buffers ahead
+        producers[i] = audio_new_producer_pool(&producer_buffer_format, TEST_BUFFERS, TEST_PRODUCER_FRAMES);
+        HOST_CHECK(audio_i2s_connect_multi_dac_extra(producers[i], i, false, 4, 32, NULL));
+    }
+}
+
+static host_i2s_probe_t *start_probe(void) {
+    host_i2s_probe_config_t config = {
+            .bclk_pin = 26,
+            .lrclk_pin = 27,
+            .lane_count = TEST_DACS,
+            .data_pins = {20, 21},
+            .slot_bits = 16,
+            .frame_capacity = TEST_MAX_FRAMES,
+    };
+    return sim_probe_start(&config);
+}
+
+/** \brief Give every DAC buffers first to first + count - 1 of its sequence */
+static void give_buffers(uint first, uint count) {
+    for (uint b = first; b < first + count; b++) {
+        for (uint dac = 0; dac < TEST_DACS; dac++) {
+            audio_buffer_t *ab = take_audio_buffer(producers[dac], true);
+            int16_t *samples = (int16_t *) ab->buffer->bytes;
+            for (uint i = 0; i < ab->max_sample_count; i++) {
+                uint frame = b * TEST_PRODUCER_FRAMES + i;
+                samples[2 * i] = test_left(dac, frame);
+                samples[2 * i + 1] = test_right(dac, frame);
+            }
+            ab->sample_count = ab->max_sample_count;
+            give_audio_buffer(producers[dac], ab);
+        }
+    }
+}
+
+/** \brief Give every DAC its sequence a buffer at a time, then run until all of it is decoded */
+static void play_all(const host_i2s_probe_t *probe) {
+    give_buffers(0, TEST_BUFFERS);
+    for (uint frames = 0; frames < TEST_MAX_FRAMES; frames += 16) {
+        bool done = true;
+        for (uint dac = 0; dac < TEST_DACS; dac++) {
+            const host_i2s_lane_t *lane = &probe->lanes[dac];
+            done &= host_test_first_signal(lane) + TEST_FRAMES < lane->frame_count;
+        }
+        if (done) {
+            break;
+        }
+        sim_run_cycles((uint64_t) frame_cycles() * 16);
+    }
+}
+
+/** \brief Each lane carries its own sequence, all starting on the same frame, with DATA moving only on BCLK falls */
+static void check_lanes(const host_i2s_probe_t *probe) {
+    uint first = host_test_first_signal(&probe->lanes[0]);
+    for (uint dac = 0; dac < TEST_DACS; dac++) {
+        const host_i2s_lane_t *lane = &probe->lanes[dac];
+        HOST_CHECK_EQ(host_test_first_signal(lane), first);
+        HOST_CHECK(first + TEST_FRAMES <= lane->frame_count);
+        HOST_CHECK_EQ(lane->slot_errors, 0);
+        HOST_CHECK_EQ(lane->late_edges, 0);
+        HOST_CHECK_EQ(lane->max_data_delay, 0);
+        for (uint i = 0; i < TEST_FRAMES; i++) {
+            HOST_CHECK_EQ(lane->frames[first + i][0], test_left(dac, i));
+            HOST_CHECK_EQ(lane->frames[first + i][1], test_right(dac, i));
+        }
+        HOST_CHECK_EQ(audio_i2s_get_stats_multi_dac((uint8_t) dac)->tx_stalls, 0);
+    }
+    HOST_CHECK_EQ(probe->gaps, 0);
+}
+
+static void run_multi(audio_i2s_multi_dac_config_t *config) {
+    setup_multi(config);
+    host_i2s_probe_t *probe = start_probe();
+    audio_i2s_set_enabled_multi_dac(true);
+    play_all(probe);
+    check_lanes(probe);
+}
+
+HOST_TEST(multi_two_dacs) {
+    audio_i2s_multi_dac_config_t config = {0};
+    run_multi(&config);
+}
+
+HOST_TEST(multi_cross_block) {
+    // the clock on pio0 and one lane on each of its neighbours, started by one CTRL write
+    audio_i2s_multi_dac_config_t config = {
+            .clock_pio = pio0,
+            .data_pios = {pio1, pio2},
+    };
+    run_multi(&config);
+}
+
+HOST_TEST(multi_single_sm_lanes) {
+    audio_i2s_multi_dac_config_t config = {
+            .single_sm = true,
+    };
+    run_multi(&config);
+}
+
+HOST_TEST(multi_single_sm_deadline) {
+    // the next lane buffer is already chained, so the IRQ has most of a lane buffer
+    // period to interleave, far longer than the joined TX FIFO lasts
+    sim_config()->irq_latency_cycles = frame_cycles() * PICO_AUDIO_I2S_MULTI_LANE_BUFFER_SAMPLE_LENGTH / 2;
+    audio_i2s_multi_dac_config_t config = {
+            .single_sm = true,
+    };
+    run_multi(&config);
+}
+
+static int32_t test_left32(uint i) {
+    return (int32_t) ((i + 1) << 12) + 5;
+}
+
+static int32_t test_right32(uint i) {
+    return -test_left32(i) - 7;
+}
+
+HOST_TEST(multi_s32_mixed) {
+    // DAC 1 takes 32-bit samples, so both slots are 32 bits and DAC 0 pads its 16-bit ones
+    audio_i2s_multi_dac_config_t config = {
+            .s32_output_mask = 1u << 1,
+    };
+    setup_multi(&config);
+    static audio_format_t format32 = {
+            .sample_freq = TEST_SAMPLE_FREQ,
+            .format = AUDIO_BUFFER_FORMAT_PCM_S32,
+            .channel_count = 2,
+    };
+    static audio_buffer_format_t buffer_format32 = {
+            .format = &format32,
+            .sample_stride = 8,
+    };
+    audio_buffer_pool_t *producer32 = audio_new_producer_pool(&buffer_format32, TEST_BUFFERS, TEST_PRODUCER_FRAMES);
+    HOST_CHECK(audio_i2s_connect_multi_dac_extra(producer32, 1, false, 4, 32, NULL));
+    host_i2s_probe_config_t probe_config = {
+            .bclk_pin = 26,
+            .lrclk_pin = 27,
+            .lane_count = TEST_DACS,
+            .data_pins = {20, 21},
+            .slot_bits = 32,
+            .frame_capacity = TEST_MAX_FRAMES,
+    };
+    host_i2s_probe_t *probe = sim_probe_start(&probe_config);
+    audio_i2s_set_enabled_multi_dac(true);
+    for (uint b = 0; b < TEST_BUFFERS; b++) {
+        audio_buffer_t *ab = take_audio_buffer(producers[0], true);
+        int16_t *samples = (int16_t *) ab->buffer->bytes;
+        for (uint i = 0; i < ab->max_sample_count; i++) {
+            samples[2 * i] = test_left(0, b * TEST_PRODUCER_FRAMES + i);
+            samples[2 * i + 1] = test_right(0, b * TEST_PRODUCER_FRAMES + i);
+        }
+        ab->sample_count = ab->max_sample_count;
+        give_audio_buffer(producers[0], ab);
+        ab = take_audio_buffer(producer32, true);
+        int32_t *samples32 = (int32_t *) ab->buffer->bytes;
+        for (uint i = 0; i < ab->max_sample_count; i++) {
+            samples32[2 * i] = test_left32(b * TEST_PRODUCER_FRAMES + i);
+            samples32[2 * i + 1] = test_right32(b * TEST_PRODUCER_FRAMES + i);
+        }
+        ab->sample_count = ab->max_sample_count;
+        give_audio_buffer(producer32, ab);
+    }
+    sim_run_cycles((uint64_t) frame_cycles() * (TEST_FRAMES + 4 * PICO_AUDIO_I2S_SILENCE_BUFFER_SAMPLE_LENGTH));
+    // both sequences start on the same frame, the 16-bit one in the top of each slot; the
+    // clocks start on a right slot, so the probe pairs each right sample with the next left one
+    uint first = host_test_first_signal(&probe->lanes[0]);
+    HOST_CHECK_EQ(host_test_first_signal(&probe->lanes[1]), first);
+    for (uint dac = 0; dac < TEST_DACS; dac++) {
+        const host_i2s_lane_t *lane = &probe->lanes[dac];
+        HOST_CHECK(first + TEST_FRAMES + 1 <= lane->frame_count);
+        HOST_CHECK_EQ(lane->slot_errors, 0);
+        HOST_CHECK_EQ(lane->late_edges, 0);
+        for (uint i = 0; i < TEST_FRAMES; i++) {
+            HOST_CHECK_EQ(lane->frames[first + i][0],
+                          dac ? test_left32(i) : (int32_t) ((uint32_t) test_left(0, i) << 16));
+            HOST_CHECK_EQ(lane->frames[first + i + 1][1],
+                          dac ? test_right32(i) : (int32_t) ((uint32_t) test_right(0, i) << 16));
+        }
+        HOST_CHECK_EQ(audio_i2s_get_stats_multi_dac((uint8_t) dac)->tx_stalls, 0);
+    }
+    HOST_CHECK_EQ(probe->gaps, 0);
+}
+
+HOST_TEST(multi_single_sm_rate_change) {
+    audio_i2s_multi_dac_config_t config = {
+            .single_sm = true,
+    };
+    setup_multi(&config);
+    host_i2s_probe_t *probe = start_probe();
+    audio_i2s_set_enabled_multi_dac(true);
+    // the second half of the sequence is given at a new rate, so the producer gives queue the change
+    give_buffers(0, TEST_BUFFERS / 2);
+    producer_format.sample_freq = 44100;
+    give_buffers(TEST_BUFFERS / 2, TEST_BUFFERS / 2);
+    uint frames = 0;
+    while (audio_i2s_get_clock_divider_multi_dac()->sample_freq != 44100) {
+        HOST_CHECK(frames++ < TEST_MAX_FRAMES);
+        sim_run_cycles(frame_cycles());
+    }
+    // every frame before the fence left the pins before the divider changed
+    for (uint dac = 0; dac < TEST_DACS; dac++) {
+        const host_i2s_lane_t *lane = &probe->lanes[dac];
+        HOST_CHECK(host_test_first_signal(lane) + TEST_FRAMES / 2 < lane->frame_count);
+    }
+    sim_run_cycles((uint64_t) frame_cycles() * (TEST_FRAMES + 8 * PICO_AUDIO_I2S_MULTI_LANE_BUFFER_SAMPLE_LENGTH));
+    // and the whole sequence played in order, with silence only between the two rates
+    for (uint dac = 0; dac < TEST_DACS; dac++) {
+        const host_i2s_lane_t *lane = &probe->lanes[dac];
+        HOST_CHECK_EQ(lane->slot_errors, 0);
+        uint next = 0;
+        for (uint i = host_test_first_signal(lane); i < lane->frame_count; i++) {
+            if (!lane->frames[i][0] && !lane->frames[i][1]) {
+                HOST_CHECK(next == TEST_FRAMES / 2 || next == TEST_FRAMES);
+                continue;
+            }
+            HOST_CHECK(next < TEST_FRAMES);
+            HOST_CHECK_EQ(lane->frames[i][0], test_left(dac, next));
+            HOST_CHECK_EQ(lane->frames[i][1], test_right(dac, next));
+            next++;
+        }
+        HOST_CHECK_EQ(next, TEST_FRAMES);
+        HOST_CHECK_EQ(audio_i2s_get_stats_multi_dac((uint8_t) dac)->tx_stalls, 0);
+    }
+}
+
+/** \brief Play half the sequence, park once idle, then wake with the other half from the gives */
+static void run_park(audio_i2s_multi_dac_config_t *config) {
+    setup_multi(config);
+    audio_i2s_set_idle_park_ms_multi_dac(1);
+    host_i2s_probe_t *probe = start_probe();
+    audio_i2s_set_enabled_multi_dac(true);
+    give_buffers(0, TEST_BUFFERS / 2);
+    uint frames = 0;
+    while (!audio_i2s_is_parked_multi_dac()) {
+        HOST_CHECK(frames++ < TEST_MAX_FRAMES);
+        sim_run_cycles(frame_cycles());
+    }
+    // no more IRQs are taken while parked
+    uint32_t isr_count = audio_i2s_get_stats_multi_dac(0)->isr_count;
+    sim_run_cycles((uint64_t) frame_cycles() * 4 * PICO_AUDIO_I2S_MULTI_LANE_BUFFER_SAMPLE_LENGTH);
+    HOST_CHECK_EQ(audio_i2s_get_stats_multi_dac(0)->isr_count, isr_count);
+    HOST_CHECK(audio_i2s_is_parked_multi_dac());
+    give_buffers(TEST_BUFFERS / 2, TEST_BUFFERS / 2);
+    HOST_CHECK(!audio_i2s_is_parked_multi_dac());
+    sim_run_cycles((uint64_t) frame_cycles() * (TEST_FRAMES + 4 * PICO_AUDIO_I2S_MULTI_LANE_BUFFER_SAMPLE_LENGTH));
+    // the whole sequence played in order, the lanes still in step after the restart
+    uint resumed = 0;
+    for (uint dac = 0; dac < TEST_DACS; dac++) {
+        const host_i2s_lane_t *lane = &probe->lanes[dac];
+        HOST_CHECK_EQ(lane->slot_errors, 0);
+        uint next = 0;
+        for (uint i = host_test_first_signal(lane); i < lane->frame_count; i++) {
+            if (!lane->frames[i][0] && !lane->frames[i][1]) {
+                HOST_CHECK(next == TEST_FRAMES / 2 || next == TEST_FRAMES);
+                continue;
+            }
+            HOST_CHECK(next < TEST_FRAMES);
+            HOST_CHECK_EQ(lane->frames[i][0], test_left(dac, next));
+            HOST_CHECK_EQ(lane->frames[i][1], test_right(dac, next));
+            if (next == TEST_FRAMES / 2) {
+                HOST_CHECK(!dac || i == resumed);
+                resumed = i;
+            }
+            next++;
+        }
+        HOST_CHECK_EQ(next, TEST_FRAMES);
+    }
+}
+
+HOST_TEST(multi_park) {
+    audio_i2s_multi_dac_config_t config = {0};
+    run_park(&config);
+}
+
+HOST_TEST(multi_single_sm_park) {
+    audio_i2s_multi_dac_config_t config = {
+            .single_sm = true,
+    };
+    run_park(&config);
+}
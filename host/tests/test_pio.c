@@ -0,0 +1,245 @@
+/*
+ * Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/** \file test_pio.c
+ *  \brief The I2S PIO programs on the emulator, fed directly through the TX FIFOs
+ */
+
+#include "host_test.h"
+#include "hardware/pio.h"
+#include "audio_i2s.pio.h"
+
+#define BCLK_PIN 26
+#define LRCLK_PIN 27
+#define DATA_PIN 28
+#define DATA_PIN_B 20
+#define DATA_PIN_C 21
+
+#define TEST_FRAMES 24
+#define TEST_DIV 4
+
+static int16_t test_left(uint i) {
+    return (int16_t) (0x1234 + 97 * i);
+}
+
+static int16_t test_right(uint i) {
+    return (int16_t) -(0x0777 + 31 * (int) i);
+}
+
+/** \brief A FIFO word of the 16-bit programs: right channel in the high half, shifted out first */
+static uint32_t s16_word(int16_t left, int16_t right) {
+    return ((uint32_t) (uint16_t) right << 16) | (uint16_t) left;
+}
+
+static host_i2s_probe_t *start_probe(uint lane_count, const uint *data_pins, uint slot_bits) {
+    host_i2s_probe_config_t config = {
+            .bclk_pin = BCLK_PIN,
+            .lrclk_pin = LRCLK_PIN,
+            .lane_count = lane_count,
+            .slot_bits = slot_bits,
+            .frame_capacity = 4 * TEST_FRAMES,
+    };
+    for (uint i = 0; i < lane_count; i++) {
+        config.data_pins[i] = data_pins[i];
+    }
+    return sim_probe_start(&config);
+}
+
+static void gpio_init_pio(PIO pio, uint32_t pin_mask) {
+    for (uint pin = 0; pin < 32; pin++) {
+        if (pin_mask & (1u << pin)) {
+            pio_gpio_init(pio, pin);
+        }
+    }
+}
+
+static void check_s16_frames(const host_i2s_lane_t *lane, uint count) {
+    HOST_CHECK(lane->frame_count >= count);
+    HOST_CHECK_EQ(lane->slot_errors, 0);
+    for (uint i = 0; i < count; i++) {
+        HOST_CHECK_EQ(lane->frames[i][0], test_left(i));
+        HOST_CHECK_EQ(lane->frames[i][1], test_right(i));
+    }
+}
+
+/** \brief Run until sm shifted out everything it was given, then one more frame's worth */
+static void drain(PIO pio, uint sm, uint slot_bits) {
+    while (!pio_sm_is_tx_fifo_empty(pio, sm)) {
+        sim_run_cycles(1);
+    }
+    sim_run_cycles(4ull * slot_bits * TEST_DIV * 2);
+}
+
+HOST_TEST(pio_audio_i2s) {
+    PIO pio = pio0;
+    uint sm = 0;
+    uint offset = (uint) pio_add_program(pio, &audio_i2s_program);
+    gpio_init_pio(pio, (1u << DATA_PIN) | (3u << BCLK_PIN));
+    audio_i2s_program_init(pio, sm, offset, DATA_PIN, BCLK_PIN);
+    pio_sm_set_clkdiv_int_frac(pio, sm, TEST_DIV, 0);
+    uint data_pin = DATA_PIN;
+    host_i2s_probe_t *probe = start_probe(1, &data_pin, 16);
+    pio_sm_set_enabled(pio, sm, true);
+    // one frame more than checked: a frame is only complete when the next slot starts
+    for (uint i = 0; i <= TEST_FRAMES; i++) {
+        pio_sm_put_blocking(pio, sm, s16_word(test_left(i), test_right(i)));
+    }
+    drain(pio, sm, 16);
+    const host_i2s_lane_t *lane = &probe->lanes[0];
+    check_s16_frames(lane, TEST_FRAMES);
+    HOST_CHECK_EQ(lane->frame_start_channel, 1);
+    HOST_CHECK_EQ(probe->min_period, 2 * TEST_DIV);
+    HOST_CHECK_EQ(probe->max_period, 2 * TEST_DIV);
+    HOST_CHECK_EQ(probe->gaps, 0);
+    HOST_CHECK_EQ(lane->late_edges, 0);
+    HOST_CHECK_EQ(lane->max_data_delay, 0);
+}
+
+HOST_TEST(pio_slot32) {
+    PIO pio = pio0;
+    uint sm = 1;
+    uint offset = (uint) pio_add_program(pio, &audio_i2s_slot_program);
+    gpio_init_pio(pio, (1u << DATA_PIN) | (3u << BCLK_PIN));
+    audio_i2s_slot_program_init(pio, sm, offset, DATA_PIN, BCLK_PIN, 32);
+    pio_sm_set_clkdiv_int_frac(pio, sm, TEST_DIV, 0);
+    uint data_pin = DATA_PIN;
+    host_i2s_probe_t *probe = start_probe(1, &data_pin, 32);
+    pio_sm_set_enabled(pio, sm, true);
+    for (uint i = 0; i <= TEST_FRAMES; i++) {
+        pio_sm_put_blocking(pio, sm, (uint32_t) (test_left(i) * 65537));
+        pio_sm_put_blocking(pio, sm, (uint32_t) (test_right(i) * 65537));
+    }
+    drain(pio, sm, 32);
+    const host_i2s_lane_t *lane = &probe->lanes[0];
+    HOST_CHECK(lane->frame_count >= TEST_FRAMES);
+    HOST_CHECK_EQ(lane->slot_errors, 0);
+    HOST_CHECK_EQ(lane->frame_start_channel, 0);
+    for (uint i = 0; i < TEST_FRAMES; i++) {
+        HOST_CHECK_EQ(lane->frames[i][0], test_left(i) * 65537);
+        HOST_CHECK_EQ(lane->frames[i][1], test_right(i) * 65537);
+    }
+    HOST_CHECK_EQ(probe->min_period, 2 * TEST_DIV);
+    HOST_CHECK_EQ(lane->late_edges, 0);
+}
+
+/** \brief Load clock_gen on clock_pio/sm 0 and data_only for two lanes on data_pios, all stopped */
+static void setup_clock_data(PIO clock_pio, PIO data_pio_b, PIO data_pio_c) {
+    uint clock_offset = (uint) pio_add_program(clock_pio, &audio_i2s_clock_gen_program);
+    gpio_init_pio(clock_pio, 3u << BCLK_PIN);
+    audio_i2s_clock_gen_program_init(clock_pio, 0, clock_offset, BCLK_PIN, 16);
+    pio_sm_set_clkdiv_int_frac(clock_pio, 0, TEST_DIV, 0);
+    PIO data_pios[2] = {data_pio_b, data_pio_c};
+    uint data_pins[2] = {DATA_PIN_B, DATA_PIN_C};
+    for (uint i = 0; i < 2; i++) {
+        PIO pio = data_pios[i];
+        uint offset = (uint) pio_add_program(pio, &audio_i2s_data_only_program);
+        uint sm = 1 + i;
+        gpio_init_pio(pio, 1u << data_pins[i]);
+        audio_i2s_data_only_program_init(pio, sm, offset, data_pins[i]);
+        pio_sm_set_clkdiv_int_frac(pio, sm, TEST_DIV, 0);
+    }
+}
+
+static void put_lane_frames(PIO pio_b, PIO pio_c, uint first, uint count) {
+    for (uint i = first; i < first + count; i++) {
+        // the first frame is the same on both lanes, so their first 1 bits coincide
+        pio_sm_put_blocking(pio_b, 1, s16_word(test_left(i), test_right(i)));
+        pio_sm_put_blocking(pio_c, 2, s16_word((int16_t) (test_left(i) + i), (int16_t) (test_right(i) - i)));
+    }
+}
+
+static void check_clock_data_lanes(const host_i2s_probe_t *probe) {
+    const host_i2s_lane_t *b = &probe->lanes[0];
+    const host_i2s_lane_t *c = &probe->lanes[1];
+    HOST_CHECK(b->frame_count >= TEST_FRAMES);
+    HOST_CHECK(c->frame_count >= TEST_FRAMES);
+    HOST_CHECK_EQ(b->slot_errors + c->slot_errors, 0);
+    for (uint i = 0; i < TEST_FRAMES; i++) {
+        HOST_CHECK_EQ(b->frames[i][0], test_left(i));
+        HOST_CHECK_EQ(b->frames[i][1], test_right(i));
+        HOST_CHECK_EQ(c->frames[i][0], (int16_t) (test_left(i) + i));
+        HOST_CHECK_EQ(c->frames[i][1], (int16_t) (test_right(i) - i));
+    }
+    HOST_CHECK_EQ(b->late_edges + c->late_edges, 0);
+    HOST_CHECK_EQ(b->max_data_delay, 0);
+    HOST_CHECK_EQ(c->max_data_delay, 0);
+    HOST_CHECK(b->first_one_bclk != UINT64_MAX);
+    HOST_CHECK_EQ(b->first_one_bclk, c->first_one_bclk);
+    HOST_CHECK_EQ(probe->min_period, 2 * TEST_DIV);
+    HOST_CHECK_EQ(probe->gaps, 0);
+}
+
+HOST_TEST(pio_clock_data_sync) {
+    setup_clock_data(pio0, pio0, pio0);
+    uint data_pins[2] = {DATA_PIN_B, DATA_PIN_C};
+    host_i2s_probe_t *probe = start_probe(2, data_pins, 16);
+    put_lane_frames(pio0, pio0, 0, 2);
+    pio_enable_sm_mask_in_sync(pio0, 0x7);
+    put_lane_frames(pio0, pio0, 2, TEST_FRAMES - 1);
+    drain(pio0, 1, 16);
+    check_clock_data_lanes(probe);
+}
+
+HOST_TEST(pio_clock_data_cross_block) {
+    // clock on pio0, lanes on its neighbours pio1 (next) and pio2 (previous)
+    setup_clock_data(pio0, pio1, pio2);
+    uint data_pins[2] = {DATA_PIN_B, DATA_PIN_C};
+    host_i2s_probe_t *probe = start_probe(2, data_pins, 16);
+    put_lane_frames(pio1, pio2, 0, 2);
+    pio_enable_sm_multi_mask_in_sync(pio0, 1u << 2, 1u << 0, 1u << 1);
+    put_lane_frames(pio1, pio2, 2, TEST_FRAMES - 1);
+    drain(pio1, 1, 16);
+    check_clock_data_lanes(probe);
+}
+
+HOST_TEST(pio_late_data_sm) {
+    setup_clock_data(pio0, pio0, pio0);
+    uint data_pins[2] = {DATA_PIN_B, DATA_PIN_C};
+    host_i2s_probe_t *probe = start_probe(2, data_pins, 16);
+    put_lane_frames(pio0, pio0, 0, 2);
+    // lane B with the clock, lane C started separately part way through a clock instruction
+    pio_enable_sm_mask_in_sync(pio0, 0x3);
+    sim_run_cycles(TEST_DIV - 1);
+    pio_sm_set_enabled(pio0, 2, true);
+    put_lane_frames(pio0, pio0, 2, TEST_FRAMES - 1);
+    drain(pio0, 1, 16);
+    HOST_CHECK_EQ(probe->lanes[0].late_edges, 0);
+    HOST_CHECK_EQ(probe->lanes[0].max_data_delay, 0);
+    HOST_CHECK(probe->lanes[1].late_edges > 0 || probe->lanes[1].max_data_delay > 0);
+}
+
+HOST_TEST(pio_tx_stall) {
+    PIO pio = pio0;
+    uint sm = 0;
+    uint offset = (uint) pio_add_program(pio, &audio_i2s_program);
+    gpio_init_pio(pio, (1u << DATA_PIN) | (3u << BCLK_PIN));
+    audio_i2s_program_init(pio, sm, offset, DATA_PIN, BCLK_PIN);
+    pio_sm_set_clkdiv_int_frac(pio, sm, TEST_DIV, 0);
+    uint data_pin = DATA_PIN;
+    host_i2s_probe_t *probe = start_probe(1, &data_pin, 16);
+    for (uint i = 0; i < 2; i++) {
+        pio_sm_put(pio, sm, s16_word(test_left(i), test_right(i)));
+    }
+    pio_sm_set_enabled(pio, sm, true);
+    sim_run_cycles(2000);
+    HOST_CHECK(sim_pio_sm_stats(pio, sm)->tx_stalls > 0);
+    HOST_CHECK(pio->fdebug & (1u << (PIO_FDEBUG_TXSTALL_LSB + sm)));
+    for (uint i = 2; i < 6; i++) {
+        pio_sm_put_blocking(pio, sm, s16_word(test_left(i), test_right(i)));
+    }
+    // the flag clears on a write of 1, and stays clear while the state machine has data
+    pio->fdebug = 1u << (PIO_FDEBUG_TXSTALL_LSB + sm);
+    sim_run_cycles(100);
+    HOST_CHECK(!(pio->fdebug & (1u << (PIO_FDEBUG_TXSTALL_LSB + sm))));
+    for (uint i = 6; i <= TEST_FRAMES; i++) {
+        pio_sm_put_blocking(pio, sm, s16_word(test_left(i), test_right(i)));
+    }
+    drain(pio, sm, 16);
+    // the clocks held through the stall, so the stream picks up where it stopped
+    check_s16_frames(&probe->lanes[0], TEST_FRAMES);
+    HOST_CHECK(probe->gaps > 0);
+    HOST_CHECK(probe->max_period > 1000);
+}
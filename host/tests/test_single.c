@@ -0,0 +1,379 @@
+/*
+ * Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/** \file test_single.c
+ *  \brief The single DAC driver end to end: producer buffers in, I2S bitstream out
+ */
+
+#include "host_test.h"
+#include "hardware/clocks.h"
+#include "include/pico/audio_i2s.h"
+#include "include/pico/audio_i2s_mixer.h"
+#include "include/pico/audio_i2s_rate_match.h"
+
+#define TEST_SAMPLE_FREQ 48000
+#define TEST_PRODUCER_FRAMES 32
+#define TEST_CONSUMER_BUFFERS 4
+#define TEST_CONSUMER_FRAMES 32
+#define TEST_BUFFERS 8
+#define TEST_FRAMES (TEST_BUFFERS * TEST_PRODUCER_FRAMES)
+// the silence queued by an output that starts without data comes first
+#define TEST_MAX_FRAMES (16 * PICO_AUDIO_I2S_SILENCE_BUFFER_SAMPLE_LENGTH + TEST_FRAMES)
+
+static audio_format_t producer_format;
+static audio_buffer_format_t producer_buffer_format;
+static audio_buffer_pool_t *producer;
+static uint next_frame;
+
+static int16_t test_left(uint i) {
+    return (int16_t) (1 + 3 * i);
+}
+
+static int16_t test_right(uint i) {
+    return (int16_t) -(1000 + (int) i);
+}
+
+static int16_t test_mono(uint i) {
+    return (int16_t) (1 + 5 * i);
+}
+
+static int32_t test_left32(uint i) {
+    return (int32_t) ((i + 1) << 12);
+}
+
+static int32_t test_right32(uint i) {
+    return -test_left32(i) - 7;
+}
+
+static uint32_t frame_cycles(void) {
+    return clock_get_hz(clk_sys) / TEST_SAMPLE_FREQ;
+}
+
+static void setup_single(uint dma_mode, uint format, uint channel_count) {
+    audio_format_t intended = {
+            .sample_freq = TEST_SAMPLE_FREQ,
+            .format = (uint16_t) format,
+            .channel_count = (uint16_t) channel_count,
+    };
+    audio_i2s_config_t config = {
+            .data_pin = 28,
+            .clock_pin_base = 26,
+            .dma_channel = 0,
+            .pio_sm = 0,
+            .dma_mode = (uint8_t) dma_mode,
+            .dma_channel_b = 1,
+            .ring_irq_interval = TEST_CONSUMER_BUFFERS / 2,
+            .mono_output = format == AUDIO_BUFFER_FORMAT_PCM_S16 && channel_count == 1,
+    };
+    HOST_CHECK(audio_i2s_setup(&intended, &config));
+    producer_format = intended;
+    producer_buffer_format.format = &producer_format;
+    producer_buffer_format.sample_stride = (uint16_t) ((format == AUDIO_BUFFER_FORMAT_PCM_S16 ? 2 : 4) * channel_count);
+    // a ring starting up takes a buffer for every descriptor at once
+    producer = audio_new_producer_pool(&producer_buffer_format, TEST_CONSUMER_BUFFERS, TEST_PRODUCER_FRAMES);
+    HOST_CHECK(audio_i2s_connect_extra(producer, false, TEST_CONSUMER_BUFFERS, TEST_CONSUMER_FRAMES, NULL));
+    next_frame = 0;
+}
+
+static host_i2s_probe_t *start_probe(uint slot_bits) {
+    host_i2s_probe_config_t config = {
+            .bclk_pin = 26,
+            .lrclk_pin = 27,
+            .lane_count = 1,
+            .data_pins = {28},
+            .slot_bits = slot_bits,
+            .frame_capacity = TEST_MAX_FRAMES,
+    };
+    return sim_probe_start(&config);
+}
+
+/** \brief Give buffers producer buffers of the test sequence, blocking for free ones */
+static void give_frames(uint buffers) {
+    for (uint b = 0; b < buffers; b++) {
+        audio_buffer_t *ab = take_audio_buffer(producer, true);
+        for (uint i = 0; i < ab->max_sample_count; i++, next_frame++) {
+            if (producer_format.format == AUDIO_BUFFER_FORMAT_PCM_S32) {
+                int32_t *samples = (int32_t *) ab->buffer->bytes;
+                samples[2 * i] = test_left32(next_frame);
+                samples[2 * i + 1] = test_right32(next_frame);
+            } else if (producer_format.channel_count == 1) {
+                ((int16_t *) ab->buffer->bytes)[i] = test_mono(next_frame);
+            } else {
+                int16_t *samples = (int16_t *) ab->buffer->bytes;
+                samples[2 * i] = test_left(next_frame);
+                samples[2 * i + 1] = test_right(next_frame);
+            }
+        }
+        ab->sample_count = ab->max_sample_count;
+        give_audio_buffer(producer, ab);
+    }
+}
+
+/** \brief Run until the probe decoded count frames from the first with signal, or for at most max_frames frames */
+static void run_until_decoded(const host_i2s_probe_t *probe, uint count, uint max_frames) {
+    const host_i2s_lane_t *lane = &probe->lanes[0];
+    for (uint frames = 0; frames < max_frames; frames += 16) {
+        if (host_test_first_signal(lane) + count < lane->frame_count) {
+            return;
+        }
+        sim_run_cycles((uint64_t) frame_cycles() * 16);
+    }
+}
+
+/** \brief Give TEST_BUFFERS producer buffers and play them out, after the silence queued ahead of them */
+static void play_all(const host_i2s_probe_t *probe) {
+    give_frames(TEST_BUFFERS);
+    run_until_decoded(probe, TEST_FRAMES, TEST_MAX_FRAMES);
+}
+
+static void check_sequence(const host_i2s_lane_t *lane, uint count) {
+    uint first = host_test_first_signal(lane);
+    HOST_CHECK(first + count <= lane->frame_count);
+    HOST_CHECK_EQ(lane->slot_errors, 0);
+    for (uint i = 0; i < count; i++) {
+        const int32_t *frame = lane->frames[first + i];
+        if (producer_format.format == AUDIO_BUFFER_FORMAT_PCM_S32) {
+            HOST_CHECK_EQ(frame[0], test_left32(i));
+            HOST_CHECK_EQ(frame[1], test_right32(i));
+        } else if (producer_format.channel_count == 1) {
+            HOST_CHECK_EQ(frame[0], test_mono(i));
+            HOST_CHECK_EQ(frame[1], test_mono(i));
+        } else {
+            HOST_CHECK_EQ(frame[0], test_left(i));
+            HOST_CHECK_EQ(frame[1], test_right(i));
+        }
+    }
+}
+
+/** \brief The whole sequence came out in order, and the clocks never stopped */
+static void check_clean_run(const host_i2s_probe_t *probe) {
+    check_sequence(&probe->lanes[0], TEST_FRAMES);
+    HOST_CHECK_EQ(sim_pio_sm_stats(pio0, 0)->tx_stalls, 0);
+    HOST_CHECK_EQ(probe->gaps, 0);
+    HOST_CHECK_EQ(probe->lanes[0].late_edges, 0);
+}
+
+static void run_mode(uint dma_mode, uint format, uint channel_count) {
+    setup_single(dma_mode, format, channel_count);
+    host_i2s_probe_t *probe = start_probe(format == AUDIO_BUFFER_FORMAT_PCM_S32 ? 32 : 16);
+    audio_i2s_set_enabled(true);
+    play_all(probe);
+    check_clean_run(probe);
+    const audio_i2s_stats_t *stats = audio_i2s_get_stats();
+    HOST_CHECK_EQ(stats->tx_stalls, 0);
+    // counted on give and take: the queue built up, then ran dry at the end
+    HOST_CHECK(stats->max_fill > 0 && stats->max_fill <= TEST_BUFFERS);
+    HOST_CHECK_EQ(stats->min_fill, 0);
+}
+
+HOST_TEST(single_ping_pong) {
+    run_mode(AUDIO_I2S_DMA_MODE_PING_PONG, AUDIO_BUFFER_FORMAT_PCM_S16, 2);
+}
+
+HOST_TEST(single_ring) {
+    run_mode(AUDIO_I2S_DMA_MODE_RING, AUDIO_BUFFER_FORMAT_PCM_S16, 2);
+}
+
+HOST_TEST(single_mono) {
+    run_mode(AUDIO_I2S_DMA_MODE_SINGLE, AUDIO_BUFFER_FORMAT_PCM_S16, 1);
+}
+
+HOST_TEST(single_s32) {
+    run_mode(AUDIO_I2S_DMA_MODE_SINGLE, AUDIO_BUFFER_FORMAT_PCM_S32, 2);
+}
+
+// A single channel is re-armed by the IRQ while the TX FIFO (4 words and the
+// OSR, one frame each) drains, so the IRQ latency it survives is under 4 frames.
+
+HOST_TEST(single_deadline_met) {
+    sim_config()->irq_latency_cycles = frame_cycles() * 4 / 2;
+    run_mode(AUDIO_I2S_DMA_MODE_SINGLE, AUDIO_BUFFER_FORMAT_PCM_S16, 2);
+}
+
+HOST_TEST(single_deadline_missed) {
+    sim_config()->irq_latency_cycles = frame_cycles() * 5 * 3 / 2;
+    setup_single(AUDIO_I2S_DMA_MODE_SINGLE, AUDIO_BUFFER_FORMAT_PCM_S16, 2);
+    host_i2s_probe_t *probe = start_probe(16);
+    audio_i2s_set_enabled(true);
+    play_all(probe);
+    // the state machine stalls with the clocks held, so nothing is lost, only late
+    HOST_CHECK(sim_pio_sm_stats(pio0, 0)->tx_stalls > 0);
+    HOST_CHECK(probe->gaps > 0);
+    check_sequence(&probe->lanes[0], TEST_FRAMES);
+}
+
+HOST_TEST(single_ping_pong_deadline) {
+    // the partner channel is already queued, so the IRQ has a whole buffer period
+    sim_config()->irq_latency_cycles = frame_cycles() * 5 * 3 / 2;
+    run_mode(AUDIO_I2S_DMA_MODE_PING_PONG, AUDIO_BUFFER_FORMAT_PCM_S16, 2);
+}
+
+/** \brief Play half the sequence, park once idle, then wake with the other half from the gives */
+static void run_park(uint dma_mode) {
+    setup_single(dma_mode, AUDIO_BUFFER_FORMAT_PCM_S16, 2);
+    audio_i2s_set_idle_park_ms(1);
+    host_i2s_probe_t *probe = start_probe(16);
+    audio_i2s_set_enabled(true);
+    give_frames(TEST_BUFFERS / 2);
+    uint frames = 0;
+    while (!audio_i2s_is_parked()) {
+        HOST_CHECK(frames++ < TEST_MAX_FRAMES);
+        sim_run_cycles(frame_cycles());
+    }
+    // no more IRQs are taken while parked
+    uint32_t isr_count = audio_i2s_get_stats()->isr_count;
+    sim_run_cycles((uint64_t) frame_cycles() * 4 * PICO_AUDIO_I2S_SILENCE_BUFFER_SAMPLE_LENGTH);
+    HOST_CHECK_EQ(audio_i2s_get_stats()->isr_count, isr_count);
+    HOST_CHECK(audio_i2s_is_parked());
+    give_frames(TEST_BUFFERS / 2);
+    HOST_CHECK(!audio_i2s_is_parked());
+    sim_run_cycles((uint64_t) frame_cycles() * (TEST_FRAMES + 4 * PICO_AUDIO_I2S_SILENCE_BUFFER_SAMPLE_LENGTH));
+    // the whole sequence played in order, with silence only while parked
+    const host_i2s_lane_t *lane = &probe->lanes[0];
+    HOST_CHECK_EQ(lane->slot_errors, 0);
+    uint next = 0;
+    for (uint i = host_test_first_signal(lane); i < lane->frame_count; i++) {
+        if (!lane->frames[i][0] && !lane->frames[i][1]) {
+            HOST_CHECK(next == TEST_FRAMES / 2 || next == TEST_FRAMES);
+            continue;
+        }
+        HOST_CHECK(next < TEST_FRAMES);
+        HOST_CHECK_EQ(lane->frames[i][0], test_left(next));
+        HOST_CHECK_EQ(lane->frames[i][1], test_right(next));
+        next++;
+    }
+    HOST_CHECK_EQ(next, TEST_FRAMES);
+}
+
+HOST_TEST(single_park) {
+    run_park(AUDIO_I2S_DMA_MODE_SINGLE);
+}
+
+HOST_TEST(single_ping_pong_park) {
+    run_park(AUDIO_I2S_DMA_MODE_PING_PONG);
+}
+
+HOST_TEST(single_ring_park) {
+    run_park(AUDIO_I2S_DMA_MODE_RING);
+}
+
+HOST_TEST(single_reenable_s32) {
+    setup_single(AUDIO_I2S_DMA_MODE_SINGLE, AUDIO_BUFFER_FORMAT_PCM_S32, 2);
+    audio_i2s_set_enabled(true);
+    give_frames(TEST_BUFFERS / 2);
+    // stop part way through a frame
+    sim_run_cycles((uint64_t) frame_cycles() * TEST_CONSUMER_FRAMES + frame_cycles() / 3);
+    audio_i2s_set_enabled(false);
+    sim_run_cycles(frame_cycles() * 4);
+    host_i2s_probe_t *probe = start_probe(32);
+    audio_i2s_set_enabled(true);
+    play_all(probe);
+    // every left sample is positive and every right one negative, so a swap shows
+    const host_i2s_lane_t *lane = &probe->lanes[0];
+    HOST_CHECK_EQ(lane->slot_errors, 0);
+    uint signal_frames = 0;
+    for (uint i = 0; i < lane->frame_count; i++) {
+        if (lane->frames[i][0] || lane->frames[i][1]) {
+            HOST_CHECK(lane->frames[i][0] > 0);
+            HOST_CHECK(lane->frames[i][1] < 0);
+            signal_frames++;
+        }
+    }
+    HOST_CHECK(signal_frames >= TEST_FRAMES);
+}
+
+/** \brief A sample through the mixer at unity gain: a rounded Q15 product */
+static int32_t mixer_unity(int16_t x) {
+    return (x * AUDIO_I2S_MIXER_UNITY_GAIN + 0x4000) >> 15;
+}
+
+/** \brief Set up a mono or 32-bit slot output, and an S16 stereo producer for a custom connection */
+static void setup_s16_producer(uint slot_format, uint channel_count) {
+    audio_format_t intended = {
+            .sample_freq = TEST_SAMPLE_FREQ,
+            .format = (uint16_t) slot_format,
+            .channel_count = (uint16_t) channel_count,
+    };
+    audio_i2s_config_t config = {
+            .data_pin = 28,
+            .clock_pin_base = 26,
+            .dma_channel = 0,
+            .pio_sm = 0,
+            .mono_output = channel_count == 1,
+    };
+    HOST_CHECK(audio_i2s_setup(&intended, &config));
+    producer_format = (audio_format_t) {
+            .sample_freq = TEST_SAMPLE_FREQ,
+            .format = AUDIO_BUFFER_FORMAT_PCM_S16,
+            .channel_count = 2,
+    };
+    producer_buffer_format.format = &producer_format;
+    producer_buffer_format.sample_stride = 4;
+    // a ring starting up takes a buffer for every descriptor at once
+    producer = audio_new_producer_pool(&producer_buffer_format, TEST_CONSUMER_BUFFERS, TEST_PRODUCER_FRAMES);
+    next_frame = 0;
+}
+
+/** \brief One S16 stereo stream through the mixer into a mono or 32-bit slot output */
+static void run_mixer(uint slot_format, uint channel_count) {
+    setup_s16_producer(slot_format, channel_count);
+    static audio_i2s_mixer_t mixer;
+    audio_buffer_pool_t *mix = audio_i2s_mixer_init(&mixer, TEST_SAMPLE_FREQ);
+    HOST_CHECK_EQ(audio_i2s_mixer_add_stream(&mixer, producer, AUDIO_I2S_MIXER_UNITY_GAIN), 0);
+    HOST_CHECK(audio_i2s_connect_extra(mix, false, TEST_CONSUMER_BUFFERS, TEST_CONSUMER_FRAMES, &mixer.core));
+
+    bool wide = slot_format == AUDIO_BUFFER_FORMAT_PCM_S32;
+    host_i2s_probe_t *probe = start_probe(wide ? 32 : 16);
+    audio_i2s_set_enabled(true);
+    play_all(probe);
+    const host_i2s_lane_t *lane = &probe->lanes[0];
+    uint first = host_test_first_signal(lane);
+    HOST_CHECK(first + TEST_FRAMES <= lane->frame_count);
+    HOST_CHECK_EQ(lane->slot_errors, 0);
+    for (uint i = 0; i < TEST_FRAMES; i++) {
+        const int32_t *frame = lane->frames[first + i];
+        int32_t left = mixer_unity(test_left(i));
+        int32_t right = mixer_unity(test_right(i));
+        if (channel_count == 1) {
+            HOST_CHECK_EQ(frame[0], (left + right) >> 1);
+            HOST_CHECK_EQ(frame[1], (left + right) >> 1);
+        } else {
+            HOST_CHECK_EQ(frame[0], wide ? left * 65536 : left);
+            HOST_CHECK_EQ(frame[1], wide ? right * 65536 : right);
+        }
+    }
+}
+
+HOST_TEST(single_mixer_mono) {
+    run_mixer(AUDIO_BUFFER_FORMAT_PCM_S16, 1);
+}
+
+HOST_TEST(single_mixer_s32) {
+    run_mixer(AUDIO_BUFFER_FORMAT_PCM_S32, 2);
+}
+
+HOST_TEST(single_rate_match_s32) {
+    setup_s16_producer(AUDIO_BUFFER_FORMAT_PCM_S32, 2);
+    static audio_i2s_rate_match_connection_t rate_match;
+    audio_connection_t *connection = audio_i2s_rate_match_connection_init(&rate_match, TEST_PRODUCER_FRAMES);
+    HOST_CHECK(audio_i2s_connect_extra(producer, false, TEST_CONSUMER_BUFFERS, TEST_CONSUMER_FRAMES, connection));
+    host_i2s_probe_t *probe = start_probe(32);
+    audio_i2s_set_enabled(true);
+    play_all(probe);
+    // interpolated samples keep their signs, and land MSB aligned in the slots
+    const host_i2s_lane_t *lane = &probe->lanes[0];
+    HOST_CHECK_EQ(lane->slot_errors, 0);
+    uint signal_frames = 0;
+    for (uint i = 0; i < lane->frame_count; i++) {
+        const int32_t *frame = lane->frames[i];
+        HOST_CHECK_EQ(frame[0] & 0xffff, 0);
+        HOST_CHECK_EQ(frame[1] & 0xffff, 0);
+        HOST_CHECK(frame[0] >= 0);
+        HOST_CHECK(frame[1] <= 0);
+        signal_frames += frame[0] > 0;
+    }
+    HOST_CHECK(signal_frames >= TEST_FRAMES / 2);
+}
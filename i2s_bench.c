@@ -0,0 +1,406 @@
+/*
+ * Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/** \file i2s_bench.c
+ *  \brief Release qualification benchmark for the I2S audio library
+ *
+ * Measures the cost of the library on the target and reports it over USB stdio:
+ * - Conversion cycles per sample for each consumer take converter
+ * - For each output configuration (single DAC in every DMA mode, 1-3 DACs with
+ *   separate state machines, 4 DACs on one state machine), each samples_per_buffer
+ *   in bench_samples_per_buffer and each rate in bench_sample_freqs: buffers played,
+ *   underruns, PIO stalls (missed refill deadlines, and lane slips with separate
+ *   data state machines), silence, ISR cycles per buffer, worst ISR and CPU load
+ *
+ * The drivers can only be set up once per boot, so each configuration and buffer
+ * size runs in its own boot: the next run index is kept in a watchdog scratch
+ * register and the board reboots itself between runs. Use a terminal that
+ * reconnects to the USB serial port (e.g. tio) to capture the whole report.
+ * Every line of results starts with "run", "conv" or "#" so it can be grepped.
+ *
+ * Synthetic generators keep every producer pool full; a sine of a different pitch
+ * is played on each DAC so the outputs can also be checked by ear or on a scope.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "pico/stdlib.h"
+#include "pico/stdio_usb.h"
+#include "hardware/clocks.h"
+#include "hardware/sync.h"
+#include "hardware/watchdog.h"
+#include "include/pico/audio_i2s.h"
+
+#if !PICO_AUDIO_I2S_STATS
+#error i2s_bench needs PICO_AUDIO_I2S_STATS
+#endif
+
+/** \brief Time each rate is played for, after settling */
+#ifndef I2S_BENCH_RUN_MS
+#define I2S_BENCH_RUN_MS 1000
+#endif
+
+/** \brief Time each rate is played for before the statistics are reset */
+#ifndef I2S_BENCH_SETTLE_MS
+#define I2S_BENCH_SETTLE_MS 100
+#endif
+
+/** \brief Buffers in each producer pool */
+#ifndef I2S_BENCH_PRODUCER_BUFFERS
+#define I2S_BENCH_PRODUCER_BUFFERS 3
+#endif
+
+/** \brief Watchdog scratch register holding the next run index across reboots */
+#define I2S_BENCH_SCRATCH_RUN 0
+/** \brief Watchdog scratch register marking I2S_BENCH_SCRATCH_RUN as valid */
+#define I2S_BENCH_SCRATCH_MAGIC 1
+#define I2S_BENCH_MAGIC 0x12550bebu
+
+/** \brief One output configuration under test */
+typedef struct bench_config {
+    const char *name;          ///< Name printed in the report
+    uint8_t num_dacs;          ///< 0 for the single DAC driver, else multi-DAC driver DAC count
+    bool single_sm;            ///< Multi-DAC: all lanes on one state machine
+    uint8_t dma_mode;          ///< Single DAC: enum audio_i2s_dma_mode
+} bench_config_t;
+
+static const bench_config_t bench_configs[] = {
+        {"single",           0, false, AUDIO_I2S_DMA_MODE_SINGLE},
+        {"single-pingpong",  0, false, AUDIO_I2S_DMA_MODE_PING_PONG},
+        {"single-ring",      0, false, AUDIO_I2S_DMA_MODE_RING},
+        {"multi-1",          1, false, 0},
+        {"multi-2",          2, false, 0},
+        {"multi-3",          3, false, 0},
+        {"multi-lanes-4",    4, true,  0},
+};
+
+static const uint bench_samples_per_buffer[] = {64, 256, 1024};
+
+static const uint32_t bench_sample_freqs[] = {22050, 44100, 48000, 96000};
+
+#define BENCH_RUN_COUNT (count_of(bench_configs) * count_of(bench_samples_per_buffer))
+
+/** \brief Data pins for separate state machine multi-DAC runs (clocks on PICO_AUDIO_I2S_CLOCK_PIN_BASE) */
+static const uint8_t bench_multi_data_pins[PICO_AUDIO_I2S_MAX_DACS] = {28, 20, 22, 24};
+
+/** \brief First of the consecutive data pins for single state machine runs */
+#define BENCH_LANE_DATA_PIN_BASE 18
+
+#define SINE_TABLE_LENGTH 256
+static int16_t sine_table[SINE_TABLE_LENGTH];
+
+static audio_format_t producer_format = {
+        .format = AUDIO_BUFFER_FORMAT_PCM_S16,
+        .sample_freq = 44100,
+        .channel_count = 2,
+};
+
+static audio_buffer_format_t producer_buffer_format = {
+        .format = &producer_format,
+        .sample_stride = 4,
+};
+
+/** \brief State of one synthetic generator */
+static struct {
+    audio_buffer_pool_t *pool;  ///< Producer pool fed by the generator
+    uint32_t phase;             ///< 16.16 position in sine_table
+    uint32_t step;              ///< 16.16 phase increment per frame
+} generators[PICO_AUDIO_I2S_MAX_DACS];
+
+static uint generator_count;
+
+static void sine_table_init(void) {
+    for (uint i = 0; i < SINE_TABLE_LENGTH; i++) {
+        sine_table[i] = (int16_t) (16384.0f * sinf((float) i * (6.2831853f / SINE_TABLE_LENGTH)));
+    }
+}
+
+/** \brief Tune every generator for the current sample rate; DAC n plays 440 Hz * (n + 1) */
+static void generators_set_freq(uint32_t sample_freq) {
+    for (uint i = 0; i < generator_count; i++) {
+        generators[i].step = (uint32_t) (((uint64_t) 440u * (i + 1) * SINE_TABLE_LENGTH << 16u) / sample_freq);
+    }
+}
+
+/** \brief Fill every free producer buffer */
+static void generators_feed(void) {
+    for (uint i = 0; i < generator_count; i++) {
+        audio_buffer_t *ab;
+        while ((ab = take_audio_buffer(generators[i].pool, false))) {
+            int16_t *samples = (int16_t *) ab->buffer->bytes;
+            uint32_t phase = generators[i].phase;
+            for (uint f = 0; f < ab->max_sample_count; f++) {
+                int16_t s = sine_table[(phase >> 16u) & (SINE_TABLE_LENGTH - 1)];
+                samples[f * 2] = s;
+                samples[f * 2 + 1] = s;
+                phase += generators[i].step;
+            }
+            generators[i].phase = phase;
+            ab->sample_count = ab->max_sample_count;
+            give_audio_buffer(generators[i].pool, ab);
+        }
+    }
+}
+
+/** \brief Keep the generators fed for ms milliseconds */
+static void generators_run(uint32_t ms) {
+    absolute_time_t until = make_timeout_time_ms(ms);
+    while (!time_reached(until)) {
+        generators_feed();
+    }
+}
+
+/** \brief Print value / divisor with two decimal places */
+static void print_fixed2(uint64_t value, uint64_t divisor) {
+    uint64_t hundredths = divisor ? (value * 100u + divisor / 2u) / divisor : 0;
+    printf("%lu.%02lu", (unsigned long) (hundredths / 100u), (unsigned long) (hundredths % 100u));
+}
+
+/** \name Conversion benchmark
+ * @{
+ */
+
+#define CONV_FRAMES 256
+#define CONV_REPEATS 16
+
+static uint32_t conv_input[CONV_FRAMES * 2];
+static uint32_t conv_output[CONV_FRAMES * 2];
+
+/** \brief One converter under test */
+typedef struct conv_case {
+    const char *name;          ///< Name printed in the report
+    uint16_t format;           ///< Producer AUDIO_BUFFER_FORMAT_*
+    uint16_t channel_count;    ///< Producer channel count
+    bool wide;                 ///< Convert to 32-bit stereo rather than S16 stereo
+    uint8_t input_offset;      ///< Byte offset of the input, to time the unaligned paths
+} conv_case_t;
+
+static const conv_case_t conv_cases[] = {
+        {"s16-stereo>s16-stereo",          AUDIO_BUFFER_FORMAT_PCM_S16, 2, false, 0},
+        {"s16-mono>s16-stereo",            AUDIO_BUFFER_FORMAT_PCM_S16, 1, false, 0},
+        {"s16-mono>s16-stereo/unaligned",  AUDIO_BUFFER_FORMAT_PCM_S16, 1, false, 2},
+        {"s8-mono>s16-stereo",             AUDIO_BUFFER_FORMAT_PCM_S8,  1, false, 0},
+        {"s8-mono>s16-stereo/unaligned",   AUDIO_BUFFER_FORMAT_PCM_S8,  1, false, 1},
+        {"s8-stereo>s16-stereo",           AUDIO_BUFFER_FORMAT_PCM_S8,  2, false, 0},
+        {"s16-stereo>s32-stereo",          AUDIO_BUFFER_FORMAT_PCM_S16, 2, true,  0},
+        {"s24-stereo>s32-stereo",          AUDIO_BUFFER_FORMAT_PCM_S24, 2, true,  0},
+        {"s32-mono>s32-stereo",            AUDIO_BUFFER_FORMAT_PCM_S32, 1, true,  0},
+};
+
+/** \brief Report the best of CONV_REPEATS timed conversions of CONV_FRAMES frames, per frame */
+static void bench_conversions(void) {
+    for (uint i = 0; i < count_of(conv_input); i++) {
+        conv_input[i] = i * 0x9e3779b9u;
+    }
+    printf("# conv <converter> <cycles per frame>\n");
+    for (uint c = 0; c < count_of(conv_cases); c++) {
+        const conv_case_t *cc = &conv_cases[c];
+        audio_format_t format = {
+                .format = cc->format,
+                .sample_freq = 44100,
+                .channel_count = cc->channel_count,
+        };
+        audio_i2s_sample_converter_t convert = cc->wide ? audio_i2s_s32_stereo_converter(&format) :
+                                               audio_i2s_s16_converter(&format, 2);
+        if (!convert) {
+            printf("conv %s unsupported\n", cc->name);
+            continue;
+        }
+        const void *input = (const uint8_t *) conv_input + cc->input_offset;
+        uint32_t best = UINT32_MAX;
+        for (uint r = 0; r < CONV_REPEATS; r++) {
+            uint32_t save = save_and_disable_interrupts();
+            uint32_t start = audio_i2s_stats_cycles();
+            convert(conv_output, input, CONV_FRAMES);
+            uint32_t cycles = audio_i2s_stats_cycles() - start;
+            restore_interrupts(save);
+#if !defined(__riscv)
+            cycles &= 0xffffffu;
+#endif
+            best = MIN(best, cycles);
+        }
+        printf("conv %s ", cc->name);
+        print_fixed2(best, CONV_FRAMES);
+        printf("\n");
+    }
+}
+
+/** @} */
+
+/** \brief Buffers each pool needs for a configuration
+ *
+ * A ring queues 2 * ring_irq_interval buffers and its IRQ takes ring_irq_interval
+ * at once, so it needs one more than the whole ring to have one being filled.
+ */
+static uint bench_buffer_count(const bench_config_t *config, uint count) {
+    if (!config->num_dacs && config->dma_mode == AUDIO_I2S_DMA_MODE_RING) {
+        return MAX(count, 2u * PICO_AUDIO_I2S_RING_IRQ_INTERVAL + 1u);
+    }
+    return count;
+}
+
+/** \brief Set up and connect the outputs for a configuration
+ *  \return Number of outputs with statistics
+ */
+static uint bench_setup(const bench_config_t *config, uint samples_per_buffer) {
+    generator_count = config->num_dacs ? config->num_dacs : 1;
+    for (uint i = 0; i < generator_count; i++) {
+        generators[i].pool = audio_new_producer_pool(&producer_buffer_format,
+                                                     bench_buffer_count(config, I2S_BENCH_PRODUCER_BUFFERS),
+                                                     samples_per_buffer);
+        generators[i].phase = 0;
+    }
+    generators_set_freq(producer_format.sample_freq);
+
+    if (!config->num_dacs) {
+        audio_i2s_config_t i2s_config = {
+                .data_pin = PICO_AUDIO_I2S_DATA_PIN,
+                .clock_pin_base = PICO_AUDIO_I2S_CLOCK_PIN_BASE,
+                .dma_channel = 0,
+                .pio_sm = 0,
+                .dma_mode = config->dma_mode,
+                .dma_channel_b = 1,
+                .ring_irq_interval = PICO_AUDIO_I2S_RING_IRQ_INTERVAL,
+        };
+        if (!audio_i2s_setup(&producer_format, &i2s_config)) {
+            panic("I2S setup failed");
+        }
+        if (!audio_i2s_connect_extra(generators[0].pool, false, bench_buffer_count(config, 2),
+                                     samples_per_buffer, NULL)) {
+            panic("I2S connect failed");
+        }
+        generators_feed();
+        audio_i2s_set_enabled(true);
+        return 1;
+    }
+
+    audio_i2s_multi_dac_config_t multi_config = {
+            .num_dacs = config->num_dacs,
+            .clock_pin_base = PICO_AUDIO_I2S_CLOCK_PIN_BASE,
+            .clock_pio_sm = 0,
+            .single_sm = config->single_sm,
+    };
+    for (uint8_t i = 0; i < config->num_dacs; i++) {
+        multi_config.data_pins[i] = config->single_sm ? (uint8_t) (BENCH_LANE_DATA_PIN_BASE + i) :
+                                    bench_multi_data_pins[i];
+        multi_config.dma_channels[i] = i;
+        multi_config.data_pio_sms[i] = (uint8_t) (i + 1);
+    }
+    if (!audio_i2s_setup_multi_dac(&producer_format, &multi_config)) {
+        panic("multi-DAC I2S setup failed");
+    }
+    for (uint8_t i = 0; i < config->num_dacs; i++) {
+        if (!audio_i2s_connect_multi_dac_extra(generators[i].pool, i, false, 2, samples_per_buffer, NULL)) {
+            panic("multi-DAC I2S connect failed");
+        }
+    }
+    generators_feed();
+    audio_i2s_set_enabled_multi_dac(true);
+    return config->num_dacs;
+}
+
+static const audio_i2s_stats_t *bench_stats(const bench_config_t *config, uint output) {
+    return config->num_dacs ? audio_i2s_get_stats_multi_dac((uint8_t) output) : audio_i2s_get_stats();
+}
+
+static void bench_reset_stats(const bench_config_t *config, uint outputs) {
+    if (!config->num_dacs) {
+        audio_i2s_reset_stats();
+        return;
+    }
+    for (uint i = 0; i < outputs; i++) {
+        audio_i2s_reset_stats_multi_dac((uint8_t) i);
+    }
+}
+
+/** \brief Play every rate in bench_sample_freqs and report each output */
+static void bench_run(uint run) {
+    const bench_config_t *config = &bench_configs[run / count_of(bench_samples_per_buffer)];
+    uint samples_per_buffer = bench_samples_per_buffer[run % count_of(bench_samples_per_buffer)];
+    uint32_t sys_hz = clock_get_hz(clk_sys);
+
+    printf("# run %u/%u: %s, %u samples per buffer, clk_sys %lu Hz\n", run + 1, (uint) BENCH_RUN_COUNT,
+           config->name, samples_per_buffer, (unsigned long) sys_hz);
+    uint outputs = bench_setup(config, samples_per_buffer);
+
+    for (uint r = 0; r < count_of(bench_sample_freqs); r++) {
+        uint32_t sample_freq = bench_sample_freqs[r];
+        // picked up by the drivers on the next buffer
+        producer_format.sample_freq = sample_freq;
+        generators_set_freq(sample_freq);
+        generators_run(I2S_BENCH_SETTLE_MS);
+
+        bench_reset_stats(config, outputs);
+        absolute_time_t start = get_absolute_time();
+        generators_run(I2S_BENCH_RUN_MS);
+        uint64_t elapsed_cycles = absolute_time_diff_us(start, get_absolute_time()) * (uint64_t) sys_hz / 1000000u;
+
+        for (uint i = 0; i < outputs; i++) {
+            const audio_i2s_stats_t *stats = bench_stats(config, i);
+            uint32_t buffers = stats->buffers_played + stats->underruns;
+            printf("run %s %u %lu %u %lu %lu %lu %lu %u %lu ", config->name, samples_per_buffer,
+                   (unsigned long) sample_freq, i, (unsigned long) stats->buffers_played,
+                   (unsigned long) stats->underruns, (unsigned long) stats->tx_stalls,
+                   (unsigned long) stats->silence_samples,
+                   stats->min_fill == 0xffffu ? 0u : stats->min_fill, (unsigned long) stats->isr_cycles_max);
+            print_fixed2(stats->isr_cycles_total, buffers);
+            printf(" ");
+            // percent of clk_sys spent in the ISR on behalf of this output
+            print_fixed2(stats->isr_cycles_total * (uint64_t) 100u, elapsed_cycles);
+            printf("\n");
+        }
+    }
+}
+
+int main() {
+    stdio_init_all();
+
+    uint run = 0;
+    if (watchdog_caused_reboot() && watchdog_hw->scratch[I2S_BENCH_SCRATCH_MAGIC] == I2S_BENCH_MAGIC) {
+        run = watchdog_hw->scratch[I2S_BENCH_SCRATCH_RUN];
+    }
+    watchdog_hw->scratch[I2S_BENCH_SCRATCH_MAGIC] = 0;
+    if (run >= BENCH_RUN_COUNT) {
+        run = 0;
+    }
+
+    // give the host a few seconds to (re)open the port
+    absolute_time_t connect_timeout = make_timeout_time_ms(5000);
+    while (!stdio_usb_connected() && !time_reached(connect_timeout)) {
+        sleep_ms(10);
+    }
+    sleep_ms(100);
+
+    sine_table_init();
+    if (!run) {
+        printf("# i2s_bench: %u runs of %u rates, %u ms each\n", (uint) BENCH_RUN_COUNT,
+               (uint) count_of(bench_sample_freqs), I2S_BENCH_RUN_MS);
+        // the cycle counter is started by the first stats reset
+        audio_i2s_reset_stats();
+        bench_conversions();
+        printf("# run <config> <samples per buffer> <Hz> <output> <buffers> <underruns> <PIO stalls> <silent frames> "
+               "<min fill> <max ISR cycles> <ISR cycles per buffer> <CPU load %%>\n");
+    }
+
+    bench_run(run);
+
+    if (run + 1 < BENCH_RUN_COUNT) {
+        watchdog_hw->scratch[I2S_BENCH_SCRATCH_RUN] = run + 1;
+        watchdog_hw->scratch[I2S_BENCH_SCRATCH_MAGIC] = I2S_BENCH_MAGIC;
+        stdio_flush();
+        sleep_ms(100);
+        watchdog_reboot(0, 0, 0);
+        while (true) {
+            tight_loop_contents();
+        }
+    }
+
+    printf("# i2s_bench done\n");
+    while (true) {
+        generators_feed();
+    }
+}
@@ -19,13 +19,14 @@
  * The library supports multiple operating modes:
  * - Single DAC mode: Traditional single-output I2S interface
  * - Multi-DAC mode: Multiple synchronized DACs sharing a common clock
+ * - TDM mode: Up to 16 slots per frame on a single data line
  * - Various audio formats: PCM 16-bit stereo/mono, 8-bit audio
  * - Configurable sample rates and DMA-based streaming
  *
  * Key Features:
  * - Hardware-accelerated audio processing using PIO state machines
  * - DMA-driven data transfer for minimal CPU overhead
- * - Support for up to 4 synchronized DACs in multi-DAC configuration
+ * - Support for up to 7 (RP2040) or 11 (RP2350) synchronized DACs in multi-DAC configuration
  * - Automatic format conversion and channel mapping
  * - Real-time frequency adjustment and clock generation
  * - Built-in silence handling and buffer management
@@ -46,10 +47,16 @@
  * - audio_i2s_common.h: Shared definitions, macros, and utility functions
  * - audio_i2s_single.h: Single DAC implementation with basic I2S functionality
  * - audio_i2s_multi.h: Multi-DAC implementation for synchronized audio output
+ * - audio_i2s_tdm.h: TDM output of up to 16 channels on one data line
+ * - audio_i2s_rate_match.h: Adaptive rate matching connection for foreign-clock producers
+ * - audio_i2s_mixer.h: Software mixer connection for several producers on one output
  */
 #include "audio_i2s_common.h"
 #include "audio_i2s_single.h"
 #include "audio_i2s_multi.h"
+#include "audio_i2s_tdm.h"
+#include "audio_i2s_rate_match.h"
+#include "audio_i2s_mixer.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -63,6 +70,9 @@ extern "C" {
  * - Common utilities and configuration macros (audio_i2s_common.h)
  * - Single DAC implementation for basic use cases (audio_i2s_single.h)  
  * - Multi-DAC implementation for advanced applications (audio_i2s_multi.h)
+ * - TDM output of many channels on one data line (audio_i2s_tdm.h)
+ * - Adaptive rate matching for producers on a foreign clock (audio_i2s_rate_match.h)
+ * - Mixing several producers into one output (audio_i2s_mixer.h)
  *
  * Include this header to access the complete I2S audio functionality.
  * The modular design allows you to include specific component headers
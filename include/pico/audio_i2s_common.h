@@ -24,6 +24,9 @@
 #include "pico/audio.h"
 #include "hardware/pio.h"
 #include "hardware/dma.h"
+#if !defined(__riscv)
+#include "hardware/structs/systick.h"
+#endif
 
 #ifdef __cplusplus
 extern "C" {
@@ -71,6 +74,79 @@ extern "C" {
 #endif
 #endif
 
+/** \brief Length of the first silence run of an underrun, or 0 to always play full silence runs
+ *
+ * When nonzero, a refill that finds no buffer ready plays only this many frames
+ * of silence before checking again, and each further refill in a row doubles the
+ * run, up to the output's full silence run. A buffer that arrives just after an
+ * underrun is then late by at most this many frames rather than a whole silence
+ * run, while an idle output settles back to one IRQ per full run after a few
+ * retries.
+ */
+#ifndef PICO_AUDIO_I2S_UNDERRUN_RETRY_SAMPLE_LENGTH
+#define PICO_AUDIO_I2S_UNDERRUN_RETRY_SAMPLE_LENGTH 0
+#endif
+
+#if PICO_AUDIO_I2S_UNDERRUN_RETRY_SAMPLE_LENGTH > PICO_AUDIO_I2S_SILENCE_BUFFER_SAMPLE_LENGTH
+#error PICO_AUDIO_I2S_UNDERRUN_RETRY_SAMPLE_LENGTH must not exceed PICO_AUDIO_I2S_SILENCE_BUFFER_SAMPLE_LENGTH
+#endif
+
+/** \brief Length in frames of the fade ramps around silence, or 0 for none
+ *
+ * When nonzero, an output that runs dry ramps from the last frame queued down to
+ * zero over this many frames before playing silence, the first buffer after
+ * silence (or after enabling) is ramped up from the silence level in place, and
+ * disabling ramps the output down before the state machines stop. This removes
+ * the click of a jump to zero with DC-offset content. Applies to the single DAC
+ * output and the multi-DAC output (not lane mode or TDM).
+ */
+#ifndef PICO_AUDIO_I2S_FADE_FRAMES
+#define PICO_AUDIO_I2S_FADE_FRAMES 0
+#endif
+
+#if PICO_AUDIO_I2S_FADE_FRAMES == 1 || PICO_AUDIO_I2S_FADE_FRAMES > 256
+#error PICO_AUDIO_I2S_FADE_FRAMES must be 0 or between 2 and 256
+#endif
+
+/** \brief 1 to repeat the last frame queued on underrun rather than play zeros
+ *
+ * The output holds its level through an underrun; with PICO_AUDIO_I2S_FADE_FRAMES
+ * the next buffer is ramped in from the held frame.
+ */
+#ifndef PICO_AUDIO_I2S_UNDERRUN_HOLD
+#define PICO_AUDIO_I2S_UNDERRUN_HOLD 0
+#endif
+
+/** \brief Whether the outputs keep fade state (PICO_AUDIO_I2S_FADE_FRAMES or PICO_AUDIO_I2S_UNDERRUN_HOLD) */
+#define AUDIO_I2S_FADE_ENABLED (PICO_AUDIO_I2S_FADE_FRAMES || PICO_AUDIO_I2S_UNDERRUN_HOLD)
+
+/** \brief Frames in the fade ramp buffer, which also holds the frame an underrun hold repeats */
+#define AUDIO_I2S_FADE_BUFFER_FRAMES (PICO_AUDIO_I2S_FADE_FRAMES ? PICO_AUDIO_I2S_FADE_FRAMES : 1u)
+
+/** \brief Words in a fade ramp buffer (S32 stereo frames at most) */
+#define AUDIO_I2S_FADE_BUFFER_WORDS (2u * AUDIO_I2S_FADE_BUFFER_FRAMES)
+
+/** \brief Frames of silence played across a rate change found from a producer's format
+ *
+ * A copying connection whose producer gives a buffer at a new sample_freq switches
+ * the output's rate at that buffer, as audio_i2s_set_sample_freq() would with this
+ * mute length. 0 switches without a gap.
+ */
+#ifndef PICO_AUDIO_I2S_RATE_CHANGE_MUTE_FRAMES
+#define PICO_AUDIO_I2S_RATE_CHANGE_MUTE_FRAMES 0
+#endif
+
+/** \brief Silence, in ms, after which an idle output parks, or 0 to never park
+ *
+ * A parked output stops its DMA and IRQs, and its state machines stall (or, for
+ * the multi-DAC outputs, stop) at a frame boundary with BCLK and LRCLK held,
+ * until a connection is given a buffer. Can be changed at run time with
+ * audio_i2s_set_idle_park_ms() and audio_i2s_set_idle_park_ms_multi_dac().
+ */
+#ifndef PICO_AUDIO_I2S_IDLE_PARK_MS
+#define PICO_AUDIO_I2S_IDLE_PARK_MS 0
+#endif
+
 /** \brief Disable I2S audio functionality (for testing/debugging)
  *  When set to 1, disables actual audio output while maintaining API compatibility
  */
@@ -82,16 +158,87 @@ extern "C" {
 #endif
 #endif
 
-/** \brief Enable mono input audio processing (single channel input) */
+/** \brief Enable mono input audio processing (single channel input)
+ *
+ *  Only read by the standalone I2S-Software-Emulation.c; the drivers take the
+ *  input format from each producer pool.
+ */
 #ifndef PICO_AUDIO_I2S_MONO_INPUT
 #define PICO_AUDIO_I2S_MONO_INPUT 0
 #endif
 
-/** \brief Enable mono output audio processing (single channel output) */
+/** \brief Make every 16-bit output mono (one sample per frame, sent in both slots)
+ *
+ *  Individual outputs can be made mono instead with audio_i2s_config_t::mono_output
+ *  or audio_i2s_multi_dac_config_t::mono_output_mask, so mono and stereo outputs can
+ *  share one firmware.
+ */
 #ifndef PICO_AUDIO_I2S_MONO_OUTPUT
 #define PICO_AUDIO_I2S_MONO_OUTPUT 0
 #endif
 
+/** \brief Dither the PIO fractional clock divider so the long-term average sample rate is exact
+ *
+ *  The 16.8 PIO divider generally cannot hit a sample rate exactly. When set to 1,
+ *  the DMA IRQ alternates between the two nearest dividers per buffer so that the
+ *  average divider over played frames equals the exact divider (clk_sys * 4 / sample_freq
+ *  for 16-bit slots).
+ */
+#ifndef PICO_AUDIO_I2S_CLOCK_DITHER
+#define PICO_AUDIO_I2S_CLOCK_DITHER 0
+#endif
+
+/** \brief Keep playback statistics for each output (see audio_i2s_stats_t)
+ *
+ *  Counting costs a few cycles per DMA refill; set to 0 to compile the statistics
+ *  out.
+ */
+#ifndef PICO_AUDIO_I2S_STATS
+#define PICO_AUDIO_I2S_STATS 1
+#endif
+
+/** \brief Run the DMA IRQ handlers from scratch X RAM (SRAM4 on RP2040, SRAM8 on RP2350)
+ *
+ *  When set to 1 the handlers, and the buffer bookkeeping and copy loop they call,
+ *  are placed in the non-striped scratch X bank instead of striped SRAM, so core
+ *  code and data in main SRAM cannot delay their instruction fetches. Scratch X is
+ *  only 4 KB and also holds core 1's default stack. The sample converters stay in
+ *  SRAM.
+ */
+#ifndef PICO_AUDIO_I2S_ISR_IN_SCRATCH
+#define PICO_AUDIO_I2S_ISR_IN_SCRATCH 0
+#endif
+
+/** \brief Give the DMA high priority on the bus fabric when an output is set up
+ *
+ *  When set to 1, audio_i2s_setup() and audio_i2s_setup_multi_dac() call
+ *  audio_i2s_set_dma_high_bus_priority(true), so the audio DMA wins arbitration
+ *  against the cores when they contend for the same SRAM bank.
+ */
+#ifndef PICO_AUDIO_I2S_DMA_HIGH_PRIORITY
+#define PICO_AUDIO_I2S_DMA_HIGH_PRIORITY 0
+#endif
+
+/** \brief Slots in each ring of an audio_i2s_spsc_connection_t (a power of 2)
+ *
+ *  Bounds the number of buffers in a producer pool handed off through the ring.
+ */
+#ifndef PICO_AUDIO_I2S_SPSC_RING_SIZE
+#define PICO_AUDIO_I2S_SPSC_RING_SIZE 8
+#endif
+
+/** \brief Buffer format for 32-bit signed samples (one int32_t per channel sample)
+ *  Not defined by pico_audio; values are chosen clear of the AUDIO_BUFFER_FORMAT_PCM_* set
+ */
+#ifndef AUDIO_BUFFER_FORMAT_PCM_S32
+#define AUDIO_BUFFER_FORMAT_PCM_S32 5
+#endif
+
+/** \brief Buffer format for 24-bit signed samples, right-justified and sign-extended in an int32_t */
+#ifndef AUDIO_BUFFER_FORMAT_PCM_S24
+#define AUDIO_BUFFER_FORMAT_PCM_S24 6
+#endif
+
 /** @} */ // end of Configuration group
 
 /** \name Configuration Validation
@@ -107,6 +254,11 @@ extern "C" {
 #error PICO_AUDIO_I2S_DMA_IRQ must be 0 or 1
 #endif
 
+/** \brief Validate the SPSC ring size is a power of 2 */
+#if !PICO_AUDIO_I2S_SPSC_RING_SIZE || (PICO_AUDIO_I2S_SPSC_RING_SIZE & (PICO_AUDIO_I2S_SPSC_RING_SIZE - 1))
+#error PICO_AUDIO_I2S_SPSC_RING_SIZE must be a power of 2
+#endif
+
 /** \brief Validate PIO block number is within valid range (0 or 1) */
 #if !(PICO_AUDIO_I2S_PIO == 0 || PICO_AUDIO_I2S_PIO == 1)
 #error PICO_AUDIO_I2S_PIO must be 0 or 1
@@ -123,8 +275,9 @@ extern "C" {
  * @{
  */
 
-/** \brief DMA transfer size based on mono/stereo output configuration
- *  16-bit for mono output, 32-bit for stereo output
+/** \brief Default DMA transfer size for 16-bit slots (see PICO_AUDIO_I2S_MONO_OUTPUT)
+ *  16-bit for mono output, 32-bit for stereo output; the drivers use
+ *  audio_i2s_s16_dma_size() for each output
  */
 #if PICO_AUDIO_I2S_MONO_OUTPUT
 #define i2s_dma_configure_size DMA_SIZE_16
@@ -141,6 +294,30 @@ extern "C" {
 /** \brief DMA request signal for selected PIO TX FIFO */
 #define DREQ_PIOx_TX0 __CONCAT(__CONCAT(DREQ_PIO, PICO_AUDIO_I2S_PIO), _TX0)
 
+/** \brief Section for the DMA IRQ handlers and the functions on their path
+ *  (see PICO_AUDIO_I2S_ISR_IN_SCRATCH); used like __time_critical_func()
+ */
+#if PICO_AUDIO_I2S_ISR_IN_SCRATCH
+#define __audio_i2s_isr_func(func_name) __scratch_x(__STRING(func_name)) func_name
+#else
+#define __audio_i2s_isr_func(func_name) __time_critical_func(func_name)
+#endif
+
+/** \brief Place a static arena (see AUDIO_I2S_POOL_ARENA_WORDS()) in scratch X RAM
+ *
+ *  Scratch X and Y (SRAM4 / SRAM5 on RP2040, SRAM8 / SRAM9 on RP2350) are not striped,
+ *  so DMA reads of buffers placed there only contend with code that uses the same
+ *  4 KB bank. Scratch X also holds core 1's default stack, and scratch Y core 0's
+ *  stack; leave room for them.
+ *  \code
+ *  static uint32_t AUDIO_I2S_ARENA_IN_SCRATCH_X arena[AUDIO_I2S_POOL_ARENA_WORDS(2, 128, 4)];
+ *  \endcode
+ */
+#define AUDIO_I2S_ARENA_IN_SCRATCH_X __scratch_x("audio_i2s_arena")
+
+/** \brief Place a static arena in scratch Y RAM (see AUDIO_I2S_ARENA_IN_SCRATCH_X) */
+#define AUDIO_I2S_ARENA_IN_SCRATCH_Y __scratch_y("audio_i2s_arena")
+
 /** @} */ // end of Hardware Abstraction group
 
 /** \name Utility Functions
@@ -148,11 +325,172 @@ extern "C" {
  * @{
  */
 
+/** \brief DMA transfer size for one frame of 16-bit slots
+ *  \ingroup pico_audio_i2s
+ *
+ *  A mono frame is one halfword, which the bus replicates into both halves of the
+ *  TX FIFO word so it is sent in both slots; a stereo frame is one packed word.
+ *
+ *  \param channel_count Channels per frame in the consumer buffers (1 or 2)
+ */
+static inline enum dma_channel_transfer_size audio_i2s_s16_dma_size(uint channel_count) {
+    return channel_count == 1 ? DMA_SIZE_16 : DMA_SIZE_32;
+}
+
+/** \brief PIO clock divider chosen for a sample rate
+ *  \ingroup pico_audio_i2s
+ *
+ *  Dividers are 16.8 fixed-point values as written to the PIO CLKDIV register.
+ *  The exact divider for a sample rate is divider_floor + remainder / modulus.
+ */
+typedef struct audio_i2s_clock_divider {
+    uint32_t sample_freq;    ///< Requested sample frequency in Hz
+    uint32_t divider;        ///< Nearest 16.8 divider
+    uint32_t divider_floor;  ///< Truncated 16.8 divider; dithering alternates this and divider_floor + 1
+    uint32_t remainder;      ///< Remainder of the exact divider, in units of 1 / modulus
+    uint32_t modulus;        ///< Denominator of remainder (sample_freq for 32-bit frames)
+    int32_t error_ppm;       ///< Rate error when running at divider, in ppm (positive means fast)
+    int32_t dither_error;    ///< Dither accumulator (frames * 1/256 divider steps, scaled by modulus)
+} audio_i2s_clock_divider_t;
+
+/** \brief Calculate the best PIO clock divider for 16-bit stereo (32 bits per frame) at the current clk_sys
+ *  \ingroup pico_audio_i2s
+ *
+ *  \param sample_freq Target sample frequency in Hz
+ *  \param div Receives the divider; the dither accumulator is reset
+ */
+void audio_i2s_calc_clock_divider(uint32_t sample_freq, audio_i2s_clock_divider_t *div);
+
+/** \brief Calculate the best PIO clock divider for a frame of frame_bits BCLK cycles
+ *  \ingroup pico_audio_i2s
+ *
+ *  The I2S programs take 2 PIO cycles per bit, so the exact divider is
+ *  clk_sys / (sample_freq * frame_bits * 2); 64-bit frames (32-bit slots) need half
+ *  the divider of 32-bit frames.
+ *
+ *  \param sample_freq Target sample frequency in Hz
+ *  \param frame_bits BCLK cycles per frame (all slots), e.g. 32 or 64, up to 512 for TDM
+ *  \param div Receives the divider; the dither accumulator is reset
+ */
+void audio_i2s_calc_clock_divider_frame_bits(uint32_t sample_freq, uint frame_bits, audio_i2s_clock_divider_t *div);
+
+/** \brief Pick the divider to use for the next frames frames when dithering
+ *  \ingroup pico_audio_i2s
+ *
+ *  Alternates between divider_floor and divider_floor + 1 so the average divider
+ *  over all frames played converges on the exact value.
+ *
+ *  \param div Divider state from audio_i2s_calc_clock_divider()
+ *  \param frames Number of frames that will be played with the returned divider
+ *  \return 16.8 divider to apply
+ */
+uint32_t audio_i2s_clock_divider_dither(audio_i2s_clock_divider_t *div, uint32_t frames);
+
+/** \brief Suggest a system clock that divides exactly to a sample rate
+ *  \ingroup pico_audio_i2s
+ *
+ *  Searches downwards from max_sys_clock_khz in 1 kHz steps for a frequency that
+ *  the PLL can generate (per check_sys_clock_khz()) and for which
+ *  clk_sys * 4 / sample_freq has no remainder.
+ *
+ *  \param sample_freq Target sample frequency in Hz
+ *  \param max_sys_clock_khz Highest acceptable system clock in kHz
+ *  \return Suggested system clock in kHz, or 0 if none was found down to half of max_sys_clock_khz
+ */
+uint32_t audio_i2s_suggest_sys_clock_khz(uint32_t sample_freq, uint32_t max_sys_clock_khz);
+
+/** \brief Suggest a system clock that suits several sample rates at once
+ *  \ingroup pico_audio_i2s
+ *
+ *  For an output that switches between rate families, e.g. 44100 and 48000 Hz.
+ *  The search covers the same range as audio_i2s_suggest_sys_clock_khz(), and
+ *  returns the PLL frequency with the smallest worst divider error (for 32-bit
+ *  frames) over all the rates: one exact for every rate if there is one. From a 12
+ *  MHz crystal the PLL can generate no clk_sys that is exact for both 44.1 and 48
+ *  kHz (that would need a VCO of at least 1764 MHz), but 138 MHz is within 0.6 ppm
+ *  of both, against 33 ppm at 150 MHz; PICO_AUDIO_I2S_CLOCK_DITHER can make up the
+ *  rest. The search divides a few times per kHz step, so it is for setup code.
+ *
+ *  \param sample_freqs Sample frequencies in Hz
+ *  \param count Number of entries in sample_freqs
+ *  \param max_sys_clock_khz Highest acceptable system clock in kHz
+ *  \param error_ppb If not NULL, receives the worst divider error of the returned clock in
+ *         parts per billion
+ *  \return Suggested system clock in kHz, or 0 if the PLL can generate nothing in the range
+ */
+uint32_t audio_i2s_suggest_sys_clock_khz_for_rates(const uint32_t *sample_freqs, uint count,
+                                                   uint32_t max_sys_clock_khz, uint32_t *error_ppb);
+
+/** \brief Find the lowest system clock that divides exactly to a sample rate
+ *  \ingroup pico_audio_i2s
+ *
+ *  Searches upwards from min_sys_clock_khz in 1 kHz steps for a frequency that
+ *  the PLL can generate and for which the 16.8 divider for frame_bits bit frames
+ *  has no remainder and is at least 1. Running the chip only as fast as the
+ *  application needs, with the audio still exact, saves power.
+ *
+ *  \param sample_freq Target sample frequency in Hz
+ *  \param frame_bits Bits per frame on the wire: 32 for 16-bit slots, 64 for 32-bit slots
+ *  \param min_sys_clock_khz Lowest acceptable system clock in kHz
+ *  \param max_sys_clock_khz Highest acceptable system clock in kHz
+ *  \return System clock in kHz, or 0 if none was found in the range
+ */
+uint32_t audio_i2s_suggest_min_sys_clock_khz(uint32_t sample_freq, uint frame_bits, uint32_t min_sys_clock_khz,
+                                             uint32_t max_sys_clock_khz);
+
+/** \brief An output whose PIO divider is worked out from clk_sys
+ *  \ingroup pico_audio_i2s
+ *
+ *  Each driver adds one at setup, so audio_i2s_lower_sys_clock() can pick a
+ *  clock that suits every output and retune them all.
+ */
+typedef struct audio_i2s_clock_user {
+    uint32_t (*sample_freq)(uint *frame_bits); ///< Rate the output runs at (0 if none yet), and its bit clocks per frame
+    void (*retune)(void);                     ///< Work the divider out again for the current clk_sys
+} audio_i2s_clock_user_t;
+
+/** \brief Add an output to retune when clk_sys changes (once; a second add is ignored)
+ *  \ingroup pico_audio_i2s
+ */
+void audio_i2s_add_clock_user(const audio_i2s_clock_user_t *user);
+
+/** \brief Run clk_sys at the lowest frequency with an exact divider for every output
+ *  \ingroup pico_audio_i2s
+ *
+ *  Picks the lowest frequency, no lower than min_sys_clock_khz (what the rest of
+ *  the application needs) and no higher than clk_sys is now, whose divider is
+ *  exact for the rate and frame of each output that has been set up and given a
+ *  rate (single DAC, multi-DAC and TDM), switches to it with set_sys_clock_khz()
+ *  and retunes all of them. At 48 kHz with 16-bit slots and a 48 MHz floor, an
+ *  RP2040 drops from its default 125 MHz, whose divider is 32 ppm out, to an
+ *  exact 48 MHz.
+ *
+ *  \param min_sys_clock_khz Lowest acceptable system clock in kHz
+ *  \return The new system clock in kHz, or 0 if there is none or no output has a
+ *          rate yet (clk_sys is unchanged)
+ *
+ *  \note The PLL is reprogrammed, so call this with the outputs disabled, or
+ *        parked, to avoid a glitch. clk_peri follows clk_sys, so UART baud rates
+ *        must be set again afterwards.
+ */
+uint32_t audio_i2s_lower_sys_clock(uint32_t min_sys_clock_khz);
+
+/** \brief Give the DMA high (or back to normal) priority on the bus fabric
+ *  \ingroup pico_audio_i2s
+ *
+ *  Sets or clears both the DMA read and write priority bits in bus_ctrl_hw->priority,
+ *  leaving the processor bits alone. This applies to every DMA channel, not only the
+ *  audio ones.
+ *
+ *  \param high true for high priority
+ */
+void audio_i2s_set_dma_high_bus_priority(bool high);
+
 /** \brief Update PIO state machine frequency for audio sample rate
  *  \ingroup pico_audio_i2s
  *
- *  Calculates and applies the appropriate PIO clock divider for the given
- *  sample frequency, ensuring accurate I2S timing.
+ *  Calculates and applies the nearest PIO clock divider for the given
+ *  sample frequency (see audio_i2s_calc_clock_divider()).
  *
  *  \param sample_freq Target sample frequency in Hz
  *  \param pio_sm PIO state machine number to configure
@@ -160,6 +498,699 @@ extern "C" {
  */
 void update_pio_frequency(uint32_t sample_freq, uint8_t pio_sm, uint32_t *freq_ptr);
 
+/** \brief Playback statistics for one output
+ *  \ingroup pico_audio_i2s
+ *
+ *  Written only by the DMA IRQ and read by the application without locking; each
+ *  field is individually consistent, but fields may be read from different
+ *  interrupts. Counters wrap and are meant to be compared against earlier reads.
+ *
+ *  tx_stalls counts missed refill deadlines as seen by the PIO itself (its sticky
+ *  TXSTALL flag), whether or not a buffer was ready: each one is an audible gap, and
+ *  with separate data state machines it also leaves that DAC's data late against
+ *  the shared LRCLK until the next enable.
+ *
+ *  ISR cycles are measured with SysTick on Arm cores (started at clk_sys with a
+ *  full 24-bit reload if not already running; an application that reprograms
+ *  SysTick with a shorter reload will skew them) and with the cycle counter on
+ *  Hazard3. isr_cycles_total stays 32-bit, so a core cannot read it torn; it wraps
+ *  after 2^32 cycles of handler time (34 s at 125 MHz, so about 20 minutes at a
+ *  3% load), which a reader comparing against an earlier read within that time
+ *  never sees.
+ *
+ *  The fill level is read from counters the output's own connections (and the
+ *  SPSC connection) update on give and take, not by walking the buffer lists, so
+ *  a refill never waits on a list lock. Other connections are not counted, and
+ *  leave min_fill and max_fill at their reset values.
+ */
+typedef struct audio_i2s_stats {
+    volatile uint32_t buffers_played;   ///< Buffers handed to the DMA
+    volatile uint32_t underruns;        ///< Refills that found no buffer ready and played silence instead
+    volatile uint32_t silence_samples;  ///< Frames of silence played because of underruns
+    volatile uint32_t tx_stalls;        ///< Refills that found the state machine had run dry since the last one
+    volatile uint16_t min_fill;         ///< Fewest buffers queued at a refill (0xffff until the first refill)
+    volatile uint16_t max_fill;         ///< Most buffers queued at a refill
+    volatile uint32_t isr_count;        ///< DMA interrupts handled for this output
+    volatile uint32_t isr_cycles_last;  ///< Cycles spent handling this output in the last interrupt
+    volatile uint32_t isr_cycles_max;   ///< Most cycles spent handling this output in one interrupt
+    volatile uint32_t isr_cycles_total; ///< Cycles spent handling this output in all interrupts (wraps, see above)
+} audio_i2s_stats_t;
+
+/** \brief Clear statistics and start the cycle counter used for ISR timing
+ *  \ingroup pico_audio_i2s
+ */
+void audio_i2s_stats_reset(audio_i2s_stats_t *stats);
+
+/** \brief Take the next buffer to play from a consumer pool, recording fill level and underruns
+ *  \ingroup pico_audio_i2s
+ *
+ *  With the SPSC connection the fill level is the number of full buffers in its
+ *  ring. The drivers record the fill of their own connections before calling
+ *  this (see audio_i2s_rate_change_take()).
+ *
+ *  \return The buffer, or NULL if none was ready
+ */
+audio_buffer_t *audio_i2s_stats_take(audio_i2s_stats_t *stats, audio_buffer_pool_t *consumer);
+
+/** \brief Take a free buffer to capture into from a producer pool, recording fill level and overruns
+ *  \ingroup pico_audio_i2s
+ *
+ *  The capture counterpart of audio_i2s_stats_take(): a missing free buffer counts
+ *  as an underrun of drop_frames discarded frames. The reader takes from producer
+ *  through pico_audio directly, so no fill level is recorded.
+ *
+ *  \return The buffer, or NULL if none was free
+ */
+audio_buffer_t *audio_i2s_stats_take_free(audio_i2s_stats_t *stats, audio_buffer_pool_t *producer,
+                                          uint32_t drop_frames);
+
+/** \brief Fold the number of full buffers queued at a refill into the min / max fill level */
+static inline void audio_i2s_stats_fill(audio_i2s_stats_t *stats, uint32_t fill) {
+#if PICO_AUDIO_I2S_STATS
+    if (fill < stats->min_fill) {
+        stats->min_fill = (uint16_t) fill;
+    }
+    if (fill > stats->max_fill) {
+        stats->max_fill = (uint16_t) MIN(fill, 0xffffu);
+    }
+#else
+    (void) stats;
+    (void) fill;
+#endif
+}
+
+/** \brief Record frames of silence played because no buffer was ready */
+static inline void audio_i2s_stats_silence(audio_i2s_stats_t *stats, uint32_t frames) {
+#if PICO_AUDIO_I2S_STATS
+    stats->silence_samples += frames;
+#else
+    (void) stats;
+    (void) frames;
+#endif
+}
+
+/** \brief Length of the next silence run of an underrun
+ *
+ * \param next_run Backoff state of the output, to be zeroed whenever a buffer is played
+ * \param full_frames Longest silence run of the output
+ * \return Frames of silence to play (full_frames unless PICO_AUDIO_I2S_UNDERRUN_RETRY_SAMPLE_LENGTH is set)
+ */
+static inline uint32_t audio_i2s_underrun_silence_frames(uint32_t *next_run, uint32_t full_frames) {
+#if PICO_AUDIO_I2S_UNDERRUN_RETRY_SAMPLE_LENGTH
+    uint32_t frames = MIN(*next_run ? *next_run : PICO_AUDIO_I2S_UNDERRUN_RETRY_SAMPLE_LENGTH, full_frames);
+    *next_run = MIN(2u * frames, full_frames);
+    return frames;
+#else
+    (void) next_run;
+    return full_frames;
+#endif
+}
+
+/** \brief Fade and hold state of one output
+ *  \ingroup pico_audio_i2s
+ *
+ *  Frames are laid out as in the output's consumer buffers: S16 mono or stereo
+ *  for 16-bit slots, S32 stereo for 32-bit slots.
+ *
+ *  Ramps and held frames are built at ramp, which a driver that queues several
+ *  silence runs ahead (a descriptor ring) points at storage of the run's own
+ *  before each audio_i2s_fade_silence(), so a run still queued is never rewritten.
+ */
+typedef struct audio_i2s_fade {
+    int32_t level[2];     ///< Per channel: the last frame queued, or the level the silence plays at
+    bool silent;          ///< Silence has played since the last buffer, so the next one is ramped in
+    uint8_t slot_bits;    ///< 16 or 32
+    uint8_t channel_count;///< Channels per consumer frame
+    uint16_t stop_skip;   ///< FIFO words of the stop ramp already sent (the first half of a 32-bit frame)
+#if AUDIO_I2S_FADE_ENABLED
+    uint32_t *ramp;       ///< Where the next fade-out ramp or held frame is built: ramp_buffer by default
+    /// AUDIO_I2S_FADE_BUFFER_WORDS of storage for ramp (8-byte aligned, for a DMA read ring over a 32-bit frame)
+    uint32_t ramp_buffer[AUDIO_I2S_FADE_BUFFER_WORDS] __attribute__((aligned(8)));
+#endif
+} audio_i2s_fade_t;
+
+/** \brief How the DMA reads a source, from audio_i2s_fade_silence() */
+enum audio_i2s_dma_read {
+    AUDIO_I2S_DMA_READ_FIXED = 0, ///< Read one word over and over
+    AUDIO_I2S_DMA_READ_STEP,      ///< Step through the source (a buffer or a ramp)
+    AUDIO_I2S_DMA_READ_FRAME,     ///< Step through one 32-bit stereo frame over and over, with an 8-byte read ring
+};
+
+/** \brief Set up a DMA channel config to read a source as audio_i2s_fade_silence() asks */
+static inline void audio_i2s_dma_config_set_read(dma_channel_config *c, uint read) {
+    channel_config_set_read_increment(c, read != AUDIO_I2S_DMA_READ_FIXED);
+    channel_config_set_ring(c, false, read == AUDIO_I2S_DMA_READ_FRAME ? 3 : 0);
+}
+
+/** \brief Set up the fade state of an output for its slot width and channel count, at zero level */
+void audio_i2s_fade_init(audio_i2s_fade_t *fade, uint slot_bits, uint channel_count);
+
+/** \brief Out-of-line parts of audio_i2s_fade_buffer() and audio_i2s_fade_silence() */
+void audio_i2s_fade_apply(audio_i2s_fade_t *fade, audio_buffer_t *ab);
+const void *audio_i2s_fade_silence_source(audio_i2s_fade_t *fade, const void *zero, uint32_t *frames,
+                                          uint *read);
+
+/** \brief Ramp a buffer just taken for playing in from silence, and remember its last frame
+ *
+ *  A no-op unless PICO_AUDIO_I2S_FADE_FRAMES or PICO_AUDIO_I2S_UNDERRUN_HOLD is set.
+ */
+static inline void audio_i2s_fade_buffer(audio_i2s_fade_t *fade, audio_buffer_t *ab) {
+#if AUDIO_I2S_FADE_ENABLED
+    audio_i2s_fade_apply(fade, ab);
+#else
+    (void) fade;
+    (void) ab;
+#endif
+}
+
+/** \brief Source for a refill that found no buffer ready
+ *
+ *  The first refill of an underrun plays the fade-out ramp instead, and with
+ *  PICO_AUDIO_I2S_UNDERRUN_HOLD the silence repeats the last frame.
+ *
+ *  \param zero Zero word of the output
+ *  \param frames Silence run length, replaced by the length of what is returned
+ *  \param read Set to how the DMA must read the source (enum audio_i2s_dma_read)
+ *  \return Read address for the DMA
+ */
+static inline const void *audio_i2s_fade_silence(audio_i2s_fade_t *fade, const void *zero, uint32_t *frames,
+                                                 uint *read) {
+#if AUDIO_I2S_FADE_ENABLED
+    return audio_i2s_fade_silence_source(fade, zero, frames, read);
+#else
+    (void) fade;
+    (void) frames;
+    *read = AUDIO_I2S_DMA_READ_FIXED;
+    return zero;
+#endif
+}
+
+/** \brief Prepare the ramp that takes a stopped DMA's output down to zero
+ *
+ *  The ramp starts from the frame the channel stopped in. The fade state follows
+ *  what has been queued, not what is playing, so the driver says what the
+ *  channel was reading.
+ *
+ *  \param source Buffer frames, or silence source from audio_i2s_fade_silence(),
+ *         the aborted DMA channel was reading; NULL if it was reading zeros
+ *  \param frames Frames at source
+ *  \param read_addr Read address the channel stopped at
+ *  \return FIFO words to push with audio_i2s_fade_stop_word() (0 if fading is off)
+ */
+uint audio_i2s_fade_prepare_stop(audio_i2s_fade_t *fade, const void *source, uint32_t frames, const void *read_addr);
+
+/** \brief FIFO word i of the stop ramp, as a DMA transfer of the output would write it */
+uint32_t audio_i2s_fade_stop_word(const audio_i2s_fade_t *fade, uint i);
+
+/** \brief Clear the sticky TXSTALL flags of the state machines in sm_mask of block pio, e.g. before enabling them */
+static inline void audio_i2s_clear_tx_stalls_pio(PIO pio, uint32_t sm_mask) {
+    pio->fdebug = sm_mask << PIO_FDEBUG_TXSTALL_LSB;
+}
+
+/** \brief Clear the sticky TXSTALL flags of the state machines in sm_mask of audio_pio */
+static inline void audio_i2s_clear_tx_stalls(uint32_t sm_mask) {
+    audio_i2s_clear_tx_stalls_pio(audio_pio, sm_mask);
+}
+
+/** \brief Test and clear the sticky TXSTALL flag of state machine sm of block pio
+ *  \return true if sm has run dry since the flag was last cleared
+ */
+static inline bool audio_i2s_take_tx_stall_pio(PIO pio, uint sm) {
+    uint32_t mask = 1u << (PIO_FDEBUG_TXSTALL_LSB + sm);
+    if (!(pio->fdebug & mask)) {
+        return false;
+    }
+    // write 1 to clear
+    pio->fdebug = mask;
+    return true;
+}
+
+/** \brief Test and clear the sticky RXSTALL flag of state machine sm of block pio
+ *  \return true if sm has found its RX FIFO full since the flag was last cleared
+ */
+static inline bool audio_i2s_take_rx_stall_pio(PIO pio, uint sm) {
+    uint32_t mask = 1u << (PIO_FDEBUG_RXSTALL_LSB + sm);
+    if (!(pio->fdebug & mask)) {
+        return false;
+    }
+    // write 1 to clear
+    pio->fdebug = mask;
+    return true;
+}
+
+/** \brief Test and clear the sticky TXSTALL flag of state machine sm of audio_pio */
+static inline bool audio_i2s_take_tx_stall(uint sm) {
+    return audio_i2s_take_tx_stall_pio(audio_pio, sm);
+}
+
+/** \brief Record a missed refill deadline reported by audio_i2s_take_tx_stall() */
+static inline void audio_i2s_stats_tx_stall(audio_i2s_stats_t *stats) {
+#if PICO_AUDIO_I2S_STATS
+    stats->tx_stalls++;
+#else
+    (void) stats;
+#endif
+}
+
+/** \brief Read the cycle counter used for ISR timing */
+static inline uint32_t audio_i2s_stats_cycles(void) {
+#if !PICO_AUDIO_I2S_STATS
+    return 0;
+#elif defined(__riscv)
+    uint32_t cycles;
+    __asm volatile ("rdcycle %0" : "=r" (cycles));
+    return cycles;
+#else
+    // SysTick counts down; negate it so the difference of two reads is positive
+    return -systick_hw->cvr;
+#endif
+}
+
+/** \brief Record the cost of an interrupt (or of one output's share of it) started at start_cycles */
+static inline void audio_i2s_stats_isr_done(audio_i2s_stats_t *stats, uint32_t start_cycles) {
+#if PICO_AUDIO_I2S_STATS
+#if defined(__riscv)
+    uint32_t cycles = audio_i2s_stats_cycles() - start_cycles;
+#else
+    uint32_t cycles = (audio_i2s_stats_cycles() - start_cycles) & 0xffffffu;
+#endif
+    stats->isr_count++;
+    stats->isr_cycles_last = cycles;
+    stats->isr_cycles_total += cycles;
+    if (cycles > stats->isr_cycles_max) {
+        stats->isr_cycles_max = cycles;
+    }
+#else
+    (void) stats;
+    (void) start_cycles;
+#endif
+}
+
+/** \brief Convert sample_count frames from a producer buffer into a consumer buffer
+ *  \ingroup pico_audio_i2s
+ *
+ *  \param output First output frame in the consumer buffer
+ *  \param input First input frame in the producer buffer
+ *  \param sample_count Number of frames to convert
+ */
+typedef void (*audio_i2s_sample_converter_t)(void *output, const void *input, uint sample_count);
+
+/** \brief Q15 gain of 1.0 for audio_i2s_output_process_t, applied exactly (not as 0x7fff / 0x8000) */
+#define AUDIO_I2S_UNITY_GAIN 0x7fff
+
+/** \brief Gain and DC blocker state of one output, applied while converting on consumer take
+ *  \ingroup pico_audio_i2s
+ *
+ *  Set fields through audio_i2s_output_process_set_gain() and
+ *  audio_i2s_output_process_set_dc_blocker(); the rest belong to the take path.
+ *
+ *  The DC blocker is the one-pole high-pass y[n] = x[n] - x[n-1] + (1 - 2^-dc_shift) y[n-1],
+ *  with its corner at about fs / (2 pi 2^dc_shift): 7.5 Hz for a dc_shift of 10 at
+ *  48 kHz. It runs before the gain, and its output saturates to the slot width. A
+ *  gain change is ramped linearly over the next consumer buffer.
+ */
+typedef struct audio_i2s_output_process {
+    volatile int16_t gain;       ///< Q15 gain to reach by the end of the next consumer buffer
+    volatile uint8_t dc_shift;   ///< DC blocker pole at 1 - 2^-dc_shift (1 to 15), 0 for none
+    volatile bool dc_restart;    ///< Start the DC blocker from the next input frame instead of from zero
+    int32_t gain_acc;            ///< Gain reached so far, Q15 in the top 16 bits
+    int64_t gain_step;           ///< Change of gain_acc per frame over the current consumer buffer (33 bits for a full swing over one frame)
+    int32_t gain_end;            ///< gain_acc at the end of the current consumer buffer
+    int32_t dc_prev[2];          ///< Previous input sample per channel, at the output's scale
+    int64_t dc_acc[2];           ///< DC blocker output per channel, with 8 fractional bits
+} audio_i2s_output_process_t;
+
+/** \brief Convert sample_count frames, applying an output's gain and DC blocker on the way
+ *  \ingroup pico_audio_i2s
+ *
+ *  Same as audio_i2s_sample_converter_t, in a single pass over the samples.
+ */
+typedef void (*audio_i2s_sample_processor_t)(audio_i2s_output_process_t *process, void *output, const void *input,
+                                             uint sample_count);
+
+/** \brief Rate change queued on an output, and where in its producer's stream it starts
+ *  \ingroup pico_audio_i2s
+ *
+ *  A change is fenced after the producer buffers given before it was queued: the
+ *  copy loop of a converting connection stops short at the fence, so old and new
+ *  rate frames never share a consumer buffer, and the driver writes the divider
+ *  once the last old buffer has left the DMA. The counters wrap.
+ *
+ *  Connections without a copy loop (copy on give, zero-copy) set consumer_fence
+ *  and count consumer buffers instead: their gives count what they queue, and the
+ *  driver's refills take through audio_i2s_rate_change_take(), which stops at the
+ *  fence. Other connections have no fence and switch at the next refill.
+ *
+ *  Between them given and taken count every buffer queued on the driver's own
+ *  connections, which the driver marks counted, so given - taken is the fill
+ *  level of the output's statistics. Each is written by one side only (the
+ *  giving core, or the DMA IRQ), so reading them takes no lock.
+ */
+typedef struct audio_i2s_rate_change {
+    volatile uint32_t given;        ///< Producer (or, with consumer_fence, consumer) buffers given so far
+    volatile uint32_t taken;        ///< Producer buffers the copy loop has started (or consumer buffers taken)
+    volatile uint32_t fence;        ///< Value of given when the change was queued
+    volatile uint32_t sample_freq;  ///< Rate queued, 0 when none is (or once the switch has begun)
+    uint32_t mute_frames;           ///< Frames of silence to play across the change
+    uint32_t producer_freq;         ///< Producer rate at the last give, to spot a change of format
+    uint32_t switch_freq;           ///< Rate being switched to
+    uint8_t countdown;              ///< Refills left until the divider is written, 0 when not switching
+    bool consumer_fence;            ///< given and taken count consumer buffers
+    bool counted;                   ///< The connection is the driver's own, so given - taken is its fill level
+    volatile bool flush;            ///< A change was queued since the last copy on give
+} audio_i2s_rate_change_t;
+
+/** \brief What a refill does about a rate change, from audio_i2s_rate_change_refill() */
+enum audio_i2s_rate_step {
+    AUDIO_I2S_RATE_KEEP = 0,    ///< Take the next buffer as usual
+    AUDIO_I2S_RATE_MUTE,        ///< Play mute_frames of silence instead of taking a buffer
+    AUDIO_I2S_RATE_SWITCH,      ///< Write the divider for switch_freq, then take the next buffer
+};
+
+/** \brief Clear any change and start counting buffers afresh, for a new connection at sample_freq */
+void audio_i2s_rate_change_reset(audio_i2s_rate_change_t *rc, uint32_t sample_freq);
+
+/** \brief Queue a change after the producer buffers given so far, replacing one not yet begun */
+void audio_i2s_rate_change_queue(audio_i2s_rate_change_t *rc, uint32_t sample_freq, uint32_t mute_frames);
+
+/** \brief Note the rate of a buffer being given, before it is counted
+ *
+ *  \return true if its rate is new and a change must be queued for it (false if the
+ *          same change was just queued explicitly, with its own mute)
+ */
+static inline bool audio_i2s_rate_change_check_give(audio_i2s_rate_change_t *rc, uint32_t sample_freq) {
+    if (sample_freq == rc->producer_freq) {
+        return false;
+    }
+    rc->producer_freq = sample_freq;
+    return rc->sample_freq != sample_freq || rc->fence != rc->given;
+}
+
+/** \brief Whether a connection with a consumer buffer fence has had every buffer before it taken
+ *
+ *  Also true for a connection without a fence, which switches at the next refill.
+ */
+static inline bool audio_i2s_rate_change_fence_taken(const audio_i2s_rate_change_t *rc) {
+    return !rc->consumer_fence || rc->taken == rc->fence;
+}
+
+/** \brief Take the next buffer to play, as audio_i2s_stats_take(), but not past a consumer buffer fence
+ *
+ *  \return The buffer, or NULL if none was ready or the next one must wait for the switch
+ */
+static inline audio_buffer_t *audio_i2s_rate_change_take(audio_i2s_rate_change_t *rc, audio_i2s_stats_t *stats,
+                                                         audio_buffer_pool_t *consumer) {
+    if (rc->counted) {
+        audio_i2s_stats_fill(stats, rc->given - rc->taken);
+    }
+    if (!rc->consumer_fence) {
+        return audio_i2s_stats_take(stats, consumer);
+    }
+    if (rc->sample_freq && rc->taken == rc->fence) {
+        // the buffers from here on are at the new rate
+        return NULL;
+    }
+    audio_buffer_t *ab = audio_i2s_stats_take(stats, consumer);
+    if (ab) {
+        rc->taken++;
+    }
+    return ab;
+}
+
+/** \brief Queue the partly filled consumer buffer of a copy-on-give connection on its own
+ *
+ *  Call before queueing a change, so the frames copied so far play at the old rate.
+ */
+void audio_i2s_rate_change_flush_give(struct producer_pool_blocking_give_connection *pbc, audio_i2s_rate_change_t *rc);
+
+/** \brief Give through a copy-on-give connection, counting the consumer buffers it fills
+ *
+ *  A change queued since the last give without audio_i2s_rate_change_flush_give(),
+ *  whether found at this buffer or queued for another output sharing the clock,
+ *  has the partly filled buffer flushed and the fence moved past it first.
+ *
+ *  \param give The connection's copying producer_pool_give, e.g. stereo_to_stereo_producer_give
+ */
+void audio_i2s_rate_change_copy_give(struct producer_pool_blocking_give_connection *pbc, audio_i2s_rate_change_t *rc,
+                                     void (*give)(audio_connection_t *, audio_buffer_t *), audio_buffer_t *buffer);
+
+/** \brief Step the rate change state at a refill of the output's DMA, before anything is taken
+ *
+ *  \param reached Every producer buffer before the fence has been copied out (see
+ *         audio_i2s_rate_change_reached()); pass true for a connection without a fence
+ *  \param refills_in_flight Refills that pass from one buffer being queued to it
+ *         leaving the DMA: 1 for a single channel, 2 for ping-pong or a descriptor ring
+ *  \return enum audio_i2s_rate_step
+ */
+static inline uint audio_i2s_rate_change_refill(audio_i2s_rate_change_t *rc, bool reached, uint refills_in_flight) {
+    if (rc->countdown) {
+        return --rc->countdown ? AUDIO_I2S_RATE_KEEP : AUDIO_I2S_RATE_SWITCH;
+    }
+    uint32_t sample_freq = rc->sample_freq;
+    if (!sample_freq || !reached) {
+        return AUDIO_I2S_RATE_KEEP;
+    }
+    // the buffers queued before this refill are the last at the old rate; with a mute,
+    // the divider is written once the silence has gone too, so no sound plays during the switch
+    rc->switch_freq = sample_freq;
+    rc->sample_freq = 0;
+    rc->countdown = (uint8_t) (refills_in_flight - 1u + (rc->mute_frames != 0));
+    if (rc->mute_frames) {
+        return AUDIO_I2S_RATE_MUTE;
+    }
+    return rc->countdown ? AUDIO_I2S_RATE_KEEP : AUDIO_I2S_RATE_SWITCH;
+}
+
+/** \brief Begin a change whose fence is reached part way through a refill that queues several buffers
+ *
+ *  For a descriptor ring, whose refill queues a block per buffer: the blocks left
+ *  in the refill play the mute at the old rate, and the divider is written once
+ *  they have left the DMA, as when audio_i2s_rate_change_refill() mutes a whole
+ *  refill.
+ *
+ *  \return true if the change has begun, so the rest of the refill is muted
+ */
+static inline bool audio_i2s_rate_change_begin_within(audio_i2s_rate_change_t *rc, bool reached,
+                                                      uint refills_in_flight) {
+    if (rc->countdown || !rc->sample_freq || !reached) {
+        return false;
+    }
+    rc->switch_freq = rc->sample_freq;
+    rc->sample_freq = 0;
+    rc->countdown = (uint8_t) refills_in_flight;
+    return true;
+}
+
+/** \brief Copying connection that converts producer buffers with a frame converter on consumer take
+ *  \ingroup pico_audio_i2s
+ *
+ *  Works like pico_audio's buffer_copying_on_consumer_take_connection, but the
+ *  per-frame work is a plain function over a run of frames, and the input and output
+ *  strides come from the pool formats, so any format pair can share the copy loop.
+ *  With a process set, process_convert stands in for convert whenever the gain or
+ *  DC blocker would change the samples.
+ */
+typedef struct audio_i2s_converting_connection {
+    struct buffer_copying_on_consumer_take_connection core;
+    audio_i2s_sample_converter_t convert;  ///< Converter from the producer format to the consumer format
+    audio_i2s_output_process_t *process;   ///< Gain and DC blocker of the output, NULL for none
+    audio_i2s_sample_processor_t process_convert; ///< convert with process applied, used while there is work to do
+    audio_i2s_rate_change_t *rate_change;  ///< Rate change fence of the output, NULL for none
+} audio_i2s_converting_connection_t;
+
+/** \brief consumer_pool_take implementation for audio_i2s_converting_connection_t
+ *  \ingroup pico_audio_i2s
+ */
+audio_buffer_t *audio_i2s_converting_consumer_take(audio_connection_t *connection, bool block);
+
+/** \brief producer_pool_give implementation for audio_i2s_converting_connection_t
+ *  \ingroup pico_audio_i2s
+ *
+ *  Counts buffers for the rate change fence, and queues a change (with
+ *  PICO_AUDIO_I2S_RATE_CHANGE_MUTE_FRAMES of mute) at a buffer whose format has a
+ *  new sample_freq. The check is made here, once per producer buffer on the
+ *  producer's side, rather than on every take in the DMA IRQ.
+ */
+void audio_i2s_converting_producer_give(audio_connection_t *connection, audio_buffer_t *buffer);
+
+/** \brief Whether a converting connection has copied out every producer buffer before its fence */
+static inline bool audio_i2s_rate_change_reached(const audio_i2s_converting_connection_t *cc) {
+    const audio_i2s_rate_change_t *rc = cc->rate_change;
+    return !rc || (rc->taken == rc->fence && !cc->core.current_producer_buffer);
+}
+
+/** \brief Pick the converter from a producer format to 16-bit output frames
+ *  \ingroup pico_audio_i2s
+ *
+ *  The converters work a word at a time, using the Cortex-M33 DSP packing
+ *  instructions where available, and run from RAM.
+ *
+ *  \param producer_format PCM S16 or S8, mono or stereo
+ *  \param output_channel_count 1 (stereo is mixed down to (left + right) / 2) or 2
+ *  \return The converter, or NULL if the conversion is not supported
+ */
+audio_i2s_sample_converter_t audio_i2s_s16_converter(const audio_format_t *producer_format, uint output_channel_count);
+
+/** \brief Pick the converter from a producer format to 32-bit stereo output frames
+ *  \ingroup pico_audio_i2s
+ *
+ *  Output samples are MSB-aligned in 32 bits, as sent in 32-bit I2S slots. Mono
+ *  input is duplicated to both channels.
+ *
+ *  \param producer_format PCM S16, S24 or S32, mono or stereo
+ *  \return The converter, or NULL if the format is not supported
+ */
+audio_i2s_sample_converter_t audio_i2s_s32_stereo_converter(const audio_format_t *producer_format);
+
+/** \brief Pick the processing counterpart of audio_i2s_s16_converter()
+ *  \ingroup pico_audio_i2s
+ *
+ *  \return The processor, or NULL if the conversion is not supported
+ */
+audio_i2s_sample_processor_t audio_i2s_s16_processor(const audio_format_t *producer_format, uint output_channel_count);
+
+/** \brief Pick the processing counterpart of audio_i2s_s32_stereo_converter()
+ *  \ingroup pico_audio_i2s
+ *
+ *  \return The processor, or NULL if the format is not supported
+ */
+audio_i2s_sample_processor_t audio_i2s_s32_stereo_processor(const audio_format_t *producer_format);
+
+/** \brief Set up output processing at unity gain with no DC blocker
+ *  \ingroup pico_audio_i2s
+ */
+void audio_i2s_output_process_init(audio_i2s_output_process_t *process);
+
+/** \brief Set the Q15 gain of an output (AUDIO_I2S_UNITY_GAIN for 1.0), reached over the next consumer buffer
+ *  \ingroup pico_audio_i2s
+ *
+ *  May be called at any time, from either core. -0x8000 is clamped to
+ *  -AUDIO_I2S_UNITY_GAIN, since inverting a full-scale negative sample by
+ *  exactly -1.0 would overflow.
+ */
+static inline void audio_i2s_output_process_set_gain(audio_i2s_output_process_t *process, int16_t gain) {
+    process->gain = (int16_t) MAX(gain, -AUDIO_I2S_UNITY_GAIN);
+}
+
+/** \brief Set the DC blocker pole of an output
+ *  \ingroup pico_audio_i2s
+ *
+ *  \param dc_shift 1 to 15 (see audio_i2s_output_process_t), or 0 to turn the DC blocker off
+ */
+void audio_i2s_output_process_set_dc_blocker(audio_i2s_output_process_t *process, uint dc_shift);
+
+/** \brief Lock-free single-producer, single-consumer ring of buffer pointers
+ *  \ingroup pico_audio_i2s
+ *
+ *  head is only written by the pushing side and tail only by the popping side, so
+ *  the two sides can run on different cores without a spin lock.
+ */
+typedef struct audio_i2s_spsc_ring {
+    audio_buffer_t *slots[PICO_AUDIO_I2S_SPSC_RING_SIZE]; ///< Buffers, indexed by position modulo the ring size
+    volatile uint32_t head;                               ///< Count of buffers pushed (wraps)
+    volatile uint32_t tail;                               ///< Count of buffers popped (wraps)
+} audio_i2s_spsc_ring_t;
+
+/** \brief Zero-copy connection that hands buffers between cores through two SPSC rings
+ *  \ingroup pico_audio_i2s
+ *
+ *  For a producer filling buffers on one core (typically core 1) while the driver
+ *  and its DMA IRQ run on the other. Full buffers travel producer to consumer
+ *  through one ring and played buffers come back through the other, so neither
+ *  side ever takes a pico_audio spin lock the other could be holding. A blocking
+ *  producer take waits with __wfe(), and the DMA IRQ wakes it with __sev() when it
+ *  returns a buffer.
+ *
+ *  The DMA plays the producer's buffers directly, so they must be in the DMA
+ *  format (as for audio_i2s_connect_zero_copy()). Connect with no consumer
+ *  buffers:
+ *  \code
+ *  static audio_i2s_spsc_connection_t spsc;
+ *  audio_i2s_connect_extra(producer, false, 0, 0, audio_i2s_spsc_connection_init(&spsc, producer));
+ *  \endcode
+ *
+ *  The first member is the audio_connection_t, so a pointer to this structure can
+ *  be passed wherever a connection is expected. Fields other than core are private.
+ */
+typedef struct audio_i2s_spsc_connection {
+    audio_connection_t core;
+    audio_i2s_spsc_ring_t full;  ///< Filled buffers, producer to consumer
+    audio_i2s_spsc_ring_t free;  ///< Played buffers, consumer back to producer
+} audio_i2s_spsc_connection_t;
+
+/** \brief Initialize an SPSC connection for a producer pool
+ *  \ingroup pico_audio_i2s
+ *
+ *  Moves every free buffer of the producer pool into the connection, so call it
+ *  before the producer takes any buffer. Panics if the pool has more than
+ *  PICO_AUDIO_I2S_SPSC_RING_SIZE buffers. The buffers are handed back to the
+ *  producer's free list by audio_i2s_disconnect() / audio_i2s_disconnect_multi_dac().
+ *
+ *  \param connection Connection state to initialize (must stay valid while connected)
+ *  \param producer Producer pool that will be connected through it
+ *  \return &connection->core, to pass to audio_i2s_connect_extra() or
+ *          audio_i2s_connect_multi_dac_extra()
+ */
+audio_connection_t *audio_i2s_spsc_connection_init(audio_i2s_spsc_connection_t *connection,
+                                                   audio_buffer_pool_t *producer);
+
+/** \brief Number of buffers in an SPSC ring */
+static inline uint audio_i2s_spsc_ring_count(const audio_i2s_spsc_ring_t *ring) {
+    return ring->head - ring->tail;
+}
+
+/** \brief Words of arena needed for a consumer pool built by audio_i2s_new_consumer_pool_in_arena()
+ *  \ingroup pico_audio_i2s
+ *
+ *  Usable as an array size, e.g. for a static uint32_t arena:
+ *  \code
+ *  static uint32_t arena[AUDIO_I2S_POOL_ARENA_WORDS(2, 256, 4)];
+ *  \endcode
+ *
+ *  \param buffer_count Number of buffers in the pool
+ *  \param samples_per_buffer Frames per buffer
+ *  \param sample_stride Bytes per consumer frame: 4 for S16 stereo output, 2 for S16 mono
+ *         output, 8 for 32-bit slots
+ */
+#define AUDIO_I2S_POOL_ARENA_WORDS(buffer_count, samples_per_buffer, sample_stride) \
+        ((buffer_count) * (((samples_per_buffer) * (sample_stride) + 3u) / 4u) + \
+         (sizeof(audio_buffer_pool_t) + (buffer_count) * (sizeof(audio_buffer_t) + sizeof(mem_buffer_t)) + 3u) / 4u)
+
+/** \brief Build a consumer pool in a caller-provided arena instead of on the heap
+ *  \ingroup pico_audio_i2s
+ *
+ *  The sample data comes first, each buffer starting on a word boundary, followed
+ *  by the pool and buffer headers; nothing is allocated. The pool is no longer used
+ *  once disconnected, so the arena can then be reused.
+ *
+ *  \param format Consumer buffer format (must stay valid while the pool is in use)
+ *  \param buffer_count Number of buffers
+ *  \param samples_per_buffer Frames per buffer
+ *  \param arena Word-aligned arena of at least
+ *         AUDIO_I2S_POOL_ARENA_WORDS(buffer_count, samples_per_buffer, format->sample_stride) words
+ *  \param arena_words Size of the arena in words; panics if it is too small
+ *  \return The pool, at an address inside the arena
+ */
+audio_buffer_pool_t *audio_i2s_new_consumer_pool_in_arena(audio_buffer_format_t *format, uint buffer_count,
+                                                         uint samples_per_buffer, uint32_t *arena, size_t arena_words);
+
+/** \brief Give back the producer buffer a copying connection is part way through
+ *  \ingroup pico_audio_i2s
+ *
+ *  For connections built on buffer_copying_on_consumer_take_connection, before the
+ *  connection is reused with a new consumer pool.
+ */
+void audio_i2s_release_copying_connection(struct buffer_copying_on_consumer_take_connection *connection);
+
+/** \brief Detach a consumer pool from its connection, returning any queued buffers
+ *  \ingroup pico_audio_i2s
+ *
+ *  Full buffers still queued in the consumer pool are handed to the connection's
+ *  consumer_pool_give, so buffers a zero-copy connection borrowed go back to the
+ *  producer. The producer pool is left unconnected and can be connected again.
+ */
+void audio_i2s_release_consumer_pool(audio_buffer_pool_t *consumer);
+
 /** @} */ // end of Utility Functions group
 
 #ifdef __cplusplus
@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _PICO_AUDIO_I2S_MIXER_H
+#define _PICO_AUDIO_I2S_MIXER_H
+
+/** \file audio_i2s_mixer.h
+ *  \brief Software mixer connection: several producer pools into one output
+ *  \ingroup pico_audio_i2s
+ *
+ * Every audio_i2s_connect*() call binds exactly one producer pool to an output.
+ * The mixer is a connection whose consumer take pulls from up to
+ * PICO_AUDIO_I2S_MIXER_MAX_STREAMS stream pools at once, scales each by its own
+ * gain and sums them with saturation straight into the consumer buffer, so
+ * there is no intermediate copy per stream. The mixer stands in for the producer
+ * pool passed to the connect function:
+ * ```c
+ * static audio_i2s_mixer_t mixer;
+ * audio_buffer_pool_t *mix = audio_i2s_mixer_init(&mixer, 44100);
+ * audio_i2s_mixer_add_stream(&mixer, music, AUDIO_I2S_MIXER_UNITY_GAIN);
+ * audio_i2s_mixer_add_stream(&mixer, effects, AUDIO_I2S_MIXER_UNITY_GAIN / 2);
+ * audio_i2s_connect_extra(mix, false, 2, 256, &mixer.core);
+ * ```
+ *
+ * Streams are PCM S16, mono or stereo, at the mixer's sample rate. The mix is
+ * written in the output's own format: S16 or S32 (MSB aligned) for 32-bit
+ * slots, and mono outputs get the left/right mix down. A stream with
+ * no buffer ready is silent until it catches up. A consumer buffer is cut short
+ * once every stream has run dry, and the output only underruns when no stream
+ * has anything ready.
+ */
+
+#include "pico/audio.h"
+#include "audio_i2s_common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** \brief Most streams one mixer can combine */
+#ifndef PICO_AUDIO_I2S_MIXER_MAX_STREAMS
+#define PICO_AUDIO_I2S_MIXER_MAX_STREAMS 4
+#endif
+
+/** \brief Q15 gain closest to 1.0 */
+#define AUDIO_I2S_MIXER_UNITY_GAIN 0x7fff
+
+/** \brief One input of a mixer
+ *  \ingroup pico_audio_i2s
+ *
+ *  Fields are private; use audio_i2s_mixer_set_gain() to change the gain.
+ */
+typedef struct audio_i2s_mixer_stream {
+    audio_connection_t core;          ///< Connection owning the stream's producer pool (producer side only)
+    audio_buffer_t *current_buffer;   ///< Producer buffer being mixed
+    uint32_t current_buffer_pos;      ///< Next frame to mix from current_buffer
+    volatile int16_t gain;            ///< Q15 gain, may be negative (-0x7fff to 0x7fff)
+} audio_i2s_mixer_stream_t;
+
+/** \brief Mixer connection state
+ *  \ingroup pico_audio_i2s
+ *
+ * The first member is the audio_connection_t, so a pointer to this structure can
+ * be passed wherever a connection is expected. Fields other than core are private.
+ */
+typedef struct audio_i2s_mixer {
+    audio_connection_t core;
+    audio_format_t format;                                          ///< Output format (S16 stereo)
+    audio_buffer_format_t buffer_format;                            ///< Output buffer format
+    audio_buffer_pool_t output;                                     ///< Buffer-less pool standing in for the producer
+    audio_i2s_mixer_stream_t streams[PICO_AUDIO_I2S_MIXER_MAX_STREAMS];
+    volatile uint8_t stream_count;                                  ///< Streams added so far
+} audio_i2s_mixer_t;
+
+/** \brief Initialize a mixer with no streams
+ *  \ingroup pico_audio_i2s
+ *
+ * \param mixer Mixer state to initialize (must stay valid while connected)
+ * \param sample_freq Output sample rate, which every stream must share
+ * \return Pool to pass as the producer to audio_i2s_connect_extra() or
+ *         audio_i2s_connect_multi_dac_extra(), along with &mixer->core as the connection
+ */
+audio_buffer_pool_t *audio_i2s_mixer_init(audio_i2s_mixer_t *mixer, uint32_t sample_freq);
+
+/** \brief Add a producer pool as a mixer input
+ *  \ingroup pico_audio_i2s
+ *
+ * May be called while the mixer is playing; the stream joins at the next
+ * consumer buffer. The pool must not be connected to anything else.
+ *
+ * \param mixer Mixer from audio_i2s_mixer_init()
+ * \param producer Producer pool of PCM S16 mono or stereo at the mixer's sample rate
+ * \param gain Q15 gain (AUDIO_I2S_MIXER_UNITY_GAIN for 1.0); -0x8000 is taken as -0x7fff
+ * \return Index of the stream, or -1 if the mixer is full
+ */
+int audio_i2s_mixer_add_stream(audio_i2s_mixer_t *mixer, audio_buffer_pool_t *producer, int16_t gain);
+
+/** \brief Change the gain of a stream
+ *  \ingroup pico_audio_i2s
+ *
+ * Takes effect from the next consumer buffer.
+ *
+ * \param mixer Mixer from audio_i2s_mixer_init()
+ * \param stream Index returned by audio_i2s_mixer_add_stream()
+ * \param gain Q15 gain; -0x8000 is taken as -0x7fff
+ */
+void audio_i2s_mixer_set_gain(audio_i2s_mixer_t *mixer, uint stream, int16_t gain);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _PICO_AUDIO_I2S_MIXER_H
@@ -12,13 +12,14 @@
  *  \ingroup pico_audio_i2s
  *
  * This module provides synchronized multi-DAC I2S audio output capability,
- * allowing up to 4 DACs to share a common clock while outputting independent
+ * allowing up to 7 DACs on RP2040, or 11 on RP2350, to share a common clock while outputting independent
  * audio streams. This is ideal for applications requiring multiple synchronized
  * audio channels such as surround sound systems, multi-zone audio, or
  * professional audio equipment.
  *
  * Key Features:
- * - Support for 2-4 synchronized DACs sharing common I2S clocks
+ * - Support for 1 to PICO_AUDIO_I2S_MAX_DACS synchronized DACs sharing common I2S clocks
+ *   (default 4; up to 7 on RP2040 and 11 on RP2350)
  * - Independent data streams for each DAC
  * - Synchronized clock generation ensuring phase coherence
  * - Configurable GPIO pins for each DAC data output
@@ -32,10 +33,16 @@
  * own data-only PIO state machine that outputs audio data synchronized to
  * the shared clock signals.
  *
+ * Alternatively, in single state machine mode one PIO state machine generates
+ * the clocks and shifts all data lanes out on consecutive pins, fed by a single
+ * DMA channel from a lane-interleaved buffer. This uses one state machine and
+ * one DMA channel regardless of DAC count, and DAC-to-DAC skew is zero by
+ * construction.
+ *
  * Pin Configuration:
  * - Shared clock pins (BCLK and LRCLK) on consecutive GPIOs
  * - Individual data pins for each DAC (configurable)
- * - All pins must be configured for the same PIO block
+ * - Each pin is driven by the PIO block of the state machine that uses it
  *
  * Usage Example:
  * ```c
@@ -79,11 +86,28 @@ extern "C" {
  * Limited by PIO state machine availability and DMA channel resources.
  * Each DAC requires one PIO state machine and one DMA channel, plus
  * one additional PIO state machine for the shared clock generator.
+ * Spreading the data state machines over several PIO blocks (see
+ * audio_i2s_multi_dac_config_t::data_pios) allows up to 7 DACs on RP2040 and
+ * 11 on RP2350.
  */
 #ifndef PICO_AUDIO_I2S_MAX_DACS
 #define PICO_AUDIO_I2S_MAX_DACS 4
 #endif
 
+/** \brief Validate that every DAC can have a data state machine, next to the clock generator */
+#if PICO_AUDIO_I2S_MAX_DACS < 1 || PICO_AUDIO_I2S_MAX_DACS > NUM_PIOS * NUM_PIO_STATE_MACHINES - 1
+#error PICO_AUDIO_I2S_MAX_DACS must be between 1 and NUM_PIOS * NUM_PIO_STATE_MACHINES - 1
+#endif
+
+/** \brief Number of stereo frames per lane-interleaved DMA buffer in single state machine mode
+ * \ingroup pico_audio_i2s
+ *
+ * Two of these buffers are allocated, each num_dacs * 4 bytes per frame.
+ */
+#ifndef PICO_AUDIO_I2S_MULTI_LANE_BUFFER_SAMPLE_LENGTH
+#define PICO_AUDIO_I2S_MULTI_LANE_BUFFER_SAMPLE_LENGTH 128u
+#endif
+
 /** @} */ // end of Multi-DAC Configuration Constants
 
 /** \brief Configuration structure for multi-DAC I2S setup
@@ -94,23 +118,74 @@ extern "C" {
  * specified number of DACs.
  *
  * Resource Requirements:
- * - PIO state machines: 1 for clock + 1 per DAC
- * - DMA channels: 1 per DAC  
- * - GPIO pins: 2 for clock + 1 per DAC data line
+ * - PIO state machines: 1 for clock + 1 per DAC (+ 1 for capture)
+ * - DMA channels: 1 per DAC (+ 1 for capture)
+ * - GPIO pins: 2 for clock + 1 per DAC data line (+ 1 capture input)
  *
  * Constraints:
- * - All PIO state machines must be from the same PIO block
+ * - Data state machines run on data_pios[i] (the clock's block when NULL); each
+ *   (block, state machine) pair must be unique
  * - All DMA channels must be unique
  * - All GPIO pins must be unique
  * - Clock pin base and base+1 must be consecutive and available
+ *
+ * Spreading DACs over PIO blocks:
+ * The data state machines count bit clocks in lockstep with the clock generator,
+ * so they are always started together. On RP2350 one CTRL write starts the
+ * clock's block and its neighbours on the same cycle. RP2040 has no cross-block
+ * start, so the blocks are started by back-to-back writes and data on another
+ * block trails the clocks by a couple of clk_sys cycles, well inside half a bit
+ * clock. Every stop also rewinds all state machines to the start of a frame, so
+ * blocks stopped a cycle apart cannot slip.
+ *
+ * Single state machine mode (single_sm = true):
+ * - clock_pio_sm drives BCLK, LRCLK and all data lanes; data_pio_sms and data_pios are unused
+ * - dma_channels[0] and dma_channels[1] (which must differ, whatever num_dacs is)
+ *   play the two lane buffers, each chained to the other, so the IRQ only interleaves
+ * - the TX FIFO is joined, 8 words deep
+ * - data_pins must be consecutive (data_pins[i] == data_pins[0] + i)
+ * - num_dacs must be 1, 2 or 4
+ *
+ * DACs whose bit is set in mono_output_mask get 16-bit mono consumer buffers (one
+ * sample per frame, sent in both slots, with stereo producers mixed down), so mono
+ * and stereo DACs can share the clock. In single state machine mode every lane is
+ * fed from stereo buffers and the mask is ignored.
+ *
+ * DACs whose bit is set in s32_output_mask get 32-bit stereo consumer buffers, with
+ * S16, S24 and S32 producers widened on take, and run the audio_i2s_data_slot
+ * program. All DACs share BCLK, so any bit set widens every slot to 32 bits
+ * (BCLK of 64 x fs): the other DACs keep their 16-bit buffers, which the
+ * audio_i2s_data_pad program sends in the top half of each slot, followed by 16
+ * zero bits, as a 16-bit I2S DAC expects. Both programs send each frame left then
+ * right, so the DACs stay frame aligned. A 32-bit DAC is always stereo. 32-bit
+ * slots are not available in single state machine mode or with capture.
+ *
+ * Capture (full duplex):
+ * With capture set, capture_pio_sm samples an I2S data input on capture_pin off
+ * the same BCLK and LRCLK, on the clock's PIO block, and capture_dma_channel
+ * drains it into buffers of the pool given to audio_i2s_connect_capture_multi_dac().
+ * The capture state machine counts bit clocks in lockstep with the outputs, so
+ * captured frame n was clocked in during played frame n, and the loopback delay
+ * is fixed by the buffering alone. In single state machine mode with capture,
+ * PICO_AUDIO_I2S_CLOCK_DITHER is not applied, as it would retune only the clock
+ * state machine.
  */
 typedef struct audio_i2s_multi_dac_config {
-    uint8_t num_dacs;                                    ///< Number of DACs to configure (2-4)
+    uint8_t num_dacs;                                    ///< Number of DACs to configure (1-PICO_AUDIO_I2S_MAX_DACS)
     uint8_t data_pins[PICO_AUDIO_I2S_MAX_DACS];        ///< GPIO pins for data output (one per DAC)
     uint8_t clock_pin_base;                             ///< Base GPIO pin for clocks (BCLK=base, LRCLK=base+1)
     uint8_t dma_channels[PICO_AUDIO_I2S_MAX_DACS];     ///< DMA channels for each DAC
     uint8_t clock_pio_sm;                               ///< PIO state machine for shared clock generation
     uint8_t data_pio_sms[PICO_AUDIO_I2S_MAX_DACS];     ///< PIO state machines for data output (one per DAC)
+    bool single_sm;                                     ///< Shift all data lanes from clock_pio_sm via two chained DMA channels
+    uint16_t mono_output_mask;                          ///< Bit per DAC index for 16-bit mono output (all set by PICO_AUDIO_I2S_MONO_OUTPUT)
+    uint16_t s32_output_mask;                           ///< Bit per DAC index for 32-bit stereo output (widens every slot to 32 bits)
+    PIO clock_pio;                                      ///< PIO block of clock_pio_sm (NULL = audio_pio, see PICO_AUDIO_I2S_PIO)
+    PIO data_pios[PICO_AUDIO_I2S_MAX_DACS];            ///< PIO block of each data state machine (NULL = clock_pio)
+    bool capture;                                       ///< Also capture an I2S input off the shared clocks
+    uint8_t capture_pin;                                ///< GPIO pin for I2S data input (SDIN)
+    uint8_t capture_pio_sm;                             ///< PIO state machine for capture, on clock_pio
+    uint8_t capture_dma_channel;                        ///< DMA channel for captured data
 } audio_i2s_multi_dac_config_t;
 
 /** \name Multi-DAC I2S Functions
@@ -137,8 +212,8 @@ typedef struct audio_i2s_multi_dac_config {
  * \note The function may adjust the intended format based on hardware constraints
  * 
  * Setup Requirements:
- * - config->num_dacs must be between 2 and PICO_AUDIO_I2S_MAX_DACS
- * - All PIO state machines must be available and from the same PIO block
+ * - config->num_dacs must be between 1 and PICO_AUDIO_I2S_MAX_DACS
+ * - All PIO state machines must be available
  * - All DMA channels must be available and unique
  * - All GPIO pins must be available and unique
  */
@@ -163,9 +238,66 @@ const audio_format_t *audio_i2s_setup_multi_dac(const audio_format_t *intended_a
  * \note DACs can be connected in any order and don't all need to be connected
  * \note Disconnected DACs will output silence
  * \note Each DAC connection is independent - different buffer pools can have different formats
+ * \note Equivalent to audio_i2s_connect_multi_dac_extra(producer, dac_index, false, 2, 256, NULL)
  */
 bool audio_i2s_connect_multi_dac(audio_buffer_pool_t *producer, uint8_t dac_index);
 
+/** \brief Connect audio buffer pool to specific DAC with custom buffering configuration
+ * \ingroup pico_audio_i2s
+ *
+ * Per-DAC equivalent of audio_i2s_connect_extra(): each DAC gets its own consumer
+ * pool, so a low-latency zone can run with few short buffers while others use more,
+ * longer ones for underrun resilience.
+ *
+ * \param producer Audio buffer pool providing source data for the specified DAC
+ * \param dac_index Index of the target DAC (0 to num_dacs-1)
+ * \param buffer_on_give If true, buffering occurs on producer give; if false, on consumer take
+ * \param buffer_count Number of consumer buffers to allocate for this DAC
+ * \param samples_per_buffer Number of audio samples per consumer buffer
+ * \param connection Optional custom connection structure (NULL for default)
+ * \return true if connection successful, false if invalid index or setup not complete
+ *
+ * \note In single state machine mode every DAC's buffers are drained in steps of
+ *       PICO_AUDIO_I2S_MULTI_LANE_BUFFER_SAMPLE_LENGTH frames, whatever their size
+ */
+bool audio_i2s_connect_multi_dac_extra(audio_buffer_pool_t *producer, uint8_t dac_index, bool buffer_on_give,
+                                       uint buffer_count, uint samples_per_buffer, audio_connection_t *connection);
+
+/** \brief Connect an audio source to a DAC, with its consumer buffers in a caller-provided arena
+ * \ingroup pico_audio_i2s
+ *
+ * Same as audio_i2s_connect_multi_dac_extra(), but the consumer pool is built in
+ * arena rather than allocated from the heap (see audio_i2s_connect_arena()).
+ * audio_i2s_disconnect_multi_dac() hands the arena back.
+ *
+ * \param arena Word-aligned arena of at least
+ *        AUDIO_I2S_POOL_ARENA_WORDS(buffer_count, samples_per_buffer, 4) words
+ *        (sample stride 2 for a mono DAC)
+ * \param arena_words Size of the arena in words; panics if it is too small
+ * \return true if connection successful, false if not initialized or dac_index is out of range
+ */
+bool audio_i2s_connect_multi_dac_arena(audio_buffer_pool_t *producer, uint8_t dac_index, bool buffer_on_give,
+                                       uint buffer_count, uint samples_per_buffer, audio_connection_t *connection,
+                                       uint32_t *arena, size_t arena_words);
+
+/** \brief Disconnect the audio source from a DAC
+ * \ingroup pico_audio_i2s
+ *
+ * Disables output on all DACs (they share the clock state machine), then returns
+ * every buffer in flight for this DAC and stops referencing its consumer pool, so
+ * an arena passed to audio_i2s_connect_multi_dac_arena() may be reused. Re-enable
+ * output with audio_i2s_set_enabled_multi_dac(); an unconnected DAC plays silence.
+ * Connecting a DAC that is already connected disconnects it first.
+ *
+ * \param dac_index Index of the DAC (0 to num_dacs-1); ignored if not connected
+ *
+ * \note Consumer pools allocated on the heap by the other connect functions
+ *       cannot be freed and are abandoned
+ * \note A custom connection passed to the connect function is only unlinked;
+ *       reinitialize it before connecting it again
+ */
+void audio_i2s_disconnect_multi_dac(uint8_t dac_index);
+
 /** \brief Enable or disable multi-DAC I2S output
  * \ingroup pico_audio_i2s
  *
@@ -185,6 +317,152 @@ bool audio_i2s_connect_multi_dac(audio_buffer_pool_t *producer, uint8_t dac_inde
  */
 void audio_i2s_set_enabled_multi_dac(bool enabled);
 
+/** \brief Get the PIO clock divider shared by all DACs
+ * \ingroup pico_audio_i2s
+ *
+ * \return Divider state for the current shared sample rate, including its error in ppm
+ *
+ * \note PICO_AUDIO_I2S_CLOCK_DITHER only applies in single state machine mode; with
+ *       separate clock and data state machines the dividers are never changed
+ *       mid-stream, as that could skew the lanes
+ */
+const audio_i2s_clock_divider_t *audio_i2s_get_clock_divider_multi_dac(void);
+
+/** \brief Get the playback statistics for one DAC
+ * \ingroup pico_audio_i2s
+ *
+ * The statistics are updated by the DMA IRQ and can be read at any time without
+ * locking. In single state machine mode one interrupt serves every lane, so each
+ * DAC reports the cost of the whole interrupt.
+ *
+ * \param dac_index Index of the DAC (0 to num_dacs-1)
+ * \return Statistics for the DAC, or NULL if dac_index is out of range
+ */
+const audio_i2s_stats_t *audio_i2s_get_stats_multi_dac(uint8_t dac_index);
+
+/** \brief Clear the playback statistics for one DAC
+ * \ingroup pico_audio_i2s
+ *
+ * \note An update made by a DMA IRQ running at the same time may be lost
+ */
+void audio_i2s_reset_stats_multi_dac(uint8_t dac_index);
+
+/** \brief Set how long the idle multi-DAC output plays silence before it parks
+ * \ingroup pico_audio_i2s
+ *
+ * Once every connected DAC has played idle_ms of underrun silence, the DMA IRQ
+ * stops the state machines together at a frame boundary, as on disable, and
+ * stops the DMA, so BCLK and LRCLK are held and no more IRQs are taken. The next
+ * buffer given to any DAC's connection restarts the output from the give, as
+ * audio_i2s_set_enabled_multi_dac() does, but on a short run of silence (two lane
+ * buffers in lane mode), so the DACs all take their first buffers in the DMA IRQ
+ * and buffers given to several DACs together stay in step.
+ *
+ * Only the connections built by audio_i2s_connect_multi_dac*() wake the output,
+ * so a custom connection on any DAC, or capture, keeps it running.
+ *
+ * \param idle_ms Silence before parking, 0 to never park (default PICO_AUDIO_I2S_IDLE_PARK_MS)
+ */
+void audio_i2s_set_idle_park_ms_multi_dac(uint32_t idle_ms);
+
+/** \brief Whether the multi-DAC output is parked (see audio_i2s_set_idle_park_ms_multi_dac())
+ * \ingroup pico_audio_i2s
+ */
+bool audio_i2s_is_parked_multi_dac(void);
+
+/** \brief Set the gain of one DAC
+ * \ingroup pico_audio_i2s
+ *
+ * As audio_i2s_set_gain(), for the DAC's convert-on-take connection (the default
+ * with buffering on take).
+ *
+ * \param dac_index Index of the DAC (0 to num_dacs-1)
+ * \param gain Q15 gain, AUDIO_I2S_UNITY_GAIN for 1.0
+ */
+void audio_i2s_set_gain_multi_dac(uint8_t dac_index, int16_t gain);
+
+/** \brief Turn the DC blocker of one DAC on or off
+ * \ingroup pico_audio_i2s
+ *
+ * As audio_i2s_set_dc_blocker(), for the DAC's convert-on-take connection.
+ *
+ * \param dac_index Index of the DAC (0 to num_dacs-1)
+ * \param dc_shift 1 to 15, or 0 to turn the filter off
+ */
+void audio_i2s_set_dc_blocker_multi_dac(uint8_t dac_index, uint dc_shift);
+
+/** \brief Switch every DAC to a new sample rate between two producer buffers
+ * \ingroup pico_audio_i2s
+ *
+ * The DACs share one clock, so they change rate together. Each connected DAC
+ * plays out the buffers given before the call (custom connections stop at their
+ * next DMA refill) and then plays silence; once
+ * every DAC is silent the state machines are stopped, retuned and restarted
+ * together, as they are for any divider change, and play resumes at the new
+ * rate. The mute lasts at least a few frames, and longer for DACs that reach
+ * their last old buffer before the others. In single state machine mode each
+ * lane stops at its fence and the lane buffers after the last one to get there
+ * play silence; the divider is written once the DMA has moved on to the second
+ * buffer of all-silence, so the mute there is at least two lane buffers
+ * (2 * PICO_AUDIO_I2S_MULTI_LANE_BUFFER_SAMPLE_LENGTH frames).
+ *
+ * Connecting a producer (or capture pool) at another rate while the output is
+ * enabled starts the same change; the new DAC plays silence until the switch.
+ *
+ * A producer that gives a buffer whose format has a new sample_freq starts the
+ * same change, with a mute of PICO_AUDIO_I2S_RATE_CHANGE_MUTE_FRAMES.
+ *
+ * \param sample_freq New sample frequency in Hz
+ * \param mute_frames Shortest silence at the old rate before the new one starts;
+ *        with PICO_AUDIO_I2S_FADE_FRAMES it begins with the fade-out ramp
+ */
+void audio_i2s_set_sample_freq_multi_dac(uint32_t sample_freq, uint32_t mute_frames);
+
+/** \brief Start capturing into a producer pool
+ * \ingroup pico_audio_i2s
+ *
+ * The DMA IRQ takes free buffers from producer, fills them with captured
+ * frames and queues them as full, as producer_pool_take_buffer_default() and
+ * producer_pool_give_buffer_default() would. The pool can be read with
+ * get_full_audio_buffer() / queue_free_audio_buffer(), or handed to a connect
+ * function that copies on consumer take, e.g. audio_i2s_connect_multi_dac() for
+ * a loopback. When no buffer is free, a block of PICO_AUDIO_I2S_SILENCE_BUFFER_SAMPLE_LENGTH
+ * frames is dropped.
+ *
+ * May be called while output is enabled; the pool is used from the next capture
+ * buffer. The pool's sample rate sets the shared clock, as a DAC producer does.
+ *
+ * \param producer Pool of PCM S16 stereo buffers with a sample stride of 4, word aligned
+ * \return true if connected, false if capture was not set up or the format is not S16 stereo
+ */
+bool audio_i2s_connect_capture_multi_dac(audio_buffer_pool_t *producer);
+
+/** \brief Stop capturing into the connected pool
+ * \ingroup pico_audio_i2s
+ *
+ * Disables output on all DACs (the capture shares their clock), and returns the
+ * buffer being filled to the pool's free list. Captured frames are discarded
+ * until another pool is connected.
+ */
+void audio_i2s_disconnect_capture_multi_dac(void);
+
+/** \brief Get the capture statistics
+ * \ingroup pico_audio_i2s
+ *
+ * The playback counters are reused: buffers_played counts buffers filled,
+ * underruns counts refills that found no free buffer and silence_samples the
+ * frames dropped for them, and tx_stalls counts RX FIFO overflows (RXSTALL). The
+ * reader takes from the pool directly, so no fill level is kept.
+ *
+ * \return Statistics, or NULL if capture was not set up
+ */
+const audio_i2s_stats_t *audio_i2s_get_capture_stats_multi_dac(void);
+
+/** \brief Clear the capture statistics
+ * \ingroup pico_audio_i2s
+ */
+void audio_i2s_reset_capture_stats_multi_dac(void);
+
 /** @} */ // end of Multi-DAC I2S Functions
 
 #ifdef __cplusplus
@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _PICO_AUDIO_I2S_RATE_MATCH_H
+#define _PICO_AUDIO_I2S_RATE_MATCH_H
+
+/** \file audio_i2s_rate_match.h
+ *  \brief Adaptive rate matching connection for producers on a foreign clock
+ *  \ingroup pico_audio_i2s
+ *
+ * Producers such as USB audio or network streams run on a clock that is not
+ * locked to the I2S output, so the producer pool slowly fills up or drains and
+ * eventually overruns or underruns. This connection copies producer buffers
+ * into the consumer pool on consumer take (like the default copying connection)
+ * but passes them through a linear-interpolating resampler whose ratio is
+ * steered by how many producer frames are waiting, keeping that backlog at a
+ * target depth.
+ *
+ * The connection plugs into the existing custom connection hook:
+ * ```c
+ * static audio_i2s_rate_match_connection_t rate_match;
+ * audio_connection_t *connection = audio_i2s_rate_match_connection_init(&rate_match, 512);
+ * audio_i2s_connect_extra(producer, false, 2, 256, connection);
+ * ```
+ *
+ * Input may be mono or stereo PCM S16; output is mono or stereo, S16 or S32
+ * (MSB aligned, for 32-bit slots), to match the output it is connected to.
+ */
+
+#include "pico/audio.h"
+#include "audio_i2s_common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** \brief Largest correction the rate matcher will apply, in ppm */
+#ifndef PICO_AUDIO_I2S_RATE_MATCH_MAX_PPM
+#define PICO_AUDIO_I2S_RATE_MATCH_MAX_PPM 1000
+#endif
+
+/** \brief Proportional gain: ppm of correction per frame of backlog error */
+#ifndef PICO_AUDIO_I2S_RATE_MATCH_GAIN_PPM_PER_FRAME
+#define PICO_AUDIO_I2S_RATE_MATCH_GAIN_PPM_PER_FRAME 1
+#endif
+
+/** \brief Integral time constant: consumer buffers for the integral term to gain 1 ppm per frame of error */
+#ifndef PICO_AUDIO_I2S_RATE_MATCH_INTEGRAL_BUFFERS
+#define PICO_AUDIO_I2S_RATE_MATCH_INTEGRAL_BUFFERS 64
+#endif
+
+/** \brief Adaptive rate matching connection state
+ *  \ingroup pico_audio_i2s
+ *
+ * The first member is the audio_connection_t, so a pointer to this structure can
+ * be passed wherever a connection is expected. Fields other than core are private.
+ */
+typedef struct audio_i2s_rate_match_connection {
+    audio_connection_t core;
+    audio_buffer_t *current_producer_buffer;  ///< Producer buffer being read
+    uint32_t current_producer_buffer_pos;     ///< Next frame to read from current_producer_buffer
+    volatile uint32_t frames_given;           ///< Frames queued by the producer (written by producer side only)
+    volatile uint32_t frames_taken;           ///< Frames read by the resampler (written by consumer side only)
+    uint32_t target_frames;                   ///< Producer backlog to hold, in frames
+    uint32_t phase;                           ///< Position between prev and cur input frames (Q8.24)
+    uint32_t step;                            ///< Input frames advanced per output frame (Q8.24)
+    int32_t prev[2];                          ///< Previous input frame (left, right)
+    int32_t cur[2];                           ///< Current input frame (left, right)
+    int32_t filtered_error;                   ///< Low-pass filtered backlog error (Q8 frames)
+    int32_t integral_ppm;                     ///< Integral term of the rate correction (Q8 ppm)
+    volatile int32_t correction_ppm;          ///< Rate correction currently applied, in ppm
+} audio_i2s_rate_match_connection_t;
+
+/** \brief Initialize an adaptive rate matching connection
+ *  \ingroup pico_audio_i2s
+ *
+ * \param connection Connection state to initialize (must stay valid while connected)
+ * \param target_frames Number of frames to keep waiting in the producer pool;
+ *        should be at least two producer buffers so the backlog never hits zero
+ * \return The connection to pass to audio_i2s_connect_extra()
+ */
+audio_connection_t *audio_i2s_rate_match_connection_init(audio_i2s_rate_match_connection_t *connection,
+                                                         uint32_t target_frames);
+
+/** \brief Get the rate correction currently applied, in ppm
+ *  \ingroup pico_audio_i2s
+ *
+ * Positive values mean the producer is running fast and input is consumed faster
+ * than the nominal rate.
+ */
+static inline int32_t audio_i2s_rate_match_get_correction_ppm(const audio_i2s_rate_match_connection_t *connection) {
+    return connection->correction_ppm;
+}
+
+/** \brief Get the number of producer frames currently waiting to be resampled
+ *  \ingroup pico_audio_i2s
+ */
+static inline uint32_t audio_i2s_rate_match_get_backlog(const audio_i2s_rate_match_connection_t *connection) {
+    return connection->frames_given - connection->frames_taken;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _PICO_AUDIO_I2S_RATE_MATCH_H
@@ -17,6 +17,7 @@
  * Features:
  * - Single DAC output with configurable pins
  * - Support for 16-bit PCM audio (stereo and mono)
+ * - 24 and 32-bit PCM audio through 32-bit I2S slots
  * - 8-bit PCM audio support with automatic conversion
  * - Configurable sample rates with automatic frequency adjustment
  * - DMA-based data transfer for low CPU overhead
@@ -78,19 +79,86 @@ extern "C" {
 
 /** @} */ // end of Default Pin Assignments
 
+/** \brief DMA scheme used to feed the I2S PIO state machine
+ * \ingroup pico_audio_i2s
+ */
+enum audio_i2s_dma_mode {
+    AUDIO_I2S_DMA_MODE_SINGLE = 0,  ///< One channel, re-armed from the DMA IRQ after every buffer
+    AUDIO_I2S_DMA_MODE_PING_PONG,   ///< Two channels chained to each other; the IRQ only refills the idle one
+    AUDIO_I2S_DMA_MODE_RING,        ///< Control channel walks a descriptor ring; IRQ every ring_irq_interval buffers
+};
+
+/** \brief Default number of buffers played between DMA IRQs in AUDIO_I2S_DMA_MODE_RING (1 to 255) */
+#ifndef PICO_AUDIO_I2S_RING_IRQ_INTERVAL
+#define PICO_AUDIO_I2S_RING_IRQ_INTERVAL 4
+#endif
+#if PICO_AUDIO_I2S_RING_IRQ_INTERVAL < 1 || PICO_AUDIO_I2S_RING_IRQ_INTERVAL > 255
+#error PICO_AUDIO_I2S_RING_IRQ_INTERVAL must be between 1 and 255
+#endif
+
+/** \brief Smallest consumer buffer, in frames, that audio_i2s_connect_latency() will choose
+ *
+ * Each buffer costs one DMA IRQ, so this bounds the IRQ rate however small the
+ * latency budget is.
+ */
+#ifndef PICO_AUDIO_I2S_MIN_BUFFER_FRAMES
+#define PICO_AUDIO_I2S_MIN_BUFFER_FRAMES 16
+#endif
+
+#if PICO_AUDIO_I2S_MIN_BUFFER_FRAMES < 1
+#error PICO_AUDIO_I2S_MIN_BUFFER_FRAMES must be at least 1
+#endif
+
 /** \brief Configuration structure for single DAC I2S setup
  * \ingroup pico_audio_i2s
  *
  * This structure defines the hardware configuration for a single DAC I2S interface.
- * All parameters must be specified when calling audio_i2s_setup().
+ * All parameters must be specified when calling audio_i2s_setup(), except the
+ * optional DMA mode fields which default to a single re-armed channel when zero.
+ *
+ * In AUDIO_I2S_DMA_MODE_PING_PONG the next buffer is already queued on the second
+ * channel when the current one finishes, so the IRQ has a full buffer period to
+ * run instead of the time it takes the PIO TX FIFO to drain.
+ *
+ * In AUDIO_I2S_DMA_MODE_RING, dma_channel_b is a control channel that reloads the
+ * data channel from a ring of 2 * ring_irq_interval descriptors without CPU
+ * involvement. The IRQ fires once per ring_irq_interval buffers and recycles the
+ * completed half of the ring. The consumer pool should hold at least
+ * 2 * ring_irq_interval buffers, since that many are queued in the ring at once.
+ *
+ * mono_output makes 16-bit slot output mono: consumer buffers hold one S16 sample
+ * per frame, sent in both slots, and stereo producers are mixed down on consumer
+ * take. It is ignored for 32-bit slots, which are always stereo.
  */
 typedef struct audio_i2s_config {
     uint8_t data_pin;          ///< GPIO pin for I2S data output (SDOUT)
     uint8_t clock_pin_base;    ///< Base GPIO pin for clocks (BCLK=base, LRCLK=base+1)
     uint8_t dma_channel;       ///< DMA channel number for audio data transfer
     uint8_t pio_sm;           ///< PIO state machine number for I2S protocol
+    uint8_t dma_mode;          ///< enum audio_i2s_dma_mode (default AUDIO_I2S_DMA_MODE_SINGLE)
+    uint8_t dma_channel_b;     ///< Second DMA channel: ping-pong partner or ring control channel
+    uint8_t ring_irq_interval; ///< Buffers per IRQ in AUDIO_I2S_DMA_MODE_RING, 1 to 255 (0 = PICO_AUDIO_I2S_RING_IRQ_INTERVAL)
+    bool mono_output;          ///< 16-bit mono output (always set by PICO_AUDIO_I2S_MONO_OUTPUT)
 } audio_i2s_config_t;
 
+/** \brief Output latency of the single DAC connection
+ * \ingroup pico_audio_i2s
+ *
+ * The output latency runs from the DMA IRQ taking a consumer buffer (and
+ * converting producer frames into it) to the last of its frames leaving the
+ * data pin: every buffer queued to the DMA, plus the PIO TX FIFO. Frames waiting
+ * in producer buffers come on top of this, so keep producer buffers no longer
+ * than samples_per_buffer for the lowest end-to-end latency.
+ */
+typedef struct audio_i2s_latency {
+    uint32_t target_us;          ///< Budget passed to audio_i2s_setup_latency() (0 if not set up that way)
+    uint32_t samples_per_buffer; ///< Frames per consumer buffer (0 for zero-copy connections)
+    uint32_t silence_frames;     ///< Frames of silence played per refill on an underrun
+    uint32_t buffers_in_flight;  ///< Consumer buffers queued to the DMA at once
+    uint32_t buffered_frames;    ///< Worst-case frames between consumer take and the data pin
+    uint32_t latency_us;         ///< buffered_frames at the connected sample rate, rounded up
+} audio_i2s_latency_t;
+
 /** \name Single DAC I2S Functions
  *  \brief Functions for single DAC I2S audio setup and operation
  * @{
@@ -107,10 +175,52 @@ typedef struct audio_i2s_config {
  * \return Actual audio format that will be used (may differ from intended)
  *
  * \note The function may adjust the intended format based on hardware constraints
+ *
+ * An intended format of AUDIO_BUFFER_FORMAT_PCM_S24 or AUDIO_BUFFER_FORMAT_PCM_S32
+ * selects 32-bit slots (BCLK = 64 x fs) with one 32-bit DMA transfer per channel
+ * sample. The output is then always stereo; S16, S24 and S32 producers, mono or
+ * stereo, are converted on consumer take regardless of mono_output.
  */
 const audio_format_t *audio_i2s_setup(const audio_format_t *intended_audio_format,
                                       const audio_i2s_config_t *config);
 
+/** \brief Initialize single DAC I2S audio for a target output latency
+ * \ingroup pico_audio_i2s
+ *
+ * Same as audio_i2s_setup(), but picks the DMA mode for small buffers and records
+ * the budget for audio_i2s_connect_latency(). AUDIO_I2S_DMA_MODE_SINGLE is replaced
+ * by AUDIO_I2S_DMA_MODE_PING_PONG, since a single channel has to be re-armed within
+ * the few frames the TX FIFO holds, so config->dma_channel_b must then name a
+ * second free DMA channel, as it would for ping-pong. A ping-pong or ring
+ * configuration is kept as given; a ring queues 2 * ring_irq_interval buffers, so
+ * they come out that much shorter.
+ *
+ * \param intended_audio_format Desired audio format specification
+ * \param config Hardware configuration (dma_channel_b is claimed in single DMA mode too)
+ * \param target_latency_us Output latency budget in microseconds
+ * \return Actual audio format that will be used
+ */
+const audio_format_t *audio_i2s_setup_latency(const audio_format_t *intended_audio_format,
+                                              const audio_i2s_config_t *config, uint32_t target_latency_us);
+
+/** \brief Connect audio buffer pool with buffers sized to the latency budget
+ * \ingroup pico_audio_i2s
+ *
+ * Splits the budget given to audio_i2s_setup_latency(), less the TX FIFO, over
+ * the buffers the DMA mode keeps in flight, at the producer's sample rate, and
+ * plays silence on underrun in runs of the same length rather than
+ * PICO_AUDIO_I2S_SILENCE_BUFFER_SAMPLE_LENGTH. Buffers are never shorter than
+ * PICO_AUDIO_I2S_MIN_BUFFER_FRAMES, so a budget below that is exceeded; check
+ * audio_i2s_get_latency() for what was achieved. At 48 kHz in ping-pong mode a
+ * 3000 us budget gives 2 buffers of 69 frames and 2980 us.
+ *
+ * Conversion is done on take, as for audio_i2s_connect_extra(producer, false, ...).
+ *
+ * \param producer Audio buffer pool to connect
+ * \return true if connection successful, false otherwise
+ */
+bool audio_i2s_connect_latency(audio_buffer_pool_t *producer);
+
 /** \brief Connect audio buffer pool with pass-through mode
  * \ingroup pico_audio_i2s
  *
@@ -134,11 +244,32 @@ bool audio_i2s_connect_thru(audio_buffer_pool_t *producer, audio_connection_t *c
  */
 bool audio_i2s_connect(audio_buffer_pool_t *producer);
 
+/** \brief Connect an audio buffer pool whose buffers are played without copying
+ * \ingroup pico_audio_i2s
+ *
+ * Producer buffers are handed straight to the DMA and returned to the producer's
+ * free list once played, removing the per-buffer copy of the buffered connections.
+ * This requires the producer format to match the DMA format exactly: PCM S16 stereo
+ * with a sample stride of 4 (S16 mono, stride 2, for mono output),
+ * or PCM S32 stereo with a stride of 8 when set up for 32-bit slots, in
+ * word-aligned buffers.
+ *
+ * \param producer Audio buffer pool to connect for I2S output
+ * \return true if connected, false if the producer format does not match (nothing is connected)
+ *
+ * \note The sample rate is fixed at connection time, and the producer pool must hold
+ *       enough buffers for the DMA mode in use plus those being filled
+ *       (e.g. 2 * ring_irq_interval + 1 in AUDIO_I2S_DMA_MODE_RING)
+ */
+bool audio_i2s_connect_zero_copy(audio_buffer_pool_t *producer);
+
 /** \brief Connect 8-bit audio buffer pool with automatic conversion
  * \ingroup pico_audio_i2s
  *
- * Connects an 8-bit audio source with automatic conversion to 16-bit output.
- * The conversion is performed on-the-fly during audio processing.
+ * Connects an 8-bit audio source, mono or stereo, with automatic conversion to
+ * 16-bit output. The conversion is performed on-the-fly during audio processing.
+ * Equivalent to audio_i2s_connect_extra(producer, false, 2, 256, NULL); use that
+ * directly to choose the number and size of the consumer buffers.
  *
  * \param producer Audio buffer pool containing 8-bit PCM data
  * \return true if connection successful, false otherwise
@@ -155,7 +286,9 @@ bool audio_i2s_connect_s8(audio_buffer_pool_t *producer);
  *
  * \param producer Audio buffer pool to connect
  * \param buffer_on_give If true, buffering occurs on producer give; if false, on consumer take
- * \param buffer_count Number of intermediate buffers to allocate
+ *        (PCM S8 producers are only supported with buffering on take)
+ * \param buffer_count Number of intermediate buffers to allocate (0 for a zero-copy
+ *        connection, see audio_i2s_connect_zero_copy())
  * \param samples_per_buffer Number of audio samples per intermediate buffer
  * \param connection Optional custom connection structure (NULL for default)
  * \return true if connection successful, false otherwise
@@ -165,6 +298,44 @@ bool audio_i2s_connect_s8(audio_buffer_pool_t *producer);
 bool audio_i2s_connect_extra(audio_buffer_pool_t *producer, bool buffer_on_give, uint buffer_count,
                              uint samples_per_buffer, audio_connection_t *connection);
 
+/** \brief Connect audio buffer pool with consumer buffers in a caller-provided arena
+ * \ingroup pico_audio_i2s
+ *
+ * Same as audio_i2s_connect_extra(), but the consumer pool is built in arena rather
+ * than allocated from the heap, so memory use is fixed and the buffers can be placed
+ * in a chosen RAM bank. audio_i2s_disconnect() hands the arena back.
+ *
+ * \code
+ * static uint32_t arena[AUDIO_I2S_POOL_ARENA_WORDS(2, 256, 4)];
+ * audio_i2s_connect_arena(producer, false, 2, 256, NULL, arena, count_of(arena));
+ * \endcode
+ *
+ * \param arena Word-aligned arena; the consumer sample stride is 4 for 16-bit stereo
+ *        output, 2 for mono output and 8 for 32-bit slots (see AUDIO_I2S_POOL_ARENA_WORDS())
+ * \param arena_words Size of the arena in words; panics if it is too small
+ * \return true if connection successful, false otherwise
+ */
+bool audio_i2s_connect_arena(audio_buffer_pool_t *producer, bool buffer_on_give, uint buffer_count,
+                             uint samples_per_buffer, audio_connection_t *connection,
+                             uint32_t *arena, size_t arena_words);
+
+/** \brief Disconnect the producer connected by any audio_i2s_connect*() function
+ * \ingroup pico_audio_i2s
+ *
+ * Disables output, then returns every buffer in flight: producer buffers go back
+ * to the producer's free list, and the consumer pool is no longer referenced, so
+ * an arena passed to audio_i2s_connect_arena() may be reused. The producer pool
+ * can then be connected again, e.g. with a new format or buffer size. Connecting
+ * while already connected disconnects first.
+ *
+ * \note Consumer pools allocated on the heap by the other connect functions
+ *       cannot be freed and are abandoned; reconnect through audio_i2s_connect_arena()
+ *       to avoid leaking them
+ * \note A custom connection passed to the connect function is only unlinked;
+ *       reinitialize it before connecting it again
+ */
+void audio_i2s_disconnect(void);
+
 /** \brief Enable or disable I2S audio output
  * \ingroup pico_audio_i2s
  *
@@ -178,6 +349,121 @@ bool audio_i2s_connect_extra(audio_buffer_pool_t *producer, bool buffer_on_give,
  */
 void audio_i2s_set_enabled(bool enabled);
 
+/** \brief Get the PIO clock divider in use for the single DAC output
+ * \ingroup pico_audio_i2s
+ *
+ * Reports the divider chosen for the current sample rate and its error in ppm.
+ * With PICO_AUDIO_I2S_CLOCK_DITHER the long-term average rate is exact regardless
+ * of error_ppm.
+ *
+ * \return Divider state (valid after a connection has been made)
+ */
+const audio_i2s_clock_divider_t *audio_i2s_get_clock_divider(void);
+
+/** \brief Get the playback statistics for the single DAC output
+ * \ingroup pico_audio_i2s
+ *
+ * The statistics are updated by the DMA IRQ and can be read at any time without
+ * locking, e.g. to poll underruns from the main loop.
+ *
+ * \return Statistics (not updated when PICO_AUDIO_I2S_STATS is 0)
+ */
+const audio_i2s_stats_t *audio_i2s_get_stats(void);
+
+/** \brief Clear the playback statistics for the single DAC output
+ * \ingroup pico_audio_i2s
+ *
+ * \note An update made by a DMA IRQ running at the same time may be lost
+ */
+void audio_i2s_reset_stats(void);
+
+/** \brief Set the output gain
+ * \ingroup pico_audio_i2s
+ *
+ * Applied by the connections that convert on consumer take (audio_i2s_connect(),
+ * audio_i2s_connect_extra() with buffering on take, audio_i2s_connect_latency()
+ * and their arena versions), in the same pass as the conversion. A change is
+ * ramped over the next consumer buffer. At AUDIO_I2S_UNITY_GAIN with no DC
+ * blocker, the plain converters run and samples are untouched.
+ *
+ * \param gain Q15 gain, AUDIO_I2S_UNITY_GAIN for 1.0 (negative inverts, down to -AUDIO_I2S_UNITY_GAIN)
+ */
+void audio_i2s_set_gain(int16_t gain);
+
+/** \brief Turn the DC blocking high-pass filter on or off
+ * \ingroup pico_audio_i2s
+ *
+ * Applied with the gain, before it; see audio_i2s_output_process_t for the
+ * filter. dc_shift 10 puts the corner at about 7.5 Hz at 48 kHz.
+ *
+ * \param dc_shift 1 to 15 (higher is a lower corner), or 0 to turn the filter off
+ */
+void audio_i2s_set_dc_blocker(uint dc_shift);
+
+/** \brief Get the output latency of the current connection
+ * \ingroup pico_audio_i2s
+ *
+ * Filled in by every audio_i2s_connect*() function, latency budget or not.
+ *
+ * \return Latency (valid after a connection has been made)
+ */
+const audio_i2s_latency_t *audio_i2s_get_latency(void);
+
+/** \brief Switch the output to a new sample rate between two producer buffers
+ * \ingroup pico_audio_i2s
+ *
+ * Call between giving the last buffer at the old rate and the first at the new
+ * one. The change is queued: the buffers already given play out at the old rate,
+ * and the new divider is written once the last of them has left the DMA, so
+ * neither rate's samples play at the other's. With copy on give, the partly
+ * filled consumer buffer is queued on its own first. Custom connections switch
+ * at the next DMA refill. The state machine keeps running throughout.
+ *
+ * A producer that changes its format's sample_freq instead switches the same way
+ * at the first buffer given at the new rate, with a mute of
+ * PICO_AUDIO_I2S_RATE_CHANGE_MUTE_FRAMES. The producer pool's format must then
+ * describe that buffer when it is given.
+ *
+ * \param sample_freq New sample frequency in Hz
+ * \param mute_frames Frames of silence (at the old rate) played before the first
+ *        buffer at the new rate, during which the divider is written; 0 for no gap,
+ *        when the few frames still in the TX FIFO play at the new rate. With
+ *        PICO_AUDIO_I2S_FADE_FRAMES the mute is the fade-out ramp instead, and the
+ *        first new buffer is ramped in. In AUDIO_I2S_DMA_MODE_RING the mute is
+ *        spread over the blocks left in the ring half the fence falls in, at least
+ *        a frame each
+ *
+ * \note A producer must be connected; a change queued before the last one has
+ *       begun replaces it
+ */
+void audio_i2s_set_sample_freq(uint32_t sample_freq, uint32_t mute_frames);
+
+/** \brief Set how long an idle output plays silence before it parks
+ * \ingroup pico_audio_i2s
+ *
+ * Once the output has played idle_ms of underrun silence, the refill that would
+ * play more stops the DMA instead; the state machine runs dry and stalls at a
+ * frame boundary, holding BCLK and LRCLK, and no DMA IRQs are taken. The next
+ * buffer given to the connection restarts the DMA through a short transfer of
+ * silence that refills the TX FIFO (about 5 frames with 16-bit slots, 3 with
+ * 32-bit slots), so playing resumes that many frames and an IRQ after the give,
+ * not after a silence run. The descriptor ring DMA mode parks by loading a
+ * disabled descriptor, so the control channel stops after the half that is
+ * playing, and is restarted with a requeued ring from the IRQ after the kick.
+ *
+ * Only the connections built by audio_i2s_connect*() (copying on take or give,
+ * and zero-copy) wake the output, so custom connections, such as the mixer and the
+ * SPSC connection, never park.
+ *
+ * \param idle_ms Silence before parking, 0 to never park (default PICO_AUDIO_I2S_IDLE_PARK_MS)
+ */
+void audio_i2s_set_idle_park_ms(uint32_t idle_ms);
+
+/** \brief Whether the output is parked (see audio_i2s_set_idle_park_ms())
+ * \ingroup pico_audio_i2s
+ */
+bool audio_i2s_is_parked(void);
+
 /** @} */ // end of Single DAC I2S Functions
 
 #ifdef __cplusplus
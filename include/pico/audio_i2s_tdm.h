@@ -0,0 +1,205 @@
+/*
+ * Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _PICO_AUDIO_I2S_TDM_H
+#define _PICO_AUDIO_I2S_TDM_H
+
+/** \file audio_i2s_tdm.h
+ *  \brief TDM output: many channels on one data line
+ *  \ingroup pico_audio_i2s
+ *
+ * TDM (time-division multiplexed) framing sends slot_count slots per frame on a
+ * single data line, with a frame sync (FSYNC) pulse marking the start of each
+ * frame in place of LRCLK. Eight channels take 3 pins, 1 PIO state machine and
+ * 1 DMA channel, where multi-DAC lanes would need four I2S data lines.
+ *
+ * Slot Formats:
+ * - 16-bit slots: consumer buffers are interleaved PCM S16, one halfword per slot
+ * - 24 and 32-bit slots: interleaved PCM S32, one word per slot; 24-bit slots
+ *   send the top 24 bits of each word
+ *
+ * Producers are PCM S16, S24 or S32 (S16 only for 16-bit slots) with at most
+ * slot_count channels; channel n is sent in slot n, and slots past the last
+ * channel are silent.
+ *
+ * Pin Configuration:
+ * - data_pin: TDM data (SDOUT)
+ * - clock_pin_base: BCLK = fs * slot_count * slot_bits
+ * - clock_pin_base + 1: FSYNC
+ *
+ * Usage Example:
+ * ```c
+ * audio_i2s_tdm_config_t config = {
+ *     .data_pin = 28,
+ *     .clock_pin_base = 26,
+ *     .dma_channel = 0,
+ *     .pio_sm = 0,
+ *     .slot_count = 8,
+ *     .slot_bits = 32,
+ *     .frame_sync_bits = 1,
+ *     .data_delay = 1,
+ * };
+ * audio_format_t format = {
+ *     .format = AUDIO_BUFFER_FORMAT_PCM_S32,
+ *     .sample_freq = 48000,
+ *     .channel_count = 8
+ * };
+ * audio_i2s_setup_tdm(&format, &config);
+ * audio_i2s_connect_tdm(eight_channel_pool);
+ * audio_i2s_set_enabled_tdm(true);
+ * ```
+ *
+ * \note The TDM output uses the same DMA IRQ (PICO_AUDIO_I2S_DMA_IRQ) and PIO
+ *       block (audio_pio) as the other outputs and can run beside them, but its
+ *       BCLK is not related to theirs
+ */
+
+#include "pico/audio.h"
+#include "audio_i2s_common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** \brief Most slots in a TDM frame */
+#ifndef PICO_AUDIO_I2S_TDM_MAX_SLOTS
+#define PICO_AUDIO_I2S_TDM_MAX_SLOTS 16
+#endif
+
+/** \brief Validate the slot limit against the longest frame the PIO divider supports (16 x 32 bits) */
+#if PICO_AUDIO_I2S_TDM_MAX_SLOTS < 2 || PICO_AUDIO_I2S_TDM_MAX_SLOTS > 16
+#error PICO_AUDIO_I2S_TDM_MAX_SLOTS must be between 2 and 16
+#endif
+
+/** \brief Configuration structure for TDM setup
+ * \ingroup pico_audio_i2s
+ *
+ * Fields left zero take the defaults given below, so a zero slot_count, slot_bits
+ * and frame_sync_bits give one FSYNC bit per frame and a slot per channel of the
+ * intended format, 16 bits wide for PCM S16 and 32 bits otherwise.
+ *
+ * Frame Sync:
+ * FSYNC is high for frame_sync_bits bit clocks from the start of each frame and
+ * changes with the falling BCLK edge, like the data. With data_delay = 1 the MSB
+ * of slot 0 follows one bit clock after FSYNC rises (I2S-style, the usual
+ * setting with a 1-bit pulse); with 0 it coincides with the rising edge (DSP
+ * mode B / left justified). A pulse of half the frame (slot_count * slot_bits / 2)
+ * suits parts that expect a 50% duty cycle frame clock. The pulse must leave at
+ * least 2 bit clocks of the frame low.
+ */
+typedef struct audio_i2s_tdm_config {
+    uint8_t data_pin;          ///< GPIO pin for TDM data output (SDOUT)
+    uint8_t clock_pin_base;    ///< Base GPIO pin for clocks (BCLK=base, FSYNC=base+1)
+    uint8_t dma_channel;       ///< DMA channel number for audio data transfer
+    uint8_t pio_sm;            ///< PIO state machine number for the TDM program
+    uint8_t slot_count;        ///< Slots per frame, 2 to PICO_AUDIO_I2S_TDM_MAX_SLOTS (0 = intended channel count)
+    uint8_t slot_bits;         ///< Bits per slot: 16, 24 or 32 (0 = by intended format)
+    uint16_t frame_sync_bits;  ///< FSYNC pulse width in bit clocks (0 = 1)
+    uint8_t data_delay;        ///< Bit clocks from FSYNC rising to the MSB of slot 0: 0 or 1
+} audio_i2s_tdm_config_t;
+
+/** \name TDM Functions
+ *  \brief Functions for TDM setup and operation
+ * @{
+ */
+
+/** \brief Initialize the TDM output
+ * \ingroup pico_audio_i2s
+ *
+ * Claims the state machine and DMA channel and loads the TDM program; output
+ * starts once a producer is connected and audio_i2s_set_enabled_tdm() is called.
+ *
+ * \param intended_audio_format Sample rate, format and channel count of the producers
+ * \param config Hardware and framing configuration
+ * \return Format of the consumer buffers sent to the PIO (slot_count channels of
+ *         PCM S16 for 16-bit slots, PCM S32 otherwise)
+ */
+const audio_format_t *audio_i2s_setup_tdm(const audio_format_t *intended_audio_format,
+                                          const audio_i2s_tdm_config_t *config);
+
+/** \brief Connect a producer to the TDM output with default buffering
+ * \ingroup pico_audio_i2s
+ *
+ * Equivalent to audio_i2s_connect_tdm_extra(producer, 2, 256, NULL).
+ *
+ * \param producer Audio buffer pool providing interleaved frames
+ * \return true if connection successful, false otherwise
+ */
+bool audio_i2s_connect_tdm(audio_buffer_pool_t *producer);
+
+/** \brief Connect a producer to the TDM output
+ * \ingroup pico_audio_i2s
+ *
+ * Producer frames are copied (and widened or padded to slot_count channels if
+ * needed) into consumer buffers on take. With a buffer_count of 0 and no
+ * connection, producer buffers already in the consumer format (see
+ * audio_i2s_setup_tdm()), in word-aligned buffers, are played without copying.
+ *
+ * \param producer Audio buffer pool to connect
+ * \param buffer_count Number of consumer buffers (0 for zero-copy)
+ * \param samples_per_buffer Frames per consumer buffer
+ * \param connection Optional custom connection (NULL for the copying or zero-copy connection)
+ * \return true if connected, false if the producer format cannot be sent (nothing is connected)
+ */
+bool audio_i2s_connect_tdm_extra(audio_buffer_pool_t *producer, uint buffer_count, uint samples_per_buffer,
+                                 audio_connection_t *connection);
+
+/** \brief Disconnect the producer connected to the TDM output
+ * \ingroup pico_audio_i2s
+ *
+ * Disables output and returns every buffer in flight, as audio_i2s_disconnect()
+ * does for the single DAC output.
+ */
+void audio_i2s_disconnect_tdm(void);
+
+/** \brief Enable or disable the TDM output
+ * \ingroup pico_audio_i2s
+ *
+ * \param enabled true to start the DMA and state machine, false to stop them
+ *
+ * \note A producer must be connected before enabling output
+ */
+void audio_i2s_set_enabled_tdm(bool enabled);
+
+/** \brief Switch the TDM output to a new sample rate between two producer buffers
+ * \ingroup pico_audio_i2s
+ *
+ * As audio_i2s_set_sample_freq() does for the single DAC output: the buffers already
+ * given play out at the old rate, then the mute, and the divider is written once
+ * they have left the DMA. A producer whose format changes sample_freq switches the
+ * same way, with a mute of PICO_AUDIO_I2S_RATE_CHANGE_MUTE_FRAMES.
+ *
+ * \param sample_freq New sample frequency in Hz
+ * \param mute_frames Frames of silence (at the old rate) played across the switch
+ */
+void audio_i2s_set_sample_freq_tdm(uint32_t sample_freq, uint32_t mute_frames);
+
+/** \brief Get the PIO clock divider in use for the TDM output
+ * \ingroup pico_audio_i2s
+ *
+ * \return Divider state (valid after a connection has been made)
+ */
+const audio_i2s_clock_divider_t *audio_i2s_get_clock_divider_tdm(void);
+
+/** \brief Get the playback statistics for the TDM output
+ * \ingroup pico_audio_i2s
+ *
+ * \return Statistics (not updated when PICO_AUDIO_I2S_STATS is 0)
+ */
+const audio_i2s_stats_t *audio_i2s_get_stats_tdm(void);
+
+/** \brief Clear the playback statistics for the TDM output
+ * \ingroup pico_audio_i2s
+ */
+void audio_i2s_reset_stats_tdm(void);
+
+/** @} */ // end of TDM Functions
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _PICO_AUDIO_I2S_TDM_H